@@ -1,5 +1,6 @@
 #include "circuit.hpp"
 #include <iostream>
+#include <algorithm>
 using namespace std::complex_literals;
 
 /**
@@ -11,10 +12,19 @@ using namespace std::complex_literals;
 /**
 	\brief Admitancja rezystancji
 */
-std::complex<double> resistor::admittance(double omega) const
+std::complex<double> resistor::admittance(std::complex<double> s) const
+{
+	(void) s;
+	return admittance_of(R);
+}
+
+/**
+	\brief Pochodna admitancji rezystora po rezystancji
+*/
+std::complex<double> resistor::admittance_derivative(double omega) const
 {
 	(void) omega;
-	return 1.0 / R;
+	return admittance_derivative_of(R);
 }
 
 /**
@@ -23,118 +33,290 @@ std::complex<double> resistor::admittance(double omega) const
 	\note Przy analizie DC cewka jest zastępowana minimalną rezystancją
 	(wielką admitancją), by nie dopuścić do dzielenia przez 0.
 */
-std::complex<double> inductor::admittance(double omega) const
+std::complex<double> inductor::admittance(std::complex<double> s) const
+{
+	return admittance_of(L, s);
+}
+
+/**
+	\brief Pochodna admitancji cewki po indukcyjności
+
+	\note Przy analizie DC admitancja cewki nie zależy od indukcyjności
+*/
+std::complex<double> inductor::admittance_derivative(double omega) const
 {
-	return 1.0 / (omega == 0 ? 1e-9 : (1i * omega * L));
+	return admittance_derivative_of(L, omega);
 }
 
 /**
 	\brief Admitancja kondensatora
 */
-std::complex<double> capacitor::admittance(double omega) const
+std::complex<double> capacitor::admittance(std::complex<double> s) const
+{
+	return admittance_of(C, s);
+}
+
+/**
+	\brief Pochodna admitancji kondensatora po pojemności
+*/
+std::complex<double> capacitor::admittance_derivative(double omega) const
 {
-	return 1i * omega * C;
+	return admittance_derivative_of(omega);
 }
 
 /**
 	\brief Tworzy solver układów
 */
 circuit_solver::circuit_solver(const circuit &circ) :
-	m_circuit(&circ)
+	m_circuit(&circ),
+	m_plan(std::make_shared<solve_plan>()),
+	m_context(m_plan)
 {
-	update_node_map();
+	rebuild();
 }
 
 /**
 	\brief Zwraca mapowania węzłów (tylko do odczytu)
 */
-const std::map<int, int> &circuit_solver::get_node_map() const
+const node_index &circuit_solver::get_node_map() const
 {
-	return m_node_map;
+	return m_plan->get_node_map();
 }
 
 /**
-	\brief Zwraca pulsację dla której wyznaczone zostało rozwiązanie
+	\brief Zwraca skompilowany obwód
+
+	Zwrócony plan nie zmienia się - późniejsze zmiany w solverze (\ref update())
+	tworzą nowy plan, jeżeli bieżący jest współdzielony.
 */
-double circuit_solver::get_solution_omega() const
+std::shared_ptr<const solve_plan> circuit_solver::get_plan() const
 {
-	return *m_solution_omega;
+	return m_plan;
 }
 
+/**
+	\brief Zwraca kontekst, w którym solver analizuje swój plan
+*/
+const solve_context &circuit_solver::get_context() const
+{
+	return m_context;
+}
 
 /**
-	\brief Aktualizuje mapę numeracji węzłów i rozwiązanie (jeżeli było gotowe)
+	\brief Zwraca plan do modyfikacji - kopiuje go, jeżeli jest współdzielony
+
+	Własny kontekst solvera nie jest traktowany jako współdzielenie - odłączany jest
+	od planu na czas zmian i otrzymuje go z powrotem po ich zakończeniu.
 */
-void circuit_solver::update()
+solve_plan &circuit_solver::mutable_plan()
 {
-	update_node_map();
-	
-	if (m_solution.has_value())
-		solve(*m_solution_omega);
+	m_context.set_plan(nullptr, false);
+	if (m_plan.use_count() > 1)
+		m_plan = std::make_shared<solve_plan>(*m_plan);
+	return *m_plan;
 }
 
 /**
-	\brief Poddaje obwód analizie dla zadanej pulsacji
+	\brief Zapamiętuje stan komponentu
 
-	Przy analizie AC wszystkie źródła DC są pomijane i na odwrót.
-	Analiza DC uruchamiana jest przez podanie omega = 0.
+	Rodzaj komponentu określany jest statycznie na podstawie \ref circuit_component::view().
 
-	\param omega pulsacja sygnału źródeł AC. 0 oznacza analizę DC.
+	\param comp Komponent
+	\param prev Poprzednio zapamiętany stan elementu o tej samej nazwie (opcjonalny)
 */
-void circuit_solver::solve(double omega)
+circuit_solver::component_state circuit_solver::capture_state(const circuit_component *comp, const component_state *prev)
 {
-	// Zapisujemy omegę, dla której była przeprowadzona analiza
-	m_solution_omega = omega;
-
-	// Reset obwodu zapisanego w mna_problem
-	m_problem.admittances.clear();
-	m_problem.voltage_sources.clear();
-	m_problem.current_sources.clear();
-	m_problem.opamps.clear();
-	
-	// Mapowanie par węzłów
-	auto map_node_pair = [&](std::pair<int, int> p)->std::pair<int, int>{
-		return {m_node_map.at(p.first), m_node_map.at(p.second)};
+	component_state st{comp, component_kind::OTHER, {0, 0, 0, 0}, {0.0, 0.0}};
+
+	if (prev && prev->ptr == comp)
+		st.index = prev->index;
+
+	auto bipole = [&](component_kind kind, const bipole_component *bp, double value, double ac = 0.0){
+		st.kind = kind;
+		st.nodes = {bp->nodes.first, bp->nodes.second, 0, 0};
+		st.values = {value, ac};
 	};
 
-	// Dodawanie elementów do problemu do analizy
+	std::visit(overloaded{
+		[&](const resistor *r){bipole(component_kind::RESISTOR, r, r->R);},
+		[&](const inductor *l){bipole(component_kind::INDUCTOR, l, l->L);},
+		[&](const capacitor *c){bipole(component_kind::CAPACITOR, c, c->C);},
+		[&](const passive_component *p){bipole(component_kind::PASSIVE, p, 0.0);},
+		[&](const voltage_source *vs){bipole(component_kind::VOLTAGE_SOURCE, vs, vs->dcV, vs->acV);},
+		[&](const current_source *cs){bipole(component_kind::CURRENT_SOURCE, cs, cs->dcI, cs->acI);},
+		[&](const opamp *opa){
+			st.kind = component_kind::OPAMP;
+			st.nodes = {opa->pos_input_node, opa->neg_input_node, opa->output_node, 0};
+		},
+		[&](const controlled_source *cs){
+			using type = controlled_source::source_type;
+			static const std::map<type, component_kind> kinds{
+				{type::VCVS, component_kind::VCVS},
+				{type::VCCS, component_kind::VCCS},
+				{type::CCVS, component_kind::CCVS},
+				{type::CCCS, component_kind::CCCS},
+			};
+
+			bipole(kinds.at(cs->type), cs, cs->gain);
+			st.nodes[2] = cs->control.first;
+			st.nodes[3] = cs->control.second;
+		},
+		[&](const nonlinear_component *nl){
+			st.kind = component_kind::NONLINEAR;
+			st.nodes = {nl->nodes[0], nl->nodes[1], nl->nodes[2], 0};
+		},
+		[&](const circuit_component*){},
+	}, comp->view());
+
+	return st;
+}
+
+/**
+	\brief Dołącza komponent do mapy węzłów i tablic elementów planu
+	\returns true, jeżeli element zmienia macierz układu
+*/
+bool circuit_solver::add_component(const std::string &ref, component_state &st)
+{
+	st.index = mutable_plan().add_component(ref, st.kind, st.ptr, st.nodes, st.values);
+	return st.index >= 0;
+}
+
+/**
+	\brief Od nowa buduje mapę węzłów, tablice elementów i zapamiętany stan obwodu
+*/
+void circuit_solver::rebuild()
+{
+	m_states.clear();
+
+	for (const auto &[ref, comp_ptr] : *m_circuit)
+		m_states.emplace_hint(m_states.end(), ref, capture_state(comp_ptr.get()));
+
+	update_node_map();
+	m_context.set_plan(m_plan);
+}
+
+/**
+	\brief Wykrywa zmiany w obwodzie i aktualizuje rozwiązanie (jeżeli było gotowe)
+
+	Obwód porównywany jest z zapamiętanym stanem:
+	 - dodanie elementów rozszerza mapę węzłów o nowe węzły,
+	 - usunięcie elementu lub zmiana jego węzłów wymaga przebudowania mapy węzłów,
+	 - zmiana wartości elementu pasywnego wymaga ponownego rozkładu macierzy,
+	 - zmiana wartości źródeł wymaga jedynie ponownego podstawienia z istniejącym rozkładem.
+*/
+void circuit_solver::update()
+{
+	bool topology_changed = false;
+	bool matrix_changed = false;
+	bool rhs_changed = false;
+	std::vector<std::map<std::string, component_state>::iterator> added;
+
+	// Równoległy przegląd obu (posortowanych) map
+	auto it = m_states.begin();
 	for (const auto &[ref, comp_ptr] : *m_circuit)
 	{
-		// Elementy pasywne
-		if (auto pcomp = std::dynamic_pointer_cast<const passive_component>(comp_ptr))
-			m_problem.admittances.emplace_back(map_node_pair(pcomp->nodes), pcomp->admittance(omega));
-
-		// Wzmacniacze operacyjne
-		if (auto opa = std::dynamic_pointer_cast<const opamp>(comp_ptr))
-			m_problem.opamps.emplace_back(
-				m_node_map.at(opa->pos_input_node),
-				m_node_map.at(opa->neg_input_node),
-				m_node_map.at(opa->output_node));
-
-		// Źródła napięciowe
-		if (auto vs = std::dynamic_pointer_cast<const voltage_source>(comp_ptr))
+		while (it != m_states.end() && it->first < ref)
 		{
-			auto x = (omega == 0) ? vs->dcV : vs->acV;
-			m_problem.voltage_sources.emplace_back(map_node_pair(vs->nodes), x);
+			topology_changed = true;
+			it = m_states.erase(it);
 		}
 
-		// Źródła prądowe
-		if (auto cs = std::dynamic_pointer_cast<const current_source>(comp_ptr))
+		if (it != m_states.end() && it->first == ref)
+		{
+			auto &prev = it->second;
+			auto st = capture_state(comp_ptr.get(), &prev);
+
+			if (st.ptr != prev.ptr || st.kind != prev.kind || st.nodes != prev.nodes)
+				topology_changed = true;
+			else if (st.values != prev.values || st.kind == component_kind::PASSIVE)
+			{
+				// Nieznane elementy pasywne zawsze uznajemy za zmienione. SEM o zerowym
+				// napięciu jest przy analizie DC zwarciem, więc wpływa na strukturę układu.
+				if (st.kind == component_kind::VOLTAGE_SOURCE && (st.values[0] == 0) != (prev.values[0] == 0))
+					matrix_changed = true;
+				else if (st.kind == component_kind::VOLTAGE_SOURCE || st.kind == component_kind::CURRENT_SOURCE)
+					rhs_changed = true;
+				else
+					matrix_changed = true;
+
+				mutable_plan().set_values(st.kind, st.index, st.values);
+			}
+
+			prev = st;
+			++it;
+		}
+		else
 		{
-			auto x = (omega == 0) ? cs->dcI : cs->acI;
-			m_problem.current_sources.emplace_back(map_node_pair(cs->nodes), x);
+			auto added_it = m_states.emplace_hint(it, ref, capture_state(comp_ptr.get()));
+			added.push_back(added_it);
+			it = std::next(added_it);
 		}
 	}
 
-	// Analiza
-	try
+	if (it != m_states.end())
 	{
-		m_solution = m_problem.solve();
+		topology_changed = true;
+		m_states.erase(it, m_states.end());
 	}
-	catch (const std::runtime_error &ex)
+
+	if (topology_changed)
+		rebuild();
+	else
 	{
-		throw std::runtime_error(std::string{"Could not compute operating point - reason: "} + ex.what());
+		for (auto st : added)
+			matrix_changed |= add_component(st->first, st->second);
+		if (!added.empty())
+			mutable_plan().link_controls();
+
+		if (matrix_changed || rhs_changed || !added.empty())
+			m_context.set_plan(m_plan, matrix_changed);
 	}
+	
+	if (m_context.has_solution())
+		m_context.solve(m_context.get_solution_omega());
+}
+
+/**
+	\brief Aktualizuje mapowania węzłów
+
+	Węzeł 0 to węzeł odniesienia - mapowany jest na -1 - indeks węzła masy
+	w zapisie macierzowym. Wszystkie inne numery węzłów są mapowane na nieujemne
+	liczby całkowite.
+
+	Przy okazji budowane są tablice elementów planu (\ref m_plan) odpowiadające elementom mna_problem.
+	Numery węzłów pochodzą z zapamiętanego stanu obwodu (\ref m_states).
+
+	\see update()
+*/
+void circuit_solver::update_node_map()
+{
+	// Współdzielony plan nie jest kopiowany - i tak zostałby wyczyszczony
+	m_context.set_plan(nullptr, false);
+	if (m_plan.use_count() > 1)
+		m_plan = std::make_shared<solve_plan>();
+	m_plan->clear();
+
+	for (auto &[ref, st] : m_states)
+		add_component(ref, st);
+
+	m_plan->link_controls();
+}
+
+/**
+	\brief Poddaje obwód analizie dla zadanej pulsacji
+	\see solve_context::solve()
+*/
+void circuit_solver::solve(double omega)
+{
+	m_context.solve(omega);
+}
+
+/**
+	\brief Włącza lub wyłącza upraszczanie topologii układu przy analizie DC
+*/
+void circuit_solver::set_dc_reduction(bool enable)
+{
+	m_context.set_dc_reduction(enable);
 }
 
 /**
@@ -142,92 +324,40 @@ void circuit_solver::solve(double omega)
 */
 const mna::mna_solution &circuit_solver::get_solution() const
 {
-	return *m_solution;
+	return m_context.get_solution();
+}
+
+/**
+	\brief Zwraca pulsację dla której wyznaczone zostało rozwiązanie
+*/
+double circuit_solver::get_solution_omega() const
+{
+	return m_context.get_solution_omega();
 }
 
 /**
 	\brief Pomiar napięcia między węzłami
-	\param pos Numer mierzonego węzła
-	\param neg Numer węzła odniesienia
+	\see solve_context::voltage()
 */
 std::complex<double> circuit_solver::voltage(int pos, int neg) const
 {
-	return m_solution->voltage(m_node_map.at(pos), m_node_map.at(neg));
+	return m_context.voltage(pos, neg);
 }
 
 /**
 	\brief Pomiar napięcia na komponencie
-	\note Pomiar napięcia jest możliwy tylko na elementach z dwoma wyprowadzeniami
 */
 std::complex<double> circuit_solver::voltage(const circuit_component &comp) const
 {
-	if (auto bipole = dynamic_cast<const bipole_component*>(&comp))
-	{
-		return voltage(bipole->nodes.first, bipole->nodes.second);
-	}
-
-	// Wzmacniacz operacyjny
-	if (auto opa = dynamic_cast<const opamp*>(&comp))
-	{
-		return voltage(opa->output_node);
-	}
-
-	throw std::runtime_error("Cannot measure voltage on component");
+	return m_context.voltage(comp);
 }
 
 /**
 	\brief Pomiar prądu płynącego przez komponent
-	\note Pomiar prądu jest możliwy tylko na elementach z dwoma wyprowadzeniami i na wzmacniaczach operacyjnych (prąd wyjścia)
 */
 std::complex<double> circuit_solver::current(const circuit_component &comp) const
 {
-	// Komponent pasywny
-	if (auto passive = dynamic_cast<const passive_component*>(&comp))
-	{
-		return voltage(comp) * passive->admittance(*m_solution_omega);
-	}
-	
-	// SEM
-	if (auto vs = dynamic_cast<const voltage_source*>(&comp))
-	{
-		// Określamy numer źródła
-		int cnt = 0;
-		for (const auto &[k, v] : *m_circuit)
-		{
-			if (auto c = dynamic_cast<const voltage_source*>(v.get()))
-			{
-				if (c == vs) break;
-				cnt++;
-			}			
-		}
-
-		return m_solution->voltage_source_current(cnt);
-	}
-
-	// SPM
-	if (auto cs = dynamic_cast<const current_source*>(&comp))
-	{
-		return *m_solution_omega == 0 ? -cs->dcI : -cs->acI;
-	}
-
-	// Wzmacniacz operacyjny
-	if (auto opa = dynamic_cast<const opamp*>(&comp))
-	{
-		// Określamy numer wzmacniacza
-		int cnt = 0;
-		for (const auto &[k, v] : *m_circuit)
-		{
-			if (auto c = std::dynamic_pointer_cast<const opamp>(v))
-			{
-				if (c.get() == opa) break;
-				cnt++;
-			}			
-		}
-
-		return m_solution->opamp_current(cnt);
-	}
-
-	throw std::runtime_error("Cannot measure current through component");
+	return m_context.current(comp);
 }
 
 /**
@@ -235,7 +365,7 @@ std::complex<double> circuit_solver::current(const circuit_component &comp) cons
 */
 std::complex<double> circuit_solver::power(const circuit_component &comp) const
 {
-	return voltage(comp) * current(comp);
+	return m_context.power(comp);
 }
 
 /**
@@ -243,7 +373,7 @@ std::complex<double> circuit_solver::power(const circuit_component &comp) const
 */
 std::complex<double> circuit_solver::voltage(const std::string &ref) const
 {
-	return voltage(*m_circuit->at(ref));
+	return m_context.voltage(*m_circuit->at(ref));
 }
 
 /**
@@ -251,7 +381,7 @@ std::complex<double> circuit_solver::voltage(const std::string &ref) const
 */
 std::complex<double> circuit_solver::current(const std::string &ref) const
 {
-	return current(*m_circuit->at(ref));
+	return m_context.current(*m_circuit->at(ref));
 }
 
 /**
@@ -259,54 +389,29 @@ std::complex<double> circuit_solver::current(const std::string &ref) const
 */
 std::complex<double> circuit_solver::power(const std::string &ref) const
 {
-	return power(*m_circuit->at(ref));
+	return m_context.power(*m_circuit->at(ref));
 }
 
 /**
-	\brief Aktualizuje mapowania węzłów
-
-	Węzeł 0 to węzeł odniesienia - mapowany jest na -1 - indeks węzła masy
-	w zapisie macierzowym. Wszystkie inne numery węzłów są mapowane na nieujemne
-	liczby całkowite.
-
-	Ta funkcja powinna zostać wywołana po wprowadzeniu zmian w układzie
-	z którym powiązana jest klasa circuit_solver.
-
-	\see update()
+	\brief Wrażliwość napięcia między węzłami na wartości elementów pasywnych
 */
-void circuit_solver::update_node_map()
+sensitivity_map circuit_solver::voltage_sensitivity(int pos, int neg) const
 {
-	m_node_map.clear();
-	m_node_map[0] = -1;
-	int cnt = 0;
-
-	auto add_node = [&](int n)
-	{
-		try
-		{
-			m_node_map.at(n);
-		}
-		catch (const std::out_of_range &ex)
-		{
-			m_node_map[n] = cnt++;
-		}
-	};
+	return m_context.voltage_sensitivity(pos, neg);
+}
 
-	for (const auto &[ref, comp_ptr] : *m_circuit)
-	{
-		// Elementy z dwoma wyprowadzeniami
-		if (auto comp = dynamic_cast<const bipole_component*>(comp_ptr.get()))
-		{
-			add_node(comp->nodes.first);
-			add_node(comp->nodes.second);
-		}
+/**
+	\brief Wrażliwość prądu płynącego przez komponent na wartości elementów pasywnych
+*/
+sensitivity_map circuit_solver::current_sensitivity(const std::string &ref) const
+{
+	return m_context.current_sensitivity(*m_circuit->at(ref));
+}
 
-		// Wzmacniacze operacyjne
-		if (auto opa = dynamic_cast<const opamp*>(comp_ptr.get()))
-		{
-			add_node(opa->pos_input_node);
-			add_node(opa->neg_input_node);
-			add_node(opa->output_node);
-		}
-	}
+/**
+	\brief Wrażliwość mocy traconej na komponencie na wartości elementów pasywnych
+*/
+sensitivity_map circuit_solver::power_sensitivity(const std::string &ref) const
+{
+	return m_context.power_sensitivity(*m_circuit->at(ref));
 }
@@ -2,9 +2,15 @@
 #include <utility>
 #include <map>
 #include <memory>
+#include <functional>
 #include <complex>
 #include <optional>
+#include <array>
+#include <vector>
+#include <variant>
+#include <unordered_map>
 #include "mna.hpp"
+#include "node_index.hpp"
 
 /**
 	\file circuit.hpp
@@ -12,12 +18,56 @@
 	\author Jacek Wieczorek
 */
 
+struct circuit_component;
+struct passive_component;
+struct resistor;
+struct inductor;
+struct capacitor;
+struct voltage_source;
+struct current_source;
+struct opamp;
+struct controlled_source;
+struct nonlinear_component;
+
+/**
+	\brief Zamknięty zbiór rodzajów komponentów - wskaźnik na komponent konkretnego typu
+
+	Pozwala na statyczny wybór sposobu obsługi komponentu (std::visit) zamiast łańcuchów
+	rzutowań dynamicznych. Komponenty spoza tego zbioru (np. nowe elementy pasywne)
+	reprezentowane są przez wskaźnik na najbliższą znaną klasę bazową.
+
+	\see circuit_component::view()
+*/
+using component_view = std::variant<
+	const resistor*,
+	const inductor*,
+	const capacitor*,
+	const passive_component*,
+	const voltage_source*,
+	const current_source*,
+	const opamp*,
+	const controlled_source*,
+	const nonlinear_component*,
+	const circuit_component*>;
+
+/**
+	\brief Pomocniczy typ łączący kilka lambd w jeden obiekt odwiedzający (dla std::visit)
+*/
+template <typename... Ts>
+struct overloaded : Ts...
+{
+	using Ts::operator()...;
+};
+
 /**
 	\brief Klasa bazowa dla wszystkich komponentów, które mogą się znaleźć w obwodzie
 */
 struct circuit_component
 {
 	virtual ~circuit_component() {}
+
+	//! Zwraca komponent jako wskaźnik konkretnego typu (jedno wywołanie wirtualne zamiast rzutowań)
+	virtual component_view view() const {return this;}
 };
 
 /**
@@ -35,11 +85,19 @@ struct bipole_component : public circuit_component
 
 /**
 	\brief Klasa bazowa dla komponentów posiadających admitancję zależną od częstotliwości
+
+	Admitancja wyznaczana jest dla zmiennej zespolonej \f$ s \f$ transformaty Laplace'a -
+	dla analizy AC \f$ s = j\omega \f$, a dla analizy DC \f$ s = 0 \f$.
 */
 struct passive_component : public bipole_component
 {
 	using bipole_component::bipole_component;
-	virtual std::complex<double> admittance(double omega) const = 0;
+	virtual std::complex<double> admittance(std::complex<double> s) const = 0;
+
+	//! Pochodna admitancji po wartości elementu (R, L lub C)
+	virtual std::complex<double> admittance_derivative(double omega) const = 0;
+
+	component_view view() const override {return this;}
 };
 
 /**
@@ -58,6 +116,8 @@ struct voltage_source : public bipole_component
 
 	//! Wartość napięcie [V] dla analizy AC
 	double acV;
+
+	component_view view() const override {return this;}
 };
 
 /**
@@ -76,6 +136,8 @@ struct current_source : public bipole_component
 
 	//! Wartość prądu [A] dla analizy AC
 	double acI;
+
+	component_view view() const override {return this;}
 };
 
 /**
@@ -88,10 +150,19 @@ struct resistor : public passive_component
 		R(r)
 	{}
 
-	std::complex<double> admittance(double omega) const override;
+	std::complex<double> admittance(std::complex<double> s) const override;
+	std::complex<double> admittance_derivative(double omega) const override;
+
+	//! Admitancja rezystora o rezystancji R
+	static std::complex<double> admittance_of(double R) {return 1.0 / R;}
+
+	//! Pochodna admitancji rezystora po rezystancji
+	static std::complex<double> admittance_derivative_of(double R) {return -1.0 / (R * R);}
 
 	//! Rezystancja [Ohm]
 	double R;
+
+	component_view view() const override {return this;}
 };
 
 /**
@@ -107,10 +178,31 @@ struct inductor : public passive_component
 		L(l)
 	{}
 
-	std::complex<double> admittance(double omega) const override;
+	std::complex<double> admittance(std::complex<double> s) const override;
+	std::complex<double> admittance_derivative(double omega) const override;
+
+	//! Admitancja cewki o indukcyjności L
+	static std::complex<double> admittance_of(double L, std::complex<double> s)
+	{
+		return 1.0 / (s == 0.0 ? std::complex<double>{1e-9} : s * L);
+	}
+
+	//! Admitancja cewki o indukcyjności L dla pulsacji omega
+	static std::complex<double> admittance_of(double L, double omega)
+	{
+		return admittance_of(L, std::complex<double>{0.0, omega});
+	}
+
+	//! Pochodna admitancji cewki po indukcyjności
+	static std::complex<double> admittance_derivative_of(double L, double omega)
+	{
+		return omega == 0 ? std::complex<double>{0.0} : std::complex<double>{0.0, 1.0 / (omega * L * L)};
+	}
 
 	//! Indukcyjność [H]
 	double L;
+
+	component_view view() const override {return this;}
 };
 
 /**
@@ -123,10 +215,22 @@ struct capacitor : public passive_component
 		C(c)
 	{}
 
-	std::complex<double> admittance(double omega) const override;
+	std::complex<double> admittance(std::complex<double> s) const override;
+	std::complex<double> admittance_derivative(double omega) const override;
+
+	//! Admitancja kondensatora o pojemności C
+	static std::complex<double> admittance_of(double C, std::complex<double> s) {return s * C;}
+
+	//! Admitancja kondensatora o pojemności C dla pulsacji omega
+	static std::complex<double> admittance_of(double C, double omega) {return {0.0, omega * C};}
+
+	//! Pochodna admitancji kondensatora po pojemności
+	static std::complex<double> admittance_derivative_of(double omega) {return {0.0, omega};}
 
 	//! Pojemność [F]
 	double C;
+
+	component_view view() const override {return this;}
 };
 
 /**
@@ -143,6 +247,102 @@ struct opamp : public circuit_component
 	int pos_input_node; //! Numer węzła wejścia nieodwracającego
 	int neg_input_node; //! Numer węzła wejścia odwracającego
 	int output_node; //! Numer węzła wyjściowego
+
+	component_view view() const override {return this;}
+};
+
+/**
+	\brief Idealne źródło sterowane (E, G, H lub F)
+
+	Źródła sterowane napięciem zależą od napięcia między węzłami \ref control, a źródła sterowane
+	prądem - od prądu SEM o nazwie \ref control_source (jak w SPICE). Prąd źródła prądowego płynie
+	przez element od pierwszego do drugiego węzła.
+*/
+struct controlled_source : public bipole_component
+{
+	//! Rodzaj źródła sterowanego
+	enum class source_type
+	{
+		VCVS, //!< Źródło napięciowe sterowane napięciem (E) - wzmocnienie napięciowe
+		VCCS, //!< Źródło prądowe sterowane napięciem (G) - transkonduktancja [S]
+		CCVS, //!< Źródło napięciowe sterowane prądem (H) - transrezystancja [Ohm]
+		CCCS  //!< Źródło prądowe sterowane prądem (F) - wzmocnienie prądowe
+	};
+
+	//! Tworzy źródło sterowane napięciem między węzłami ctrl
+	controlled_source(source_type t, const std::pair<int, int> &p, const std::pair<int, int> &ctrl, double g) :
+		bipole_component(p),
+		type(t),
+		control(ctrl),
+		gain(g)
+	{}
+
+	//! Tworzy źródło sterowane prądem SEM o nazwie src
+	controlled_source(source_type t, const std::pair<int, int> &p, const std::string &src, double g) :
+		bipole_component(p),
+		type(t),
+		control_source(src),
+		gain(g)
+	{}
+
+	//! Rodzaj źródła
+	source_type type;
+
+	//! Węzły sterujące (źródła sterowane napięciem)
+	std::pair<int, int> control{0, 0};
+
+	//! Nazwa SEM, której prąd steruje źródłem (źródła sterowane prądem)
+	std::string control_source;
+
+	//! Wzmocnienie, transkonduktancja lub transrezystancja
+	double gain;
+
+	component_view view() const override {return this;}
+};
+
+/**
+	\brief Linearyzacja elementu nieliniowego w punkcie pracy
+
+	Prądy wpływające do kolejnych wyprowadzeń elementu i macierz konduktancji
+	\f$ g_{kj} = \partial i_k / \partial v_j \f$ (potencjały wyprowadzeń względem masy).
+*/
+struct device_linearization
+{
+	std::array<double, 3> current{};
+	std::array<std::array<double, 3>, 3> conductance{};
+};
+
+/**
+	\brief Klasa bazowa dla elementów nieliniowych (diod i tranzystorów)
+
+	Element opisany jest prądami wyprowadzeń w funkcji ich potencjałów. Analiza DC układu
+	nieliniowego (\ref newton_solver) w każdej iteracji metody Newtona zastępuje element
+	jego linearyzacją (\ref evaluate()), a przed nią może ograniczyć zmianę napięć złącz
+	(\ref limit()), aby wykładnicze charakterystyki nie powodowały rozbieżności.
+*/
+struct nonlinear_component : public circuit_component
+{
+	nonlinear_component(const std::array<int, 3> &n, int count) :
+		nodes(n),
+		terminal_count(count)
+	{}
+
+	//! Wyznacza prądy wyprowadzeń i ich pochodne dla potencjałów v
+	virtual void evaluate(const std::array<double, 3> &v, device_linearization &lin) const = 0;
+
+	//! Ogranicza zmianę potencjałów względem poprzedniej iteracji (v_old) - zwraca true, jeżeli v zmieniono
+	virtual bool limit(const std::array<double, 3> &v_old, std::array<double, 3> &v) const {(void) v_old; (void) v; return false;}
+
+	//! Konduktancja dołączana równolegle do złącz [S]
+	static constexpr double gmin = 1e-12;
+
+	//! Węzły kolejnych wyprowadzeń
+	std::array<int, 3> nodes;
+
+	//! Liczba wyprowadzeń (2 lub 3)
+	int terminal_count;
+
+	component_view view() const override {return this;}
 };
 
 /**
@@ -150,6 +350,360 @@ struct opamp : public circuit_component
 */
 using circuit = std::map<std::string, std::shared_ptr<circuit_component>>;
 
+/**
+	\brief Wrażliwości wielkości na wartości elementów pasywnych
+
+	Kluczem jest nazwa elementu, a wartością pochodna wielkości po jego
+	rezystancji, indukcyjności lub pojemności.
+*/
+using sensitivity_map = std::map<std::string, std::complex<double>>;
+
+/**
+	\brief Transmitancje z pobudzeń układu do mierzonej wielkości
+
+	Wyznaczane jednym rozwiązaniem układu sprzężonego, niezależnie od liczby pobudzeń
+	(\ref solve_context::voltage_transfer()).
+*/
+struct transfer_map
+{
+	//! Transimpedancja z prądu wstrzykiwanego do węzła (według numeracji planu)
+	std::vector<std::complex<double>> nodes;
+
+	//! Wzmocnienie z napięcia SEM (według numeracji planu, brak dla SEM wyeliminowanych z układu)
+	std::vector<std::optional<std::complex<double>>> voltage_sources;
+
+	std::complex<double> injection(int a, int b) const;
+};
+
+/**
+	\brief Skompilowany obwód - niezmienny plan rozwiązywania układu równań
+
+	Zawiera wszystko, co jest potrzebne do złożenia i rozwiązania układu MNA dla dowolnej
+	pulsacji: numerację węzłów, elementy pogrupowane według rodzaju w ciągłych tablicach
+	(z przemapowanymi już numerami węzłów i zapamiętanymi wartościami) oraz numerację gałęzi
+	SEM, wzmacniaczy operacyjnych i źródeł napięciowych sterowanych (\ref branch_index()). Wykonanie planu (\ref assemble(), \ref solve()) nie
+	odwołuje się do \ref circuit ani do obiektów komponentów (poza elementami pasywnymi
+	nieznanego typu, których admitancja wyznaczana jest wirtualnie). Elementy nieliniowe są
+	w planie jedynie zapamiętywane (wraz z numeracją ich węzłów) - \ref assemble() ich nie
+	uwzględnia, a linearyzuje je w kolejnych iteracjach \ref newton_solver.
+
+	Plan jest niezmienny - wszystkie metody publiczne (poza \ref set_value() i \ref set_ac_value()) są stałe, więc może
+	być współdzielony (tylko do odczytu) przez wiele wątków. Plany tworzy \ref circuit_solver
+	(\ref circuit_solver::get_plan()). Wartości elementów można zmieniać jedynie w prywatnej
+	kopii planu (np. w kolejnych próbach analizy Monte Carlo).
+*/
+class solve_plan
+{
+public:
+	//! Rodzaj komponentu
+	enum class component_kind
+	{
+		RESISTOR,
+		INDUCTOR,
+		CAPACITOR,
+		PASSIVE,
+		VOLTAGE_SOURCE,
+		CURRENT_SOURCE,
+		OPAMP,
+		VCVS,
+		VCCS,
+		CCVS,
+		CCCS,
+		NONLINEAR,
+		OTHER
+	};
+
+	/**
+		\brief Elementy dwukońcówkowe jednego rodzaju zapisane w osobnych, ciągłych tablicach
+
+		Numery węzłów są już przemapowane (\ref get_node_map()).
+	*/
+	struct bipole_array
+	{
+		std::vector<const circuit_component*> comp; //!< Element obwodu (identyfikator)
+		std::vector<int> a;                         //!< Pierwszy węzeł
+		std::vector<int> b;                         //!< Drugi węzeł
+		std::vector<double> value;                  //!< R, L, C lub wartość DC źródła
+		std::vector<double> ac;                     //!< Wartość AC źródła
+
+		int push_back(const circuit_component *c, int na, int nb, const std::array<double, 2> &v);
+		int size() const;
+		void clear();
+	};
+
+	/**
+		\brief Wzmacniacze operacyjne zapisane w osobnych, ciągłych tablicach
+	*/
+	struct opamp_array
+	{
+		std::vector<const circuit_component*> comp;
+		std::vector<int> pos;
+		std::vector<int> neg;
+		std::vector<int> out;
+
+		int size() const;
+		void clear();
+	};
+
+	/**
+		\brief Źródła sterowane jednego rodzaju zapisane w osobnych, ciągłych tablicach
+	*/
+	struct controlled_array
+	{
+		std::vector<const circuit_component*> comp;
+		std::vector<int> a;       //!< Pierwszy węzeł wyjścia
+		std::vector<int> b;       //!< Drugi węzeł wyjścia
+		std::vector<int> c;       //!< Pierwszy węzeł sterujący (źródła sterowane napięciem)
+		std::vector<int> d;       //!< Drugi węzeł sterujący
+		std::vector<int> control; //!< Numer SEM sterującej (źródła sterowane prądem)
+		std::vector<double> gain; //!< Wzmocnienie, transkonduktancja lub transrezystancja
+
+		int size() const;
+		void clear();
+	};
+
+	/**
+		\brief Elementy nieliniowe zapisane w osobnych, ciągłych tablicach
+	*/
+	struct nonlinear_array
+	{
+		std::vector<const nonlinear_component*> comp;
+		std::vector<std::array<int, 3>> nodes; //!< Węzły wyprowadzeń (nieużywane wyprowadzenia - masa)
+
+		int size() const;
+		void clear();
+	};
+
+	/**
+		\brief Elementy obwodu pogrupowane według rodzaju
+
+		Nazwy elementów przechowywane są osobno (\ref get_names()).
+	*/
+	struct component_store
+	{
+		bipole_array resistors;
+		bipole_array inductors;
+		bipole_array capacitors;
+		bipole_array passives; //!< Pozostałe elementy pasywne (admitancja wyznaczana wirtualnie)
+		bipole_array voltage_sources;
+		bipole_array current_sources;
+		opamp_array opamps;
+		controlled_array vcvs;
+		controlled_array vccs;
+		controlled_array ccvs;
+		controlled_array cccs;
+		nonlinear_array nonlinear;
+
+		bipole_array *bipoles(component_kind kind);
+		const bipole_array *bipoles(component_kind kind) const;
+		controlled_array *controlled(component_kind kind);
+		const controlled_array *controlled(component_kind kind) const;
+		void clear();
+	};
+
+	/**
+		\brief Położenie elementu w tablicach planu
+	*/
+	struct component_ref
+	{
+		component_kind kind;
+		int index; //!< Numer elementu w tablicy danego rodzaju
+	};
+
+	const ::node_index &get_node_map() const;
+	int node_index(int node) const;
+	int get_node_count() const;
+	int get_branch_count() const;
+	int branch_index(const component_ref &ref) const;
+	const component_store &get_components() const;
+	const component_ref *find_component(const circuit_component *comp) const;
+	const circuit_component *component(const std::string &ref) const;
+	const std::map<std::string, component_ref> &get_names() const;
+	int voltage_source_index(const circuit_component *comp) const;
+	int opamp_index(const circuit_component *comp) const;
+
+	std::complex<double> passive_admittance(component_kind kind, int index, double omega) const;
+	std::complex<double> passive_admittance(component_kind kind, int index, std::complex<double> s) const;
+	std::complex<double> passive_admittance_derivative(component_kind kind, int index, double omega) const;
+
+	void assemble(double omega, mna::mna_problem &problem) const;
+	void assemble(std::complex<double> s, mna::mna_problem &problem) const;
+	mna::mna_solution solve(double omega) const;
+
+	void set_value(const component_ref &ref, double value);
+	void set_ac_value(const component_ref &ref, double ac);
+
+private:
+	friend class circuit_solver;
+
+	int add_component(const std::string &ref, component_kind kind, const circuit_component *comp,
+		const std::array<int, 4> &nodes, const std::array<double, 2> &values);
+	void link_controls();
+	void set_values(component_kind kind, int index, const std::array<double, 2> &values);
+	void clear();
+
+	//! Mapowanie numerów węzłów do bardziej restrykcyjnej numeracji mna::mna_problem
+	::node_index m_node_map;
+
+	//! Elementy obwodu w kolejności dodania, pogrupowane według rodzaju
+	component_store m_components;
+
+	//! Położenie każdego elementu w tablicach (dla SEM i wzmacniaczy - także numer gałęzi)
+	std::unordered_map<const circuit_component*, component_ref> m_refs;
+
+	//! Położenie elementów według nazw
+	std::map<std::string, component_ref> m_names;
+};
+
+/**
+	\brief Kontekst analizy - zmienny stan rozwiązywania układu na podstawie planu
+
+	Plan (\ref solve_plan) opisuje obwód i nie zmienia się, a kontekst przechowuje wszystko,
+	co zmienia się przy kolejnych analizach: złożony układ równań, jego rozwiązanie (wraz
+	z rozkładem macierzy) i wynik upraszczania topologii przy analizie DC. Wiele kontekstów
+	może jednocześnie korzystać z jednego planu, więc wiele punktów analizy może być
+	wyznaczanych równolegle bez kopiowania obwodu - każdy wątek powinien mieć własny kontekst.
+	Pojedynczy kontekst nie jest bezpieczny wielowątkowo.
+
+	Po wywołaniu \ref solve(), możliwy jest pomiar napięć, prądów i mocy
+	w układzie za pomocą \ref voltage(), \ref current() i \ref power().
+	Wrażliwości tych wielkości na wartości elementów pasywnych wyznaczane są metodą
+	układu sprzężonego (\ref voltage_sensitivity(), \ref current_sensitivity(),
+	\ref power_sensitivity()).
+
+	Przy analizie DC (o ile nie wyłączono jej przez \ref set_dc_reduction()) układ jest
+	wstępnie upraszczany: węzły połączone cewkami i źródłami 0 V są łączone, kondensatory
+	pomijane, a węzły połączone z masą przez SEM otrzymują znany potencjał i znikają z układu
+	równań. Prądy wyeliminowanych elementów odtwarzane są z praw Kirchhoffa. SEM sterujące
+	źródłami sterowanymi prądem pozostają w układzie równań (ich prąd jest zmienną).
+*/
+class solve_context
+{
+public:
+	explicit solve_context(std::shared_ptr<const solve_plan> plan);
+
+	void set_plan(std::shared_ptr<const solve_plan> plan, bool matrix_changed = true);
+	std::shared_ptr<const solve_plan> get_plan() const;
+	void solve(double omega);
+	void solve_batch(double omega, int count, const std::function<void(int k)> &set_point,
+		const std::function<void(int k)> &visit);
+	void set_dc_reduction(bool enable);
+
+	bool has_solution() const;
+	const mna::mna_solution &get_solution() const;
+	double get_solution_omega() const;
+
+	std::complex<double> variable(int row) const;
+	std::complex<double> voltage(int pos, int neg = 0) const;
+	std::complex<double> voltage(const circuit_component &comp) const;
+	std::complex<double> current(const circuit_component &comp) const;
+	std::complex<double> power(const circuit_component &comp) const;
+
+	std::complex<double> voltage(const std::string &ref) const;
+	std::complex<double> current(const std::string &ref) const;
+	std::complex<double> power(const std::string &ref) const;
+
+	sensitivity_map voltage_sensitivity(int pos, int neg = 0) const;
+	sensitivity_map current_sensitivity(const circuit_component &comp) const;
+	sensitivity_map power_sensitivity(const circuit_component &comp) const;
+	sensitivity_map current_sensitivity(const std::string &ref) const;
+	sensitivity_map power_sensitivity(const std::string &ref) const;
+
+	transfer_map voltage_transfer(int pos, int neg = 0) const;
+
+private:
+	using component_kind = solve_plan::component_kind;
+	using bipole_array = solve_plan::bipole_array;
+	using controlled_array = solve_plan::controlled_array;
+
+	/**
+		\brief Położenie węzła w analizowanym układzie równań
+
+		Potencjał węzła to wartość zmiennej o numerze index (0 dla masy - index < 0)
+		powiększona o napięcie SEM, która łączy węzeł z masą (jeżeli węzeł ma znany potencjał).
+	*/
+	struct node_ref
+	{
+		int index;
+		int source = -1; //!< Numer SEM w \ref solve_plan::component_store::voltage_sources
+		double sign = 0.0;
+	};
+
+	/**
+		\brief Admitancja łącząca węzeł o znanym potencjale z niewiadomą - zastępowana
+		admitancją do masy i źródłem prądowym (twierdzenie Nortona)
+	*/
+	struct norton_source
+	{
+		int node;
+		double Y;
+		node_ref known;
+	};
+
+	/**
+		\brief Liniowa kombinacja prądów elementów obecnych w układzie równań
+
+		Opisuje prąd elementu wyeliminowanego z układu (zwarcia lub SEM ustalającej potencjał węzła).
+	*/
+	using current_terms = std::vector<std::pair<const circuit_component*, double>>;
+
+	/**
+		\brief Funkcjonał liniowy rozwiązania \f$ q = c^T x \f$ wraz z bezpośrednimi
+		pochodnymi \f$ q \f$ po wartościach elementów (niezależnymi od \f$ x \f$)
+	*/
+	struct linear_functional
+	{
+		matrix<std::complex<double>> c;
+		std::map<const circuit_component*, std::complex<double>> direct;
+	};
+
+	void assemble_matrix(double omega);
+	void assemble_rhs(double omega);
+	void reduce_dc_topology();
+	int branch_index(const circuit_component *comp) const;
+	std::complex<double> node_voltage(int node) const;
+	std::complex<double> index_voltage(int index) const;
+	double known_potential(const node_ref &ref) const;
+	const node_ref &index_ref(int index) const;
+	sensitivity_map adjoint_sensitivity(const linear_functional &f) const;
+	void add_voltage_weights(linear_functional &f, int pos, int neg, std::complex<double> scale) const;
+	void add_current_weights(linear_functional &f, const circuit_component &comp, std::complex<double> scale) const;
+	linear_functional make_functional() const;
+
+	//! Analizowany plan
+	std::shared_ptr<const solve_plan> m_plan;
+
+	//! Położenie węzłów w układzie równań według numeracji planu (masa na końcu)
+	std::vector<node_ref> m_index_refs;
+
+	//! Numery SEM w mna_problem (-1 dla SEM wyeliminowanych z układu)
+	std::vector<int> m_voltage_source_rows;
+
+	//! Węzły, w których potencjał znanego węzła uwzględniany jest jako źródło prądowe
+	std::vector<norton_source> m_norton_sources;
+
+	//! Prądy elementów wyeliminowanych z układu równań
+	std::map<const circuit_component*, current_terms> m_eliminated;
+
+	//! Czy upraszczać topologię układu przy analizie DC
+	bool m_dc_reduction = true;
+
+	//! Czy macierz A wymaga ponownego wyznaczenia i rozkładu
+	bool m_matrix_dirty = true;
+
+	//! Czy wektor wyrazów wolnych (wartości źródeł) wymaga aktualizacji
+	bool m_rhs_dirty = true;
+
+	//! Obwód w wersji mna_problem
+	mna::mna_problem m_problem;
+
+	//! Rozwiązanie (może być nieobecne)
+	std::optional<mna::mna_solution> m_solution;
+
+	//! Pulsacja dla której układ był ostatnio analizowany
+	std::optional<double> m_solution_omega;
+};
+
 /**
 	\brief Analizator układów liniowych
 
@@ -159,8 +713,16 @@ using circuit = std::map<std::string, std::shared_ptr<circuit_component>>;
 	proste dodawanie różnych elementów do powiązanej klasy \ref circuit i rozluźnia
 	wymagania dot. numeracji węzłów.
 
-	Po wywołaniu \ref solve(), możliwy jest pomiar napięć, prądów i mocy
-	w układzie za pomocą \ref voltage(), \ref current() i \ref power().
+	Solver zapamiętuje stan elementów obwodu (węzły i wartości). Po wprowadzeniu zmian
+	w obwodzie należy wywołać \ref update(), który porównuje obwód z zapamiętanym stanem
+	i ponownie wyznacza tylko to, co jest konieczne - zmiana samych wartości źródeł
+	nie wymaga ponownego rozkładu macierzy układu. Zapamiętane elementy przechowywane są
+	w skompilowanym planie (\ref solve_plan), więc składanie układu równań nie wymaga
+	rzutowania ani odwołań do obiektów obwodu.
+
+	Sama analiza i pomiary wykonywane są przez własny kontekst solvera (\ref solve_context,
+	\ref get_context()). Plan może zostać pobrany (\ref get_plan()) i analizowany w wielu
+	wątkach jednocześnie - każdy z własnym kontekstem.
 */
 class circuit_solver
 {
@@ -169,10 +731,13 @@ public:
 
 	void update();	
 	void solve(double omega);
+	void set_dc_reduction(bool enable);
 
+	const solve_context &get_context() const;
 	const mna::mna_solution &get_solution() const;
-	const std::map<int, int> &get_node_map() const;
+	const node_index &get_node_map() const;
 	double get_solution_omega() const;
+	std::shared_ptr<const solve_plan> get_plan() const;
 
 	std::complex<double> voltage(int pos, int neg = 0) const;
 	std::complex<double> voltage(const circuit_component &comp) const;
@@ -183,21 +748,43 @@ public:
 	std::complex<double> current(const std::string &ref) const;
 	std::complex<double> power(const std::string &ref) const;
 
+	sensitivity_map voltage_sensitivity(int pos, int neg = 0) const;
+	sensitivity_map current_sensitivity(const std::string &ref) const;
+	sensitivity_map power_sensitivity(const std::string &ref) const;
+
 private:
+	using component_kind = solve_plan::component_kind;
+
+	/**
+		\brief Stan komponentu zapamiętany przy ostatniej aktualizacji
+
+		Porównanie z bieżącym stanem obwodu pozwala wykryć dodane, usunięte i zmienione elementy.
+	*/
+	struct component_state
+	{
+		const circuit_component *ptr;
+		component_kind kind;
+		std::array<int, 4> nodes;
+		std::array<double, 2> values;
+		int index = -1; //!< Położenie elementu w tablicach planu (\ref m_plan)
+	};
+
+	static component_state capture_state(const circuit_component *comp, const component_state *prev = nullptr);
+
+	void rebuild();
+	bool add_component(const std::string &ref, component_state &st);
 	void update_node_map();
+	solve_plan &mutable_plan();
 
 	//! Analizowany obwód
 	const circuit *m_circuit;
 
-	//! Mapowanie numerów węzłów do bardziej restrykcyjnej numeracji mna::mna_problem
-	std::map<int, int> m_node_map;
+	//! Stan elementów obwodu przy ostatniej aktualizacji
+	std::map<std::string, component_state> m_states;
 
-	//! Obwód w wersji mna_problem
-	mna::mna_problem m_problem;
-
-	//! Rozwiązanie (może być nieobecne)
-	std::optional<mna::mna_solution> m_solution;
+	//! Skompilowany obwód (kopiowany przed modyfikacją, jeżeli jest współdzielony)
+	std::shared_ptr<solve_plan> m_plan;
 
-	//! Pulsacja dla której układ był ostatnio analizowany
-	std::optional<double> m_solution_omega;
-};
\ No newline at end of file
+	//! Kontekst, w którym solver analizuje swój plan
+	solve_context m_context;
+};
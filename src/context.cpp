@@ -0,0 +1,1081 @@
+#include "circuit.hpp"
+#include <algorithm>
+
+/**
+	\file context.cpp
+	\brief Implementacja \ref solve_context - analizy obwodu na podstawie planu
+	\author Jacek Wieczorek
+*/
+
+/**
+	\brief Tworzy kontekst analizy planu
+*/
+solve_context::solve_context(std::shared_ptr<const solve_plan> plan) :
+	m_plan(std::move(plan))
+{
+}
+
+/**
+	\brief Zmienia analizowany plan
+
+	Rozwiązanie pozostaje dostępne do czasu kolejnej analizy (\ref solve()).
+
+	\param plan Nowy plan (może być kolejną wersją poprzedniego planu)
+	\param matrix_changed false, jeżeli względem poprzedniego planu zmieniły się
+		jedynie wartości źródeł - kolejna analiza wykorzysta wtedy istniejący rozkład macierzy
+*/
+void solve_context::set_plan(std::shared_ptr<const solve_plan> plan, bool matrix_changed)
+{
+	m_plan = std::move(plan);
+	m_rhs_dirty = true;
+	if (matrix_changed)
+		m_matrix_dirty = true;
+}
+
+/**
+	\brief Zwraca analizowany plan
+*/
+std::shared_ptr<const solve_plan> solve_context::get_plan() const
+{
+	return m_plan;
+}
+
+/**
+	\brief Sprawdza, czy kontekst zawiera rozwiązanie
+*/
+bool solve_context::has_solution() const
+{
+	return m_solution.has_value();
+}
+
+/**
+	\brief Zwraca pulsację dla której wyznaczone zostało rozwiązanie
+*/
+double solve_context::get_solution_omega() const
+{
+	return *m_solution_omega;
+}
+
+/**
+	\brief Wpisuje do mna_problem admitancje i wzmacniacze operacyjne
+
+	Wpisywane są także węzły źródeł, ponieważ źródła napięciowe mają swój udział w macierzy A.
+	Przy analizie DC układ jest wcześniej upraszczany przez \ref reduce_dc_topology().
+*/
+void solve_context::assemble_matrix(double omega)
+{
+	m_norton_sources.clear();
+	m_eliminated.clear();
+
+	if (omega == 0 && m_dc_reduction)
+	{
+		reduce_dc_topology();
+		return;
+	}
+
+	// Każdy węzeł jest osobną zmienną
+	const int n = m_plan->get_node_map().size();
+	m_index_refs.assign(n, node_ref{-1});
+	for (int i = 0; i < n - 1; i++)
+		m_index_refs[i] = node_ref{i};
+
+	m_plan->assemble(omega, m_problem);
+
+	m_voltage_source_rows.resize(m_problem.voltage_sources.size());
+	for (unsigned int i = 0; i < m_voltage_source_rows.size(); i++)
+		m_voltage_source_rows[i] = i;
+}
+
+/**
+	\brief Upraszcza topologię układu na potrzeby analizy DC
+
+	Dla omega = 0:
+	 - węzły połączone cewkami i SEM o zerowym napięciu są łączone w jeden węzeł,
+	 - kondensatory (rozwarcia) są pomijane,
+	 - węzły połączone z masą przez SEM otrzymują znany potencjał. Admitancje łączące je
+	   z pozostałymi węzłami zastępowane są źródłami prądowymi (\ref norton_source).
+
+	Dzięki temu układ równań jest mniejszy, a macierz nie zawiera sztucznych, ogromnych
+	admitancji zwarć. Prądy wyeliminowanych elementów (\ref m_eliminated) wyznaczane są
+	z prądowego prawa Kirchhoffa jako kombinacje liniowe prądów pozostałych elementów.
+	Jeżeli zwarcia tworzą pętle, prąd rozdzielany jest między nie po równo (tak, jakby
+	były jednakowymi rezystancjami).
+
+	\note Węzły, do których podłączone są wzmacniacze operacyjne i źródła sterowane, nie otrzymują
+	znanego potencjału. SEM sterujące źródłami sterowanymi prądem nie są eliminowane (także SEM 0 V).
+*/
+void solve_context::reduce_dc_topology()
+{
+	// Węzły numerowane wg planu, masa ma numer n - 1
+	const int n = m_plan->get_node_map().size();
+	const int ground = n - 1;
+	auto dense_id = [&](int index){
+		return index < 0 ? ground : index;
+	};
+
+	const auto &st = m_plan->get_components();
+	const auto &vsources = st.voltage_sources;
+
+	// Find-union ze ścieżką skracaną o połowę
+	std::vector<int> parent(n);
+	for (int i = 0; i < n; i++)
+		parent[i] = i;
+
+	auto find = [&](int x){
+		while (parent[x] != x)
+			x = parent[x] = parent[parent[x]];
+		return x;
+	};
+
+	auto unite = [&](int a, int b){
+		a = find(a);
+		b = find(b);
+		if (b == ground) std::swap(a, b);
+		if (a != b) parent[b] = a;
+	};
+
+	// Zwarcia - cewki i SEM 0 V
+	struct short_edge
+	{
+		const circuit_component *comp;
+		int a, b;
+		bool source;
+	};
+	std::vector<short_edge> shorts;
+
+	// SEM sterujące źródłami sterowanymi prądem - ich prąd musi być zmienną układu
+	std::vector<bool> controlling(vsources.size());
+	for (const auto *arr : {&st.ccvs, &st.cccs})
+		for (int k : arr->control)
+			controlling[k] = true;
+
+	for (int i = 0; i < st.inductors.size(); i++)
+		shorts.push_back({st.inductors.comp[i], dense_id(st.inductors.a[i]), dense_id(st.inductors.b[i]), false});
+
+	for (int i = 0; i < vsources.size(); i++)
+		if (vsources.value[i] == 0 && !controlling[i])
+			shorts.push_back({vsources.comp[i], dense_id(vsources.a[i]), dense_id(vsources.b[i]), true});
+
+	for (const auto &s : shorts)
+		unite(s.a, s.b);
+
+	// Węzły połączone ze wzmacniaczami operacyjnymi i źródłami sterowanymi
+	std::vector<bool> touched(n);
+	for (int i = 0; i < st.opamps.size(); i++)
+		for (int index : {st.opamps.pos[i], st.opamps.neg[i], st.opamps.out[i]})
+			touched[find(dense_id(index))] = true;
+
+	const controlled_array *controlled[] = {&st.vcvs, &st.vccs, &st.ccvs, &st.cccs};
+	for (const auto *arr : controlled)
+		for (int i = 0; i < arr->size(); i++)
+			for (int index : {arr->a[i], arr->b[i], arr->c[i], arr->d[i]})
+				touched[find(dense_id(index))] = true;
+
+	// Węzły o znanym potencjale - SEM między masą i węzłem
+	std::vector<node_ref> known(n, node_ref{-1});
+	std::vector<bool> collapsed(vsources.size());
+	for (int i = 0; i < vsources.size(); i++)
+	{
+		if (vsources.value[i] == 0 || controlling[i]) continue;
+
+		auto ra = find(dense_id(vsources.a[i]));
+		auto rb = find(dense_id(vsources.b[i]));
+		if ((ra == ground) == (rb == ground)) continue;
+
+		auto k = (rb == ground) ? ra : rb;
+		if (known[k].source >= 0 || touched[k]) continue;
+
+		known[k] = node_ref{-1, i, (rb == ground) ? 1.0 : -1.0};
+		collapsed[i] = true;
+	}
+
+	// Numeracja pozostałych węzłów
+	int cnt = 0;
+	std::vector<int> class_index(n, -1);
+	for (int i = 0; i < ground; i++)
+	{
+		auto r = find(i);
+		if (r != ground && known[r].source < 0 && class_index[r] < 0)
+			class_index[r] = cnt++;
+	}
+
+	auto ref_of_id = [&](int id){
+		auto r = find(id);
+		auto ref = known[r];
+		ref.index = class_index[r];
+		return ref;
+	};
+
+	m_index_refs.resize(n);
+	for (int i = 0; i < n; i++)
+		m_index_refs[i] = ref_of_id(i);
+
+	auto map_node = [&](int index){
+		return m_index_refs[dense_id(index)].index;
+	};
+
+	// Elementy pasywne - rezystory i elementy o nieznanym typie (cewki i kondensatory są wyeliminowane)
+	m_problem.admittances.clear();
+	auto stamp = [&](const bipole_array &arr, auto admittance){
+		for (int i = 0; i < arr.size(); i++)
+		{
+			auto Y = admittance(i);
+			int ia = dense_id(arr.a[i]);
+			int ib = dense_id(arr.b[i]);
+			if (Y == 0.0 || find(ia) == find(ib))
+				continue;
+
+			// Elementy między masą a węzłami o znanym potencjale nie wpływają na układ
+			const auto &a = m_index_refs[ia];
+			const auto &b = m_index_refs[ib];
+			if (a.index < 0 && b.index < 0)
+				continue;
+
+			m_problem.admittances.push_back({{a.index, b.index}, Y});
+
+			if (a.source >= 0)
+				m_norton_sources.push_back({b.index, Y.real(), a});
+			if (b.source >= 0)
+				m_norton_sources.push_back({a.index, Y.real(), b});
+		}
+	};
+
+	stamp(st.resistors, [&](int i){return resistor::admittance_of(st.resistors.value[i]);});
+	stamp(st.passives, [&](int i){return static_cast<const passive_component*>(st.passives.comp[i])->admittance(0.0);});
+
+	// Wzmacniacze operacyjne
+	m_problem.opamps.resize(st.opamps.size());
+	for (int i = 0; i < st.opamps.size(); i++)
+		m_problem.opamps[i] = {map_node(st.opamps.pos[i]), map_node(st.opamps.neg[i]), map_node(st.opamps.out[i])};
+
+	// Źródła napięciowe pozostające w układzie
+	m_problem.voltage_sources.clear();
+	m_voltage_source_rows.assign(vsources.size(), -1);
+	for (int i = 0; i < vsources.size(); i++)
+	{
+		if ((vsources.value[i] == 0 && !controlling[i]) || collapsed[i])
+			continue;
+
+		m_voltage_source_rows[i] = m_problem.voltage_sources.size();
+		m_problem.voltage_sources.push_back({{map_node(vsources.a[i]), map_node(vsources.b[i])}, 0.0});
+	}
+
+	// Źródła sterowane (węzły nie mają znanego potencjału, a SEM sterujące pozostają w układzie)
+	auto map_pair = [&](int a, int b){
+		return std::make_pair(map_node(a), map_node(b));
+	};
+
+	m_problem.voltage_gains.resize(st.vcvs.size());
+	for (int i = 0; i < st.vcvs.size(); i++)
+		m_problem.voltage_gains[i] = {map_pair(st.vcvs.a[i], st.vcvs.b[i]), map_pair(st.vcvs.c[i], st.vcvs.d[i]), st.vcvs.gain[i]};
+
+	m_problem.transconductances.resize(st.vccs.size());
+	for (int i = 0; i < st.vccs.size(); i++)
+		m_problem.transconductances[i] = {map_pair(st.vccs.a[i], st.vccs.b[i]), map_pair(st.vccs.c[i], st.vccs.d[i]), st.vccs.gain[i]};
+
+	m_problem.transresistances.resize(st.ccvs.size());
+	for (int i = 0; i < st.ccvs.size(); i++)
+		m_problem.transresistances[i] = {map_pair(st.ccvs.a[i], st.ccvs.b[i]), m_voltage_source_rows[st.ccvs.control[i]], st.ccvs.gain[i]};
+
+	m_problem.current_gains.resize(st.cccs.size());
+	for (int i = 0; i < st.cccs.size(); i++)
+		m_problem.current_gains[i] = {map_pair(st.cccs.a[i], st.cccs.b[i]), m_voltage_source_rows[st.cccs.control[i]], st.cccs.gain[i]};
+
+	// Źródła prądowe i źródła zastępcze węzłów o znanym potencjale
+	const auto &isources = st.current_sources;
+	m_problem.current_sources.resize(isources.size() + m_norton_sources.size());
+	for (int i = 0; i < isources.size(); i++)
+		m_problem.current_sources[i].nodes = {map_node(isources.a[i]), map_node(isources.b[i])};
+	for (unsigned int i = 0; i < m_norton_sources.size(); i++)
+		m_problem.current_sources[isources.size() + i].nodes = {m_norton_sources[i].node, -1};
+
+	// Prądy wypływające z węzłów przez elementy obecne w układzie (lub SEM ustalające potencjał)
+	std::vector<current_terms> leaving(n);
+	auto add_leaving = [&](const bipole_array &arr, int i){
+		leaving[dense_id(arr.a[i])].emplace_back(arr.comp[i], 1.0);
+		leaving[dense_id(arr.b[i])].emplace_back(arr.comp[i], -1.0);
+	};
+
+	for (int i = 0; i < st.resistors.size(); i++)
+		add_leaving(st.resistors, i);
+
+	for (int i = 0; i < st.passives.size(); i++)
+		add_leaving(st.passives, i);
+
+	for (int i = 0; i < vsources.size(); i++)
+		if (vsources.value[i] != 0 || controlling[i])
+			add_leaving(vsources, i);
+
+	for (int i = 0; i < isources.size(); i++)
+		add_leaving(isources, i);
+
+	for (int i = 0; i < st.opamps.size(); i++)
+		leaving[dense_id(st.opamps.out[i])].emplace_back(st.opamps.comp[i], 1.0);
+
+	for (const auto *arr : controlled)
+		for (int i = 0; i < arr->size(); i++)
+		{
+			leaving[dense_id(arr->a[i])].emplace_back(arr->comp[i], 1.0);
+			leaving[dense_id(arr->b[i])].emplace_back(arr->comp[i], -1.0);
+		}
+
+	// Węzły należące do poszczególnych grup
+	std::vector<std::vector<int>> members(n);
+	for (int i = 0; i < n; i++)
+		members[find(i)].push_back(i);
+
+	// Prąd, który zwarcia muszą odprowadzić z węzła - J(i) (rozwinięty o prądy wyeliminowanych SEM)
+	auto injection = [&](int id){
+		std::map<const circuit_component*, double> J;
+		for (const auto &[comp, sign] : leaving[id])
+		{
+			if (auto it = m_eliminated.find(comp); it != m_eliminated.end())
+				for (const auto &[c, a] : it->second)
+					J[c] -= sign * a;
+			else
+				J[comp] -= sign;
+		}
+		return J;
+	};
+
+	auto to_terms = [](const std::map<const circuit_component*, double> &J){
+		current_terms terms;
+		for (const auto &[c, a] : J)
+			if (a != 0.0)
+				terms.emplace_back(c, a);
+		return terms;
+	};
+
+	// Prądy SEM ustalających potencjał - z prawa Kirchhoffa dla całej grupy węzłów
+	for (int r = 0; r < n; r++)
+	{
+		if (known[r].source < 0) continue;
+
+		const auto source = vsources.comp[known[r].source];
+		std::map<const circuit_component*, double> sum;
+		for (int id : members[r])
+			for (const auto &[c, a] : injection(id))
+				sum[c] += a;
+
+		// Prąd samej SEM nie wchodzi do sumy
+		sum.erase(source);
+		for (auto &[c, a] : sum)
+			a *= known[r].sign;
+
+		m_eliminated[source] = to_terms(sum);
+	}
+
+	// Rozpływ prądu w grafie zwarć o jednostkowych konduktancjach. Suma prądów zwarć
+	// wypływających z każdego węzła (poza węzłem odniesienia) jest równa J tego węzła.
+	using term_map = std::map<const circuit_component*, double>;
+	auto distribute = [](const std::vector<int> &nodes, int ref, const std::vector<std::pair<int, int>> &edges,
+		std::map<int, term_map> &J){
+		std::map<int, int> local;
+		for (int id : nodes)
+			if (id != ref)
+				local.emplace(id, local.size());
+
+		const int k = local.size();
+		std::vector<term_map> currents(edges.size());
+		if (k == 0) return currents;
+
+		// Odwrotność zredukowanej macierzy Laplace'a grupy
+		matrix<std::complex<double>> L(k, k), I(k, k);
+		for (const auto &[ea, eb] : edges)
+		{
+			if (ea == eb) continue;
+			auto a = local.find(ea);
+			auto b = local.find(eb);
+			if (a != local.end()) L(a->second, a->second) += 1.0;
+			if (b != local.end()) L(b->second, b->second) += 1.0;
+			if (a != local.end() && b != local.end())
+			{
+				L(a->second, b->second) -= 1.0;
+				L(b->second, a->second) -= 1.0;
+			}
+		}
+
+		for (int i = 0; i < k; i++)
+			I(i, i) = 1.0;
+
+		auto M = mna::lu_factorization(L).solve(I);
+
+		// i = phi(a) - phi(b), phi = M * J
+		for (unsigned int e = 0; e < edges.size(); e++)
+		{
+			auto a = local.find(edges[e].first);
+			auto b = local.find(edges[e].second);
+			for (const auto &[id, j] : local)
+			{
+				double w = 0.0;
+				if (a != local.end()) w += M(a->second, j).real();
+				if (b != local.end()) w -= M(b->second, j).real();
+				if (w == 0.0) continue;
+
+				for (const auto &[c, x] : J[id])
+					currents[e][c] += w * x;
+			}
+		}
+
+		return currents;
+	};
+
+	// Podgrupy węzłów połączonych samymi SEM 0 V. Cewki modelują bardzo małe rezystancje,
+	// więc prąd płynie przez nie tylko wtedy, gdy nie ma równoległej ścieżki przez idealne SEM.
+	std::vector<int> vparent(n);
+	for (int i = 0; i < n; i++)
+		vparent[i] = i;
+
+	auto vfind = [&](int x){
+		while (vparent[x] != x)
+			x = vparent[x] = vparent[vparent[x]];
+		return x;
+	};
+
+	std::vector<std::vector<const short_edge*>> group_shorts(n);
+	for (const auto &s : shorts)
+	{
+		group_shorts[find(s.a)].push_back(&s);
+		if (s.source)
+			vparent[vfind(s.a)] = vfind(s.b);
+	}
+
+	// Prądy zwarć w obrębie każdej grupy
+	for (int r = 0; r < n; r++)
+	{
+		if (group_shorts[r].empty()) continue;
+
+		// Węzeł odniesienia: masa, węzeł SEM ustalającej potencjał lub pierwszy węzeł grupy
+		const auto &nodes = members[r];
+		int ref = nodes.front();
+		if (r == ground)
+			ref = ground;
+		else if (known[r].source >= 0)
+			ref = dense_id(known[r].sign > 0 ? vsources.a[known[r].source] : vsources.b[known[r].source]);
+
+		std::map<int, term_map> J;
+		for (int id : nodes)
+			J[id] = injection(id);
+
+		// Etap 1 - cewki między podgrupami połączonymi SEM 0 V
+		std::vector<int> supernodes;
+		std::map<int, term_map> JS;
+		std::vector<std::pair<int, int>> inductor_edges;
+		std::vector<const short_edge*> inductors, sources;
+
+		for (int id : nodes)
+		{
+			auto v = vfind(id);
+			if (JS.find(v) == JS.end())
+				supernodes.push_back(v);
+			for (const auto &[c, x] : J[id])
+				JS[v][c] += x;
+		}
+
+		for (auto s : group_shorts[r])
+		{
+			if (s->source)
+				sources.push_back(s);
+			else
+			{
+				inductors.push_back(s);
+				inductor_edges.emplace_back(vfind(s->a), vfind(s->b));
+			}
+		}
+
+		auto inductor_currents = distribute(supernodes, vfind(ref), inductor_edges, JS);
+		for (unsigned int i = 0; i < inductors.size(); i++)
+		{
+			m_eliminated[inductors[i]->comp] = to_terms(inductor_currents[i]);
+
+			// SEM 0 V odprowadzają z węzłów to, czego nie odprowadzają cewki
+			for (const auto &[c, x] : inductor_currents[i])
+			{
+				J[inductors[i]->a][c] -= x;
+				J[inductors[i]->b][c] += x;
+			}
+		}
+
+		// Etap 2 - SEM 0 V wewnątrz podgrup
+		for (int v : supernodes)
+		{
+			std::vector<int> sub_nodes;
+			for (int id : nodes)
+				if (vfind(id) == v)
+					sub_nodes.push_back(id);
+
+			std::vector<std::pair<int, int>> edges;
+			std::vector<const short_edge*> sub_sources;
+			for (auto s : sources)
+				if (vfind(s->a) == v)
+				{
+					edges.emplace_back(s->a, s->b);
+					sub_sources.push_back(s);
+				}
+
+			if (edges.empty()) continue;
+
+			int sub_ref = vfind(ref) == v ? ref : sub_nodes.front();
+			auto source_currents = distribute(sub_nodes, sub_ref, edges, J);
+			for (unsigned int i = 0; i < sub_sources.size(); i++)
+				m_eliminated[sub_sources[i]->comp] = to_terms(source_currents[i]);
+		}
+	}
+}
+
+/**
+	\brief Wpisuje do mna_problem wartości źródeł dla zadanej pulsacji
+
+	Napięcia SEM pozostających w układzie są korygowane o znane potencjały węzłów,
+	a źródła zastępcze (\ref norton_source) otrzymują prąd \f$ Y V_k \f$.
+*/
+void solve_context::assemble_rhs(double omega)
+{
+	const auto &vsources = m_plan->get_components().voltage_sources;
+	for (int i = 0; i < vsources.size(); i++)
+	{
+		auto row = m_voltage_source_rows[i];
+		if (row < 0) continue;
+
+		auto V = (omega == 0) ? vsources.value[i] : vsources.ac[i];
+		V += known_potential(index_ref(vsources.b[i])) - known_potential(index_ref(vsources.a[i]));
+
+		m_problem.voltage_sources[row].V = V;
+	}
+
+	const auto &isources = m_plan->get_components().current_sources;
+	for (int i = 0; i < isources.size(); i++)
+		m_problem.current_sources[i].I = (omega == 0) ? isources.value[i] : isources.ac[i];
+
+	for (unsigned int i = 0; i < m_norton_sources.size(); i++)
+	{
+		const auto &ns = m_norton_sources[i];
+		m_problem.current_sources[isources.size() + i].I = ns.Y * known_potential(ns.known);
+	}
+}
+
+/**
+	\brief Włącza lub wyłącza upraszczanie topologii układu przy analizie DC
+*/
+void solve_context::set_dc_reduction(bool enable)
+{
+	m_dc_reduction = enable;
+	m_matrix_dirty = true;
+}
+
+/**
+	\brief Poddaje obwód analizie dla zadanej pulsacji
+
+	Przy analizie AC wszystkie źródła DC są pomijane i na odwrót.
+	Analiza DC uruchamiana jest przez podanie omega = 0.
+
+	Jeżeli od ostatniej analizy (dla tej samej pulsacji) zmieniły się tylko
+	wartości źródeł, wykorzystywany jest istniejący rozkład macierzy układu.
+
+	\param omega pulsacja sygnału źródeł AC. 0 oznacza analizę DC.
+*/
+void solve_context::solve(double omega)
+{
+	// Zmiana pulsacji zmienia admitancje i wartości źródeł (DC/AC)
+	if (!m_solution.has_value() || *m_solution_omega != omega)
+	{
+		m_matrix_dirty = true;
+		m_rhs_dirty = true;
+	}
+
+	// Zapisujemy omegę, dla której była przeprowadzona analiza
+	m_solution_omega = omega;
+
+	// Analiza
+	try
+	{
+		if (m_matrix_dirty)
+		{
+			assemble_matrix(omega);
+			assemble_rhs(omega);
+			m_solution = m_problem.solve();
+		}
+		else if (m_rhs_dirty)
+		{
+			assemble_rhs(omega);
+			m_solution = m_problem.solve(m_solution->get_factorization());
+		}
+	}
+	catch (const std::runtime_error &ex)
+	{
+		m_solution.reset();
+		throw std::runtime_error(std::string{"Could not compute operating point - reason: "} + ex.what());
+	}
+
+	m_matrix_dirty = false;
+	m_rhs_dirty = false;
+}
+
+/**
+	\brief Rozwiązuje układ dla wielu punktów różniących się jedynie wartościami źródeł
+
+	Macierz układu rozkładana jest najwyżej raz (jeżeli wymaga tego zmiana planu lub pulsacji),
+	a wektory wyrazów wolnych wszystkich punktów rozwiązywane są razem
+	(\ref mna::mna_problem::solve_batch()). Następnie dla każdego punktu kontekst zawiera jego
+	rozwiązanie i wywoływana jest funkcja visit - pomiary i analiza wrażliwości działają
+	tak samo, jak po \ref solve().
+
+	\param set_point Funkcja ustawiająca w analizowanym planie (prywatnej kopii, \ref solve_plan::set_value())
+		wartości źródeł k-tego punktu. Wywoływana jest także tuż przed visit(k).
+	\param visit Funkcja wywoływana po kolei dla każdego rozwiązanego punktu
+	\warning Wartości źródeł nie mogą zmieniać struktury układu. Rozkład wyznaczany jest dla
+		wartości źródeł zapisanych w planie w chwili wywołania, a przy analizie DC zerowa SEM
+		jest zwarciem - przemiatane SEM muszą mieć wtedy niezerową wartość.
+*/
+void solve_context::solve_batch(double omega, int count, const std::function<void(int k)> &set_point,
+	const std::function<void(int k)> &visit)
+{
+	if (count <= 0)
+		return;
+
+	solve(omega);
+
+	std::vector<mna::mna_solution> solutions;
+	try
+	{
+		solutions = m_problem.solve_batch(m_solution->get_factorization(), count, [&](int k){
+			set_point(k);
+			assemble_rhs(omega);
+		});
+	}
+	catch (const std::runtime_error &ex)
+	{
+		m_solution.reset();
+		throw std::runtime_error(std::string{"Could not compute operating point - reason: "} + ex.what());
+	}
+
+	for (int k = 0; k < count; k++)
+	{
+		set_point(k);
+		m_solution = std::move(solutions[k]);
+		visit(k);
+	}
+}
+
+/**
+	\brief Zwraca rozwiązanie jako mna_solution
+*/
+const mna::mna_solution &solve_context::get_solution() const
+{
+	return *m_solution;
+}
+
+/**
+	\brief Zwraca zmienną pełnego układu równań (\ref solve_plan::assemble()) - potencjał węzła lub prąd gałęzi
+
+	Numeracja zmiennych nie zależy od uproszczenia topologii przy analizie DC - prądy
+	wyeliminowanych SEM odtwarzane są tak jak w \ref current().
+
+	\param row Numer wiersza rozwiązania pełnego układu (gałęzie według \ref solve_plan::branch_index())
+	\throws std::out_of_range dla nieistniejących zmiennych
+*/
+std::complex<double> solve_context::variable(int row) const
+{
+	const int node_count = m_plan->get_node_count();
+	if (row < node_count)
+		return index_voltage(row);
+
+	const auto &st = m_plan->get_components();
+	int branch = row - node_count;
+	for (const auto *comps : {&st.voltage_sources.comp, &st.opamps.comp, &st.vcvs.comp, &st.ccvs.comp})
+	{
+		if (branch < static_cast<int>(comps->size()))
+			return current(*(*comps)[branch]);
+		branch -= comps->size();
+	}
+
+	throw std::out_of_range("Invalid equation system variable");
+}
+
+/**
+	\brief Pomiar napięcia między węzłami
+	\param pos Numer mierzonego węzła
+	\param neg Numer węzła odniesienia
+*/
+std::complex<double> solve_context::voltage(int pos, int neg) const
+{
+	return node_voltage(pos) - node_voltage(neg);
+}
+
+/**
+	\brief Zwraca potencjał węzła
+*/
+std::complex<double> solve_context::node_voltage(int node) const
+{
+	return index_voltage(m_plan->node_index(node));
+}
+
+/**
+	\brief Zwraca potencjał węzła o numerze nadanym przez plan
+*/
+std::complex<double> solve_context::index_voltage(int index) const
+{
+	const auto &ref = index_ref(index);
+	return (ref.index < 0 ? 0.0 : m_solution->voltage(ref.index)) + known_potential(ref);
+}
+
+/**
+	\brief Zwraca znaną (ustaloną przez SEM) część potencjału węzła
+*/
+double solve_context::known_potential(const node_ref &ref) const
+{
+	return ref.source >= 0 ? ref.sign * m_plan->get_components().voltage_sources.value[ref.source] : 0.0;
+}
+
+/**
+	\brief Zwraca położenie węzła o numerze nadanym przez plan w układzie równań
+*/
+const solve_context::node_ref &solve_context::index_ref(int index) const
+{
+	return m_index_refs.at(index < 0 ? m_index_refs.size() - 1 : index);
+}
+
+/**
+	\brief Pomiar napięcia na komponencie
+	\note Pomiar napięcia jest możliwy tylko na elementach z dwoma wyprowadzeniami
+	i na wzmacniaczach operacyjnych (napięcie wyjścia)
+*/
+std::complex<double> solve_context::voltage(const circuit_component &comp) const
+{
+	return std::visit(overloaded{
+		[&](const opamp *opa){return voltage(opa->output_node);},
+		[&](const nonlinear_component *) -> std::complex<double> {
+			throw std::runtime_error("Cannot measure voltage on component");
+		},
+		[&](const circuit_component *) -> std::complex<double> {
+			throw std::runtime_error("Cannot measure voltage on component");
+		},
+		[&](const auto *bp){return voltage(bp->nodes.first, bp->nodes.second);},
+	}, comp.view());
+}
+
+/**
+	\brief Pomiar prądu płynącego przez komponent
+	\note Pomiar prądu jest możliwy tylko na elementach z dwoma wyprowadzeniami i na wzmacniaczach operacyjnych (prąd wyjścia)
+*/
+std::complex<double> solve_context::current(const circuit_component &comp) const
+{
+	// Element wyeliminowany z układu równań
+	if (auto it = m_eliminated.find(&comp); it != m_eliminated.end())
+	{
+		std::complex<double> I = 0.0;
+		for (const auto &[c, a] : it->second)
+			I += a * current(*c);
+		return I;
+	}
+
+	return std::visit(overloaded{
+		[&](const voltage_source *vs){
+			return m_solution->voltage_source_current(m_voltage_source_rows.at(branch_index(vs)));
+		},
+		[&](const current_source *cs) -> std::complex<double> {
+			const auto &st = m_plan->get_components().current_sources;
+			const int i = m_plan->find_component(cs)->index;
+			return *m_solution_omega == 0 ? -st.value[i] : -st.ac[i];
+		},
+		[&](const opamp *opa){
+			return m_solution->opamp_current(branch_index(opa));
+		},
+		[&](const controlled_source *cs) -> std::complex<double> {
+			const auto &st = m_plan->get_components();
+			const auto *ref = m_plan->find_component(cs);
+			const auto &arr = *st.controlled(ref->kind);
+			const int i = ref->index;
+			switch (ref->kind)
+			{
+				case component_kind::VCVS: return m_solution->controlled_source_current(i);
+				case component_kind::CCVS: return m_solution->controlled_source_current(st.vcvs.size() + i);
+				case component_kind::VCCS: return arr.gain[i] * (index_voltage(arr.c[i]) - index_voltage(arr.d[i]));
+				default: return arr.gain[i] * current(*st.voltage_sources.comp[arr.control[i]]);
+			}
+		},
+		[&](const nonlinear_component *) -> std::complex<double> {
+			throw std::runtime_error("Cannot measure current through component");
+		},
+		[&](const circuit_component *) -> std::complex<double> {
+			throw std::runtime_error("Cannot measure current through component");
+		},
+		[&](const auto *passive){
+			auto ref = m_plan->find_component(passive);
+			return voltage(*passive) * m_plan->passive_admittance(ref->kind, ref->index, *m_solution_omega);
+		},
+	}, comp.view());
+}
+
+/**
+	\brief Wyznacza numer gałęzi SEM lub wzmacniacza operacyjnego
+
+	Gałęzie SEM i wzmacniaczy numerowane są osobno, w kolejności występowania w mna_problem.
+	Numeracja odpowiada tej przyjętej w \ref mna::mna_solution.
+*/
+int solve_context::branch_index(const circuit_component *comp) const
+{
+	return std::visit(overloaded{
+		[&](const voltage_source*){return m_plan->voltage_source_index(comp);},
+		[&](const opamp*){return m_plan->opamp_index(comp);},
+		[&](const auto*) -> int {throw std::runtime_error("Component has no branch current");},
+	}, comp->view());
+}
+
+/**
+	\brief Pomiar mocy traconej na komponencie
+*/
+std::complex<double> solve_context::power(const circuit_component &comp) const
+{
+	return voltage(comp) * current(comp);
+}
+
+/**
+	\brief Pomiar spadku napięcia na komponencie
+*/
+std::complex<double> solve_context::voltage(const std::string &ref) const
+{
+	return voltage(*m_plan->component(ref));
+}
+
+/**
+	\brief Pomiar prądu płynącego przez komponent
+*/
+std::complex<double> solve_context::current(const std::string &ref) const
+{
+	return current(*m_plan->component(ref));
+}
+
+/**
+	\brief Pomiar mocy traconej na komponencie
+*/
+std::complex<double> solve_context::power(const std::string &ref) const
+{
+	return power(*m_plan->component(ref));
+}
+
+/**
+	\brief Tworzy zerowy funkcjonał liniowy rozwiązania
+*/
+solve_context::linear_functional solve_context::make_functional() const
+{
+	return linear_functional{matrix<std::complex<double>>(m_solution->get_matrix().get_height(), 1), {}};
+}
+
+/**
+	\brief Dodaje do funkcjonału napięcie między węzłami pomnożone przez zadany współczynnik
+*/
+void solve_context::add_voltage_weights(linear_functional &f, int pos, int neg, std::complex<double> scale) const
+{
+	auto p = index_ref(m_plan->node_index(pos)).index;
+	auto n = index_ref(m_plan->node_index(neg)).index;
+	if (p >= 0) f.c(p, 0) += scale;
+	if (n >= 0) f.c(n, 0) -= scale;
+}
+
+/**
+	\brief Dodaje do funkcjonału prąd płynący przez komponent pomnożony przez zadany współczynnik
+*/
+void solve_context::add_current_weights(linear_functional &f, const circuit_component &comp, std::complex<double> scale) const
+{
+	// Element wyeliminowany z układu równań
+	if (auto it = m_eliminated.find(&comp); it != m_eliminated.end())
+	{
+		for (const auto &[c, a] : it->second)
+			add_current_weights(f, *c, scale * a);
+		return;
+	}
+
+	std::visit(overloaded{
+		// SEM i wzmacniacz operacyjny - prąd jest zmienną w rozwiązaniu
+		[&](const voltage_source *vs){
+			f.c(m_solution->voltage_source_row(m_voltage_source_rows.at(branch_index(vs))), 0) += scale;
+		},
+		[&](const opamp *opa){
+			f.c(m_solution->opamp_row(branch_index(opa)), 0) += scale;
+		},
+
+		// Źródło sterowane - prąd gałęzi lub wzmocniona wielkość sterująca
+		[&](const controlled_source *cs){
+			const auto &st = m_plan->get_components();
+			const auto *ref = m_plan->find_component(cs);
+			const auto &arr = *st.controlled(ref->kind);
+			const int i = ref->index;
+			switch (ref->kind)
+			{
+				case component_kind::VCVS:
+					f.c(m_solution->controlled_source_row(i), 0) += scale;
+					break;
+				case component_kind::CCVS:
+					f.c(m_solution->controlled_source_row(st.vcvs.size() + i), 0) += scale;
+					break;
+				case component_kind::VCCS:
+					add_voltage_weights(f, cs->control.first, cs->control.second, scale * arr.gain[i]);
+					break;
+				default:
+					add_current_weights(f, *st.voltage_sources.comp[arr.control[i]], scale * arr.gain[i]);
+			}
+		},
+
+		// SPM - prąd nie zależy od wartości elementów
+		[&](const current_source*){},
+
+		[&](const nonlinear_component*){
+			throw std::runtime_error("Cannot measure current through component");
+		},
+		[&](const circuit_component*){
+			throw std::runtime_error("Cannot measure current through component");
+		},
+
+		// Komponent pasywny - I = Y * V
+		[&](const auto *passive){
+			auto ref = m_plan->find_component(passive);
+			add_voltage_weights(f, passive->nodes.first, passive->nodes.second,
+				scale * m_plan->passive_admittance(ref->kind, ref->index, *m_solution_omega));
+			f.direct[&comp] += scale * voltage(comp) * m_plan->passive_admittance_derivative(ref->kind, ref->index, *m_solution_omega);
+		},
+	}, comp.view());
+}
+
+/**
+	\brief Wyznacza wrażliwości funkcjonału \f$ q = c^T x \f$ na wartości wszystkich elementów pasywnych
+
+	Wykorzystuje rozkład macierzy z ostatniej analizy - wymaga jednego rozwiązania układu sprzężonego
+	\f$ A^T \lambda = c \f$, niezależnie od liczby elementów. Dla elementu o admitancji \f$ Y \f$
+	między węzłami \f$ a \f$ i \f$ b \f$:
+	\f[ \frac{\partial q}{\partial p} = -(\lambda_a - \lambda_b)(x_a - x_b) \frac{\partial Y}{\partial p} \f]
+
+	Dla węzłów o znanym potencjale (i masy) przyjmowane jest \f$ \lambda = 0 \f$.
+*/
+sensitivity_map solve_context::adjoint_sensitivity(const linear_functional &f) const
+{
+	auto lambda = m_solution->solve_adjoint(f.c);
+
+	auto index_value = [&](int index) -> std::complex<double> {
+		auto n = index_ref(index).index;
+		return n < 0 ? 0.0 : lambda(n, 0);
+	};
+
+	sensitivity_map sens;
+	for (const auto &[ref, cr] : m_plan->get_names())
+	{
+		if (cr.kind != component_kind::RESISTOR && cr.kind != component_kind::INDUCTOR
+			&& cr.kind != component_kind::CAPACITOR && cr.kind != component_kind::PASSIVE)
+			continue;
+
+		const auto &arr = *m_plan->get_components().bipoles(cr.kind);
+		int a = arr.a[cr.index];
+		int b = arr.b[cr.index];
+
+		auto dl = index_value(a) - index_value(b);
+		auto v = index_voltage(a) - index_voltage(b);
+		auto &s = sens[ref];
+		s = -dl * v * m_plan->passive_admittance_derivative(cr.kind, cr.index, *m_solution_omega);
+
+		if (auto it = f.direct.find(arr.comp[cr.index]); it != f.direct.end())
+			s += it->second;
+	}
+
+	return sens;
+}
+
+/**
+	\brief Transimpedancja ze źródła prądowego wstrzykującego prąd do węzła a i pobierającego go
+	z węzła b (numeracja planu, -1 oznacza masę)
+*/
+std::complex<double> transfer_map::injection(int a, int b) const
+{
+	return (a < 0 ? 0.0 : nodes.at(a)) - (b < 0 ? 0.0 : nodes.at(b));
+}
+
+/**
+	\brief Transmitancje z pobudzeń układu do napięcia między węzłami
+
+	Składowa rozwiązania układu sprzężonego \f$ A^T \lambda = c \f$ odpowiadająca węzłowi jest
+	transimpedancją z prądu wstrzykiwanego do tego węzła, a składowa odpowiadająca gałęzi
+	SEM - wzmocnieniem z jej napięcia. Wykorzystuje rozkład macierzy z ostatniej analizy.
+
+	Węzły o znanym potencjale (przy uproszczonej analizie DC) mają zerową transimpedancję.
+	Wzmocnienie nie jest wyznaczane dla SEM wyeliminowanych z układu równań.
+	\param pos Numer mierzonego węzła
+	\param neg Numer węzła odniesienia
+*/
+transfer_map solve_context::voltage_transfer(int pos, int neg) const
+{
+	auto f = make_functional();
+	add_voltage_weights(f, pos, neg, 1.0);
+	auto lambda = m_solution->solve_adjoint(f.c);
+
+	transfer_map tm;
+	tm.nodes.resize(m_plan->get_node_count());
+	for (unsigned int i = 0; i < tm.nodes.size(); i++)
+		if (auto n = index_ref(i).index; n >= 0)
+			tm.nodes[i] = lambda(n, 0);
+
+	tm.voltage_sources.resize(m_voltage_source_rows.size());
+	for (unsigned int i = 0; i < tm.voltage_sources.size(); i++)
+		if (m_voltage_source_rows[i] >= 0)
+			tm.voltage_sources[i] = lambda(m_solution->voltage_source_row(m_voltage_source_rows[i]), 0);
+
+	return tm;
+}
+
+/**
+	\brief Wrażliwość napięcia między węzłami na wartości elementów pasywnych
+	\param pos Numer mierzonego węzła
+	\param neg Numer węzła odniesienia
+*/
+sensitivity_map solve_context::voltage_sensitivity(int pos, int neg) const
+{
+	auto f = make_functional();
+	add_voltage_weights(f, pos, neg, 1.0);
+	return adjoint_sensitivity(f);
+}
+
+/**
+	\brief Wrażliwość prądu płynącego przez komponent na wartości elementów pasywnych
+*/
+sensitivity_map solve_context::current_sensitivity(const circuit_component &comp) const
+{
+	auto f = make_functional();
+	add_current_weights(f, comp, 1.0);
+	return adjoint_sensitivity(f);
+}
+
+/**
+	\brief Wrażliwość prądu płynącego przez komponent na wartości elementów pasywnych
+*/
+sensitivity_map solve_context::current_sensitivity(const std::string &ref) const
+{
+	return current_sensitivity(*m_plan->component(ref));
+}
+
+/**
+	\brief Wrażliwość mocy traconej na komponencie na wartości elementów pasywnych
+
+	Z \f$ dP = I\,dV + V\,dI \f$ - wystarcza jedno rozwiązanie układu sprzężonego.
+*/
+sensitivity_map solve_context::power_sensitivity(const circuit_component &comp) const
+{
+	auto V = voltage(comp);
+	auto I = current(comp);
+	auto f = make_functional();
+
+	std::visit(overloaded{
+		[&](const opamp *opa){add_voltage_weights(f, opa->output_node, 0, I);},
+		[&](const nonlinear_component*){throw std::runtime_error("Cannot measure voltage on component");},
+		[&](const circuit_component*){throw std::runtime_error("Cannot measure voltage on component");},
+		[&](const auto *bp){add_voltage_weights(f, bp->nodes.first, bp->nodes.second, I);},
+	}, comp.view());
+
+	add_current_weights(f, comp, V);
+	return adjoint_sensitivity(f);
+}
+
+/**
+	\brief Wrażliwość mocy traconej na komponencie na wartości elementów pasywnych
+*/
+sensitivity_map solve_context::power_sensitivity(const std::string &ref) const
+{
+	return power_sensitivity(*m_plan->component(ref));
+}
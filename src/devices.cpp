@@ -0,0 +1,255 @@
+#include "devices.hpp"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+/**
+	\file devices.cpp
+	\brief Implementacja modeli elementów nieliniowych
+	\author Jacek Wieczorek
+*/
+
+//! Potencjał termiczny kT/q w temperaturze 300.15 K [V]
+static const double thermal_voltage = 1.380649e-23 * 300.15 / 1.602176634e-19;
+
+//! Największy wykładnik funkcji exp() w charakterystykach złącz (ochrona przed przepełnieniem)
+static const double max_exponent = 80.0;
+
+/**
+	\brief Prąd złącza p-n i jego pochodna
+
+	\param v Napięcie złącza [V]
+	\param is Prąd nasycenia [A]
+	\param nvt Iloczyn współczynnika emisji i potencjału termicznego [V]
+	\returns Para (prąd, konduktancja)
+*/
+static std::pair<double, double> junction(double v, double is, double nvt)
+{
+	const double e = std::exp(std::min(v / nvt, max_exponent));
+	return {is * (e - 1.0), is * e / nvt};
+}
+
+/**
+	\brief Ogranicza zmianę napięcia złącza p-n między iteracjami (jak pnjlim w SPICE)
+
+	Powyżej napięcia krytycznego przyrost napięcia zastępowany jest przyrostem logarytmicznym,
+	dzięki czemu prąd wykładniczej charakterystyki zmienia się najwyżej liniowo.
+
+	\returns true, jeżeli napięcie zostało ograniczone
+*/
+static bool limit_junction(double v_old, double &v, double is, double nvt)
+{
+	const double vcrit = nvt * std::log(nvt / (M_SQRT2 * is));
+	if (v <= vcrit || std::abs(v - v_old) <= 2 * nvt)
+		return false;
+
+	if (v_old > 0)
+	{
+		const double arg = 1 + (v - v_old) / nvt;
+		v = arg > 0 ? v_old + nvt * std::log(arg) : vcrit;
+	}
+	else
+		v = nvt * std::log(v / nvt);
+
+	return true;
+}
+
+/**
+	\brief Tworzy diodę
+	\throws std::runtime_error dla niedodatnich parametrów
+*/
+diode::diode(const std::pair<int, int> &p, double is, double n) :
+	nonlinear_component({p.first, p.second, 0}, 2),
+	Is(is),
+	N(n)
+{
+	if (!(is > 0) || !(n > 0))
+		throw std::runtime_error("Invalid diode parameters");
+}
+
+/**
+	\brief Linearyzacja diody (z konduktancją gmin równolegle do złącza)
+*/
+void diode::evaluate(const std::array<double, 3> &v, device_linearization &lin) const
+{
+	const double vd = v[0] - v[1];
+	auto [id, gd] = junction(vd, Is, N * thermal_voltage);
+	id += gmin * vd;
+	gd += gmin;
+
+	lin.current = {id, -id, 0.0};
+	lin.conductance = {{{gd, -gd, 0.0}, {-gd, gd, 0.0}, {0.0, 0.0, 0.0}}};
+}
+
+/**
+	\brief Ogranicza zmianę napięcia złącza diody
+*/
+bool diode::limit(const std::array<double, 3> &v_old, std::array<double, 3> &v) const
+{
+	double vd = v[0] - v[1];
+	if (!limit_junction(v_old[0] - v_old[1], vd, Is, N * thermal_voltage))
+		return false;
+
+	v[0] = v[1] + vd;
+	return true;
+}
+
+/**
+	\brief Tworzy tranzystor bipolarny
+	\throws std::runtime_error dla niedodatnich parametrów
+*/
+bjt::bjt(const std::array<int, 3> &n, bool pnp, double is, double bf, double br) :
+	nonlinear_component(n, 3),
+	PNP(pnp),
+	Is(is),
+	BF(bf),
+	BR(br)
+{
+	if (!(is > 0) || !(bf > 0) || !(br > 0))
+		throw std::runtime_error("Invalid BJT parameters");
+}
+
+/**
+	\brief Linearyzacja tranzystora bipolarnego (z konduktancjami gmin równolegle do złącz)
+
+	Napięcia złącz liczone są z uwzględnieniem biegunowości, więc macierz konduktancji
+	jest taka sama dla tranzystorów NPN i PNP - zmienia się jedynie znak prądów.
+*/
+void bjt::evaluate(const std::array<double, 3> &v, device_linearization &lin) const
+{
+	const double p = PNP ? -1.0 : 1.0;
+	const double vbe = p * (v[1] - v[2]);
+	const double vbc = p * (v[1] - v[0]);
+
+	const auto [i_f, g_f] = junction(vbe, Is, thermal_voltage);
+	const auto [i_r, g_r] = junction(vbc, Is, thermal_voltage);
+
+	// Prądy kolektora i bazy oraz ich pochodne po napięciach złącz
+	const double ic = i_f - i_r - i_r / BR - gmin * vbc;
+	const double ib = i_f / BF + i_r / BR + gmin * (vbe + vbc);
+	const double dic_dvbe = g_f;
+	const double dic_dvbc = -g_r - g_r / BR - gmin;
+	const double dib_dvbe = g_f / BF + gmin;
+	const double dib_dvbc = g_r / BR + gmin;
+
+	lin.current = {p * ic, p * ib, -p * (ic + ib)};
+
+	auto row = [](double d_vbe, double d_vbc) -> std::array<double, 3> {
+		return {-d_vbc, d_vbe + d_vbc, -d_vbe};
+	};
+	lin.conductance[0] = row(dic_dvbe, dic_dvbc);
+	lin.conductance[1] = row(dib_dvbe, dib_dvbc);
+	for (int j = 0; j < 3; j++)
+		lin.conductance[2][j] = -lin.conductance[0][j] - lin.conductance[1][j];
+}
+
+/**
+	\brief Ogranicza zmianę napięć złącz baza-emiter i baza-kolektor
+*/
+bool bjt::limit(const std::array<double, 3> &v_old, std::array<double, 3> &v) const
+{
+	const double p = PNP ? -1.0 : 1.0;
+	double vbe = p * (v[1] - v[2]);
+	double vbc = p * (v[1] - v[0]);
+
+	bool limited = limit_junction(p * (v_old[1] - v_old[2]), vbe, Is, thermal_voltage);
+	limited |= limit_junction(p * (v_old[1] - v_old[0]), vbc, Is, thermal_voltage);
+	if (!limited)
+		return false;
+
+	v[2] = v[1] - p * vbe;
+	v[0] = v[1] - p * vbc;
+	return true;
+}
+
+/**
+	\brief Tworzy tranzystor MOS
+	\param vto Napięcie progowe (ujemne dla tranzystorów PMOS z kanałem wzbogacanym)
+	\throws std::runtime_error dla niedodatniego KP lub ujemnego LAMBDA
+*/
+mosfet::mosfet(const std::array<int, 3> &n, bool pmos, double kp, double vto, double lambda) :
+	nonlinear_component(n, 3),
+	PMOS(pmos),
+	KP(kp),
+	VTO(vto),
+	LAMBDA(lambda)
+{
+	if (!(kp > 0) || lambda < 0)
+		throw std::runtime_error("Invalid MOSFET parameters");
+}
+
+/**
+	\brief Linearyzacja tranzystora MOS (z konduktancją gmin między drenem i źródłem)
+*/
+void mosfet::evaluate(const std::array<double, 3> &v, device_linearization &lin) const
+{
+	const double p = PMOS ? -1.0 : 1.0;
+	double vgs = p * (v[1] - v[2]);
+	double vds = p * (v[0] - v[2]);
+
+	// Przy ujemnym napięciu dren-źródło role drenu i źródła są zamieniane
+	const bool reversed = vds < 0;
+	if (reversed)
+	{
+		vgs -= vds;
+		vds = -vds;
+	}
+
+	double id = 0, gm = 0, gds = 0;
+	const double vov = vgs - p * VTO;
+	const double clm = 1 + LAMBDA * vds;
+	if (vov > 0 && vds < vov)
+	{
+		// Zakres liniowy
+		const double f = vov * vds - vds * vds / 2;
+		id = KP * f * clm;
+		gm = KP * vds * clm;
+		gds = KP * (vov - vds) * clm + KP * f * LAMBDA;
+	}
+	else if (vov > 0)
+	{
+		// Nasycenie
+		id = KP / 2 * vov * vov * clm;
+		gm = KP * vov * clm;
+		gds = KP / 2 * vov * vov * LAMBDA;
+	}
+
+	// Prąd drenu i jego pochodne po potencjałach drenu, bramki i źródła
+	std::array<double, 3> row;
+	if (!reversed)
+		row = {gds, gm, -gm - gds};
+	else
+	{
+		id = -id;
+		row = {gm + gds, -gm, -gds};
+	}
+
+	const double vds_actual = v[0] - v[2];
+	const double i_drain = p * id + gmin * vds_actual;
+	row[0] += gmin;
+	row[2] -= gmin;
+
+	lin.current = {i_drain, 0.0, -i_drain};
+	lin.conductance[0] = row;
+	lin.conductance[1] = {0.0, 0.0, 0.0};
+	lin.conductance[2] = {-row[0], -row[1], -row[2]};
+}
+
+/**
+	\brief Ogranicza zmianę napięcia bramka-źródło między iteracjami
+
+	Przyrost jest ograniczany do wartości przesterowania bramki w poprzedniej iteracji
+	powiększonej o 0.5 V - kwadratowa charakterystyka nie wymaga silniejszego tłumienia.
+*/
+bool mosfet::limit(const std::array<double, 3> &v_old, std::array<double, 3> &v) const
+{
+	const double vgs_old = v_old[1] - v_old[2];
+	const double vgs = v[1] - v[2];
+	const double max_step = std::abs(vgs_old - VTO) + 0.5;
+
+	if (std::abs(vgs - vgs_old) <= max_step)
+		return false;
+
+	v[1] = v[2] + vgs_old + std::copysign(max_step, vgs - vgs_old);
+	return true;
+}
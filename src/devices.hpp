@@ -0,0 +1,63 @@
+#pragma once
+#include <array>
+#include <utility>
+#include "circuit.hpp"
+
+/**
+	\file devices.hpp
+	\brief Modele elementów nieliniowych - diody, tranzystora bipolarnego i tranzystora MOS
+	\author Jacek Wieczorek
+*/
+
+/**
+	\brief Dioda półprzewodnikowa (model Shockleya)
+
+	\f$ i_D = I_S (e^{v_D / (N V_T)} - 1) \f$. Wyprowadzenia: anoda, katoda.
+*/
+struct diode : public nonlinear_component
+{
+	diode(const std::pair<int, int> &p, double is = 1e-14, double n = 1.0);
+
+	void evaluate(const std::array<double, 3> &v, device_linearization &lin) const override;
+	bool limit(const std::array<double, 3> &v_old, std::array<double, 3> &v) const override;
+
+	double Is; //!< Prąd nasycenia [A]
+	double N;  //!< Współczynnik emisji
+};
+
+/**
+	\brief Tranzystor bipolarny (model transportowy Ebersa-Molla)
+
+	Wyprowadzenia: kolektor, baza, emiter.
+*/
+struct bjt : public nonlinear_component
+{
+	bjt(const std::array<int, 3> &n, bool pnp = false, double is = 1e-16, double bf = 100.0, double br = 1.0);
+
+	void evaluate(const std::array<double, 3> &v, device_linearization &lin) const override;
+	bool limit(const std::array<double, 3> &v_old, std::array<double, 3> &v) const override;
+
+	bool PNP;  //!< Czy tranzystor jest typu PNP
+	double Is; //!< Prąd nasycenia [A]
+	double BF; //!< Wzmocnienie prądowe w kierunku normalnym
+	double BR; //!< Wzmocnienie prądowe w kierunku inwersyjnym
+};
+
+/**
+	\brief Tranzystor MOS (model Shichmana-Hodgesa, poziom 1)
+
+	Wyprowadzenia: dren, bramka, źródło (podłoże połączone ze źródłem). Dren i źródło
+	są zamieniane przy ujemnym napięciu dren-źródło.
+*/
+struct mosfet : public nonlinear_component
+{
+	mosfet(const std::array<int, 3> &n, bool pmos = false, double kp = 2e-5, double vto = 1.0, double lambda = 0.0);
+
+	void evaluate(const std::array<double, 3> &v, device_linearization &lin) const override;
+	bool limit(const std::array<double, 3> &v_old, std::array<double, 3> &v) const override;
+
+	bool PMOS;     //!< Czy tranzystor ma kanał typu P
+	double KP;     //!< Transkonduktancja (uwzględniająca W/L) [A/V²]
+	double VTO;    //!< Napięcie progowe [V]
+	double LAMBDA; //!< Współczynnik modulacji długości kanału [1/V]
+};
@@ -0,0 +1,651 @@
+#include "expression.hpp"
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+
+/**
+	\file expression.cpp
+	\brief Implementacja \ref expression i \ref parameter_set
+	\author Jacek Wieczorek
+*/
+
+using namespace std::string_literals;
+
+/**
+	\brief Zwraca mnożnik odpowiadający przedrostkowi SI (np. 1e3 dla "k")
+	\throws std::runtime_error dla nieznanych przedrostków
+*/
+double si_prefix_multiplier(std::string_view prefix)
+{
+	const static std::map<std::string_view, double> muls = {
+		{"p", 1e-12},
+		{"n", 1e-9},
+		{"u", 1e-6},
+		{"m", 1e-3},
+		{"k", 1e3},
+		{"Meg", 1e6},
+		{"G", 1e9},
+	};
+
+	auto it = muls.find(prefix);
+	if (it == muls.end())
+		throw std::runtime_error("Invalid SI prefix");
+	return it->second;
+}
+
+/**
+	\brief Sprawdza, czy wartość jest skończona (nie jest nieskończonością ani NaN)
+
+	Sprawdzany jest bezpośrednio wykładnik - przy kompilacji z -ffast-math
+	std::isfinite() jest zastępowane stałą true.
+*/
+bool is_finite_value(double x)
+{
+	constexpr std::uint64_t exponent_mask = 0x7ff0000000000000;
+	return (std::bit_cast<std::uint64_t>(x) & exponent_mask) != exponent_mask;
+}
+
+//! Funkcje jednego argumentu dostępne w wyrażeniach
+static const std::pair<std::string_view, double(*)(double)> unary_functions[] = {
+	{"sqrt", [](double x){return std::sqrt(x);}},
+	{"exp", [](double x){return std::exp(x);}},
+	{"log", [](double x){return std::log(x);}},
+	{"log10", [](double x){return std::log10(x);}},
+	{"abs", [](double x){return std::abs(x);}},
+	{"sin", [](double x){return std::sin(x);}},
+	{"cos", [](double x){return std::cos(x);}},
+	{"tan", [](double x){return std::tan(x);}},
+	{"atan", [](double x){return std::atan(x);}},
+};
+
+//! Funkcje dwóch argumentów dostępne w wyrażeniach
+static const std::pair<std::string_view, double(*)(double, double)> binary_functions[] = {
+	{"min", [](double a, double b){return std::min(a, b);}},
+	{"max", [](double a, double b){return std::max(a, b);}},
+	{"pow", [](double a, double b){return std::pow(a, b);}},
+};
+
+/**
+	\brief Kompilator wyrażeń (parser metodą zejść rekurencyjnych)
+
+	Gramatyka (od najniższego priorytetu):
+	\verbatim
+	sum     := product (('+' | '-') product)*
+	product := unary (('*' | '/') unary)*
+	unary   := ('+' | '-') unary | power
+	power   := primary (('^' | '**') unary)?
+	primary := liczba | 'pi' | nazwa | nazwa '(' sum (',' sum)? ')' | '(' sum ')'
+	\endverbatim
+
+	Kod emitowany jest od razu w trakcie analizy - jeżeli wszystkie argumenty operacji
+	są stałymi, zamiast operacji emitowany jest jej wynik.
+*/
+class expression_compiler
+{
+public:
+	expression_compiler(expression &expr, std::string_view text, const expression::symbol_function &symbol) :
+		m_expr(expr),
+		m_text(text),
+		m_symbol(symbol)
+	{
+	}
+
+	void compile()
+	{
+		parse_sum();
+		skip_space();
+		if (m_pos != m_text.size())
+			error("unexpected '"s + m_text[m_pos] + "'");
+
+		std::sort(m_expr.m_dependencies.begin(), m_expr.m_dependencies.end());
+		m_expr.m_dependencies.erase(std::unique(m_expr.m_dependencies.begin(), m_expr.m_dependencies.end()),
+			m_expr.m_dependencies.end());
+	}
+
+	/**
+		\brief Wykonuje operację na argumentach ze szczytu stosu
+	*/
+	static double apply(expression::opcode op, int arg, double a, double b)
+	{
+		using opcode = expression::opcode;
+		switch (op)
+		{
+			case opcode::ADD: return a + b;
+			case opcode::SUB: return a - b;
+			case opcode::MUL: return a * b;
+			case opcode::DIV: return a / b;
+			case opcode::POW: return std::pow(a, b);
+			case opcode::NEG: return -b;
+			case opcode::CALL1: return unary_functions[arg].second(b);
+			case opcode::CALL2: return binary_functions[arg].second(a, b);
+			default: return 0;
+		}
+	}
+
+private:
+	using opcode = expression::opcode;
+
+	[[noreturn]] void error(const std::string &reason) const
+	{
+		throw std::runtime_error("Invalid expression '"s + std::string{m_text} + "' - " + reason);
+	}
+
+	void skip_space()
+	{
+		while (m_pos < m_text.size() && std::isspace(static_cast<unsigned char>(m_text[m_pos])))
+			m_pos++;
+	}
+
+	bool accept(std::string_view token)
+	{
+		skip_space();
+		if (m_text.substr(m_pos, token.size()) != token)
+			return false;
+		m_pos += token.size();
+		return true;
+	}
+
+	void expect(char c)
+	{
+		if (!accept(std::string_view{&c, 1}))
+			error("expected '"s + c + "'");
+	}
+
+	/**
+		\brief Emituje instrukcję, obliczając ją od razu, jeżeli argumenty są stałymi
+	*/
+	void emit(opcode op, int arg = 0)
+	{
+		auto &code = m_expr.m_code;
+		auto &consts = m_expr.m_constants;
+		auto is_const = [&](int i){return int(code.size()) >= i && code[code.size() - i].op == opcode::CONST;};
+
+		switch (op)
+		{
+			case opcode::CONST:
+			case opcode::PARAM:
+				if (++m_depth > expression::max_stack)
+					error("too complex");
+				break;
+
+			case opcode::NEG:
+			case opcode::CALL1:
+				if (is_const(1))
+				{
+					consts[code.back().arg] = apply(op, arg, 0, consts[code.back().arg]);
+					return;
+				}
+				break;
+
+			default:
+				if (is_const(1) && is_const(2))
+				{
+					double b = consts[code.back().arg];
+					code.pop_back();
+					consts.pop_back();
+					consts.back() = apply(op, arg, consts.back(), b);
+					m_depth--;
+					return;
+				}
+				m_depth--;
+				break;
+		}
+
+		code.push_back({op, arg});
+	}
+
+	void push_constant(double value)
+	{
+		m_expr.m_constants.push_back(value);
+		emit(opcode::CONST, m_expr.m_constants.size() - 1);
+	}
+
+	void parse_sum()
+	{
+		parse_product();
+		while (true)
+		{
+			if (accept("+"))
+				parse_product(), emit(opcode::ADD);
+			else if (accept("-"))
+				parse_product(), emit(opcode::SUB);
+			else
+				return;
+		}
+	}
+
+	void parse_product()
+	{
+		parse_unary();
+		while (true)
+		{
+			// "**" to potęgowanie, a nie mnożenie
+			skip_space();
+			if (m_text.substr(m_pos, 2) != "**" && accept("*"))
+				parse_unary(), emit(opcode::MUL);
+			else if (accept("/"))
+				parse_unary(), emit(opcode::DIV);
+			else
+				return;
+		}
+	}
+
+	void parse_unary()
+	{
+		if (accept("-"))
+			parse_unary(), emit(opcode::NEG);
+		else if (accept("+"))
+			parse_unary();
+		else
+			parse_power();
+	}
+
+	void parse_power()
+	{
+		parse_primary();
+		if (accept("^") || accept("**"))
+			parse_unary(), emit(opcode::POW);
+	}
+
+	void parse_primary()
+	{
+		skip_space();
+		if (m_pos == m_text.size())
+			error("unexpected end");
+
+		if (accept("("))
+		{
+			parse_sum();
+			expect(')');
+			return;
+		}
+
+		const char c = m_text[m_pos];
+
+		// Liczba z opcjonalnym przedrostkiem SI
+		if (std::isdigit(static_cast<unsigned char>(c)) || c == '.')
+		{
+			double value;
+			auto [end, ec] = std::from_chars(m_text.data() + m_pos, m_text.data() + m_text.size(), value);
+			if (ec != std::errc{})
+				error("invalid number");
+			m_pos = end - m_text.data();
+
+			auto begin = m_pos;
+			while (m_pos < m_text.size() && std::isalpha(static_cast<unsigned char>(m_text[m_pos])))
+				m_pos++;
+			if (m_pos != begin)
+				value *= si_prefix_multiplier(m_text.substr(begin, m_pos - begin));
+
+			push_constant(value);
+			return;
+		}
+
+		// Nazwa parametru, stałej lub funkcji
+		if (std::isalpha(static_cast<unsigned char>(c)) || c == '_')
+		{
+			std::string name;
+			while (m_pos < m_text.size() && (std::isalnum(static_cast<unsigned char>(m_text[m_pos])) || m_text[m_pos] == '_'))
+				name += std::tolower(static_cast<unsigned char>(m_text[m_pos++]));
+
+			if (accept("("))
+			{
+				for (unsigned int i = 0; i < std::size(unary_functions); i++)
+					if (unary_functions[i].first == name)
+					{
+						parse_sum();
+						expect(')');
+						emit(opcode::CALL1, i);
+						return;
+					}
+
+				for (unsigned int i = 0; i < std::size(binary_functions); i++)
+					if (binary_functions[i].first == name)
+					{
+						parse_sum();
+						expect(',');
+						parse_sum();
+						expect(')');
+						emit(opcode::CALL2, i);
+						return;
+					}
+
+				error("unknown function '" + name + "'");
+			}
+
+			if (name == "pi")
+				push_constant(M_PI);
+			else
+			{
+				int index = m_symbol(name);
+				m_expr.m_dependencies.push_back(index);
+				emit(opcode::PARAM, index);
+			}
+			return;
+		}
+
+		error("unexpected '"s + c + "'");
+	}
+
+	expression &m_expr;
+	std::string_view m_text;
+	const expression::symbol_function &m_symbol;
+	std::size_t m_pos = 0;
+	int m_depth = 0;
+};
+
+/**
+	\brief Kompiluje wyrażenie
+
+	\param text Tekst wyrażenia (bez nawiasów klamrowych)
+	\param symbol Funkcja wyznaczająca numery parametrów użytych w wyrażeniu
+	\throws std::runtime_error dla niepoprawnych wyrażeń
+*/
+expression::expression(std::string_view text, const symbol_function &symbol)
+{
+	expression_compiler(*this, text, symbol).compile();
+}
+
+/**
+	\brief Oblicza wartość wyrażenia dla zadanych wartości parametrów
+*/
+double expression::evaluate(const std::vector<double> &params) const
+{
+	double stack[max_stack];
+	int top = -1;
+
+	for (const auto &ins : m_code)
+	{
+		switch (ins.op)
+		{
+			case opcode::CONST:
+				stack[++top] = m_constants[ins.arg];
+				break;
+
+			case opcode::PARAM:
+				stack[++top] = params[ins.arg];
+				break;
+
+			case opcode::NEG:
+			case opcode::CALL1:
+				stack[top] = expression_compiler::apply(ins.op, ins.arg, 0, stack[top]);
+				break;
+
+			default:
+				top--;
+				stack[top] = expression_compiler::apply(ins.op, ins.arg, stack[top], stack[top + 1]);
+				break;
+		}
+	}
+
+	return stack[0];
+}
+
+/**
+	\brief Zwraca numery parametrów, od których zależy wyrażenie (posortowane, bez powtórzeń)
+*/
+const std::vector<int> &expression::get_dependencies() const
+{
+	return m_dependencies;
+}
+
+/**
+	\brief Usuwa nawiasy klamrowe otaczające wyrażenie (jeżeli są)
+*/
+static std::string_view strip_braces(std::string_view text)
+{
+	if (text.size() >= 2 && text.front() == '{' && text.back() == '}')
+		return text.substr(1, text.size() - 2);
+	return text;
+}
+
+/**
+	\brief Zwraca obliczoną wartość, jeżeli jest skończona
+	\throws std::runtime_error dla wartości nieskończonych i nieokreślonych (NaN)
+*/
+static double finite_value(double value, std::string_view kind, std::string_view name)
+{
+	if (!is_finite_value(value))
+	{
+		std::string message = "Value of ";
+		message.append(kind).append(" '").append(name).append("' is not finite");
+		throw std::runtime_error(message);
+	}
+	return value;
+}
+
+/**
+	\brief Zwraca numer parametru o zadanej nazwie, w razie potrzeby dodając go do zbioru
+
+	Po wyznaczeniu zależności (\ref resolve()) nie można dodawać nowych parametrów.
+*/
+int parameter_set::symbol(const std::string &name)
+{
+	if (auto it = m_names.find(name); it != m_names.end())
+		return it->second;
+
+	if (m_resolved)
+		throw std::runtime_error("Undefined parameter '" + name + "'");
+
+	m_params.emplace_back();
+	m_params.back().name = name;
+	m_names[name] = m_params.size() - 1;
+	return m_params.size() - 1;
+}
+
+/**
+	\brief Definiuje parametr (.param nazwa=wyrażenie)
+
+	Wyrażenie może odwoływać się do parametrów zdefiniowanych później.
+	\throws std::runtime_error dla powtórzonych definicji i niepoprawnych wyrażeń
+*/
+void parameter_set::define(const std::string &name, std::string_view text)
+{
+	if (m_resolved)
+		throw std::runtime_error("Parameters can not be defined after resolving dependencies");
+
+	std::string lname;
+	for (char c : name)
+		lname += std::tolower(static_cast<unsigned char>(c));
+
+	if (lname == "pi")
+		throw std::runtime_error("Parameter name 'pi' is reserved");
+
+	auto index = symbol(lname);
+	if (m_params[index].expr)
+		throw std::runtime_error("Duplicate definition of parameter '" + lname + "'");
+
+	// Kompilacja może dodać nowe parametry (i przenieść tablicę m_params)
+	expression expr(strip_braces(text), [this](const std::string &n){return symbol(n);});
+	m_params[index].expr = std::move(expr);
+}
+
+/**
+	\brief Wyznacza kolejność obliczeń i wartości wszystkich parametrów
+	\throws std::runtime_error dla niezdefiniowanych parametrów i zależności cyklicznych
+*/
+void parameter_set::resolve()
+{
+	const int count = m_params.size();
+	for (const auto &p : m_params)
+		if (!p.expr)
+			throw std::runtime_error("Undefined parameter '" + p.name + "'");
+
+	// Sortowanie topologiczne (0 - nieodwiedzony, 1 - w trakcie, 2 - gotowy)
+	std::vector<int> order;
+	std::vector<int> state(count, 0);
+	std::function<void(int)> visit = [&](int p){
+		if (state[p] == 2)
+			return;
+		if (state[p] == 1)
+			throw std::runtime_error("Circular dependency of parameter '" + m_params[p].name + "'");
+
+		state[p] = 1;
+		for (int d : m_params[p].expr->get_dependencies())
+			visit(d);
+		state[p] = 2;
+		order.push_back(p);
+	};
+
+	for (int p = 0; p < count; p++)
+		visit(p);
+
+	// Parametry, od których zależą kolejne parametry (w kolejności obliczeń)
+	std::vector<int> position(count);
+	for (int i = 0; i < count; i++)
+		position[order[i]] = i;
+
+	for (int p : order)
+	{
+		auto &anc = m_params[p].ancestors;
+		for (int d : m_params[p].expr->get_dependencies())
+		{
+			anc.push_back(d);
+			anc.insert(anc.end(), m_params[d].ancestors.begin(), m_params[d].ancestors.end());
+		}
+
+		std::sort(anc.begin(), anc.end());
+		anc.erase(std::unique(anc.begin(), anc.end()), anc.end());
+		for (int a : anc)
+			m_params[a].dependent_params.push_back(p);
+	}
+
+	// Wartości
+	m_values.assign(count, 0.0);
+	for (int p : order)
+		m_values[p] = m_params[p].expr->evaluate(m_values);
+
+	m_resolved = true;
+}
+
+/**
+	\brief Dodaje wyrażenie wyznaczające wartość elementu
+
+	Wymaga wcześniejszego wyznaczenia zależności parametrów (\ref resolve()).
+
+	\param target Nazwa elementu
+	\param text Wyrażenie (w nawiasach klamrowych lub bez)
+	\return Numer wyrażenia
+	\throws std::runtime_error dla niepoprawnych wyrażeń, niezdefiniowanych parametrów i nieskończonych wartości
+*/
+int parameter_set::bind(const std::string &target, std::string_view text)
+{
+	if (!m_resolved)
+		throw std::runtime_error("Parameter dependencies must be resolved before binding values");
+
+	expression expr(strip_braces(text), [this](const std::string &n){return symbol(n);});
+	const int index = m_targets.size();
+
+	for (int d : expr.get_dependencies())
+	{
+		auto add = [&](int p){
+			auto &deps = m_params[p].dependent_targets;
+			if (deps.empty() || deps.back() != index)
+				deps.push_back(index);
+		};
+
+		add(d);
+		for (int a : m_params[d].ancestors)
+			add(a);
+	}
+
+	m_target_values.push_back(finite_value(expr.evaluate(m_values), "expression", strip_braces(text)));
+	m_targets.push_back({target, std::move(expr)});
+	return index;
+}
+
+/**
+	\brief Oblicza wartość wyrażenia, które nie wyznacza wartości elementu (np. wartości AC źródła)
+
+	Wymaga wcześniejszego wyznaczenia zależności parametrów (\ref resolve()).
+	\throws std::runtime_error dla niepoprawnych wyrażeń i nieskończonych wartości
+*/
+double parameter_set::evaluate(std::string_view text)
+{
+	if (!m_resolved)
+		throw std::runtime_error("Parameter dependencies must be resolved before evaluating expressions");
+
+	const auto stripped = strip_braces(text);
+	const double value = expression(stripped, [this](const std::string &n){return symbol(n);}).evaluate(m_values);
+	return finite_value(value, "expression", stripped);
+}
+
+/**
+	\brief Zwraca numer parametru o zadanej nazwie (-1, jeżeli nie istnieje)
+*/
+int parameter_set::find(const std::string &name) const
+{
+	std::string lname;
+	for (char c : name)
+		lname += std::tolower(static_cast<unsigned char>(c));
+
+	auto it = m_names.find(lname);
+	return it == m_names.end() ? -1 : it->second;
+}
+
+/**
+	\brief Zwraca wartość parametru
+*/
+double parameter_set::get_value(int param) const
+{
+	return m_values.at(param);
+}
+
+/**
+	\brief Zwraca liczbę wyrażeń wyznaczających wartości elementów
+*/
+int parameter_set::get_target_count() const
+{
+	return m_targets.size();
+}
+
+/**
+	\brief Zwraca nazwę elementu, którego wartość wyznacza wyrażenie
+*/
+const std::string &parameter_set::get_target_name(int target) const
+{
+	return m_targets.at(target).name;
+}
+
+/**
+	\brief Zwraca wartość wyrażenia wyznaczającego wartość elementu
+*/
+double parameter_set::get_target_value(int target) const
+{
+	return m_target_values.at(target);
+}
+
+/**
+	\brief Zwraca numery wyrażeń wartości elementów zależnych (pośrednio lub bezpośrednio) od parametru
+*/
+const std::vector<int> &parameter_set::get_dependent_targets(int param) const
+{
+	return m_params.at(param).dependent_targets;
+}
+
+/**
+	\brief Zmienia wartość parametru i ponownie oblicza tylko zależne od niego wyrażenia
+
+	Parametr zachowuje zadaną wartość do czasu zmiany parametrów, od których zależy jego definicja.
+
+	\return Numery wyrażeń wartości elementów, które zostały obliczone ponownie
+	\throws std::runtime_error jeżeli wartość któregoś z zależnych wyrażeń nie jest skończona
+*/
+const std::vector<int> &parameter_set::set_value(int param, double value)
+{
+	const auto &p = m_params.at(param);
+	m_values[param] = value;
+
+	for (int d : p.dependent_params)
+		m_values[d] = finite_value(m_params[d].expr->evaluate(m_values), "parameter", m_params[d].name);
+
+	for (int t : p.dependent_targets)
+		m_target_values[t] = finite_value(m_targets[t].expr.evaluate(m_values), "component", m_targets[t].name);
+
+	return p.dependent_targets;
+}
@@ -0,0 +1,129 @@
+#pragma once
+#include <functional>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+	\file expression.hpp
+	\brief Wyrażenia parametryczne (.param, {expr}) kompilowane do kodu bajtowego
+	\author Jacek Wieczorek
+*/
+
+double si_prefix_multiplier(std::string_view prefix);
+bool is_finite_value(double x);
+
+/**
+	\brief Wyrażenie arytmetyczne skompilowane do kodu bajtowego maszyny stosowej
+
+	Obsługiwane są operatory `+ - * / ^` (oraz `**`), nawiasy, liczby z przedrostkami SI
+	(np. `2.2k`), stała `pi`, funkcje `sqrt exp log log10 abs sin cos tan atan min max pow`
+	oraz parametry (nazwy wielkość liter nie ma znaczenia). Wyrażenie kompilowane jest raz -
+	obliczenie wartości nie wymaga analizy tekstu ani alokacji pamięci, a stałe
+	podwyrażenia są obliczane już w czasie kompilacji.
+*/
+class expression
+{
+public:
+	/**
+		\brief Funkcja zamieniająca nazwę parametru (małymi literami) na jego numer
+	*/
+	using symbol_function = std::function<int(const std::string &name)>;
+
+	expression(std::string_view text, const symbol_function &symbol);
+
+	double evaluate(const std::vector<double> &params) const;
+	const std::vector<int> &get_dependencies() const;
+
+private:
+	friend class expression_compiler;
+
+	//! Instrukcje maszyny stosowej
+	enum class opcode
+	{
+		CONST, //!< Odłożenie stałej m_constants[arg]
+		PARAM, //!< Odłożenie wartości parametru arg
+		ADD,
+		SUB,
+		MUL,
+		DIV,
+		POW,
+		NEG,
+		CALL1, //!< Funkcja jednego argumentu (arg - numer funkcji)
+		CALL2, //!< Funkcja dwóch argumentów (arg - numer funkcji)
+	};
+
+	struct instruction
+	{
+		opcode op;
+		int arg = 0;
+	};
+
+	//! Maksymalna głębokość stosu
+	static const int max_stack = 32;
+
+	std::vector<instruction> m_code;
+	std::vector<double> m_constants;
+
+	//! Numery parametrów, od których zależy wyrażenie (posortowane)
+	std::vector<int> m_dependencies;
+};
+
+/**
+	\brief Zbiór parametrów (.param) i wyrażeń wyznaczających wartości elementów
+
+	Parametry mogą zależeć od innych parametrów (w dowolnej kolejności definicji). Po
+	wczytaniu wszystkich definicji (\ref resolve()) wyznaczana jest kolejność obliczeń
+	(sortowanie topologiczne) oraz - dla każdego parametru - lista zależnych od niego
+	parametrów i wyrażeń wartości elementów. Zmiana wartości parametru (\ref set_value())
+	powoduje ponowne obliczenie jedynie tych wyrażeń.
+*/
+class parameter_set
+{
+public:
+	void define(const std::string &name, std::string_view text);
+	int bind(const std::string &target, std::string_view text);
+	double evaluate(std::string_view text);
+	void resolve();
+
+	int find(const std::string &name) const;
+	double get_value(int param) const;
+
+	int get_target_count() const;
+	const std::string &get_target_name(int target) const;
+	double get_target_value(int target) const;
+	const std::vector<int> &get_dependent_targets(int param) const;
+
+	const std::vector<int> &set_value(int param, double value);
+
+private:
+	int symbol(const std::string &name);
+
+	//! Parametr
+	struct parameter
+	{
+		std::string name;
+		std::optional<expression> expr;    //!< Definicja (brak dla parametrów użytych, ale niezdefiniowanych)
+		std::vector<int> ancestors;        //!< Parametry, od których parametr zależy (pośrednio lub bezpośrednio)
+		std::vector<int> dependent_params; //!< Parametry zależne (w kolejności obliczeń)
+		std::vector<int> dependent_targets;
+	};
+
+	//! Wyrażenie wyznaczające wartość elementu
+	struct target
+	{
+		std::string name;
+		expression expr;
+	};
+
+	std::map<std::string, int> m_names;
+	std::vector<parameter> m_params;
+	std::vector<double> m_values;
+	std::vector<target> m_targets;
+	std::vector<double> m_target_values;
+
+	//! Czy zależności zostały wyznaczone (\ref resolve())
+	bool m_resolved = false;
+};
@@ -4,13 +4,33 @@
 #include <string>
 #include <vector>
 #include <algorithm>
-#include <functional>
 #include <memory>
 #include <numeric>
 #include <optional>
+#include <span>
+#include <array>
 #include <cmath>
 #include <regex>
+#include <sstream>
+#include <set>
+#include <tuple>
+#include <unistd.h>
 #include "circuit.hpp"
+#include "reduction.hpp"
+#include "measurement.hpp"
+#include "parallel.hpp"
+#include "montecarlo.hpp"
+#include "sweep.hpp"
+#include "expression.hpp"
+#include "noise.hpp"
+#include "transfer.hpp"
+#include "transient.hpp"
+#include "periodic.hpp"
+#include "laplace.hpp"
+#include "devices.hpp"
+#include "newton.hpp"
+#include "waveform.hpp"
+#include "netlist.hpp"
 
 using namespace std::string_literals;
 
@@ -29,6 +49,94 @@ struct ac_analysis_params
 	double stop;     //!< Górna częstotliwość [Hz]
 	double exponent; //!< Wykładnik sweep'a. 0 to sweep liniowy.
 	int steps;       //!< Liczba punktów na exponent-krotną zmianę częstotliwości/łącznie
+
+	//! Zwraca łączną liczbę kroków - przy sweepie nieliniowym określona liczba kroków
+	//! przypada na exponent-krotną zmianę częstotliwości
+	int get_step_count() const
+	{
+		if (exponent == 0 || exponent == 1)
+			return steps;
+		return std::floor(steps * std::log(stop / start) / std::log(exponent));
+	}
+
+	//! Zwraca pulsację w i-tym z count kroków (count wyznaczane jest raz, przez get_step_count())
+	double get_omega(int i, int count) const
+	{
+		auto start_omega = 2 * M_PI * start;
+		auto stop_omega = 2 * M_PI * stop;
+
+		if (exponent == 0 || exponent == 1)
+			return start_omega + (stop_omega - start_omega) * i / (count - 1);
+
+		auto s = std::log(start_omega) / std::log(exponent);
+		auto e = std::log(stop_omega) / std::log(exponent);
+		return std::pow(exponent, s + (e - s) * i / (count - 1));
+	}
+};
+
+/**
+	\brief Parametry analizy funkcji przejścia
+*/
+struct transfer_function_params
+{
+	int pos;           //!< Węzeł wyjściowy
+	int neg;           //!< Węzeł odniesienia wyjścia
+	std::string input; //!< Źródło wejściowe
+};
+
+/**
+	\brief Parametry analizy szumów
+*/
+struct noise_analysis_params
+{
+	int pos;                 //!< Węzeł wyjściowy
+	int neg;                 //!< Węzeł odniesienia wyjścia
+	std::string input;       //!< Źródło wejściowe
+	ac_analysis_params sweep; //!< Zakres częstotliwości
+};
+
+/**
+	\brief Parametry analizy stanów nieustalonych
+*/
+struct transient_analysis_params
+{
+	double step;      //!< Krok całkowania [s]
+	double stop;      //!< Chwila końcowa [s]
+	double start = 0; //!< Chwila, od której wypisywane są wyniki [s]
+	double max_step = 0; //!< Największy krok [s] (0 - stały krok całkowania)
+};
+
+/**
+	\brief Parametry analizy okresowego stanu ustalonego
+*/
+struct periodic_analysis_params
+{
+	double frequency; //!< Częstotliwość podstawowa [Hz]
+	int harmonics;    //!< Liczba harmonicznych
+	int points = 0;   //!< Liczba punktów okresu (0 - wynikająca z liczby harmonicznych)
+};
+
+/**
+	\brief Parametry analizy odpowiedzi skokowej lub impulsowej
+*/
+struct response_analysis_params
+{
+	response_kind kind;     //!< Rodzaj pobudzenia
+	std::string input;      //!< Nazwa źródła wejściowego
+	double stop;            //!< Chwila końcowa [s]
+	int points = 100;       //!< Liczba chwil
+	int contour_points = 0; //!< Liczba punktów konturu Talbota (0 - dobierana automatycznie)
+};
+
+/**
+	\brief Parametry analizy Monte Carlo
+*/
+struct mc_analysis_params
+{
+	int samples;            //!< Liczba prób
+	std::uint64_t seed = 1; //!< Ziarno generatora liczb pseudolosowych
+	double frequency = 0;   //!< Częstotliwość, dla której rozwiązywany jest układ [Hz]
+	int bins = 20;          //!< Liczba przedziałów histogramów
 };
 
 /**
@@ -82,6 +190,58 @@ double probe_complex(std::complex<double> c, complex_probing_method method, doub
 	}
 }
 
+/**
+	\brief Zwraca pochodną określonego komponentu zespolonej wielkości fizycznej
+
+	\param c Wartość wielkości zespolonej
+	\param dc Pochodna wielkości zespolonej po parametrze
+	\see probe_complex()
+*/
+double probe_complex_derivative(std::complex<double> c, std::complex<double> dc, complex_probing_method method, double omega = 0)
+{
+	switch (method)
+	{
+		case complex_probing_method::DEFAULT:
+			if (omega == 0.0)
+				return dc.real();
+			else
+				return probe_complex_derivative(c, dc, complex_probing_method::MAGNITUDE);
+			break;
+
+		case complex_probing_method::MAGNITUDE:
+			return std::abs(c) == 0.0 ? 0.0 : (std::conj(c) * dc).real() / std::abs(c);
+			break;
+
+		case complex_probing_method::PHASE:
+			return std::abs(c) == 0.0 ? 0.0 : (dc / c).imag();
+			break;
+
+		case complex_probing_method::REAL:
+			return dc.real();
+			break;
+
+		case complex_probing_method::IMAGINARY:
+			return dc.imag();
+			break;
+
+		default:
+			return 0.0;
+			break;
+	}
+}
+
+/**
+	\brief Przelicza wrażliwości wielkości zespolonej na wrażliwości mierzonego komponentu
+*/
+static std::map<std::string, double> probe_complex_sensitivity(std::complex<double> c, const sensitivity_map &sens,
+	complex_probing_method method, double omega)
+{
+	std::map<std::string, double> res;
+	for (const auto &[ref, dc] : sens)
+		res[ref] = probe_complex_derivative(c, dc, method, omega);
+	return res;
+}
+
 /**
 	\brief Zwraca suffix dodawany do oznaczenia mierzonej wartości zespolonej
 */
@@ -125,10 +285,68 @@ public:
 		return m_name;
 	}
 
-	virtual double get_value(const circuit_solver &solver) const = 0;
+	virtual double get_value(const solve_context &ctx) const = 0;
+	virtual double get_value(const transient_state &state) const = 0;
+	virtual std::map<std::string, double> get_sensitivity(const solve_context &ctx) const = 0;
+
+	/**
+		\brief Kompiluje pomiar względem planu - dodaje mierzoną wielkość do zbioru
+		\param circ Obwód, na podstawie którego utworzono plan
+	*/
+	void bind(measurement_set &ms, const circuit &circ)
+	{
+		try
+		{
+			m_slot = add_quantity(ms, circ);
+		}
+		catch (const std::exception &ex)
+		{
+			throw std::runtime_error("Probing '"s + m_name + "' failed");
+		}
+	}
+
+	/**
+		\brief Zwraca zmierzoną wartość na podstawie wielkości wyznaczonych przez \ref measurement_set::evaluate()
+
+		Pomiary, których nie dodano do zbioru (np. napięcia węzłów usuniętych przy upraszczaniu
+		obwodu), odczytywane są z kontekstu analizy.
+	*/
+	double get_bound_value(const std::vector<std::complex<double>> &values, const solve_context &ctx) const
+	{
+		if (m_slot < 0)
+			return get_value(ctx);
+		return probe_complex(values.at(m_slot), m_probing_method, ctx.get_solution_omega());
+	}
+
+	/**
+		\brief Ustawia uproszczenie obwodu, na podstawie którego odtwarzane są napięcia usuniętych węzłów
+	*/
+	void set_reduction(const network_reduction *reduction)
+	{
+		m_reduction = reduction;
+	}
+
+	/**
+		\brief Dodaje do zbiorów węzły i elementy, które muszą pozostać w uproszczonym obwodzie
+	*/
+	virtual void get_dependencies(std::set<int> &nodes, std::set<std::string> &components) const = 0;
 
 protected:
+	probe(complex_probing_method pm) :
+		m_probing_method(pm)
+	{}
+
+	//! Dodaje mierzoną wielkość do zbioru i zwraca jej numer (-1, jeżeli nie może być dodana)
+	virtual int add_quantity(measurement_set &ms, const circuit &circ) const = 0;
+
 	std::string m_name;
+	complex_probing_method m_probing_method;
+
+	//! Uproszczenie obwodu, którego rozwiązanie jest mierzone (lub nullptr)
+	const network_reduction *m_reduction = nullptr;
+
+	//! Numer wielkości w zbiorze, względem którego skompilowano pomiar
+	int m_slot = -1;
 };
 
 /**
@@ -138,7 +356,7 @@ class voltage_probe : public probe
 {
 public:
 	voltage_probe(const circuit &circ, const std::string &ref, complex_probing_method pm) :
-		m_probing_method(pm)
+		probe(pm)
 	{
 		try
 		{
@@ -154,8 +372,8 @@ public:
 	}
 
 	voltage_probe(int pos, int neg, complex_probing_method pm) :
-		m_nodes(pos, neg),
-		m_probing_method(pm)
+		probe(pm),
+		m_nodes(pos, neg)
 	{
 		if (neg != 0)
 		{
@@ -166,11 +384,23 @@ public:
 			m_name = std::string{"V"} + probing_method_suffix(pm) + "(" + std::to_string(m_nodes.first) + ")";
 	}
 
-	double get_value(const circuit_solver &solver) const override
+	double get_value(const solve_context &ctx) const override
+	{
+		try
+		{
+			return probe_complex(voltage(ctx), m_probing_method, ctx.get_solution_omega());
+		}
+		catch (const std::exception &ex)
+		{
+			throw std::runtime_error("Probing '"s + m_name + "' failed");
+		}
+	}
+
+	double get_value(const transient_state &state) const override
 	{
 		try
 		{
-			return probe_complex(solver.voltage(m_nodes.first, m_nodes.second), m_probing_method, solver.get_solution_omega());
+			return probe_complex(state.voltage(m_nodes.first, m_nodes.second), m_probing_method);
 		}
 		catch (const std::exception &ex)
 		{
@@ -178,9 +408,46 @@ public:
 		}
 	}
 
+	std::map<std::string, double> get_sensitivity(const solve_context &ctx) const override
+	{
+		try
+		{
+			return probe_complex_sensitivity(
+				voltage(ctx),
+				ctx.voltage_sensitivity(m_nodes.first, m_nodes.second),
+				m_probing_method,
+				ctx.get_solution_omega());
+		}
+		catch (const std::exception &ex)
+		{
+			throw std::runtime_error("Sensitivity analysis of '"s + m_name + "' failed");
+		}
+	}
+
+	//! Napięcia usuniętych węzłów odtwarzane są na podstawie rozwiązania uproszczonego obwodu
+	void get_dependencies(std::set<int> &nodes, std::set<std::string> &components) const override
+	{
+	}
+
+protected:
+	int add_quantity(measurement_set &ms, const circuit &circ) const override
+	{
+		// Napięcie usuniętego węzła nie jest stałą kombinacją zmiennych uproszczonego układu
+		if (m_reduction && (m_reduction->is_eliminated(m_nodes.first) || m_reduction->is_eliminated(m_nodes.second)))
+			return -1;
+		return ms.add_voltage(m_nodes.first, m_nodes.second);
+	}
+
 private:
+	//! Napięcie między węzłami pierwotnego obwodu
+	std::complex<double> voltage(const solve_context &ctx) const
+	{
+		if (m_reduction)
+			return m_reduction->voltage(ctx, m_nodes.first, m_nodes.second);
+		return ctx.voltage(m_nodes.first, m_nodes.second);
+	}
+
 	std::pair<int, int> m_nodes;
-	complex_probing_method m_probing_method;
 };
 
 /**
@@ -190,17 +457,29 @@ class current_probe : public probe
 {
 public:
 	current_probe(const circuit &circ, const std::string &ref, complex_probing_method pm) :
-		m_ref(ref),
-		m_probing_method(pm)
+		probe(pm),
+		m_ref(ref)
 	{
 		m_name = std::string{"I"} + probing_method_suffix(pm) + "(" + ref + ")";
 	}
 
-	double get_value(const circuit_solver &solver) const override
+	double get_value(const solve_context &ctx) const override
+	{
+		try
+		{
+			return probe_complex(ctx.current(m_ref), m_probing_method, ctx.get_solution_omega());
+		}
+		catch (const std::exception &ex)
+		{
+			throw std::runtime_error("Probing '"s + m_name + "' failed");
+		}
+	}
+
+	double get_value(const transient_state &state) const override
 	{
 		try
 		{
-			return probe_complex(solver.current(m_ref), m_probing_method, solver.get_solution_omega());
+			return probe_complex(state.current(m_ref), m_probing_method);
 		}
 		catch (const std::exception &ex)
 		{
@@ -208,9 +487,31 @@ public:
 		}
 	}
 
+	std::map<std::string, double> get_sensitivity(const solve_context &ctx) const override
+	{
+		try
+		{
+			return probe_complex_sensitivity(ctx.current(m_ref), ctx.current_sensitivity(m_ref),
+				m_probing_method, ctx.get_solution_omega());
+		}
+		catch (const std::exception &ex)
+		{
+			throw std::runtime_error("Sensitivity analysis of '"s + m_name + "' failed");
+		}
+	}
+
+	void get_dependencies(std::set<int> &nodes, std::set<std::string> &components) const override
+	{
+		components.insert(m_ref);
+	}
+
 protected:
+	int add_quantity(measurement_set &ms, const circuit &circ) const override
+	{
+		return ms.add_current(*circ.at(m_ref));
+	}
+
 	std::string m_ref;
-	complex_probing_method m_probing_method;
 };
 
 /**
@@ -225,17 +526,48 @@ public:
 		m_name = std::string{"P"} + probing_method_suffix(pm) + "(" + ref + ")";
 	}
 
-	double get_value(const circuit_solver &solver) const override
+	double get_value(const solve_context &ctx) const override
+	{
+		try
+		{
+			return probe_complex(ctx.power(m_ref), m_probing_method, ctx.get_solution_omega());
+		}
+		catch (const std::exception &ex)
+		{
+			throw std::runtime_error("Probing '"s + m_name + "' failed");
+		}
+	}
+
+	double get_value(const transient_state &state) const override
 	{
 		try
 		{
-			return probe_complex(solver.power(m_ref), m_probing_method, solver.get_solution_omega());
+			return probe_complex(state.power(m_ref), m_probing_method);
 		}
 		catch (const std::exception &ex)
 		{
 			throw std::runtime_error("Probing '"s + m_name + "' failed");
 		}
 	}
+
+	std::map<std::string, double> get_sensitivity(const solve_context &ctx) const override
+	{
+		try
+		{
+			return probe_complex_sensitivity(ctx.power(m_ref), ctx.power_sensitivity(m_ref),
+				m_probing_method, ctx.get_solution_omega());
+		}
+		catch (const std::exception &ex)
+		{
+			throw std::runtime_error("Sensitivity analysis of '"s + m_name + "' failed");
+		}
+	}
+
+protected:
+	int add_quantity(measurement_set &ms, const circuit &circ) const override
+	{
+		return ms.add_power(*circ.at(m_ref));
+	}
 };
 
 /**
@@ -246,73 +578,88 @@ struct circuit_simulation
 	std::string title;
 	circuit circ;
 	std::optional<ac_analysis_params> ac;
+	std::optional<noise_analysis_params> noise;
+	std::optional<transfer_function_params> tf;
+	std::optional<transient_analysis_params> tran;
+	std::optional<periodic_analysis_params> pss;
+	std::optional<response_analysis_params> response;
+	std::vector<sweep_range> dc; //!< Zakresy przemiatanych źródeł analizy DC (puste - brak analizy)
 	std::vector<std::shared_ptr<probe>> probes;
+	bool sens = false; //!< Czy przeprowadzić analizę wrażliwości mierzonych wielkości
+	std::optional<bool> reduce; //!< Czy uprościć obwód przed analizą (true - także przekształceniem gwiazda-trójkąt)
+	int threads = 1; //!< Liczba wątków analizy (0 - liczba wątków sprzętowych)
+	std::optional<mc_analysis_params> mc;
+	std::map<std::string, component_tolerance> tolerances; //!< Tolerancje elementów (dla analizy Monte Carlo)
+	parameter_set params; //!< Parametry (.param) i wyrażenia wartości elementów
+	std::map<std::string, waveform> waveforms; //!< Przebiegi czasowe źródeł (dla analizy stanów nieustalonych)
+	integration_method method = integration_method::TRAPEZOIDAL; //!< Metoda całkowania analizy stanów nieustalonych
+	step_control step_tolerances; //!< Tolerancje błędu lokalnego analizy stanów nieustalonych (.options)
 };
 
 /**
 	\brief Zamienia litery w stringu na małe
 */
-static std::string tolower(std::string s)
+static std::string tolower(std::string_view s)
 {
-	for (char &c : s)
+	std::string lower(s);
+	for (char &c : lower)
 		c = std::tolower(c);
-	return s;
+	return lower;
+}
+
+/**
+	\brief Zwraca typ elementu - przedrostek nazwy przed pierwszą cyfrą (np. "OPA" dla "OPA1")
+*/
+static std::string_view component_type(std::string_view ref)
+{
+	return ref.substr(0, std::find_if(ref.begin(), ref.end(), [](char c){return std::isdigit(c);}) - ref.begin());
 }
 
 /**
-	\brief Zwraca wektor fragmentów tekstu rozdzielonych znakami białymi
+	\brief Zwraca widok od początku tokenu do końca linii, w której się znajduje
 */
-static std::vector<std::string> tokenize_string(const std::string &s, std::function<bool(char c)> predicate)
+static std::string_view rest_of_line(std::string_view line, std::string_view token)
 {
-	std::vector<std::string> tokens;
+	return line.substr(token.data() - line.data());
+}
 
-	auto bit = s.begin();
-	auto eit = bit;
+/**
+	\brief Łączy tokeny należące do jednego wyrażenia w nawiasach klamrowych (np. `{a * 2}`)
+
+	Tokeny są widokami na jedną linię, więc połączony token to widok od pierwszego do ostatniego z nich.
+*/
+static void group_braces(std::vector<std::string_view> &tokens)
+{
+	unsigned int count = 0;
+	bool open = false;
 
-	while (bit != s.end() && eit != s.end())
+	for (unsigned int i = 0; i < tokens.size(); i++)
 	{
-		eit = std::find_if(bit, s.end(), predicate);
-		if (bit != eit)
-			tokens.emplace_back(bit, eit);		
-		bit = std::next(eit);
+		const auto t = tokens[i];
+		if (open)
+			tokens[count - 1] = {tokens[count - 1].data(), static_cast<std::size_t>(t.data() + t.size() - tokens[count - 1].data())};
+		else
+			tokens[count++] = t;
+
+		if (t.find('{') != std::string_view::npos)
+			open = true;
+		if (t.find('}') != std::string_view::npos)
+			open = false;
 	}
 
-	return tokens;
+	tokens.resize(count);
+	if (open)
+		throw std::runtime_error("Unterminated expression '" + std::string(tokens.back()) + "'");
 }
 
 /**
-	\brief Zamienia tekst będący liczbą z przedrostkiem SI na wartość
+	\brief Zamienia tekst będący liczbą z przedrostkiem SI lub wyrażeniem w nawiasach klamrowych na wartość
 */
-static double si_string_to_double(const std::string &s)
+static double parse_value(std::string_view s, parameter_set &params)
 {
-	const static std::map<std::string, double> muls = {
-		{"p", 1e-12},
-		{"n", 1e-9},
-		{"u", 1e-6},
-		{"m", 1e-3},
-		{"k", 1e3},
-		{"Meg", 1e6},
-		{"G", 1e9},
-	};
-
-	std::istringstream ss(s);
-	std::string prefix;
-	double val;
-	ss >> val >> prefix;
-
-	if (!prefix.empty())
-	{
-		try
-		{
-			return val * muls.at(prefix);
-		}
-		catch (const std::out_of_range &ex)
-		{
-			throw std::runtime_error("Invalid SI prefix");
-		}
-	}
-	else
-		return val;
+	if (!s.empty() && s[0] == '{')
+		return params.evaluate(s);
+	return parse_si_number(s);
 }
 
 
@@ -322,18 +669,22 @@ static double si_string_to_double(const std::string &s)
 	\note Akceptuje nazwy węzłów typu '2z'. Nie jest to piękne, ale też na razie nie ma 
 	potrzeby żeby to na siłę naprawiać.
 */
-static std::shared_ptr<circuit_component> create_component(const std::vector<std::string> &tokens)
+static std::shared_ptr<circuit_component> create_component(const std::vector<std::string_view> &tokens, parameter_set &params)
 {
-	auto ref = tokens.at(0);
-	std::string ref_type{ref.begin(), std::find_if(ref.begin(), ref.end(), [](char c){return std::isdigit(c);})};
+	const auto ref = tokens.at(0);
+	const auto ref_type = component_type(ref);
 
-	// Interpretuje trójkę wartości, która opisuje wszystkie komponenty "bipolowe"
-	auto parse_component_triplet = [](const std::vector<std::string> &tokens, std::pair<int, int> &nodes, double &value){
+	// Interpretuje trójkę wartości, która opisuje wszystkie komponenty "bipolowe".
+	// Wartość podana jako wyrażenie jest zapamiętywana - zależy od parametrów.
+	auto parse_component_triplet = [&](const std::vector<std::string_view> &tokens, std::pair<int, int> &nodes, double &value){
 		try
 		{
-			nodes.first = std::stoi(tokens.at(1));
-			nodes.second = std::stoi(tokens.at(2));
-			value = si_string_to_double(tokens.at(3));
+			nodes.first = parse_int(tokens.at(1));
+			nodes.second = parse_int(tokens.at(2));
+			if (tokens.at(3)[0] == '{')
+				value = params.get_target_value(params.bind(std::string(ref), tokens[3]));
+			else
+				value = parse_si_number(tokens[3]);
 		}
 		catch (const std::out_of_range &ex)
 		{
@@ -366,13 +717,13 @@ static std::shared_ptr<circuit_component> create_component(const std::vector<std
 		return std::make_shared<capacitor>(nodes, value);
 	}
 
-	if (ref_type == "E" || ref_type == "V")
+	if (ref_type == "V")
 	{
 		parse_component_triplet(tokens, nodes, value);
 		double ac = 0.0;
 
-		if (tokens.size() >= 6 && tolower(tokens[4]) == "ac")
-			ac = std::stoi(tokens[5]);
+		if (tokens.size() >= 6 && iequals(tokens[4], "ac"))
+			ac = parse_value(tokens[5], params);
 
 		return std::make_shared<voltage_source>(nodes, value, ac);
 	}
@@ -382,8 +733,8 @@ static std::shared_ptr<circuit_component> create_component(const std::vector<std
 		parse_component_triplet(tokens, nodes, value);
 		double ac = 0.0;
 
-		if (tokens.size() >= 6 && tolower(tokens[4]) == "ac")
-			ac = std::stoi(tokens[5]);
+		if (tokens.size() >= 6 && iequals(tokens[4], "ac"))
+			ac = parse_value(tokens[5], params);
 
 		return std::make_shared<current_source>(nodes, value, ac);
 	}
@@ -393,270 +744,1432 @@ static std::shared_ptr<circuit_component> create_component(const std::vector<std
 		if (tokens.size() < 4)
 			throw std::runtime_error("Missing nodes!");
 
-		int pos = std::stoi(tokens[1]);
-		int neg = std::stoi(tokens[2]);
-		int out = std::stoi(tokens[3]);
+		int pos = parse_int(tokens[1]);
+		int neg = parse_int(tokens[2]);
+		int out = parse_int(tokens[3]);
 		return std::make_shared<opamp>(pos, neg, out);
 	}
 
-	throw std::runtime_error("Invalid component type");
-}
-
-/**
-	\brief Tworzy symulację na podstawie pliku częściowo kompatybilnego z formatem SPICE
-*/
-static circuit_simulation read_spice_file(std::istream &netlist)
-{
-	circuit_simulation sim;
-
-	// Pierwsza linia zawiera tytuł
-	std::getline(netlist, sim.title);
-
-	// Wszystkie napotkane polecenia
-	std::vector<std::string> commands;
-
-	int line_number = 1;
-	std::string line;
-	while (line_number++, std::getline(netlist, line))
+	// Źródła sterowane - węzły wyjścia, węzły sterujące (E, G) lub nazwa SEM sterującej (F, H) i wzmocnienie
+	if (ref_type == "E" || ref_type == "G" || ref_type == "F" || ref_type == "H")
 	{
-		auto tokens = tokenize_string(line, [](char c){return isspace(c);});
-		if (!tokens.size()) continue;
+		using type = controlled_source::source_type;
+		const bool voltage_controlled = ref_type == "E" || ref_type == "G";
+		const unsigned int gain_index = voltage_controlled ? 5 : 4;
+		double gain;
 
-		// Polecenie SPICE do obsłużenia później
-		if (tokens[0][0] == '.')
-			commands.push_back(line);
-		else // Element układu
+		try
 		{
-			auto ref = tokens[0];
-			if (sim.circ.find(ref) == sim.circ.end())
+			nodes.first = parse_int(tokens.at(1));
+			nodes.second = parse_int(tokens.at(2));
+			const auto g = tokens.at(gain_index);
+			gain = g[0] == '{' ? params.get_target_value(params.bind(std::string(ref), g)) : parse_si_number(g);
+
+			if (voltage_controlled)
 			{
-				try
-				{
-					sim.circ[ref] = create_component(tokens);
-				}
-				catch (const std::exception &ex)
-				{
-					throw std::runtime_error("Could not parse component in line "s + std::to_string(line_number) + " - reason: " + ex.what());
-				}
+				std::pair<int, int> control{parse_int(tokens[3]), parse_int(tokens[4])};
+				return std::make_shared<controlled_source>(ref_type == "E" ? type::VCVS : type::VCCS, nodes, control, gain);
 			}
-			else
-				throw std::runtime_error("Duplicate components found! (line "s + std::to_string(line_number) + ")");
 		}
+		catch (const std::out_of_range &ex)
+		{
+			throw std::runtime_error("Missing arguments (or invalid value)");
+		}
+		catch (const std::invalid_argument &ex)
+		{
+			throw std::runtime_error("Invalid value");
+		}
+
+		return std::make_shared<controlled_source>(ref_type == "H" ? type::CCVS : type::CCCS, nodes, std::string(tokens[3]), gain);
 	}
 
-	// Interpretacja poleceń SPICE
-	for (const auto &cmd : commands)
+	// Elementy nieliniowe - węzły, opcjonalny typ i parametry modelu (`NAZWA=wartość`).
+	// Wartości domyślne są nadpisywane w miejscu w tablicy podanej przez wywołującego.
+	struct device_parameter
 	{
-		auto tokens = tokenize_string(cmd, [](char c){return isspace(c);});
-		auto lowercase_command = tolower(tokens[0]);
+		std::string_view name;
+		double value;
+	};
 
-		if (lowercase_command == ".ac")
+	auto parse_device = [&](int node_count, std::initializer_list<std::string_view> types, std::span<device_parameter> values){
+		std::array<int, 3> device_nodes{0, 0, 0};
+		std::string_view type = types.size() ? *types.begin() : std::string_view{};
+		try
 		{
-			if (tokens.size() != 5)
-				throw std::runtime_error("Invalid use of .ac command!");
+			for (int i = 0; i < node_count; i++)
+				device_nodes[i] = parse_int(tokens.at(i + 1));
+		}
+		catch (const std::exception &ex)
+		{
+			throw std::runtime_error("Missing or invalid nodes");
+		}
 
-			// Typ sweepa
-			auto sweep_type = tolower(tokens[1]);
-			double exponent;
-			if (sweep_type == "lin")
-				exponent = 0;
-			else if (sweep_type == "dec")
-				exponent = 10;
-			else if (sweep_type == "oct")
-				exponent = 2;
-			else
-				throw std::runtime_error("Invalid .ac sweep type!");
+		for (unsigned int i = node_count + 1; i < tokens.size(); i++)
+		{
+			const auto token = tokens[i];
+			const auto eq = token.find('=');
+			const auto name = token.substr(0, eq);
+			if (eq == std::string_view::npos)
+			{
+				auto it = std::find_if(types.begin(), types.end(), [&](auto t){return iequals(t, name);});
+				if (it == types.end())
+					throw std::runtime_error("Invalid device parameter '" + std::string(token) + "'");
+				type = *it;
+				continue;
+			}
+
+			auto it = std::find_if(values.begin(), values.end(), [&](const auto &p){return iequals(p.name, name);});
+			if (it == values.end())
+				throw std::runtime_error("Invalid device parameter '" + std::string(token) + "'");
 
-			// Parametry liczbowe
-			int n;
-			double fstart;
-			double fstop;
 			try
 			{
-				n = std::stoi(tokens[2]);
-				fstart = si_string_to_double(tokens[3]);
-				fstop = si_string_to_double(tokens[4]);
-
-				if (fstart <= 0 || fstop <= fstart || n <= 0)
-					throw std::runtime_error("Invalid .ac command parameter value");
+				it->value = parse_value(token.substr(eq + 1), params);
 			}
-			catch (const std::exception &ex)
+			catch (const std::invalid_argument &ex)
 			{
-				throw std::runtime_error("Malformed .ac command parameter");
+				throw std::runtime_error("Invalid device parameter value '" + std::string(token) + "'");
 			}
+		}
+
+		return std::make_pair(device_nodes, type);
+	};
+
+	if (ref_type == "D")
+	{
+		std::array<device_parameter, 2> v{{{"is", 1e-14}, {"n", 1.0}}};
+		auto [n, type] = parse_device(2, {}, v);
+		return std::make_shared<diode>(std::make_pair(n[0], n[1]), v[0].value, v[1].value);
+	}
+
+	if (ref_type == "Q")
+	{
+		std::array<device_parameter, 3> v{{{"is", 1e-16}, {"bf", 100.0}, {"br", 1.0}}};
+		auto [n, type] = parse_device(3, {"npn", "pnp"}, v);
+		return std::make_shared<bjt>(n, type == "pnp", v[0].value, v[1].value, v[2].value);
+	}
+
+	if (ref_type == "M")
+	{
+		std::array<device_parameter, 5> v{{{"kp", 2e-5}, {"vto", NAN}, {"lambda", 0.0}, {"w", 1.0}, {"l", 1.0}}};
+		auto [n, type] = parse_device(3, {"nmos", "pmos"}, v);
+		const bool pmos = type == "pmos";
+		const double vto = std::isnan(v[1].value) ? (pmos ? -1.0 : 1.0) : v[1].value;
+		return std::make_shared<mosfet>(n, pmos, v[0].value * v[3].value / v[4].value, vto, v[2].value);
+	}
+
+	throw std::runtime_error("Invalid component type");
+}
 
-			sim.ac = ac_analysis_params{.start = fstart, .stop = fstop, .exponent = exponent, .steps = n};
+/**
+	\brief Odczytuje przebieg czasowy źródła ze "stokenizowanej" linii pliku SPICE
+
+	Przebieg (`PULSE(...)`, `SIN(...)` lub `PWL(...)`) podaje się po węzłach źródła.
+	Tokeny opisujące przebieg są usuwane z linii, a jeżeli nie podano wartości DC,
+	zastępuje ją wartość przebiegu w chwili 0 (zapisana w storage).
+*/
+static std::optional<waveform> parse_waveform(std::string_view line, std::vector<std::string_view> &tokens,
+	std::string &storage, parameter_set &params)
+{
+	static const std::regex waveform_regex("\\s*(pulse|sin|pwl)\\s*\\(([^)]*)\\)(.*)", std::regex_constants::icase);
+
+	// Linie bez nawiasów nie opisują przebiegu
+	if (line.find('(') == std::string_view::npos)
+		return {};
+
+	for (unsigned int i = 3; i < tokens.size(); i++)
+	{
+		const auto rest = rest_of_line(line, tokens[i]);
+
+		std::cmatch match;
+		if (!std::regex_match(rest.data(), rest.data() + rest.size(), match, waveform_regex))
+			continue;
+
+		const auto ref_type = component_type(tokens.at(0));
+		if (ref_type != "V" && ref_type != "I")
+			throw std::runtime_error("Waveform can only be given for independent sources");
+
+		std::vector<double> args;
+		try
+		{
+			std::vector<std::string_view> arg_tokens;
+			tokenize({match[2].first, static_cast<std::size_t>(match[2].length())}, arg_tokens, true);
+			for (const auto &arg : arg_tokens)
+				args.push_back(parse_value(arg, params));
 		}
-		else if (lowercase_command == ".print")
+		catch (const std::exception &ex)
 		{
-			// Nazwy na różne typy interpretacji zespolonych wielkości fizycznych
-			const static std::map<std::string, complex_probing_method> complex_probing_names =
-			{
-				{"", complex_probing_method::DEFAULT},
-				{"re", complex_probing_method::REAL},
-				{"im", complex_probing_method::IMAGINARY},
-				{"mag", complex_probing_method::MAGNITUDE},
-				{"ph", complex_probing_method::PHASE},
-			};
+			throw std::runtime_error("Invalid waveform parameter");
+		}
 
-			const std::regex probe_regex("([VPI])(re|im|mag|ph)?\\(\\s*([^\\s,]*)(\\s*,\\s*([^\\s,]*))?\\s*\\)",
-				std::regex_constants::icase);
+		waveform wf(waveform::parse_shape(match[1]), args);
 
-			std::smatch match;
-			for (std::string str = cmd; std::regex_search(str, match, probe_regex); str = match.suffix())
-			{
-				auto probe_type = tolower(match[1]);
-				auto probing_method_name = tolower(match[2]);
-			
-				// Metoda pomiaru wielkości zespolonej
-				auto probing_method = complex_probing_method::DEFAULT;
-				if (auto it = complex_probing_names.find(probing_method_name); it != complex_probing_names.end())
-					probing_method = it->second;
-				else
-					throw std::runtime_error("Invalid probing method '"s + probing_method_name + "'");
+		// Pozostałe tokeny (np. wartość AC) zastępują opis przebiegu
+		std::vector<std::string_view> suffix;
+		tokenize({match[3].first, static_cast<std::size_t>(match[3].length())}, suffix);
+		tokens.resize(i);
+		if (tokens.size() == 3 && (suffix.empty() || iequals(suffix[0], "ac")))
+		{
+			std::ostringstream ss;
+			ss.precision(17);
+			ss << wf.value(0);
+			storage = ss.str();
+			tokens.push_back(storage);
+		}
+		tokens.insert(tokens.end(), suffix.begin(), suffix.end());
 
-				try
-				{ 
-					// Pomiar napięcia
-					if (probe_type == "v")
-					{
-						int pos, neg = 0;
-						try
-						{
-							pos = std::stoi(match[3]);
-							if (!match[4].str().empty())
-								neg = std::stoi(match[5]);
-						}
-						catch (const std::exception &ex)
-						{
-							throw std::runtime_error("Invalid node numbers in '"s + line + "'");
-						}
+		return wf;
+	}
 
-						sim.probes.push_back(std::make_shared<voltage_probe>(pos, neg, probing_method));
-					}
+	return {};
+}
 
-					// Pomiar prądu
-					if (probe_type == "i") 
-						sim.probes.push_back(std::make_shared<current_probe>(sim.circ, match[3], probing_method));
+/**
+	\brief Odczytuje tolerancję elementu ze "stokenizowanej" linii pliku SPICE
 
-					// Pomiar mocy
-					if (probe_type == "p") 
-						sim.probes.push_back(std::make_shared<power_probe>(sim.circ, match[3], probing_method));
-				}
-				catch (const std::exception &ex)
-				{
-					throw std::runtime_error("Could not probe '"s + line + "' - reason: "s + ex.what());
-				}
+	Tolerancję podaje się po wartości elementu R, L lub C: `tol=5%` (lub `tol=0.05`), a rozkład
+	odchyłki - `dist=uniform` (domyślnie) lub `dist=gauss` (tolerancja odpowiada 3 sigma).
+*/
+static std::optional<component_tolerance> parse_tolerance(const std::vector<std::string_view> &tokens)
+{
+	std::optional<double> tol;
+	auto dist = tolerance_distribution::UNIFORM;
+	bool has_dist = false;
+
+	for (unsigned int i = 4; i < tokens.size(); i++)
+	{
+		if (tokens[i].find('=') == std::string_view::npos)
+			continue;
+
+		const auto token = tokens[i];
+		const auto eq = token.find('=');
+		const auto name = token.substr(0, eq);
+		const auto value = token.substr(eq + 1);
+		if (iequals(name, "tol"))
+		{
+			try
+			{
+				if (!value.empty() && value.back() == '%')
+					tol = parse_si_number(value.substr(0, value.size() - 1)) / 100;
+				else
+					tol = parse_si_number(value);
+			}
+			catch (const std::exception &ex)
+			{
+				throw std::runtime_error("Invalid tolerance value");
 			}
+
+			if (*tol < 0)
+				throw std::runtime_error("Negative tolerance");
 		}
-		else
+		else if (iequals(name, "dist"))
 		{
-			std::cerr << "Ignoring command '" << lowercase_command << "'..." << std::endl;
+			if (iequals(value, "uniform"))
+				dist = tolerance_distribution::UNIFORM;
+			else if (iequals(value, "gauss") || iequals(value, "gaussian"))
+				dist = tolerance_distribution::GAUSSIAN;
+			else
+				throw std::runtime_error(std::string("Invalid tolerance distribution '").append(value).append("'"));
+			has_dist = true;
 		}
 	}
 
-	return sim;
+	if (!tol)
+	{
+		if (has_dist)
+			throw std::runtime_error("Tolerance distribution given without tolerance");
+		return {};
+	}
+
+	const auto ref_type = component_type(tokens.at(0));
+	if (ref_type != "R" && ref_type != "L" && ref_type != "C")
+		throw std::runtime_error("Tolerance can only be given for R, L and C components");
+
+	return component_tolerance{.tolerance = *tol, .distribution = dist};
 }
 
 /**
-	\brief Funkcja main dla rozszerzonej wersji programu
+	\brief Odczytuje zakres częstotliwości analizy (`lin/dec/oct N fs fe`) począwszy od zadanego tokenu
 */
-int main_extended(int argc, char *argv[])
+static ac_analysis_params parse_frequency_sweep(const std::vector<std::string_view> &tokens, unsigned int first, const std::string &command)
 {
-	auto &fin = std::cin;
-	auto &fout = std::cout;
+	// Typ sweepa
+	auto sweep_type = tolower(tokens.at(first));
+	double exponent;
+	if (sweep_type == "lin")
+		exponent = 0;
+	else if (sweep_type == "dec")
+		exponent = 10;
+	else if (sweep_type == "oct")
+		exponent = 2;
+	else
+		throw std::runtime_error("Invalid " + command + " sweep type!");
 
+	// Parametry liczbowe
+	int n;
+	double fstart;
+	double fstop;
 	try
 	{
-		auto sim = read_spice_file(fin);
+		n = parse_int(tokens.at(first + 1));
+		fstart = parse_si_number(tokens.at(first + 2));
+		fstop = parse_si_number(tokens.at(first + 3));
 
-		try
-		{
-			circuit_solver solver(sim.circ);
-	
-			if (sim.ac)
-			{
-				auto &params = *sim.ac;
-				auto start_omega = 2 * M_PI * params.start;
-				auto stop_omega = 2 * M_PI * params.stop;
-				int steps = params.steps;
-				bool linear = params.exponent == 0 || params.exponent == 1;
-
-				// Sweep nieliniowy - określona liczba kroków
-				// na exponent-krotną zmianę częstotliwości
-				if (!linear)
-					steps = std::floor(params.steps * std::log(params.stop / params.start) / std::log(params.exponent));
-
-				// Wypisanie nagłówków
-				fout << "step\tfrequency\t";
-				for (const auto &p : sim.probes)
-					fout << p->get_name() << "\t";
-				fout << std::endl;
+		if (fstart <= 0 || fstop <= fstart || n <= 0)
+			throw std::runtime_error("Invalid " + command + " command parameter value");
+	}
+	catch (const std::exception &ex)
+	{
+		throw std::runtime_error("Malformed " + command + " command parameter");
+	}
 
-				for (int i = 0; i < steps; i++)
-				{
-					// Pulsacja dla tego kroku
-					double omega;
-					if (linear)
-						omega = start_omega + (stop_omega - start_omega) * i / (steps - 1);
-					else
-					{
-						auto s = std::log(start_omega) / std::log(params.exponent);
-						auto e = std::log(stop_omega) / std::log(params.exponent);
-						omega = std::pow(params.exponent, s + (e - s) * i / (steps - 1));
-					}
+	return ac_analysis_params{.start = fstart, .stop = fstop, .exponent = exponent, .steps = n};
+}
 
-					try
-					{
-						solver.solve(omega);
-					}
-					catch (const std::exception &ex)
-					{
-						throw std::runtime_error("Could not perform "s + std::to_string(i) 
-							+ " step of small signal AC analysis - reason: "s + ex.what());
-					}
+/**
+	\brief Tworzy symulację na podstawie pliku częściowo kompatybilnego z formatem SPICE
 
-					// Wypisanie mierzonych wartości
-					try
-					{
-						fout << i << "\t" << omega / 2.0 / M_PI << "\t"; 
-						for (const auto &p : sim.probes)
-						{
-							auto val = p->get_value(solver);
-							fout << val << "\t";
-						}
-						fout << std::endl;
-					}
-					catch (const std::exception &ex)
-					{
-						throw std::runtime_error("AC probing failed - reason: "s + ex.what());
-					}
-				}
-			}
-			else
+	Linie i tokeny są widokami na bufor wejścia, a wektor tokenów wykorzystywany jest ponownie
+	dla każdej linii. Elementy układu tworzone są dopiero po wczytaniu wszystkich parametrów -
+	zapamiętywane są widoki ich linii, które są wtedy dzielone na tokeny po raz drugi.
+
+	\param text Zawartość pliku (musi istnieć do końca wywołania)
+*/
+static circuit_simulation read_spice_file(std::string_view text)
+{
+	circuit_simulation sim;
+	line_reader reader(text);
+
+	// Pierwsza linia zawiera tytuł
+	std::string_view title;
+	if (reader.next(title))
+		sim.title = title;
+
+	// Wszystkie napotkane polecenia
+	std::vector<std::string_view> commands;
+
+	// Elementy układu (z numerami linii) - tworzone po wczytaniu wszystkich parametrów
+	std::vector<std::pair<int, std::string_view>> components;
+
+	// Nazwy parametrów (z numerami linii definicji) - wartości znane są dopiero po wyznaczeniu zależności
+	std::vector<std::pair<int, std::string>> param_lines;
+
+	int line_number = 1;
+	std::string_view line;
+	std::vector<std::string_view> tokens;
+	while (line_number++, reader.next(line))
+	{
+		tokenize(line, tokens);
+		if (!tokens.size()) continue;
+
+		// Definicje parametrów - wyrażenia mogą odwoływać się do parametrów definiowanych później
+		if (iequals(tokens[0], ".param"))
+		{
+			static const std::regex param_regex("\\s*([A-Za-z_]\\w*)\\s*=\\s*(\\{[^}]*\\}|[^\\s{}=]+)\\s*");
+			auto rest = rest_of_line(line, tokens[0]).substr(tokens[0].size());
+
+			std::cmatch match;
+			if (rest.find_first_not_of(" \t") == std::string_view::npos)
+				throw std::runtime_error("Invalid use of .param command! (line "s + std::to_string(line_number) + ")");
+
+			for (; !rest.empty(); rest.remove_prefix(match.length(0)))
 			{
+				if (!std::regex_search(rest.data(), rest.data() + rest.size(), match, param_regex, std::regex_constants::match_continuous))
+					throw std::runtime_error("Invalid use of .param command! (line "s + std::to_string(line_number) + ")");
+
 				try
 				{
-					solver.solve(0);
+					sim.params.define(match[1], {match[2].first, static_cast<std::size_t>(match[2].length())});
+					param_lines.emplace_back(line_number, match[1]);
 				}
 				catch (const std::exception &ex)
 				{
-					throw std::runtime_error(ex.what());
+					throw std::runtime_error("Could not parse parameter in line "s + std::to_string(line_number) + " - reason: " + ex.what());
 				}
+			}
+		}
+		// Polecenie SPICE do obsłużenia później
+		else if (tokens[0][0] == '.')
+			commands.push_back(line);
+		else // Element układu
+			components.emplace_back(line_number, line);
+	}
+
+	try
+	{
+		sim.params.resolve();
+	}
+	catch (const std::exception &ex)
+	{
+		throw std::runtime_error("Invalid parameters - reason: "s + ex.what());
+	}
+
+	for (const auto &[number, name] : param_lines)
+		if (!is_finite_value(sim.params.get_value(sim.params.find(name))))
+			throw std::runtime_error("Could not parse parameter in line "s + std::to_string(number)
+				+ " - reason: Value of parameter '" + name + "' is not finite");
+
+	std::string storage;
+	for (const auto &[number, component_line] : components)
+	{
+		tokenize(component_line, tokens);
+		auto [it, inserted] = sim.circ.try_emplace(std::string(tokens[0]));
+		if (!inserted)
+			throw std::runtime_error("Duplicate components found! (line "s + std::to_string(number) + ")");
+
+		const auto &ref = it->first;
+		try
+		{
+			group_braces(tokens);
+			auto wf = parse_waveform(component_line, tokens, storage, sim.params);
+			it->second = create_component(tokens, sim.params);
+			if (wf)
+				sim.waveforms.emplace(ref, *wf);
+			if (auto tol = parse_tolerance(tokens))
+				sim.tolerances[ref] = *tol;
+		}
+		catch (const std::exception &ex)
+		{
+			throw std::runtime_error("Could not parse component in line "s + std::to_string(number) + " - reason: " + ex.what());
+		}
+	}
+
+	// Interpretacja poleceń SPICE
+	for (const auto cmd : commands)
+	{
+		tokenize(cmd, tokens);
+		auto lowercase_command = tolower(tokens[0]);
+
+		if (lowercase_command == ".ac")
+		{
+			if (tokens.size() != 5)
+				throw std::runtime_error("Invalid use of .ac command!");
+
+			sim.ac = parse_frequency_sweep(tokens, 1, lowercase_command);
+		}
+		else if (lowercase_command == ".noise")
+		{
+			// .noise V(out[, ref]) SRC lin/dec/oct N fs fe
+			static const std::regex noise_regex("\\s*\\S+\\s+V\\(\\s*([^\\s,()]+)\\s*(,\\s*([^\\s,()]+)\\s*)?\\)(.*)",
+				std::regex_constants::icase);
+
+			std::cmatch match;
+			if (!std::regex_match(cmd.data(), cmd.data() + cmd.size(), match, noise_regex))
+				throw std::runtime_error("Invalid use of .noise command!");
+
+			std::vector<std::string_view> rest;
+			tokenize({match[4].first, static_cast<std::size_t>(match[4].length())}, rest);
+			if (rest.size() != 5)
+				throw std::runtime_error("Invalid use of .noise command!");
+
+			noise_analysis_params noise;
+			try
+			{
+				noise.pos = std::stoi(match[1]);
+				noise.neg = match[3].matched ? std::stoi(match[3]) : 0;
+			}
+			catch (const std::exception &ex)
+			{
+				throw std::runtime_error("Invalid node numbers in .noise command");
+			}
+
+			noise.input = rest[0];
+			noise.sweep = parse_frequency_sweep(rest, 1, lowercase_command);
+			sim.noise = noise;
+		}
+		else if (lowercase_command == ".tf")
+		{
+			// .tf V(out[, ref]) SRC
+			static const std::regex tf_regex("\\s*\\S+\\s+V\\(\\s*([^\\s,()]+)\\s*(,\\s*([^\\s,()]+)\\s*)?\\)\\s+(\\S+)\\s*",
+				std::regex_constants::icase);
+
+			std::cmatch match;
+			if (!std::regex_match(cmd.data(), cmd.data() + cmd.size(), match, tf_regex))
+				throw std::runtime_error("Invalid use of .tf command!");
+
+			transfer_function_params tf;
+			try
+			{
+				tf.pos = std::stoi(match[1]);
+				tf.neg = match[3].matched ? std::stoi(match[3]) : 0;
+			}
+			catch (const std::exception &ex)
+			{
+				throw std::runtime_error("Invalid node numbers in .tf command");
+			}
+
+			tf.input = match[4];
+			sim.tf = tf;
+		}
+		else if (lowercase_command == ".tran")
+		{
+			if (tokens.size() < 3 || tokens.size() > 5)
+				throw std::runtime_error("Invalid use of .tran command!");
+
+			transient_analysis_params tran;
+			try
+			{
+				tran.step = parse_si_number(tokens[1]);
+				tran.stop = parse_si_number(tokens[2]);
+				if (tokens.size() >= 4)
+					tran.start = parse_si_number(tokens[3]);
+				if (tokens.size() == 5)
+					tran.max_step = parse_si_number(tokens[4]);
+
+				if (tran.step <= 0 || tran.stop <= 0 || tran.start < 0 || tran.start > tran.stop || tran.max_step < 0)
+					throw std::runtime_error("Invalid .tran command parameter value");
+			}
+			catch (const std::exception &ex)
+			{
+				throw std::runtime_error("Malformed .tran command parameter");
+			}
+
+			sim.tran = tran;
+		}
+		else if (lowercase_command == ".pss")
+		{
+			if (tokens.size() != 3 && tokens.size() != 4)
+				throw std::runtime_error("Invalid use of .pss command!");
+
+			periodic_analysis_params pss;
+			try
+			{
+				pss.frequency = parse_si_number(tokens[1]);
+				pss.harmonics = parse_int(tokens[2]);
+				if (tokens.size() == 4)
+					pss.points = parse_int(tokens[3]);
+
+				if (pss.frequency <= 0 || pss.harmonics <= 0 || pss.points < 0)
+					throw std::runtime_error("Invalid .pss command parameter value");
+			}
+			catch (const std::exception &ex)
+			{
+				throw std::runtime_error("Malformed .pss command parameter");
+			}
+
+			sim.pss = pss;
+		}
+		else if (lowercase_command == ".response")
+		{
+			if (tokens.size() < 4 || tokens.size() > 6)
+				throw std::runtime_error("Invalid use of .response command!");
+
+			response_analysis_params response;
+			const auto kind = tolower(tokens[1]);
+			if (kind == "step")
+				response.kind = response_kind::STEP;
+			else if (kind == "impulse")
+				response.kind = response_kind::IMPULSE;
+			else
+				throw std::runtime_error("Invalid .response kind - must be 'step' or 'impulse'");
 
+			response.input = tokens[2];
+			try
+			{
+				response.stop = parse_si_number(tokens[3]);
+				if (tokens.size() >= 5)
+					response.points = parse_int(tokens[4]);
+				if (tokens.size() == 6)
+					response.contour_points = parse_int(tokens[5]);
+
+				if (response.stop <= 0 || response.points <= 0 || (tokens.size() == 6 && response.contour_points < 2))
+					throw std::runtime_error("Invalid .response command parameter value");
+			}
+			catch (const std::exception &ex)
+			{
+				throw std::runtime_error("Malformed .response command parameter");
+			}
+
+			sim.response = response;
+		}
+		else if (lowercase_command == ".dc")
+		{
+			if (tokens.size() != 5 && tokens.size() != 9)
+				throw std::runtime_error("Invalid use of .dc command!");
+
+			sim.dc.clear();
+			for (unsigned int i = 1; i < tokens.size(); i += 4)
+			{
+				sweep_range range;
 				try
 				{
-					for (const auto &p : sim.probes)
-					{
-						auto val = p->get_value(solver);
-						fout << p->get_name() << " = " << val << std::endl;
-					}
+					range.source = tokens[i];
+					range.start = parse_si_number(tokens[i + 1]);
+					range.stop = parse_si_number(tokens[i + 2]);
+					range.step = parse_si_number(tokens[i + 3]);
+
+					if (range.step == 0 || (range.stop - range.start) * range.step < 0)
+						throw std::runtime_error("Invalid .dc command parameter value");
+					range.get_point_count(); // Sprawdza, czy liczba punktów jest skończona
 				}
 				catch (const std::exception &ex)
 				{
-					throw std::runtime_error("DC probing failed - reason: "s + ex.what());
+					throw std::runtime_error("Malformed .dc command parameter");
 				}
+
+				sim.dc.push_back(range);
 			}
+
+			try
+			{
+				sweep_range::get_total_point_count(sim.dc);
+			}
+			catch (const std::exception &ex)
+			{
+				throw std::runtime_error("Too many points in .dc command!");
+			}
+		}
+		else if (lowercase_command == ".mc")
+		{
+			if (tokens.size() < 2)
+				throw std::runtime_error("Invalid use of .mc command!");
+
+			mc_analysis_params mc;
+			try
+			{
+				mc.samples = parse_int(tokens[1]);
+				if (mc.samples <= 0)
+					throw std::runtime_error("Invalid number of samples");
+
+				for (auto it = std::next(tokens.begin(), 2); it != tokens.end(); ++it)
+				{
+					auto param = tolower(*it);
+					auto eq = param.find('=');
+					auto name = param.substr(0, eq);
+					if (eq == std::string::npos)
+						throw std::runtime_error("Invalid parameter");
+
+					if (name == "seed")
+						mc.seed = std::stoull(param.substr(eq + 1));
+					else if (name == "freq")
+						mc.frequency = parse_si_number(it->substr(eq + 1));
+					else if (name == "bins")
+						mc.bins = std::stoi(param.substr(eq + 1));
+					else
+						throw std::runtime_error("Invalid parameter");
+				}
+
+				if (mc.frequency < 0 || mc.bins <= 0)
+					throw std::runtime_error("Invalid .mc command parameter value");
+			}
+			catch (const std::exception &ex)
+			{
+				throw std::runtime_error("Malformed .mc command parameter");
+			}
+
+			sim.mc = mc;
+		}
+		else if (lowercase_command == ".sens")
+		{
+			if (tokens.size() != 1)
+				throw std::runtime_error("Invalid use of .sens command!");
+
+			sim.sens = true;
+		}
+		else if (lowercase_command == ".reduce")
+		{
+			if (tokens.size() > 2 || (tokens.size() == 2 && tolower(tokens[1]) != "star"))
+				throw std::runtime_error("Invalid use of .reduce command!");
+
+			sim.reduce = tokens.size() == 2;
+		}
+		else if (lowercase_command == ".options")
+		{
+			for (auto it = std::next(tokens.begin()); it != tokens.end(); ++it)
+			{
+				auto option = tolower(*it);
+				auto eq = option.find('=');
+				auto name = option.substr(0, eq);
+
+				if (name == "threads" && eq != std::string::npos)
+				{
+					try
+					{
+						sim.threads = std::stoi(option.substr(eq + 1));
+						if (sim.threads < 0)
+							throw std::runtime_error("Negative thread count");
+					}
+					catch (const std::exception &ex)
+					{
+						throw std::runtime_error("Invalid value of .options threads!");
+					}
+				}
+				else if ((name == "reltol" || name == "vntol" || name == "abstol") && eq != std::string::npos)
+				{
+					double value;
+					try
+					{
+						value = parse_si_number(option.substr(eq + 1));
+					}
+					catch (const std::exception &ex)
+					{
+						value = 0;
+					}
+
+					if (!(value > 0))
+						throw std::runtime_error("Invalid value of .options " + name + "!");
+
+					auto &control = sim.step_tolerances;
+					(name == "reltol" ? control.reltol : name == "vntol" ? control.vntol : control.abstol) = value;
+				}
+				else if (name == "method" && eq != std::string::npos)
+				{
+					auto method = option.substr(eq + 1);
+					if (method == "trap")
+						sim.method = integration_method::TRAPEZOIDAL;
+					else if (method == "euler")
+						sim.method = integration_method::BACKWARD_EULER;
+					else
+						throw std::runtime_error("Invalid value of .options method!");
+				}
+				else
+					std::cerr << "Ignoring option '" << name << "'..." << std::endl;
+			}
+		}
+		else if (lowercase_command == ".print")
+		{
+			// Nazwy na różne typy interpretacji zespolonych wielkości fizycznych
+			const static std::map<std::string, complex_probing_method> complex_probing_names =
+			{
+				{"", complex_probing_method::DEFAULT},
+				{"re", complex_probing_method::REAL},
+				{"im", complex_probing_method::IMAGINARY},
+				{"mag", complex_probing_method::MAGNITUDE},
+				{"ph", complex_probing_method::PHASE},
+			};
+
+			static const std::regex probe_regex("([VPI])(re|im|mag|ph)?\\(\\s*([^\\s,]*)(\\s*,\\s*([^\\s,]*))?\\s*\\)",
+				std::regex_constants::icase);
+
+			std::cmatch match;
+			for (auto str = cmd; std::regex_search(str.data(), str.data() + str.size(), match, probe_regex); str.remove_prefix(match.suffix().first - str.data()))
+			{
+				auto probe_type = tolower(match[1].str());
+				auto probing_method_name = tolower(match[2].str());
+			
+				// Metoda pomiaru wielkości zespolonej
+				auto probing_method = complex_probing_method::DEFAULT;
+				if (auto it = complex_probing_names.find(probing_method_name); it != complex_probing_names.end())
+					probing_method = it->second;
+				else
+					throw std::runtime_error("Invalid probing method '"s + probing_method_name + "'");
+
+				try
+				{ 
+					// Pomiar napięcia
+					if (probe_type == "v")
+					{
+						int pos, neg = 0;
+						try
+						{
+							pos = std::stoi(match[3]);
+							if (!match[4].str().empty())
+								neg = std::stoi(match[5]);
+						}
+						catch (const std::exception &ex)
+						{
+							throw std::runtime_error("Invalid node numbers in '"s + std::string(cmd) + "'");
+						}
+
+						sim.probes.push_back(std::make_shared<voltage_probe>(pos, neg, probing_method));
+					}
+
+					// Pomiar prądu
+					if (probe_type == "i") 
+						sim.probes.push_back(std::make_shared<current_probe>(sim.circ, match[3], probing_method));
+
+					// Pomiar mocy
+					if (probe_type == "p") 
+						sim.probes.push_back(std::make_shared<power_probe>(sim.circ, match[3], probing_method));
+				}
+				catch (const std::exception &ex)
+				{
+					throw std::runtime_error("Could not probe '"s + std::string(cmd) + "' - reason: "s + ex.what());
+				}
+			}
+		}
+		else
+		{
+			std::cerr << "Ignoring command '" << lowercase_command << "'..." << std::endl;
+		}
+	}
+
+	return sim;
+}
+
+/**
+	\brief Upraszcza obwód z zachowaniem mierzonych elementów (napięcia usuniętych węzłów są odtwarzane)
+
+	\param reduction Uproszczony obwód (pozostaje pusty, jeżeli analiza wymaga oryginalnego obwodu)
+*/
+static void reduce_circuit(const circuit_simulation &sim, bool nonlinear, std::optional<network_reduction> &reduction)
+{
+	if (!sim.reduce)
+		return;
+
+	if (sim.sens)
+		std::cerr << "Ignoring .reduce command - sensitivity analysis requires the original circuit..." << std::endl;
+	else if (sim.mc)
+		std::cerr << "Ignoring .reduce command - Monte Carlo analysis requires the original circuit..." << std::endl;
+	else if (sim.noise)
+		std::cerr << "Ignoring .reduce command - noise analysis requires the original resistors..." << std::endl;
+	else if (sim.tran)
+		std::cerr << "Ignoring .reduce command - transient analysis requires the original reactive components..." << std::endl;
+	else if (nonlinear)
+		std::cerr << "Ignoring .reduce command - not supported in circuits with nonlinear devices..." << std::endl;
+	else
+	{
+		std::set<int> kept_nodes;
+		std::set<std::string> kept_components;
+		for (const auto &p : sim.probes)
+			p->get_dependencies(kept_nodes, kept_components);
+
+		// Węzły wyjściowe funkcji przejścia
+		if (sim.tf)
+			kept_nodes.insert({sim.tf->pos, sim.tf->neg});
+
+		// Wartości elementów zależnych od parametrów mogą być zmieniane w analizie DC
+		if (!sim.dc.empty())
+			for (int t = 0; t < sim.params.get_target_count(); t++)
+				kept_components.insert(sim.params.get_target_name(t));
+
+		reduction.emplace(sim.circ, kept_nodes, kept_components, *sim.reduce);
+		for (const auto &p : sim.probes)
+			p->set_reduction(&*reduction);
+		std::cerr << "Network reduction eliminated " << reduction->get_eliminated_count() << " nodes..." << std::endl;
+	}
+}
+
+/**
+	\brief Wypisuje nagłówek tabeli wyników - kolumny argumentu, mierzone wielkości i ich wrażliwości
+
+	\param columns Nagłówki kolumn poprzedzających pomiary (zakończone tabulatorem)
+*/
+static void print_header(std::ostream &fout, std::string_view columns, const circuit_simulation &sim,
+	const std::vector<std::string> &sens_params = {})
+{
+	fout << columns;
+	for (const auto &p : sim.probes)
+		fout << p->get_name() << "\t";
+	for (const auto &p : sim.probes)
+		for (const auto &ref : sens_params)
+			fout << "d" << p->get_name() << "/d" << ref << "\t";
+	fout << std::endl;
+}
+
+/**
+	\brief Wypisuje wiersz wyników analizy w dziedzinie czasu
+*/
+static void print_time_point(std::ostream &fout, int step, const transient_state &state, const circuit_simulation &sim)
+{
+	fout << step << "\t" << state.get_time() << "\t";
+	for (const auto &p : sim.probes)
+		fout << p->get_value(state) << "\t";
+	fout << std::endl;
+}
+
+/**
+	\brief Wypisuje nagłówek tabeli wyników analizy DC (numer punktu i przemiatane źródła)
+*/
+static void print_dc_header(std::ostream &fout, const circuit_simulation &sim, const std::vector<std::string> &sens_params = {})
+{
+	std::string columns = "step\t";
+	for (const auto &r : sim.dc)
+		columns.append(r.source).append("\t");
+	print_header(fout, columns, sim, sens_params);
+}
+
+/**
+	\brief Punkt pracy układu nieliniowego
+*/
+static void run_nonlinear_operating_point(const circuit_simulation &sim, newton_solver &newton, task_scheduler &scheduler, std::ostream &fout)
+{
+	const transient_state *state = nullptr;
+	try
+	{
+		scheduler.run([&]{state = &newton.solve();});
+	}
+	catch (const std::exception &ex)
+	{
+		throw std::runtime_error("Nonlinear DC analysis failed - reason: "s + ex.what());
+	}
+
+	try
+	{
+		for (const auto &p : sim.probes)
+			fout << p->get_name() << " = " << p->get_value(*state) << std::endl;
+	}
+	catch (const std::exception &ex)
+	{
+		throw std::runtime_error("DC probing failed - reason: "s + ex.what());
+	}
+}
+
+/**
+	\brief Analiza DC układu nieliniowego - punkty rozwiązywane są po kolei metodą Newtona-Raphsona
+
+	Rozwiązanie poprzedniego punktu jest przybliżeniem początkowym następnego.
+
+	\param plan Plan, w którym zmieniane są wartości przemiatanych źródeł (rozwiązywany przez newton)
+*/
+static void run_nonlinear_dc_sweep(const circuit_simulation &sim, solve_plan &plan, newton_solver &newton,
+	task_scheduler &scheduler, std::ostream &fout)
+{
+	using kind = solve_plan::component_kind;
+	std::vector<solve_plan::component_ref> swept;
+	const int count = sweep_range::get_total_point_count(sim.dc);
+	for (const auto &r : sim.dc)
+	{
+		auto it = plan.get_names().find(r.source);
+		if (it == plan.get_names().end() || (it->second.kind != kind::VOLTAGE_SOURCE && it->second.kind != kind::CURRENT_SOURCE))
+			throw std::runtime_error("Swept source '" + r.source + "' is not an independent source "
+				"(parameter sweeps are not supported in circuits with nonlinear devices)");
+		swept.push_back(it->second);
+	}
+
+	print_dc_header(fout, sim);
+
+	scheduler.run([&]{
+		std::vector<double> values(sim.dc.size());
+		for (int point = 0; point < count; point++)
+		{
+			sweep_range::get_point_values(sim.dc, point, values);
+			for (unsigned int r = 0; r < sim.dc.size(); r++)
+				plan.set_value(swept[r], values[r]);
+
+			try
+			{
+				const auto &state = newton.solve();
+				fout << point << "\t";
+				for (auto v : values)
+					fout << v << "\t";
+				for (const auto &p : sim.probes)
+					fout << p->get_value(state) << "\t";
+				fout << std::endl;
+			}
+			catch (const std::exception &ex)
+			{
+				throw std::runtime_error("Nonlinear DC sweep failed at point "s + std::to_string(point) + " - reason: " + ex.what());
+			}
+		}
+	});
+}
+
+/**
+	\brief Analiza układu z elementami nieliniowymi (punkt pracy lub analiza DC)
+*/
+static void run_nonlinear_analysis(const circuit_simulation &sim, const circuit_solver &solver, task_scheduler &scheduler, std::ostream &fout)
+{
+	if (sim.mc || sim.ac || sim.noise || sim.tran || sim.pss || sim.response)
+		throw std::runtime_error("Circuits with nonlinear devices support only DC operating point and DC sweep analyses");
+	if (sim.sens)
+		std::cerr << "Ignoring .sens command - not supported in circuits with nonlinear devices..." << std::endl;
+	if (sim.tf)
+		std::cerr << "Ignoring .tf command - not supported in circuits with nonlinear devices..." << std::endl;
+
+	// Wartości przemiatanych źródeł zmieniane są w prywatnej kopii planu
+	auto plan = std::make_shared<solve_plan>(*solver.get_plan());
+	newton_solver newton(plan);
+
+	if (sim.dc.empty())
+		run_nonlinear_operating_point(sim, newton, scheduler, fout);
+	else
+		run_nonlinear_dc_sweep(sim, *plan, newton, scheduler, fout);
+}
+
+/**
+	\brief Analiza Monte Carlo - statystyki i histogramy mierzonych wielkości
+*/
+static void run_monte_carlo_analysis(const circuit_simulation &sim, const circuit &solved_circ, const circuit_solver &solver,
+	task_scheduler &scheduler, std::ostream &fout)
+{
+	auto &params = *sim.mc;
+	if (sim.ac)
+		std::cerr << "Ignoring .ac command - Monte Carlo analysis is performed at a single frequency..." << std::endl;
+	if (sim.sens)
+		std::cerr << "Ignoring .sens command - not supported in Monte Carlo analysis..." << std::endl;
+	if (!sim.dc.empty())
+		std::cerr << "Ignoring .dc command - Monte Carlo analysis is performed at a single frequency..." << std::endl;
+	if (sim.noise)
+		std::cerr << "Ignoring .noise command - only one analysis can be performed..." << std::endl;
+	if (sim.tf)
+		std::cerr << "Ignoring .tf command - only one analysis can be performed..." << std::endl;
+	if (sim.tran || sim.pss || sim.response)
+		std::cerr << "Ignoring .tran, .pss and .response commands - only one analysis can be performed..." << std::endl;
+
+	// Pomiary kompilowane są raz dla wszystkich prób
+	measurement_set measurements(solver.get_plan());
+	try
+	{
+		for (const auto &p : sim.probes)
+			p->bind(measurements, solved_circ);
+	}
+	catch (const std::exception &ex)
+	{
+		throw std::runtime_error("Monte Carlo probing failed - reason: "s + ex.what());
+	}
+
+	std::vector<streaming_statistics> stats;
+	try
+	{
+		monte_carlo mc(solver.get_plan(), sim.tolerances);
+		stats = mc.run(scheduler, params.samples, params.seed, 2 * M_PI * params.frequency,
+			sim.probes.size(), params.bins, [&](const solve_context &ctx, double *values){
+				// Próby rozwiązywane są równolegle - każdy wątek ma własny bufor wielkości
+				thread_local std::vector<std::complex<double>> measured;
+				measurements.evaluate(ctx, measured);
+				for (unsigned int i = 0; i < sim.probes.size(); i++)
+					values[i] = sim.probes[i]->get_bound_value(measured, ctx);
+			});
+	}
+	catch (const std::exception &ex)
+	{
+		throw std::runtime_error("Monte Carlo analysis failed - reason: "s + ex.what());
+	}
+
+	// Statystyki mierzonych wielkości
+	fout << "probe\tmean\tsigma\tmin\t";
+	for (auto p : streaming_statistics::percentiles)
+		fout << "p" << p << "\t";
+	fout << "max\t" << std::endl;
+
+	for (unsigned int i = 0; i < sim.probes.size(); i++)
+	{
+		const auto &st = stats[i];
+		fout << sim.probes[i]->get_name() << "\t" << st.get_mean() << "\t" << st.get_sigma() << "\t" << st.get_min() << "\t";
+		for (unsigned int j = 0; j < streaming_statistics::percentiles.size(); j++)
+			fout << st.get_percentile(j) << "\t";
+		fout << st.get_max() << "\t" << std::endl;
+	}
+
+	// Histogramy (bez pustych przedziałów na krańcach)
+	for (unsigned int i = 0; i < sim.probes.size(); i++)
+	{
+		const auto &hist = stats[i].get_histogram();
+		auto counts = hist.get_counts();
+		auto first = std::find_if(counts.begin(), counts.end(), [](auto c){return c != 0;}) - counts.begin();
+		auto last = counts.rend() - std::find_if(counts.rbegin(), counts.rend(), [](auto c){return c != 0;});
+
+		fout << std::endl << "histogram\t" << sim.probes[i]->get_name() << std::endl;
+		fout << "from\tto\tcount" << std::endl;
+		for (auto j = first; j < last; j++)
+			fout << hist.get_lower() + j * hist.get_bin_width() << "\t"
+				<< hist.get_lower() + (j + 1) * hist.get_bin_width() << "\t" << counts[j] << std::endl;
+	}
+}
+
+/**
+	\brief Analiza szumów - gęstości widmowe dla kolejnych częstotliwości i wartości skuteczne w paśmie
+*/
+static void run_noise_analysis(const circuit_simulation &sim, const circuit_solver &solver, task_scheduler &scheduler, std::ostream &fout)
+{
+	auto &params = *sim.noise;
+	if (sim.ac || !sim.dc.empty() || sim.tf || sim.tran || sim.pss || sim.response)
+		std::cerr << "Ignoring .ac, .dc, .tf, .tran, .pss and .response commands - only one analysis can be performed..." << std::endl;
+	if (sim.sens)
+		std::cerr << "Ignoring .sens command - not supported in noise analysis..." << std::endl;
+
+	std::vector<double> frequencies(params.sweep.get_step_count());
+	for (unsigned int i = 0; i < frequencies.size(); i++)
+		frequencies[i] = params.sweep.get_omega(i, frequencies.size()) / 2.0 / M_PI;
+
+	std::vector<noise_point> points;
+	std::optional<noise_analysis> noise;
+	try
+	{
+		noise.emplace(solver.get_plan(), params.pos, params.neg, params.input);
+		points = noise->run(scheduler, frequencies);
+	}
+	catch (const std::exception &ex)
+	{
+		throw std::runtime_error("Noise analysis failed - reason: "s + ex.what());
+	}
+
+	// Gęstości widmowe szumów (pierwiastki gęstości widmowych mocy) dla kolejnych częstotliwości
+	const auto &sources = noise->get_sources();
+	fout << "step\tfrequency\tonoise\tinoise\t";
+	for (const auto &ref : sources)
+		fout << ref << "\t";
+	fout << std::endl;
+
+	for (unsigned int i = 0; i < points.size(); i++)
+	{
+		const auto &pt = points[i];
+		fout << i << "\t" << pt.frequency << "\t" << std::sqrt(pt.output) << "\t" << std::sqrt(pt.input()) << "\t";
+		for (auto c : pt.contributions)
+			fout << std::sqrt(c) << "\t";
+		fout << std::endl;
+	}
+
+	// Wartości skuteczne szumów w całym paśmie
+	auto totals = noise_analysis::integrate(points);
+	fout << std::endl << "total\tonoise\tinoise\t";
+	for (const auto &ref : sources)
+		fout << ref << "\t";
+	fout << std::endl << "\t" << totals.output << "\t" << totals.input << "\t";
+	for (auto c : totals.contributions)
+		fout << c << "\t";
+	fout << std::endl;
+}
+
+/**
+	\brief Analiza stanów nieustalonych (ze stałym lub zmiennym krokiem całkowania)
+*/
+static void run_transient_analysis(const circuit_simulation &sim, const circuit_solver &solver, task_scheduler &scheduler, std::ostream &fout)
+{
+	auto &params = *sim.tran;
+	if (sim.ac || !sim.dc.empty() || sim.tf || sim.pss || sim.response)
+		std::cerr << "Ignoring .ac, .dc, .tf, .pss and .response commands - only one analysis can be performed..." << std::endl;
+	if (sim.sens)
+		std::cerr << "Ignoring .sens command - not supported in transient analysis..." << std::endl;
+
+	print_header(fout, "step\ttime\t", sim);
+
+	try
+	{
+		transient_analysis tran(solver.get_plan(), sim.waveforms, sim.method);
+		auto visit = [&](int step, const transient_state &state){
+			print_time_point(fout, step, state, sim);
+		};
+
+		// Podanie największego kroku włącza zmienny krok całkowania
+		auto control = sim.step_tolerances;
+		control.max_step = params.max_step;
+		scheduler.run([&]{
+			if (control.max_step > 0)
+				tran.run_adaptive(params.step, params.stop, params.start, control, visit);
+			else
+				tran.run(params.step, params.stop, params.start, visit);
+		});
+	}
+	catch (const std::exception &ex)
+	{
+		throw std::runtime_error("Transient analysis failed - reason: "s + ex.what());
+	}
+}
+
+/**
+	\brief Analiza okresowego stanu ustalonego
+*/
+static void run_periodic_analysis(const circuit_simulation &sim, const circuit_solver &solver, task_scheduler &scheduler, std::ostream &fout)
+{
+	auto &params = *sim.pss;
+	if (sim.ac || !sim.dc.empty() || sim.tf || sim.response)
+		std::cerr << "Ignoring .ac, .dc, .tf and .response commands - only one analysis can be performed..." << std::endl;
+	if (sim.sens)
+		std::cerr << "Ignoring .sens command - not supported in periodic steady state analysis..." << std::endl;
+
+	print_header(fout, "step\ttime\t", sim);
+
+	try
+	{
+		periodic_steady_state pss(solver.get_plan(), sim.waveforms, params.frequency, params.harmonics);
+		pss.run(scheduler, params.points, [&](int step, const transient_state &state){
+			print_time_point(fout, step, state, sim);
+		});
+	}
+	catch (const std::exception &ex)
+	{
+		throw std::runtime_error("Periodic steady state analysis failed - reason: "s + ex.what());
+	}
+}
+
+/**
+	\brief Odpowiedź skokowa lub impulsowa wyznaczana przez odwrotną transformatę Laplace'a
+*/
+static void run_response_analysis(const circuit_simulation &sim, const circuit_solver &solver, task_scheduler &scheduler, std::ostream &fout)
+{
+	auto &params = *sim.response;
+	if (sim.ac || !sim.dc.empty() || sim.tf)
+		std::cerr << "Ignoring .ac, .dc and .tf commands - only one analysis can be performed..." << std::endl;
+	if (sim.sens)
+		std::cerr << "Ignoring .sens command - not supported in step response analysis..." << std::endl;
+
+	print_header(fout, "step\ttime\t", sim);
+
+	try
+	{
+		laplace_response response(solver.get_plan(), params.input, params.kind, params.contour_points);
+		const bool reliable = response.run(scheduler, params.stop, params.points, [&](int step, const transient_state &state){
+			print_time_point(fout, step, state, sim);
+		});
+
+		if (!reliable)
+			std::cerr << "Step response results may be inaccurate (weakly damped oscillations?) - "
+				"consider shorter tstop or .tran analysis..." << std::endl;
+	}
+	catch (const std::exception &ex)
+	{
+		throw std::runtime_error("Step response analysis failed - reason: "s + ex.what());
+	}
+}
+
+/**
+	\brief Analiza małosygnałowa AC (kroki wykonywane są równolegle)
+*/
+static void run_ac_analysis(const circuit_simulation &sim, const circuit &solved_circ, const circuit_solver &solver,
+	const std::vector<std::string> &sens_params, task_scheduler &scheduler, std::ostream &fout)
+{
+	auto &params = *sim.ac;
+	if (!sim.dc.empty() || sim.tf)
+		std::cerr << "Ignoring .dc and .tf commands - only one analysis can be performed..." << std::endl;
+
+	const int steps = params.get_step_count();
+
+	// Pomiary kompilowane są raz dla całego sweep'a
+	measurement_set measurements(solver.get_plan());
+	try
+	{
+		for (const auto &p : sim.probes)
+			p->bind(measurements, solved_circ);
+	}
+	catch (const std::exception &ex)
+	{
+		throw std::runtime_error("AC probing failed - reason: "s + ex.what());
+	}
+
+	print_header(fout, "step\tfrequency\t", sim, sens_params);
+
+	// Kroki wykonywane są równolegle - każdy krok ma własny kontekst analizy
+	ordered_executor executor(scheduler);
+	executor.run(steps, [&](int i, std::ostream &out){
+		solve_context ctx(solver.get_plan());
+		std::vector<std::complex<double>> values;
+
+		// Pulsacja dla tego kroku
+		const double omega = params.get_omega(i, steps);
+
+		try
+		{
+			ctx.solve(omega);
+		}
+		catch (const std::exception &ex)
+		{
+			throw std::runtime_error("Could not perform "s + std::to_string(i) 
+				+ " step of small signal AC analysis - reason: "s + ex.what());
+		}
+
+		// Wypisanie mierzonych wartości
+		try
+		{
+			measurements.evaluate(ctx.get_solution(), omega, values);
+			out << i << "\t" << omega / 2.0 / M_PI << "\t"; 
+			for (const auto &p : sim.probes)
+				out << p->get_bound_value(values, ctx) << "\t";
+			if (sim.sens)
+				for (const auto &p : sim.probes)
+				{
+					auto sens = p->get_sensitivity(ctx);
+					for (const auto &ref : sens_params)
+						out << sens.at(ref) << "\t";
+				}
+			out << std::endl;
+		}
+		catch (const std::exception &ex)
+		{
+			throw std::runtime_error("AC probing failed - reason: "s + ex.what());
+		}
+	}, fout);
+}
+
+/**
+	\brief Analiza DC ze zmianą wartości źródeł lub parametrów (.dc)
+*/
+static void run_dc_sweep(const circuit_simulation &sim, const circuit &solved_circ, const circuit_solver &solver,
+	const std::vector<std::string> &sens_params, task_scheduler &scheduler, std::ostream &fout)
+{
+	if (sim.tf)
+		std::cerr << "Ignoring .tf command - only one analysis can be performed..." << std::endl;
+
+	// Macierz rozkładana jest raz - punkty różnią się tylko wektorem wyrazów wolnych
+	std::optional<dc_sweep> sweep;
+	try
+	{
+		sweep.emplace(solver.get_plan(), sim.dc, sim.params);
+	}
+	catch (const std::exception &ex)
+	{
+		throw std::runtime_error("Invalid DC sweep - reason: "s + ex.what());
+	}
+
+	// Pomiary kompilowane są raz dla całej analizy
+	measurement_set measurements(solver.get_plan());
+	try
+	{
+		for (const auto &p : sim.probes)
+			p->bind(measurements, solved_circ);
+	}
+	catch (const std::exception &ex)
+	{
+		throw std::runtime_error("DC sweep probing failed - reason: "s + ex.what());
+	}
+
+	print_dc_header(fout, sim, sens_params);
+
+	scheduler.run([&]{
+		std::vector<std::complex<double>> measured;
+		sweep->run([&](int point, const std::vector<double> &values, const solve_context &ctx){
+			try
+			{
+				measurements.evaluate(ctx, measured);
+				fout << point << "\t";
+				for (auto v : values)
+					fout << v << "\t";
+				for (const auto &p : sim.probes)
+					fout << p->get_bound_value(measured, ctx) << "\t";
+				if (sim.sens)
+					for (const auto &p : sim.probes)
+					{
+						auto sens = p->get_sensitivity(ctx);
+						for (const auto &ref : sens_params)
+							fout << sens.at(ref) << "\t";
+					}
+				fout << std::endl;
+			}
+			catch (const std::exception &ex)
+			{
+				throw std::runtime_error("DC sweep probing failed - reason: "s + ex.what());
+			}
+		});
+	});
+}
+
+/**
+	\brief Punkt pracy (wraz z wrażliwościami i funkcją przejścia .tf)
+*/
+static void run_operating_point(const circuit_simulation &sim, circuit_solver &solver,
+	const std::vector<std::string> &sens_params, task_scheduler &scheduler, std::ostream &fout)
+{
+	try
+	{
+		scheduler.run([&]{solver.solve(0);});
+	}
+	catch (const std::exception &ex)
+	{
+		throw std::runtime_error(ex.what());
+	}
+
+	try
+	{
+		for (const auto &p : sim.probes)
+		{
+			auto val = p->get_value(solver.get_context());
+			fout << p->get_name() << " = " << val << std::endl;
+		}
+
+		if (sim.sens)
+			for (const auto &p : sim.probes)
+			{
+				auto sens = p->get_sensitivity(solver.get_context());
+				for (const auto &ref : sens_params)
+					fout << "d" << p->get_name() << "/d" << ref << " = " << sens.at(ref) << std::endl;
+			}
+	}
+	catch (const std::exception &ex)
+	{
+		throw std::runtime_error("DC probing failed - reason: "s + ex.what());
+	}
+
+	// Funkcja przejścia w punkcie pracy
+	if (!sim.tf)
+		return;
+
+	const auto &params = *sim.tf;
+	transfer_function_result tf;
+	try
+	{
+		transfer_function_analysis analysis(solver.get_plan(), params.pos, params.neg, params.input);
+		scheduler.run([&]{tf = analysis.solve();});
+	}
+	catch (const std::exception &ex)
+	{
+		throw std::runtime_error("Transfer function analysis failed - reason: "s + ex.what());
+	}
+
+	auto output = "V(" + std::to_string(params.pos) + (params.neg ? "," + std::to_string(params.neg) : ""s) + ")";
+	fout << output << "/" << params.input << " = " << tf.gain << std::endl;
+	fout << "Rin(" << params.input << ") = " << tf.input_resistance << std::endl;
+	fout << "Rout(" << output << ") = " << tf.output_resistance << std::endl;
+}
+
+/**
+	\brief Funkcja main dla rozszerzonej wersji programu
+*/
+int main_extended(int argc, char *argv[])
+{
+	auto &fout = std::cout;
+
+	// Liczba wątków podana w linii poleceń (-j N) ma pierwszeństwo przed .options threads=N
+	std::optional<int> threads;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg.rfind("-j", 0) != 0)
+		{
+			std::cerr << "Ignoring argument '" << arg << "'..." << std::endl;
+			continue;
+		}
+
+		try
+		{
+			threads = std::stoi(arg.size() > 2 ? arg.substr(2) : std::string{i + 1 < argc ? argv[++i] : ""});
+			if (*threads < 0)
+				throw std::runtime_error("Negative thread count");
+		}
+		catch (const std::exception &ex)
+		{
+			std::cerr << "Invalid thread count in '-j' option" << std::endl;
+			return 1;
+		}
+	}
+
+	try
+	{
+		// Bufor musi istnieć tylko w czasie analizy pliku - symulacja przechowuje kopie potrzebnych nazw
+		auto sim = read_spice_file(netlist_buffer(STDIN_FILENO).text());
+
+		// Elementy nieliniowe wymagają analizy metodą Newtona-Raphsona
+		const bool nonlinear = std::any_of(sim.circ.begin(), sim.circ.end(), [](const auto &c){
+			return std::holds_alternative<const nonlinear_component*>(c.second->view());
+		});
+
+		try
+		{
+			std::optional<network_reduction> reduction;
+			reduce_circuit(sim, nonlinear, reduction);
+
+			const auto &solved_circ = reduction ? reduction->get_circuit() : sim.circ;
+			circuit_solver solver(solved_circ);
+
+			// Wspólny planista zadań dla wszystkich analiz
+			task_scheduler scheduler(threads ? *threads : sim.threads);
+
+			// Elementy, po których wartościach liczone są wrażliwości
+			std::vector<std::string> sens_params;
+			if (sim.sens)
+				for (const auto &[ref, comp_ptr] : sim.circ)
+					if (dynamic_cast<const passive_component*>(comp_ptr.get()))
+						sens_params.push_back(ref);
+
+			// Wykonywana jest jedna analiza - pierwsza według kolejności poniżej
+			if (nonlinear)
+				run_nonlinear_analysis(sim, solver, scheduler, fout);
+			else if (sim.mc)
+				run_monte_carlo_analysis(sim, solved_circ, solver, scheduler, fout);
+			else if (sim.noise)
+				run_noise_analysis(sim, solver, scheduler, fout);
+			else if (sim.tran)
+				run_transient_analysis(sim, solver, scheduler, fout);
+			else if (sim.pss)
+				run_periodic_analysis(sim, solver, scheduler, fout);
+			else if (sim.response)
+				run_response_analysis(sim, solver, scheduler, fout);
+			else if (sim.ac)
+				run_ac_analysis(sim, solved_circ, solver, sens_params, scheduler, fout);
+			else if (!sim.dc.empty())
+				run_dc_sweep(sim, solved_circ, solver, sens_params, scheduler, fout);
+			else
+				run_operating_point(sim, solver, sens_params, scheduler, fout);
 		}
 		catch (const std::exception &ex)
 		{
@@ -0,0 +1,302 @@
+#include "laplace.hpp"
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <stdexcept>
+
+/**
+	\file laplace.cpp
+	\brief Implementacja \ref laplace_response
+	\author Jacek Wieczorek
+*/
+
+/**
+	\brief Przygotowuje analizę
+
+	\param plan Plan rozwiązania układu
+	\param input Nazwa źródła wejściowego (SEM lub SPM)
+	\param excitation Rodzaj pobudzenia
+	\param contour_points Liczba punktów konturu Talbota \f$ M \f$ (0 - dobierana automatycznie)
+	\throws std::runtime_error jeżeli źródło wejściowe nie istnieje lub nie jest niezależnym źródłem
+*/
+laplace_response::laplace_response(std::shared_ptr<const solve_plan> plan, const std::string &input, response_kind kind,
+	int contour_points) :
+	m_kind(kind),
+	m_contour_points(contour_points)
+{
+	using kind_t = solve_plan::component_kind;
+	const auto &names = plan->get_names();
+
+	if (contour_points != 0 && contour_points < 2)
+		throw std::runtime_error("Invalid number of Talbot contour points");
+
+	auto it = names.find(input);
+	if (it == names.end())
+		throw std::runtime_error("Input source '" + input + "' does not exist");
+	if (it->second.kind != kind_t::VOLTAGE_SOURCE && it->second.kind != kind_t::CURRENT_SOURCE)
+		throw std::runtime_error("Component '" + input + "' is not an independent source");
+	m_input = it->second;
+
+	// Pobudzane jest tylko źródło wejściowe
+	auto copy = std::make_shared<solve_plan>(*plan);
+	const auto &st = copy->get_components();
+	for (int i = 0; i < st.voltage_sources.size(); i++)
+		copy->set_ac_value({kind_t::VOLTAGE_SOURCE, i}, 0.0);
+	for (int i = 0; i < st.current_sources.size(); i++)
+		copy->set_ac_value({kind_t::CURRENT_SOURCE, i}, 0.0);
+	copy->set_ac_value(m_input, 1.0);
+	m_plan = std::move(copy);
+}
+
+/**
+	\brief Wyznacza transformaty wszystkich zmiennych układu dla zadanej zmiennej s
+
+	Zmienne to kolejno potencjały węzłów, prądy gałęzi (\ref solve_plan::branch_index()), prądy cewek
+	i kondensatorów.
+	Transformaty przemnażane są przez transformatę pobudzenia.
+
+	\param s Zmienna zespolona transformaty Laplace'a
+	\param excitation Rodzaj pobudzenia
+	\param problem Bufor problemu MNA (wykorzystywany ponownie)
+	\param values Transformaty zmiennych układu
+*/
+void laplace_response::transform(std::complex<double> s, response_kind excitation, mna::mna_problem &problem, spectrum &values) const
+{
+	using kind = solve_plan::component_kind;
+
+	const auto &st = m_plan->get_components();
+	const int node_count = m_plan->get_node_count();
+
+	m_plan->assemble(s, problem);
+	auto solution = problem.solve();
+	if (solution.get_node_count() != node_count)
+		throw std::runtime_error("Invalid Laplace domain equation system");
+
+	const auto &x = solution.get_matrix();
+	const auto U = excitation == response_kind::STEP ? 1.0 / s : 1.0;
+	const int branch_count = m_plan->get_branch_count();
+	auto out = values.begin();
+
+	for (int i = 0; i < node_count + branch_count; i++)
+		*out++ = x(i, 0) * U;
+
+	auto voltage = [&](int a, int b){
+		return (a < 0 ? 0.0 : x(a, 0)) - (b < 0 ? 0.0 : x(b, 0));
+	};
+	for (int i = 0; i < st.inductors.size(); i++)
+		*out++ = voltage(st.inductors.a[i], st.inductors.b[i]) * m_plan->passive_admittance(kind::INDUCTOR, i, s) * U;
+	for (int i = 0; i < st.capacitors.size(); i++)
+		*out++ = voltage(st.capacitors.a[i], st.capacitors.b[i]) * m_plan->passive_admittance(kind::CAPACITOR, i, s) * U;
+}
+
+/**
+	\brief Wyznacza stan układu w chwili t > 0 (metoda Talbota ze stałym konturem)
+
+	\param t Chwila [s]
+	\param M Liczba punktów konturu
+	\param excitation Rodzaj pobudzenia
+	\param problem Bufor problemu MNA (wykorzystywany ponownie)
+*/
+transient_state laplace_response::evaluate(double t, int M, response_kind excitation, mna::mna_problem &problem) const
+{
+	const auto &st = m_plan->get_components();
+	const int node_count = m_plan->get_node_count();
+	const int branch_count = m_plan->get_branch_count();
+	const int variable_count = node_count + branch_count + st.inductors.size() + st.capacitors.size();
+
+	const double r = 2.0 * M / (5.0 * t);
+
+	std::vector<double> f(variable_count);
+	spectrum F(variable_count);
+
+	// Punkt konturu na osi rzeczywistej
+	transform(r, excitation, problem, F);
+	const double w0 = 0.5 * std::exp(r * t);
+	for (int v = 0; v < variable_count; v++)
+		f[v] = w0 * F[v].real();
+
+	for (int k = 1; k < M; k++)
+	{
+		const double theta = k * M_PI / M;
+		const double cot = 1.0 / std::tan(theta);
+		const std::complex<double> s = r * theta * std::complex<double>{cot, 1.0};
+		const double sigma = theta + (theta * cot - 1.0) * cot;
+		const auto w = std::exp(t * s) * std::complex<double>{1.0, sigma};
+
+		transform(s, excitation, problem, F);
+		for (int v = 0; v < variable_count; v++)
+			f[v] += (w * F[v]).real();
+	}
+
+	transient_state state;
+	state.m_plan = m_plan;
+	state.m_time = t;
+	state.m_voltages.resize(node_count);
+	state.m_branch_currents.resize(branch_count);
+	state.m_inductor_currents.resize(st.inductors.size());
+	state.m_capacitor_currents.resize(st.capacitors.size());
+	state.m_current_sources.resize(st.current_sources.size());
+
+	int v = 0;
+	for (auto *values : {&state.m_voltages, &state.m_branch_currents, &state.m_inductor_currents, &state.m_capacitor_currents})
+		for (auto &x : *values)
+			x = f[v++] * r / M;
+
+	// Chwilowa wartość pobudzenia (impuls Diraca jest zerowy dla t > 0)
+	if (m_input.kind == solve_plan::component_kind::CURRENT_SOURCE)
+		state.m_current_sources[m_input.index] = excitation == response_kind::STEP ? 1.0 : 0.0;
+
+	return state;
+}
+
+/**
+	\brief Wyznacza równolegle stan układu w zadanych chwilach dla zadanych liczb punktów konturu
+
+	\param scheduler Planista zadań
+	\param excitation Rodzaj pobudzenia
+	\param probes Pary (chwila, liczba punktów konturu)
+	\throws std::runtime_error jeżeli nie udało się rozwiązać układu (zgłaszana jest pierwsza para, dla której
+		wystąpił błąd)
+*/
+std::vector<transient_state> laplace_response::evaluate_all(task_scheduler &scheduler, response_kind excitation,
+	const std::vector<std::pair<double, int>> &probes) const
+{
+	const int count = probes.size();
+	std::vector<transient_state> states(count);
+	std::vector<std::exception_ptr> errors(count);
+
+	scheduler.parallel_for(0, count, 4, [&](int begin, int end){
+		mna::mna_problem problem;
+		for (int i = begin; i < end; i++)
+		{
+			try
+			{
+				states[i] = evaluate(probes[i].first, probes[i].second, excitation, problem);
+			}
+			catch (...)
+			{
+				errors[i] = std::current_exception();
+			}
+		}
+	});
+
+	for (int i = 0; i < count; i++)
+		if (errors[i])
+		{
+			try
+			{
+				std::rethrow_exception(errors[i]);
+			}
+			catch (const std::exception &ex)
+			{
+				throw std::runtime_error("Solving at t = " + std::to_string(probes[i].first) + " s failed - reason: " + ex.what());
+			}
+		}
+
+	return states;
+}
+
+/**
+	\brief Dobiera liczbę punktów konturu dla chwili końcowej
+
+	Metoda przestaje uwzględniać bieguny o części urojonej większej od ok. \f$ M / (2t) \f$, a dla \f$ M \f$
+	większych od kilkudziesięciu wynik psuje się z powodu błędów zaokrągleń. Wybierana jest najmniejsza
+	z kolejnych wartości \f$ M \f$, dla której stan w chwili końcowej jest zgodny ze stanem dla największej
+	wartości. Błąd metody rośnie z czasem, więc liczba punktów dobrana dla chwili końcowej wystarcza dla
+	wcześniejszych chwil.
+
+	Biegun leżący poza konturem dla wszystkich wartości \f$ M \f$ nie zmienia wyniku w chwili końcowej, dlatego
+	dodatkowo porównywane są wyniki dla najmniejszej i największej wartości \f$ M \f$ w chwilach
+	\f$ t / 4^j \f$ - różnica oznacza biegun o częstotliwości zbyt dużej dla chwili końcowej.
+
+	Porównywana jest zawsze odpowiedź skokowa - ma te same bieguny, a odpowiedź impulsowa może zawierać
+	impuls Diraca (np. prąd kondensatora dołączonego do źródła), którego metoda nie odtwarza.
+
+	\param scheduler Planista zadań
+	\param stop Chwila końcowa [s]
+	\param M Wybrana liczba punktów konturu (największa sprawdzana, jeżeli nie udało się potwierdzić dokładności)
+	\returns false, jeżeli nie udało się potwierdzić dokładności wyniku
+*/
+bool laplace_response::select_contour_points(task_scheduler &scheduler, double stop, int &M) const
+{
+	static constexpr int candidates[] = {16, 24, 32, 48, 64};
+	static constexpr int candidate_count = std::size(candidates);
+	static constexpr int scale_count = 4;
+	static constexpr double tolerance = 1e-4;
+
+	// Zgodność wszystkich zmiennych układu względem największej z nich
+	auto agree = [](const transient_state &a, const transient_state &b){
+		double scale = 0, error = 0;
+		auto compare = [&](const std::vector<double> &x, const std::vector<double> &y){
+			for (std::size_t i = 0; i < x.size(); i++)
+			{
+				scale = std::max({scale, std::abs(x[i]), std::abs(y[i])});
+				error = std::max(error, std::abs(x[i] - y[i]));
+			}
+		};
+
+		compare(a.m_voltages, b.m_voltages);
+		compare(a.m_branch_currents, b.m_branch_currents);
+		compare(a.m_inductor_currents, b.m_inductor_currents);
+		compare(a.m_capacitor_currents, b.m_capacitor_currents);
+		return error <= tolerance * scale;
+	};
+
+	std::vector<std::pair<double, int>> probes;
+	for (int m : candidates)
+		probes.emplace_back(stop, m);
+	for (int j = 1; j <= scale_count; j++)
+	{
+		const double t = stop / std::pow(4.0, j);
+		probes.emplace_back(t, candidates[0]);
+		probes.emplace_back(t, candidates[candidate_count - 1]);
+	}
+
+	const auto states = evaluate_all(scheduler, response_kind::STEP, probes);
+	const auto &best = states[candidate_count - 1];
+
+	M = candidates[candidate_count - 1];
+	if (!agree(states[candidate_count - 2], best))
+		return false;
+	for (int j = 0; j < scale_count; j++)
+		if (!agree(states[candidate_count + 2 * j], states[candidate_count + 2 * j + 1]))
+			return false;
+
+	int i = 0;
+	while (!agree(states[i], best))
+		i++;
+	M = candidates[i];
+	return true;
+}
+
+/**
+	\brief Wykonuje analizę
+
+	\param scheduler Planista zadań, w którym równolegle wyznaczane są kolejne chwile
+	\param stop Chwila końcowa [s]
+	\param points Liczba chwil - wyznaczany jest stan w chwilach \f$ t_i = (i + 1) \cdot stop / points \f$
+	\param visit Funkcja wywoływana po kolei dla każdej chwili
+	\returns false, jeżeli liczba punktów konturu dobierana była automatycznie i nie udało się potwierdzić
+		dokładności wyniku (np. dla słabo tłumionych rezonansów)
+	\throws std::runtime_error jeżeli parametry są nieprawidłowe lub nie udało się rozwiązać układu
+		(zgłaszana jest najwcześniejsza chwila, dla której wystąpił błąd)
+*/
+bool laplace_response::run(task_scheduler &scheduler, double stop, int points, const visitor &visit) const
+{
+	if (!(stop > 0) || points <= 0)
+		throw std::runtime_error("Invalid step response analysis time parameters");
+
+	int M = m_contour_points;
+	bool reliable = true;
+	if (!M)
+		reliable = select_contour_points(scheduler, stop, M);
+
+	std::vector<std::pair<double, int>> probes;
+	for (int i = 0; i < points; i++)
+		probes.emplace_back(stop * (i + 1) / points, M);
+
+	const auto states = evaluate_all(scheduler, m_kind, probes);
+	for (int i = 0; i < points; i++)
+		visit(i, states[i]);
+	return reliable;
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include <complex>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "circuit.hpp"
+#include "scheduler.hpp"
+#include "transient.hpp"
+
+/**
+	\file laplace.hpp
+	\brief Odpowiedź skokowa i impulsowa wyznaczana numerycznym odwróceniem transformaty Laplace'a (.response)
+	\author Jacek Wieczorek
+*/
+
+/**
+	\brief Rodzaj pobudzenia w analizie \ref laplace_response
+*/
+enum class response_kind
+{
+	STEP,   //!< Skok jednostkowy - \f$ U(s) = 1/s \f$
+	IMPULSE //!< Impuls Diraca - \f$ U(s) = 1 \f$
+};
+
+/**
+	\brief Odpowiedź skokowa lub impulsowa układu liniowego (przy zerowych warunkach początkowych)
+
+	Transformata odpowiedzi \f$ F(s) = H(s) U(s) \f$ każdej zmiennej układu wyznaczana jest
+	rozwiązaniem układu MNA dla zespolonej zmiennej \f$ s \f$ (\ref solve_plan::assemble()),
+	przy jednostkowej wartości AC źródła wejściowego i zerowych wartościach pozostałych źródeł.
+	Przebieg czasowy otrzymywany jest metodą Talbota ze stałym konturem (Abate-Valkó):
+	\f[
+		f(t) \approx \frac{r}{M} \left[ \frac{1}{2} F(r) e^{rt} + \sum_{k=1}^{M-1}
+		\mathrm{Re} \left( e^{t s_k} F(s_k) (1 + j \sigma_k) \right) \right]
+	\f]
+	gdzie \f$ r = 2M / (5t) \f$, \f$ \theta_k = k\pi/M \f$, \f$ s_k = r \theta_k (\cot\theta_k + j) \f$,
+	\f$ \sigma_k = \theta_k + (\theta_k \cot\theta_k - 1) \cot\theta_k \f$.
+
+	Kontur zależy od chwili \f$ t \f$, więc każdy punkt czasu to \f$ M \f$ niezależnych rozwiązań
+	układu - wszystkie chwile wyznaczane są równolegle. W przeciwieństwie do \ref transient_analysis
+	wynik w danej chwili nie zależy od poprzednich kroków, więc nie kumuluje się błąd całkowania.
+
+	Dokładność metody zależy od iloczynu \f$ t \cdot \max |\mathrm{Im}\, p| \f$ (\f$ p \f$ - bieguny \f$ F(s) \f$):
+	dla słabo tłumionych rezonansów o okresie znacznie krótszym od \f$ t \f$ potrzeba
+	\f$ M \gtrsim 2 t \max |\mathrm{Im}\, p| \f$, a dla \f$ M \f$ większych od kilkudziesięciu wynik psuje się
+	z powodu błędów zaokrągleń (wagi rzędu \f$ e^{2M/5} \f$). Jeżeli liczba punktów konturu nie jest podana,
+	dobierana jest automatycznie (od 16 do 64, \ref select_contour_points()), a \ref run() zgłasza, że nie
+	udało się potwierdzić dokładności wyniku - wtedy należy skrócić analizę lub użyć \ref transient_analysis.
+*/
+class laplace_response
+{
+public:
+	using visitor = transient_analysis::visitor;
+
+	laplace_response(std::shared_ptr<const solve_plan> plan, const std::string &input, response_kind kind,
+		int contour_points = 0);
+
+	bool run(task_scheduler &scheduler, double stop, int points, const visitor &visit) const;
+
+private:
+	using spectrum = std::vector<std::complex<double>>;
+
+	void transform(std::complex<double> s, response_kind excitation, mna::mna_problem &problem, spectrum &values) const;
+	transient_state evaluate(double t, int M, response_kind excitation, mna::mna_problem &problem) const;
+	std::vector<transient_state> evaluate_all(task_scheduler &scheduler, response_kind excitation,
+		const std::vector<std::pair<double, int>> &probes) const;
+	bool select_contour_points(task_scheduler &scheduler, double stop, int &M) const;
+
+	//! Plan z jednostkową wartością AC źródła wejściowego i zerowymi wartościami AC pozostałych źródeł
+	std::shared_ptr<const solve_plan> m_plan;
+
+	//! Położenie źródła wejściowego w planie
+	solve_plan::component_ref m_input;
+
+	response_kind m_kind;
+
+	//! Liczba punktów konturu Talbota (0 - dobierana automatycznie)
+	int m_contour_points;
+};
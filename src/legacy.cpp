@@ -103,7 +103,9 @@ static void print_solution(const circuit &circ, const circuit_solver &sol, std::
 {
 	// Potencjały węzłowe
 	f << "Potencjaly wezlowe:" << std::endl;
-	for (const auto &[k, v] : sol.get_node_map())
+	auto nodes = sol.get_node_map().get_nodes();
+	std::sort(nodes.begin(), nodes.end());
+	for (auto k : nodes)
 		f << "\tV(" << k + 1 << ") = " << sol.voltage(k).real() << " V" << std::endl;
 
 	f << std::endl;
@@ -64,6 +64,14 @@ public:
 		return m_matrix.data();
 	}
 
+	/**
+		\brief Dostęp do danych w podlegającym macierzy std::vector
+	*/
+	const T *data() const
+	{
+		return m_matrix.data();
+	}
+
 	/**
 		\brief Dostęp do danych w macierzy
 	*/
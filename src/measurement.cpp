@@ -0,0 +1,250 @@
+#include "measurement.hpp"
+
+/**
+	\file measurement.cpp
+	\brief Implementacja \ref measurement_set
+	\author Jacek Wieczorek
+*/
+
+/**
+	\brief Tworzy pusty zbiór wielkości mierzonych dla zadanego planu
+*/
+measurement_set::measurement_set(std::shared_ptr<const solve_plan> plan) :
+	m_plan(std::move(plan))
+{
+}
+
+/**
+	\brief Zwraca położenie elementu w planie
+	\throws std::runtime_error dla elementów spoza planu
+*/
+const solve_plan::component_ref &measurement_set::find_ref(const circuit_component &comp) const
+{
+	auto ref = m_plan->find_component(&comp);
+	if (!ref)
+		throw std::runtime_error("Component is not a part of the solve plan");
+	return *ref;
+}
+
+/**
+	\brief Tworzy pustą kombinację liniową
+	\returns Numer kombinacji
+*/
+int measurement_set::add_form()
+{
+	m_form_scales.push_back(-1);
+	return m_form_scales.size() - 1;
+}
+
+/**
+	\brief Dodaje do kombinacji napięcie między węzłami
+*/
+void measurement_set::add_voltage_terms(int form, int pos, int neg)
+{
+	auto p = m_plan->node_index(pos);
+	auto n = m_plan->node_index(neg);
+	if (p >= 0) m_terms.push_back({form, p, 1.0});
+	if (n >= 0) m_terms.push_back({form, n, -1.0});
+}
+
+/**
+	\brief Tworzy kombinację opisującą napięcie na komponencie
+	\returns Numer kombinacji
+*/
+int measurement_set::add_voltage_form(const circuit_component &comp)
+{
+	int form = add_form();
+	std::visit(overloaded{
+		[&](const opamp *opa){add_voltage_terms(form, opa->output_node, 0);},
+		[&](const nonlinear_component *){throw std::runtime_error("Cannot measure voltage on component");},
+		[&](const circuit_component *){throw std::runtime_error("Cannot measure voltage on component");},
+		[&](const auto *bp){add_voltage_terms(form, bp->nodes.first, bp->nodes.second);},
+	}, comp.view());
+	return form;
+}
+
+/**
+	\brief Tworzy kombinację opisującą prąd płynący przez komponent
+	\returns Numer kombinacji
+*/
+int measurement_set::add_current_form(const circuit_component &comp)
+{
+	int form = add_form();
+	const auto &ref = find_ref(comp);
+	const auto &st = m_plan->get_components();
+	const int n = m_plan->get_node_count();
+
+	switch (ref.kind)
+	{
+		// Prąd SEM, wyjścia wzmacniacza i źródła napięciowego sterowanego jest zmienną w rozwiązaniu
+		case component_kind::VOLTAGE_SOURCE:
+		case component_kind::OPAMP:
+		case component_kind::VCVS:
+		case component_kind::CCVS:
+			m_terms.push_back({form, n + m_plan->branch_index(ref), 1.0});
+			break;
+
+		// Źródło prądowe sterowane - wzmocnione napięcie lub prąd SEM sterującej
+		case component_kind::VCCS:
+		{
+			const auto &arr = st.vccs;
+			if (arr.c[ref.index] >= 0) m_terms.push_back({form, arr.c[ref.index], arr.gain[ref.index]});
+			if (arr.d[ref.index] >= 0) m_terms.push_back({form, arr.d[ref.index], -arr.gain[ref.index]});
+			break;
+		}
+
+		case component_kind::CCCS:
+			m_terms.push_back({form, n + st.cccs.control[ref.index], st.cccs.gain[ref.index]});
+			break;
+
+		case component_kind::CURRENT_SOURCE:
+			m_constants.push_back({form, ref.index});
+			break;
+
+		// Element pasywny - I = Y * V
+		case component_kind::RESISTOR:
+		case component_kind::INDUCTOR:
+		case component_kind::CAPACITOR:
+		case component_kind::PASSIVE:
+		{
+			const auto &arr = *st.bipoles(ref.kind);
+			if (arr.a[ref.index] >= 0) m_terms.push_back({form, arr.a[ref.index], 1.0});
+			if (arr.b[ref.index] >= 0) m_terms.push_back({form, arr.b[ref.index], -1.0});
+			m_form_scales[form] = m_scales.size();
+			m_scales.push_back(ref);
+			break;
+		}
+
+		default:
+			throw std::runtime_error("Cannot measure current through component");
+	}
+
+	return form;
+}
+
+/**
+	\brief Dodaje pomiar napięcia między węzłami
+	\returns Numer wielkości (położenie w wyniku \ref evaluate())
+*/
+int measurement_set::add_voltage(int pos, int neg)
+{
+	int form = add_form();
+	add_voltage_terms(form, pos, neg);
+	m_quantities.push_back({form});
+	return m_quantities.size() - 1;
+}
+
+/**
+	\brief Dodaje pomiar napięcia na komponencie
+	\returns Numer wielkości
+*/
+int measurement_set::add_voltage(const circuit_component &comp)
+{
+	m_quantities.push_back({add_voltage_form(comp)});
+	return m_quantities.size() - 1;
+}
+
+/**
+	\brief Dodaje pomiar prądu płynącego przez komponent
+	\returns Numer wielkości
+*/
+int measurement_set::add_current(const circuit_component &comp)
+{
+	m_quantities.push_back({add_current_form(comp)});
+	return m_quantities.size() - 1;
+}
+
+/**
+	\brief Dodaje pomiar mocy traconej na komponencie
+	\returns Numer wielkości
+*/
+int measurement_set::add_power(const circuit_component &comp)
+{
+	int v = add_voltage_form(comp);
+	int i = add_current_form(comp);
+	m_quantities.push_back({v, i});
+	return m_quantities.size() - 1;
+}
+
+/**
+	\brief Zwraca liczbę wielkości mierzonych
+*/
+int measurement_set::size() const
+{
+	return m_quantities.size();
+}
+
+/**
+	\brief Zbiera wyrazy wszystkich kombinacji i wyznacza wielkości mierzone
+
+	Admitancje elementów wyznaczane są raz dla danej pulsacji, a następnie
+	wszystkie wyrazy zbierane są w jednym przejściu po zmiennych układu.
+
+	\param plan Plan, z którego pochodzą wartości elementów (może być kopią planu zbioru)
+	\param variable Funkcja zwracająca zmienną pełnego układu równań o zadanym numerze
+	\param ctx Kontekst analizy, z którego odczytywane są prądy cewek przy analizie DC (lub nullptr)
+*/
+template <typename Variable>
+void measurement_set::gather(const solve_plan &plan, double omega, const Variable &variable, const solve_context *ctx,
+	std::vector<std::complex<double>> &values) const
+{
+	const auto &st = plan.get_components();
+
+	std::vector<std::complex<double>> Y(m_scales.size());
+	for (unsigned int i = 0; i < m_scales.size(); i++)
+		Y[i] = plan.passive_admittance(m_scales[i].kind, m_scales[i].index, omega);
+
+	std::vector<std::complex<double>> acc(m_form_scales.size());
+	for (const auto &t : m_terms)
+		acc[t.form] += t.coef * variable(t.row);
+
+	for (unsigned int i = 0; i < acc.size(); i++)
+	{
+		const int scale = m_form_scales[i];
+		if (scale < 0)
+			continue;
+
+		// Cewki mogą zostać zwarte przy upraszczaniu układu DC - ich prąd zna jedynie kontekst
+		const auto &ref = m_scales[scale];
+		if (ctx && omega == 0 && ref.kind == component_kind::INDUCTOR)
+			acc[i] = ctx->current(*st.inductors.comp[ref.index]);
+		else
+			acc[i] *= Y[scale];
+	}
+
+	for (const auto &c : m_constants)
+		acc[c.form] -= omega == 0 ? st.current_sources.value[c.source] : st.current_sources.ac[c.source];
+
+	values.resize(m_quantities.size());
+	for (unsigned int i = 0; i < m_quantities.size(); i++)
+	{
+		const auto &q = m_quantities[i];
+		values[i] = q.second < 0 ? acc[q.first] : acc[q.first] * acc[q.second];
+	}
+}
+
+/**
+	\brief Wyznacza wszystkie wielkości mierzone na podstawie rozwiązania
+
+	\param solution Rozwiązanie pełnego układu równań
+	\param omega Pulsacja, dla której wyznaczono rozwiązanie
+	\param values Wartości wielkości w kolejności dodania (bufor jest wykorzystywany ponownie)
+*/
+void measurement_set::evaluate(const mna::mna_solution &solution, double omega, std::vector<std::complex<double>> &values) const
+{
+	const auto &x = solution.get_matrix();
+	gather(*m_plan, omega, [&](int row){return x(row, 0);}, nullptr, values);
+}
+
+/**
+	\brief Wyznacza wszystkie wielkości mierzone na podstawie rozwiązania z kontekstu analizy
+
+	Wartości elementów pochodzą z planu kontekstu, który może być zmienioną kopią planu zbioru
+	(np. w analizie DC lub Monte Carlo), o ile ma tę samą strukturę.
+
+	\param values Wartości wielkości w kolejności dodania (bufor jest wykorzystywany ponownie)
+*/
+void measurement_set::evaluate(const solve_context &ctx, std::vector<std::complex<double>> &values) const
+{
+	gather(*ctx.get_plan(), ctx.get_solution_omega(), [&](int row){return ctx.variable(row);}, &ctx, values);
+}
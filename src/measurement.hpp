@@ -0,0 +1,86 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <complex>
+#include "circuit.hpp"
+
+/**
+	\file measurement.hpp
+	\brief Wielkości mierzone skompilowane względem planu rozwiązywania układu
+	\author Jacek Wieczorek
+*/
+
+/**
+	\brief Zbiór wielkości mierzonych (napięć, prądów i mocy) skompilowany względem planu
+
+	Nazwy elementów i numery węzłów rozwiązywane są raz, przy dodawaniu wielkości.
+	Każda wielkość zapisywana jest jako kombinacja liniowa elementów wektora rozwiązania
+	pełnego układu MNA (\ref solve_plan::assemble()) - lista par (numer wiersza, współczynnik),
+	mnożona opcjonalnie przez admitancję elementu (prąd elementu pasywnego) i powiększona
+	o prąd SPM. Moc jest iloczynem dwóch takich kombinacji.
+
+	Wyznaczenie wszystkich wielkości dla jednego rozwiązania (\ref evaluate()) to jedno
+	przejście po ciągłej tablicy wyrazów - bez wyszukiwania nazw, rzutowań i wyjątków.
+	Zbiór jest niezmienny po skompilowaniu, więc może być używany przez wiele wątków.
+
+	\note Rozwiązanie podane wprost musi pochodzić z pełnego układu równań - z \ref solve_plan::solve()
+	lub z \ref circuit_solver przy analizie AC. Przy analizie DC \ref solve_context upraszcza
+	układ, więc numeracja zmiennych jest inna - wtedy wielkości wyznaczane są na podstawie
+	kontekstu (\ref solve_context::variable()).
+*/
+class measurement_set
+{
+public:
+	explicit measurement_set(std::shared_ptr<const solve_plan> plan);
+
+	int add_voltage(int pos, int neg = 0);
+	int add_voltage(const circuit_component &comp);
+	int add_current(const circuit_component &comp);
+	int add_power(const circuit_component &comp);
+
+	int size() const;
+	void evaluate(const mna::mna_solution &solution, double omega, std::vector<std::complex<double>> &values) const;
+	void evaluate(const solve_context &ctx, std::vector<std::complex<double>> &values) const;
+
+private:
+	using component_kind = solve_plan::component_kind;
+
+	//! Wyraz kombinacji liniowej - coef * x[row]
+	struct term
+	{
+		int form; //!< Numer kombinacji, do której należy wyraz
+		int row;  //!< Numer wiersza rozwiązania
+		double coef;
+	};
+
+	//! Stały wyraz kombinacji - prąd SPM
+	struct constant
+	{
+		int form;
+		int source; //!< Numer SPM w tablicach planu
+	};
+
+	//! Wielkość mierzona - kombinacja lub iloczyn dwóch kombinacji (moc)
+	struct quantity
+	{
+		int first;
+		int second = -1;
+	};
+
+	int add_form();
+	int add_voltage_form(const circuit_component &comp);
+	int add_current_form(const circuit_component &comp);
+	void add_voltage_terms(int form, int pos, int neg);
+	const solve_plan::component_ref &find_ref(const circuit_component &comp) const;
+
+	template <typename Variable>
+	void gather(const solve_plan &plan, double omega, const Variable &variable, const solve_context *ctx,
+		std::vector<std::complex<double>> &values) const;
+
+	std::shared_ptr<const solve_plan> m_plan;
+	std::vector<int> m_form_scales; //!< Numer admitancji w \ref m_scales mnożącej kombinację (-1 - brak)
+	std::vector<term> m_terms;
+	std::vector<constant> m_constants;
+	std::vector<solve_plan::component_ref> m_scales;
+	std::vector<quantity> m_quantities;
+};
@@ -1,5 +1,7 @@
 #include "mna.hpp"
+#include "scheduler.hpp"
 #include <iostream>
+#include <algorithm>
 using namespace mna;
 
 /**
@@ -8,8 +10,8 @@ using namespace mna;
 
 	Ten plik implementuje narzędzia do analizy układów na "najniższym poziomie".
 	Analizowany układ musi zostać uprzednio zdegenerowany do opisu problemu, na
-	który składają się admitancje międzywęzłowe, źródła napięciowe i prądowe
-	oraz idealne wzmacniacze operacyjne (pracujące z ujemnym sprzężeniem zwrotnym).
+	który składają się admitancje międzywęzłowe, źródła napięciowe i prądowe, źródła
+	sterowane oraz idealne wzmacniacze operacyjne (pracujące z ujemnym sprzężeniem zwrotnym).
 
 	Na tym poziomie obowiązuje numeracja węzłów od 0. Węzły o numerach ujemnych
 	traktowane są jako napięcie odniesienia (masa).
@@ -18,46 +20,47 @@ using namespace mna;
 	\author Jacek Wieczorek
 */
 
+//! Minimalna liczba wierszy do wyeliminowania, przy której eliminacja jest zrównoleglana
+static constexpr int parallel_elimination_rows = 128;
+
+//! Minimalna liczba wierszy eliminowanych w jednym zadaniu
+static constexpr int parallel_elimination_grain = 16;
+
 /**
-	\brief Rozwiązuje układ zespolonych równań liniowych metodą eliminacji Gaussa
+	\brief Wyznacza rozkład LU macierzy kwadratowej
+
+	Eliminacja Gaussa z częściowym wyborem elementu głównego (największy moduł w kolumnie).
+	Współczynniki eliminacji zapisywane są pod przekątną, dzięki czemu rozkład można później
+	wykorzystać do rozwiązania układu dla dowolnego wektora wyrazów wolnych.
 
-	\param mat Macierz o rozmiarze Nx(N+1) opisująca układ równań
-	\returns Macierz o rozmiarze Nx1 zawierająca rozwiązanie
+	Jeżeli rozkład wykonywany jest w ramach zadania \ref task_scheduler, eliminacja
+	w dużych macierzach dzielona jest między wątki planisty. Każdy wiersz przetwarzany
+	jest przez dokładnie jeden wątek, więc wynik nie zależy od liczby wątków.
+
+	\param A Macierz NxN opisująca układ równań
+	\throw std::runtime_error jeżeli macierz jest osobliwa
 */
-static matrix<std::complex<double>> gaussian_elimination(matrix<std::complex<double>> mat)
+lu_factorization::lu_factorization(matrix<std::complex<double>> A) :
+	m_lu(std::move(A)),
+	m_perm(m_lu.get_height())
 {
-	const int N = mat.get_height();
+	const int N = m_lu.get_height();
 
-	if (mat.get_width() != N + 1)
+	if (m_lu.get_width() != N)
 		throw std::runtime_error("Invalid equation system dimensions");
 
-	// Funkcja pomocnicza do zamiany wierszy
-	auto swap_rows = [&](int a, int b){
-		for (int i = 0; i < mat.get_width(); i++)
-			std::swap(mat(a, i), mat(b, i));
-	};
+	for (int i = 0; i < N; i++)
+		m_perm[i] = i;
 
-	// Funkcja pomocnicza do sumowania wierszy
-	auto add_rows = [&](int dest, int src){
-		for (int i = 0; i < mat.get_width(); i++)
-			mat(dest, i) += mat(src, i);
-	};
-
-	// Funkcja pomocnicza do mnożenia wiersza przez stałą
-	auto multiply_row = [&](int r, std::complex<double> k){
-		for (int i = 0; i < mat.get_width(); i++)
-			mat(r, i) *= k;
-	};
-
-	// Redukcja macierzy do macierzy trójkątnej (row echelon form)
+	auto *a = m_lu.data();
 	for (int k = 0; k < N; k++)
 	{
 		// Wyszukanie wiersza z "największą" wartością w k-tej kolumnie
 		int row_max = k;
-		auto max = std::abs(mat(k, k));
+		auto max = std::abs(a[k * N + k]);
 		for (int i = k + 1; i < N; i++)
 		{
-			auto x = std::abs(mat(i, k));
+			auto x = std::abs(a[i * N + k]);
 			if (x > max)
 			{
 				max = x;
@@ -70,39 +73,153 @@ static matrix<std::complex<double>> gaussian_elimination(matrix<std::complex<dou
 			throw std::runtime_error("Could not solve equation system (Gaussian elimination failed)");
 
 		// Przerzucenie "maksymalnego" wiersza na górę (zamiast k-tego wiersza)
-		swap_rows(row_max, k);
-
-		// Wartość "maksymalnego" współczynnika
-		auto v = mat(k, k);
+		if (row_max != k)
+		{
+			std::swap_ranges(a + row_max * N, a + row_max * N + N, a + k * N);
+			std::swap(m_perm[row_max], m_perm[k]);
+		}
 
 		// Redukujemy współczynniki przy tej zmiennej do 0 we wszystkich
-		// równaniach poniżej
-		for (int i = k + 1; i < N; i++)
-			if (mat(i, k) != 0.0)
+		// równaniach poniżej, zapamiętując użyte mnożniki
+		const auto pivot = a[k * N + k];
+		auto eliminate = [&](int begin, int end){
+			for (int i = begin; i < end; i++)
 			{
-				multiply_row(i, -v / mat(i, k));
-				add_rows(i, k);
+				auto &l = a[i * N + k];
+				if (l == 0.0) continue;
+
+				l /= pivot;
+				for (int j = k + 1; j < N; j++)
+					a[i * N + j] -= l * a[k * N + j];
 			}
+		};
+
+		// Wiersze są modyfikowane niezależnie, więc przy dużej macierzy dzielimy je
+		// między wątki planisty, w ramach którego wykonywany jest rozkład (jeżeli taki jest)
+		auto *scheduler = task_scheduler::current();
+		if (scheduler && N - k > parallel_elimination_rows)
+			scheduler->parallel_for(k + 1, N, parallel_elimination_grain, eliminate);
+		else
+			eliminate(k + 1, N);
 	}
+}
+
+/**
+	\brief Rozwiązuje układ \f$ Ax = z \f$
 
-	// Macierz zawierająca rozwiązanie
-	matrix<std::complex<double>> solution(N, 1);
+	Wszystkie kolumny przetwarzane są jednocześnie - każdy współczynnik rozkładu
+	odczytywany jest raz i stosowany do ciągłego wiersza K wartości. Kolejność działań
+	w każdej kolumnie jest taka sama, jak przy rozwiązywaniu jej osobno.
 
-	// Podstawianie wsteczne (back substitution) celem
-	// wyznaczenia wartości zmiennych
+	\param z Macierz NxK - każda kolumna to osobny wektor wyrazów wolnych
+	\returns Macierz NxK zawierająca rozwiązania
+*/
+matrix<std::complex<double>> lu_factorization::solve(const matrix<std::complex<double>> &z) const
+{
+	const int N = size();
+	const int K = z.get_width();
+
+	if (z.get_height() != N)
+		throw std::runtime_error("Invalid equation system dimensions");
+
+	const auto *a = m_lu.data();
+	matrix<std::complex<double>> x(N, K);
+	auto *xd = x.data();
+	const auto *zd = z.data();
+
+	// Podstawianie w przód (L ma jedynki na przekątnej)
+	for (int i = 0; i < N; i++)
+	{
+		auto *xi = xd + i * K;
+		std::copy(zd + m_perm[i] * K, zd + m_perm[i] * K + K, xi);
+		for (int j = 0; j < i; j++)
+		{
+			const auto l = a[i * N + j];
+			if (l == 0.0) continue;
+
+			const auto *xj = xd + j * K;
+			for (int c = 0; c < K; c++)
+				xi[c] -= l * xj[c];
+		}
+	}
+
+	// Podstawianie wsteczne (back substitution)
 	for (int i = N - 1; i >= 0; i--)
 	{
-		auto sum = mat(i, N); // Wyraz wolny i-tego równania
+		auto *xi = xd + i * K;
+		for (int j = i + 1; j < N; j++)
+		{
+			const auto u = a[i * N + j];
+			if (u == 0.0) continue;
 
-		// Podstawienie reszty zmiennych
-		for (int j = i; j < N; j++)
-			sum -= mat(i, j) * solution(j, 0);
-	
-		// Wartość i-tej zmiennej
-		solution(i, 0) = sum / mat(i, i); 
+			const auto *xj = xd + j * K;
+			for (int c = 0; c < K; c++)
+				xi[c] -= u * xj[c];
+		}
+
+		const auto d = a[i * N + i];
+		for (int c = 0; c < K; c++)
+			xi[c] /= d;
 	}
 
-	return solution;
+	return x;
+}
+
+/**
+	\brief Rozwiązuje układ sprzężony (transponowany) \f$ A^T y = c \f$
+
+	Wykorzystywany przy analizie wrażliwości - jedno rozwiązanie układu sprzężonego
+	pozwala wyznaczyć pochodne wybranej wielkości po wszystkich parametrach układu.
+
+	\param c Macierz NxK - każda kolumna to osobny wektor wyrazów wolnych
+	\returns Macierz NxK zawierająca rozwiązania
+*/
+matrix<std::complex<double>> lu_factorization::solve_transposed(const matrix<std::complex<double>> &c) const
+{
+	const int N = size();
+	const int K = c.get_width();
+
+	if (c.get_height() != N)
+		throw std::runtime_error("Invalid equation system dimensions");
+
+	const auto *a = m_lu.data();
+	matrix<std::complex<double>> w(N, 1);
+	matrix<std::complex<double>> y(N, K);
+
+	for (int k = 0; k < K; k++)
+	{
+		// U^T w = c (podstawianie w przód)
+		for (int i = 0; i < N; i++)
+		{
+			auto sum = c(i, k);
+			for (int j = 0; j < i; j++)
+				sum -= a[j * N + i] * w(j, 0);
+			w(i, 0) = sum / a[i * N + i];
+		}
+
+		// L^T v = w (podstawianie wstecz)
+		for (int i = N - 1; i >= 0; i--)
+		{
+			auto sum = w(i, 0);
+			for (int j = i + 1; j < N; j++)
+				sum -= a[j * N + i] * w(j, 0);
+			w(i, 0) = sum;
+		}
+
+		// Odwrócenie permutacji wierszy
+		for (int i = 0; i < N; i++)
+			y(m_perm[i], k) = w(i, 0);
+	}
+
+	return y;
+}
+
+/**
+	\brief Zwraca rozmiar układu równań
+*/
+int lu_factorization::size() const
+{
+	return m_lu.get_height();
 }
 
 /**
@@ -118,6 +235,12 @@ int mna_problem::get_max_node() const
 		max_node = std::max(max_node, v.nodes.second);
 	}
 
+	for (const auto &v : transconductances)
+	{
+		max_node = std::max({max_node, v.nodes.first, v.nodes.second});
+		max_node = std::max({max_node, v.control.first, v.control.second});
+	}
+
 	for (const auto &v : voltage_sources)
 	{
 		max_node = std::max(max_node, v.nodes.first);
@@ -137,9 +260,29 @@ int mna_problem::get_max_node() const
 		max_node = std::max(max_node, v.output_node);
 	}
 
+	for (const auto &v : voltage_gains)
+	{
+		max_node = std::max({max_node, v.nodes.first, v.nodes.second});
+		max_node = std::max({max_node, v.control.first, v.control.second});
+	}
+
+	for (const auto &v : current_gains)
+		max_node = std::max({max_node, v.nodes.first, v.nodes.second});
+
+	for (const auto &v : transresistances)
+		max_node = std::max({max_node, v.nodes.first, v.nodes.second});
+
 	return max_node;
 }
 
+/**
+	\brief Zwraca liczbę gałęzi (prądów) w układzie równań - SEM, wzmacniaczy i źródeł napięciowych sterowanych
+*/
+int mna_problem::get_branch_count() const
+{
+	return voltage_sources.size() + opamps.size() + voltage_gains.size() + transresistances.size();
+}
+
 /**
 	\brief Wyznacza i zwraca rozwiązanie (potencjały węzłowe) układu.
 	
@@ -153,14 +296,76 @@ mna_solution mna_problem::solve() const
 	const int node_count = get_max_node() + 1;
 	auto A = compute_matrix_A(node_count);
 	auto z = compute_matrix_z(node_count);
-	auto system = join_matrices_horizontal(A, z);
-	auto x = gaussian_elimination(system);
+	auto lu = std::make_shared<const lu_factorization>(std::move(A));
+	auto x = lu->solve(z);
 
 	// DEBUG
-	// std::cout << system << std::endl;
+	// std::cout << z << std::endl;
 	// std::cout << x << std::endl;
 
-	return mna_solution(x, node_count, voltage_sources.size());
+	return mna_solution(x, node_count, voltage_sources.size(), opamps.size(), lu);
+}
+
+/**
+	\brief Wyznacza rozwiązanie układu wykorzystując istniejący rozkład macierzy A
+
+	Pozwala uniknąć ponownego rozkładu, gdy od jego wyznaczenia zmieniły się
+	wyłącznie wartości źródeł (wektor z).
+
+	\param lu Rozkład macierzy A wyznaczony dla tego samego układu
+	\warning Zmiana admitancji lub struktury układu unieważnia rozkład
+*/
+mna_solution mna_problem::solve(std::shared_ptr<const lu_factorization> lu) const
+{
+	const int node_count = get_max_node() + 1;
+	auto z = compute_matrix_z(node_count);
+	auto x = lu->solve(z);
+	return mna_solution(x, node_count, voltage_sources.size(), opamps.size(), std::move(lu));
+}
+
+/**
+	\brief Wyznacza rozwiązania układu dla wielu wariantów wartości źródeł z wykorzystaniem istniejącego rozkładu
+
+	Wektory wyrazów wolnych wszystkich wariantów zbierane są w jednej macierzy NxK,
+	która jest rozwiązywana jednym wywołaniem \ref lu_factorization::solve().
+
+	\param lu Rozkład macierzy A wyznaczony dla tego samego układu
+	\param count Liczba wariantów
+	\param update_sources Funkcja ustawiająca wartości źródeł problemu dla k-tego wariantu
+	\returns Rozwiązania kolejnych wariantów
+	\warning Funkcja update_sources może zmieniać jedynie wartości źródeł
+*/
+std::vector<mna_solution> mna_problem::solve_batch(std::shared_ptr<const lu_factorization> lu, int count,
+	const std::function<void(int k)> &update_sources)
+{
+	const int node_count = get_max_node() + 1;
+	const int N = lu->size();
+
+	matrix<std::complex<double>> Z(N, count);
+	for (int k = 0; k < count; k++)
+	{
+		update_sources(k);
+		auto z = compute_matrix_z(node_count);
+		if (z.get_height() != N)
+			throw std::runtime_error("Invalid equation system dimensions");
+
+		for (int i = 0; i < N; i++)
+			Z(i, k) = z(i, 0);
+	}
+
+	auto X = lu->solve(Z);
+
+	std::vector<mna_solution> solutions;
+	solutions.reserve(count);
+	for (int k = 0; k < count; k++)
+	{
+		matrix<std::complex<double>> x(N, 1);
+		for (int i = 0; i < N; i++)
+			x(i, 0) = X(i, k);
+		solutions.emplace_back(x, node_count, voltage_sources.size(), opamps.size(), lu);
+	}
+
+	return solutions;
 }
 
 /**
@@ -168,9 +373,9 @@ mna_solution mna_problem::solve() const
 */
 matrix<std::complex<double>> mna_problem::compute_matrix_A(int node_count) const
 {
-	// Liczba węzłów (bez masy) i sił elektromotorycznych
+	// Liczba węzłów (bez masy) i gałęzi
 	const auto n = node_count;
-	const auto m = opamps.size() + voltage_sources.size();
+	const auto m = get_branch_count();
 
 	// Macierze składowe macierzy A
 	matrix<std::complex<double>> G(n, n);
@@ -195,6 +400,17 @@ matrix<std::complex<double>> mna_problem::compute_matrix_A(int node_count) const
 		}
 	}
 
+	// Transkonduktancje - niesymetryczne wpisy w macierzy G
+	for (const auto &elem : transconductances)
+	{
+		const std::pair<int, int> rows[] = {{elem.nodes.first, 1}, {elem.nodes.second, -1}};
+		const std::pair<int, int> cols[] = {{elem.control.first, 1}, {elem.control.second, -1}};
+		for (const auto &[r, rs] : rows)
+			for (const auto &[c, cs] : cols)
+				if (r >= 0 && c >= 0)
+					G(r, c) += static_cast<double>(rs * cs) * elem.G;
+	}
+
 	// Budowa macierzy B na podstawie źródeł napięciowych
 	for (unsigned int i = 0; i < voltage_sources.size(); i++)
 	{
@@ -225,6 +441,42 @@ matrix<std::complex<double>> mna_problem::compute_matrix_A(int node_count) const
 		i++;
 	}	
 
+	// Źródła napięciowe sterowane - gałęzie za wzmacniaczami operacyjnymi. Równanie gałęzi
+	// to napięcie wyjścia pomniejszone o napięcie (lub prąd) sterujący przemnożony przez wzmocnienie.
+	auto output_branch = [&](const std::pair<int, int> &nodes, int branch){
+		if (nodes.first >= 0) B(nodes.first, branch) = C(branch, nodes.first) = 1;
+		if (nodes.second >= 0) B(nodes.second, branch) = C(branch, nodes.second) = -1;
+	};
+
+	auto control_branch = [&](int control){
+		if (control < 0 || control >= static_cast<int>(voltage_sources.size()))
+			throw std::runtime_error("Invalid controlling voltage source");
+		return control;
+	};
+
+	for (const auto &vg : voltage_gains)
+	{
+		output_branch(vg.nodes, i);
+		if (vg.control.first >= 0) C(i, vg.control.first) -= vg.gain;
+		if (vg.control.second >= 0) C(i, vg.control.second) += vg.gain;
+		i++;
+	}
+
+	for (const auto &tr : transresistances)
+	{
+		output_branch(tr.nodes, i);
+		D(i, control_branch(tr.control)) -= tr.gain;
+		i++;
+	}
+
+	// Źródła prądowe sterowane prądem - prąd SEM sterującej w równaniach węzłów wyjściowych
+	for (const auto &cg : current_gains)
+	{
+		const int k = control_branch(cg.control);
+		if (cg.nodes.first >= 0) B(cg.nodes.first, k) += cg.gain;
+		if (cg.nodes.second >= 0) B(cg.nodes.second, k) -= cg.gain;
+	}
+
 	return join_matrices_vertical(join_matrices_horizontal(G, B), join_matrices_horizontal(C, D));
 }
 
@@ -233,9 +485,9 @@ matrix<std::complex<double>> mna_problem::compute_matrix_A(int node_count) const
 */
 matrix<std::complex<double>> mna_problem::compute_matrix_z(int node_count) const
 {
-	// Liczba węzłów (bez masy) i sił elektromotorycznych
+	// Liczba węzłów (bez masy) i gałęzi
 	const auto n = node_count;
-	const auto m = opamps.size() + voltage_sources.size();
+	const auto m = get_branch_count();
 
 	matrix<std::complex<double>> I(n, 1);
 	matrix<std::complex<double>> E(m, 1);
@@ -261,11 +513,16 @@ matrix<std::complex<double>> mna_problem::compute_matrix_z(int node_count) const
 	\param solution Macierz zawierająca rozwiązanie
 	\param node_count Liczba węzłów w układzie
 	\param vs_count Liczba SEM w układzie (nie licząc wzmacniaczy operacyjnych)
+	\param opamp_count Liczba wzmacniaczy operacyjnych w układzie
+	\param factorization Rozkład macierzy układu (opcjonalny, wymagany przez \ref solve_adjoint())
 */
-mna_solution::mna_solution(const matrix<std::complex<double>> &solution, int node_count, int vs_count) : 
+mna_solution::mna_solution(const matrix<std::complex<double>> &solution, int node_count, int vs_count, int opamp_count,
+	std::shared_ptr<const lu_factorization> factorization) : 
 	m_solution(solution),
 	m_node_count(node_count),
-	m_voltage_source_count(vs_count)
+	m_voltage_source_count(vs_count),
+	m_opamp_count(opamp_count),
+	m_factorization(std::move(factorization))
 {
 }
 
@@ -307,16 +564,96 @@ std::complex<double> mna_solution::voltage_source_current(int id) const
 */
 std::complex<double> mna_solution::opamp_current(int id) const
 {
-	if (id < 0 || id >= m_solution.get_height() - m_node_count - m_voltage_source_count)
+	if (id < 0 || id >= m_opamp_count)
 		throw std::out_of_range("mna_solution::opamp_current() invalid source ID");
 
 	return m_solution.at(m_node_count + m_voltage_source_count + id, 0);
 }
 
+/**
+	\brief Zwraca prąd pobierany ze źródła napięciowego sterowanego
+
+	\param id numer źródła (najpierw źródła sterowane napięciem, potem prądem)
+*/
+std::complex<double> mna_solution::controlled_source_current(int id) const
+{
+	return m_solution.at(controlled_source_row(id), 0);
+}
+
+/**
+	\brief Zwraca liczbę węzłów (bez masy) w układzie
+*/
+int mna_solution::get_node_count() const
+{
+	return m_node_count;
+}
+
+/**
+	\brief Zwraca numer wiersza rozwiązania zawierającego prąd źródła napięciowego
+
+	\param id numer źródła napięciowego (numeracja od 0)
+*/
+int mna_solution::voltage_source_row(int id) const
+{
+	if (id < 0 || id >= m_voltage_source_count)
+		throw std::out_of_range("mna_solution::voltage_source_row() invalid source ID");
+
+	return m_node_count + id;
+}
+
+/**
+	\brief Zwraca numer wiersza rozwiązania zawierającego prąd wyjścia wzmacniacza operacyjnego
+
+	\param id numer wzmacniacza
+*/
+int mna_solution::opamp_row(int id) const
+{
+	if (id < 0 || id >= m_opamp_count)
+		throw std::out_of_range("mna_solution::opamp_row() invalid opamp ID");
+
+	return m_node_count + m_voltage_source_count + id;
+}
+
+/**
+	\brief Zwraca numer wiersza rozwiązania zawierającego prąd źródła napięciowego sterowanego
+
+	\param id numer źródła (najpierw źródła sterowane napięciem, potem prądem)
+*/
+int mna_solution::controlled_source_row(int id) const
+{
+	const int first = m_node_count + m_voltage_source_count + m_opamp_count;
+	if (id < 0 || id >= m_solution.get_height() - first)
+		throw std::out_of_range("mna_solution::controlled_source_row() invalid source ID");
+
+	return first + id;
+}
+
+/**
+	\brief Rozwiązuje układ sprzężony \f$ A^T \lambda = c \f$ wykorzystując istniejący rozkład macierzy
+
+	\param c Wektor (lub macierz) wag wielkości wyjściowej \f$ q = c^T x \f$
+	\returns Rozwiązanie układu sprzężonego \f$ \lambda \f$
+*/
+matrix<std::complex<double>> mna_solution::solve_adjoint(const matrix<std::complex<double>> &c) const
+{
+	if (!m_factorization)
+		throw std::runtime_error("mna_solution::solve_adjoint() - factorization not available");
+
+	return m_factorization->solve_transposed(c);
+}
+
+/**
+	\brief Zwraca rozkład macierzy układu, na podstawie którego wyznaczono rozwiązanie
+*/
+std::shared_ptr<const lu_factorization> mna_solution::get_factorization() const
+{
+	return m_factorization;
+}
+
 /**
 	\brief Zwraca macierz zawierająca rozwiązanie
 */
-const matrix<std::complex<double>> mna_solution::get_matrix() const
+const matrix<std::complex<double>> &mna_solution::get_matrix() const
 {
 	return m_solution;
 }
\ No newline at end of file
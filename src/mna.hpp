@@ -3,6 +3,8 @@
 #include <utility>
 #include <complex>
 #include <vector>
+#include <memory>
+#include <functional>
 
 #include "matrix.hpp"
 
@@ -50,6 +52,58 @@ struct current_source
 	double I;
 };
 
+/**
+	\brief Źródło prądowe sterowane napięciem (transkonduktancja)
+
+	Prąd \f$ G (V_{c+} - V_{c-}) \f$ płynie przez element od pierwszego do drugiego węzła
+	(tak jak prąd admitancji). Element nie wymaga dodatkowej gałęzi w układzie równań.
+*/
+struct transconductance
+{
+	std::pair<int, int> nodes;   //!< Węzły wyjściowe
+	std::pair<int, int> control; //!< Węzły sterujące
+	std::complex<double> G;
+};
+
+/**
+	\brief Źródło napięciowe sterowane napięciem (VCVS)
+
+	\f$ V_{+} - V_{-} = \mu (V_{c+} - V_{c-}) \f$. Prąd źródła jest dodatkową zmienną układu
+	równań (gałęzie źródeł sterowanych następują po gałęziach wzmacniaczy operacyjnych).
+*/
+struct voltage_gain
+{
+	std::pair<int, int> nodes;   //!< Węzły wyjściowe
+	std::pair<int, int> control; //!< Węzły sterujące
+	std::complex<double> gain;
+};
+
+/**
+	\brief Źródło prądowe sterowane prądem (CCCS)
+
+	Prąd \f$ \beta I_k \f$, gdzie \f$ I_k \f$ to prąd k-tej SEM, płynie przez element od pierwszego
+	do drugiego węzła. Element nie wymaga dodatkowej gałęzi w układzie równań.
+*/
+struct current_gain
+{
+	std::pair<int, int> nodes; //!< Węzły wyjściowe
+	int control;               //!< Numer SEM, której prąd steruje źródłem
+	std::complex<double> gain;
+};
+
+/**
+	\brief Źródło napięciowe sterowane prądem (CCVS)
+
+	\f$ V_{+} - V_{-} = r I_k \f$, gdzie \f$ I_k \f$ to prąd k-tej SEM. Prąd źródła jest dodatkową
+	zmienną układu równań (po gałęziach \ref voltage_gain).
+*/
+struct transresistance
+{
+	std::pair<int, int> nodes; //!< Węzły wyjściowe
+	int control;               //!< Numer SEM, której prąd steruje źródłem
+	std::complex<double> gain;
+};
+
 /**
 	\brief Idealny wzmacniacz operacyjny
 
@@ -64,6 +118,31 @@ struct opamp
 	int output_node;
 };
 
+/**
+	\brief Rozkład LU macierzy układu równań z częściowym wyborem elementu głównego
+
+	Raz wyznaczony rozkład pozwala na tanie rozwiązywanie układu \f$ Ax = z \f$ dla
+	dowolnej liczby wektorów wyrazów wolnych oraz układu transponowanego \f$ A^T y = c \f$
+	(układu sprzężonego), bez ponownej eliminacji.
+*/
+class lu_factorization
+{
+public:
+	explicit lu_factorization(matrix<std::complex<double>> A);
+
+	matrix<std::complex<double>> solve(const matrix<std::complex<double>> &z) const;
+	matrix<std::complex<double>> solve_transposed(const matrix<std::complex<double>> &c) const;
+
+	int size() const;
+
+private:
+	//! Połączone macierze L (bez jedynek na przekątnej) i U
+	matrix<std::complex<double>> m_lu;
+
+	//! Permutacja wierszy - i-ty wiersz rozkładu odpowiada wierszowi m_perm[i] macierzy A
+	std::vector<int> m_perm;
+};
+
 /**
 	\brief Wynik analizy układu metodą MNA
 
@@ -73,18 +152,32 @@ struct opamp
 class mna_solution
 {
 public:
-	mna_solution(const matrix<std::complex<double>> &solution, int node_count, int vs_count);
+	mna_solution(const matrix<std::complex<double>> &solution, int node_count, int vs_count, int opamp_count,
+		std::shared_ptr<const lu_factorization> factorization = nullptr);
 
 	std::complex<double> voltage(int pos, int neg = -1) const;
 	std::complex<double> voltage_source_current(int id) const;
 	std::complex<double> opamp_current(int id) const;
+	std::complex<double> controlled_source_current(int id) const;
+
+	int get_node_count() const;
+	int voltage_source_row(int id) const;
+	int opamp_row(int id) const;
+	int controlled_source_row(int id) const;
+
+	matrix<std::complex<double>> solve_adjoint(const matrix<std::complex<double>> &c) const;
+	std::shared_ptr<const lu_factorization> get_factorization() const;
 
-	const matrix<std::complex<double>> get_matrix() const;
+	const matrix<std::complex<double>> &get_matrix() const;
 
 private:
 	matrix<std::complex<double>> m_solution;
 	int m_node_count;
 	int m_voltage_source_count;
+	int m_opamp_count;
+
+	//! Rozkład macierzy A, na podstawie którego wyznaczono rozwiązanie
+	std::shared_ptr<const lu_factorization> m_factorization;
 };
 
 
@@ -92,7 +185,10 @@ private:
 	\brief Układ do rozwiązania metodą MNA
 
 	Układ jest zdegenerowany do listy admitancji międzywęzłowych, sił napięciowych
-	i prądowych.
+	i prądowych oraz źródeł sterowanych.
+
+	Kolejne gałęzie układu równań (prądy) to: SEM, wyjścia wzmacniaczy operacyjnych,
+	źródła \ref voltage_gain i źródła \ref transresistance.
 
 	\note Węzły poniżej 0 to napięcie odniesienia (masa). 
 
@@ -102,14 +198,22 @@ private:
 struct mna_problem
 {
 	std::vector<admittance> admittances;
+	std::vector<transconductance> transconductances;
 	std::vector<voltage_source> voltage_sources;
 	std::vector<current_source> current_sources;
 	std::vector<opamp> opamps;
+	std::vector<voltage_gain> voltage_gains;
+	std::vector<current_gain> current_gains;
+	std::vector<transresistance> transresistances;
 
 	mna_solution solve() const;
+	mna_solution solve(std::shared_ptr<const lu_factorization> lu) const;
+	std::vector<mna_solution> solve_batch(std::shared_ptr<const lu_factorization> lu, int count,
+		const std::function<void(int k)> &update_sources);
 
 private:
 	int get_max_node() const;
+	int get_branch_count() const;
 	matrix<std::complex<double>> compute_matrix_A(int node_count) const;
 	matrix<std::complex<double>> compute_matrix_z(int node_count) const;
 };
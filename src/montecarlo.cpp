@@ -0,0 +1,513 @@
+#include "montecarlo.hpp"
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <stdexcept>
+
+/**
+	\file montecarlo.cpp
+	\brief Implementacja analizy Monte Carlo
+	\author Jacek Wieczorek
+*/
+
+/**
+	\brief Krok generatora SplitMix64 - służy do wyznaczenia stanu początkowego strumienia
+*/
+static std::uint64_t splitmix64(std::uint64_t &x)
+{
+	std::uint64_t z = (x += 0x9e3779b97f4a7c15ull);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+	return z ^ (z >> 31);
+}
+
+/**
+	\brief Tworzy generator strumienia o zadanym numerze
+*/
+sample_rng::sample_rng(std::uint64_t seed, std::uint64_t stream)
+{
+	std::uint64_t x = seed;
+	x = splitmix64(x) ^ stream;
+	for (auto &s : m_state)
+		s = splitmix64(x);
+}
+
+/**
+	\brief Zwraca kolejną 64-bitową liczbę pseudolosową
+*/
+std::uint64_t sample_rng::next()
+{
+	auto rotl = [](std::uint64_t x, int k){return (x << k) | (x >> (64 - k));};
+
+	auto *s = m_state;
+	const auto result = rotl(s[1] * 5, 7) * 9;
+	const auto t = s[1] << 17;
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = rotl(s[3], 45);
+	return result;
+}
+
+/**
+	\brief Zwraca liczbę z rozkładu jednostajnego w przedziale [0, 1)
+*/
+double sample_rng::uniform()
+{
+	return (next() >> 11) * 0x1.0p-53;
+}
+
+/**
+	\brief Zwraca liczbę ze standardowego rozkładu normalnego
+*/
+double sample_rng::normal()
+{
+	auto u1 = 1.0 - uniform(); // (0, 1]
+	auto u2 = uniform();
+	return std::sqrt(-2.0 * std::log(u1)) * std::cos(2.0 * M_PI * u2);
+}
+
+/**
+	\brief Losuje wartość elementu o zadanej wartości nominalnej
+*/
+double component_tolerance::sample(double nominal, sample_rng &rng) const
+{
+	switch (distribution)
+	{
+		case tolerance_distribution::GAUSSIAN:
+			return nominal * (1.0 + tolerance / 3.0 * rng.normal());
+
+		case tolerance_distribution::UNIFORM:
+		default:
+			return nominal * (1.0 + tolerance * (2.0 * rng.uniform() - 1.0));
+	}
+}
+
+/**
+	\brief Tworzy estymator kwantyla rzędu p (od 0 do 1)
+*/
+p2_quantile::p2_quantile(double p) :
+	m_p(p)
+{
+}
+
+/**
+	\brief Dodaje próbkę
+*/
+void p2_quantile::add(double x)
+{
+	auto &q = m_heights;
+	auto &n = m_positions;
+
+	// Pierwsze pięć próbek staje się znacznikami
+	if (m_count < 5)
+	{
+		q[m_count++] = x;
+		if (m_count == 5)
+		{
+			std::sort(q, q + 5);
+			for (int i = 0; i < 5; i++)
+				n[i] = i + 1;
+
+			const double p = m_p;
+			const double desired[5] = {1, 1 + 2 * p, 1 + 4 * p, 3 + 2 * p, 5};
+			const double increments[5] = {0, p / 2, p, (1 + p) / 2, 1};
+			std::copy(desired, desired + 5, m_desired);
+			std::copy(increments, increments + 5, m_increments);
+		}
+		return;
+	}
+
+	// Przedział między znacznikami, do którego trafia próbka
+	int k;
+	if (x < q[0])
+	{
+		q[0] = x;
+		k = 0;
+	}
+	else if (x >= q[4])
+	{
+		q[4] = x;
+		k = 3;
+	}
+	else
+	{
+		k = 0;
+		while (x >= q[k + 1])
+			k++;
+	}
+
+	for (int i = k + 1; i < 5; i++)
+		n[i]++;
+	for (int i = 0; i < 5; i++)
+		m_desired[i] += m_increments[i];
+	m_count++;
+
+	// Korekta położenia środkowych znaczników
+	for (int i = 1; i < 4; i++)
+	{
+		double d = m_desired[i] - n[i];
+		if ((d >= 1 && n[i + 1] - n[i] > 1) || (d <= -1 && n[i - 1] - n[i] < -1))
+		{
+			int s = d >= 0 ? 1 : -1;
+			double h = parabolic(i, s);
+			if (q[i - 1] < h && h < q[i + 1])
+				q[i] = h;
+			else
+				q[i] = linear(i, s);
+			n[i] += s;
+		}
+	}
+}
+
+/**
+	\brief Interpolacja paraboliczna wysokości znacznika
+*/
+double p2_quantile::parabolic(int i, int d) const
+{
+	const auto &q = m_heights;
+	const auto &n = m_positions;
+	return q[i] + d / (n[i + 1] - n[i - 1])
+		* ((n[i] - n[i - 1] + d) * (q[i + 1] - q[i]) / (n[i + 1] - n[i])
+		+ (n[i + 1] - n[i] - d) * (q[i] - q[i - 1]) / (n[i] - n[i - 1]));
+}
+
+/**
+	\brief Interpolacja liniowa wysokości znacznika
+*/
+double p2_quantile::linear(int i, int d) const
+{
+	const auto &q = m_heights;
+	const auto &n = m_positions;
+	return q[i] + d * (q[i + d] - q[i]) / (n[i + d] - n[i]);
+}
+
+/**
+	\brief Zwraca oszacowanie kwantyla
+
+	Dla mniej niż pięciu próbek zwracany jest dokładny kwantyl (z interpolacją liniową).
+*/
+double p2_quantile::get_value() const
+{
+	if (m_count >= 5)
+		return m_heights[2];
+
+	if (m_count == 0)
+		return NAN;
+
+	double sorted[5];
+	std::copy(m_heights, m_heights + m_count, sorted);
+	std::sort(sorted, sorted + m_count);
+
+	double pos = m_p * (m_count - 1);
+	int i = std::floor(pos);
+	if (i + 1 >= m_count)
+		return sorted[m_count - 1];
+	return sorted[i] + (pos - i) * (sorted[i + 1] - sorted[i]);
+}
+
+/**
+	\brief Tworzy pusty histogram o zadanej liczbie przedziałów
+*/
+streaming_histogram::streaming_histogram(int bins) :
+	m_counts(std::max(bins, 1))
+{
+}
+
+/**
+	\brief Dodaje próbkę (wartości nieskończone i NaN są pomijane)
+*/
+void streaming_histogram::add(double x)
+{
+	if (!std::isfinite(x))
+		return;
+
+	if (m_width == 0)
+	{
+		m_initial.push_back(x);
+		if (static_cast<int>(m_initial.size()) >= initial_samples)
+			start();
+		return;
+	}
+
+	insert(x);
+}
+
+/**
+	\brief Ustala zakres na podstawie pierwszych próbek i umieszcza je w histogramie
+
+	Zakres pierwszych próbek jest poszerzany o 25% w każdą stronę, by kolejne próbki
+	rzadko wymagały jego podwojenia (zmniejszającego rozdzielczość histogramu).
+	Jeżeli próbek było mniej, niż \ref initial_samples, zakres nie jest poszerzany.
+*/
+void streaming_histogram::start()
+{
+	if (m_initial.empty())
+		return;
+
+	auto [lo, hi] = std::minmax_element(m_initial.begin(), m_initial.end());
+	const int bins = m_counts.size();
+	const double margin = static_cast<int>(m_initial.size()) >= initial_samples ? 0.25 : 0.0;
+
+	if (*hi > *lo)
+	{
+		m_width = (*hi - *lo) * (1 + 2 * margin) / bins;
+		m_lower = *lo - (*hi - *lo) * margin;
+	}
+	else
+	{
+		m_width = *lo != 0 ? std::abs(*lo) * 1e-9 : 1e-12;
+		m_lower = *lo - m_width * bins / 2;
+	}
+
+	// Pierwsze próbki mieszczą się w zakresie (największa - także przy błędach zaokrągleń)
+	for (auto x : m_initial)
+		m_counts[std::clamp(static_cast<int>(std::floor((x - m_lower) / m_width)), 0, bins - 1)]++;
+	m_initial.clear();
+}
+
+/**
+	\brief Umieszcza próbkę w histogramie, rozszerzając zakres w razie potrzeby
+*/
+void streaming_histogram::insert(double x)
+{
+	const int bins = m_counts.size();
+
+	while (true)
+	{
+		double i = std::floor((x - m_lower) / m_width);
+		if (i >= 0 && i < bins)
+		{
+			m_counts[static_cast<int>(i)]++;
+			return;
+		}
+
+		// Podwojenie szerokości przedziałów - w górę lub w dół od bieżącego zakresu
+		std::vector<long long> merged(bins);
+		int offset = i < 0 ? bins : 0;
+		for (int j = 0; j < bins; j++)
+			merged[(offset + j) / 2] += m_counts[j];
+
+		if (i < 0)
+			m_lower -= bins * m_width;
+		m_width *= 2;
+		m_counts = std::move(merged);
+	}
+}
+
+/**
+	\brief Zwraca dolną granicę pierwszego przedziału
+*/
+double streaming_histogram::get_lower() const
+{
+	return m_width == 0 ? started().m_lower : m_lower;
+}
+
+/**
+	\brief Zwraca szerokość przedziału
+*/
+double streaming_histogram::get_bin_width() const
+{
+	return m_width == 0 ? started().m_width : m_width;
+}
+
+/**
+	\brief Zwraca liczności przedziałów
+*/
+std::vector<long long> streaming_histogram::get_counts() const
+{
+	return m_width == 0 ? started().m_counts : m_counts;
+}
+
+/**
+	\brief Zwraca kopię histogramu z zakresem ustalonym na podstawie dotychczasowych próbek
+*/
+streaming_histogram streaming_histogram::started() const
+{
+	auto h = *this;
+	h.start();
+	return h;
+}
+
+const std::vector<double> streaming_statistics::percentiles = {1, 5, 50, 95, 99};
+
+/**
+	\brief Tworzy puste statystyki z histogramem o zadanej liczbie przedziałów
+*/
+streaming_statistics::streaming_statistics(int bins) :
+	m_histogram(bins)
+{
+	for (auto p : percentiles)
+		m_quantiles.emplace_back(p / 100.0);
+}
+
+/**
+	\brief Dodaje próbkę
+*/
+void streaming_statistics::add(double x)
+{
+	m_count++;
+	if (m_count == 1)
+		m_min = m_max = x;
+	else
+	{
+		m_min = std::min(m_min, x);
+		m_max = std::max(m_max, x);
+	}
+
+	// Algorytm Welforda
+	double delta = x - m_mean;
+	m_mean += delta / m_count;
+	m_m2 += delta * (x - m_mean);
+
+	for (auto &q : m_quantiles)
+		q.add(x);
+	m_histogram.add(x);
+}
+
+//! Liczba próbek
+long long streaming_statistics::get_count() const
+{
+	return m_count;
+}
+
+//! Średnia
+double streaming_statistics::get_mean() const
+{
+	return m_mean;
+}
+
+//! Odchylenie standardowe (z próby)
+double streaming_statistics::get_sigma() const
+{
+	return m_count > 1 ? std::sqrt(m_m2 / (m_count - 1)) : 0.0;
+}
+
+//! Najmniejsza wartość
+double streaming_statistics::get_min() const
+{
+	return m_min;
+}
+
+//! Największa wartość
+double streaming_statistics::get_max() const
+{
+	return m_max;
+}
+
+/**
+	\brief Zwraca oszacowanie percentyla
+	\param i Numer percentyla w \ref percentiles
+*/
+double streaming_statistics::get_percentile(int i) const
+{
+	return m_quantiles.at(i).get_value();
+}
+
+//! Histogram wartości
+const streaming_histogram &streaming_statistics::get_histogram() const
+{
+	return m_histogram;
+}
+
+/**
+	\brief Przygotowuje analizę dla zadanego planu
+
+	\param plan Plan rozwiązania z wartościami nominalnymi
+	\param tolerances Tolerancje elementów (według nazw)
+	\throws std::runtime_error jeżeli tolerancję przypisano elementowi, którego wartości nie można zmieniać
+*/
+monte_carlo::monte_carlo(std::shared_ptr<const solve_plan> plan, const std::map<std::string, component_tolerance> &tolerances) :
+	m_plan(std::move(plan))
+{
+	using kind = solve_plan::component_kind;
+	const auto &names = m_plan->get_names();
+	const auto &st = m_plan->get_components();
+
+	for (const auto &[name, tol] : tolerances)
+	{
+		auto it = names.find(name);
+		if (it == names.end())
+			throw std::runtime_error("Component '" + name + "' is not a part of the solve plan");
+
+		const auto &ref = it->second;
+		if (ref.kind != kind::RESISTOR && ref.kind != kind::INDUCTOR && ref.kind != kind::CAPACITOR)
+			throw std::runtime_error("Tolerance of component '" + name + "' is not supported");
+
+		m_components.push_back({ref, st.bipoles(ref.kind)->value[ref.index], tol});
+	}
+}
+
+/**
+	\brief Wykonuje analizę
+
+	\param scheduler Planista wykonujący próby
+	\param samples Liczba prób
+	\param seed Ziarno generatora - ta sama wartość daje te same wyniki
+	\param omega Pulsacja, dla której rozwiązywany jest układ
+	\param quantities Liczba wielkości mierzonych w każdej próbie
+	\param bins Liczba przedziałów histogramów
+	\param measure Funkcja mierząca wielkości
+	\returns Statystyki kolejnych wielkości
+	\throws std::runtime_error jeżeli nie udało się rozwiązać układu w którejś z prób
+		(zgłaszana jest próba o najmniejszym numerze)
+*/
+std::vector<streaming_statistics> monte_carlo::run(task_scheduler &scheduler, int samples, std::uint64_t seed,
+	double omega, int quantities, int bins, const measure_function &measure) const
+{
+	std::vector<streaming_statistics> stats(quantities, streaming_statistics(bins));
+	std::vector<double> values(batch_size * quantities);
+	std::vector<std::exception_ptr> errors(batch_size);
+
+	for (int first = 0; first < samples; first += batch_size)
+	{
+		const int count = std::min(batch_size, samples - first);
+
+		// Każde zadanie rozwiązuje kolejne próby na własnej kopii planu
+		scheduler.parallel_for(0, count, 8, [&](int begin, int end){
+			auto plan = std::make_shared<solve_plan>(*m_plan);
+			solve_context ctx(plan);
+
+			for (int i = begin; i < end; i++)
+			{
+				try
+				{
+					sample_rng rng(seed, first + i);
+					for (const auto &c : m_components)
+						plan->set_value(c.ref, c.tolerance.sample(c.nominal, rng));
+
+					ctx.set_plan(plan);
+					ctx.solve(omega);
+					measure(ctx, &values[i * quantities]);
+				}
+				catch (...)
+				{
+					errors[i] = std::current_exception();
+				}
+			}
+		});
+
+		// Wyniki dodawane są do statystyk w kolejności prób
+		for (int i = 0; i < count; i++)
+		{
+			if (errors[i])
+			{
+				try
+				{
+					std::rethrow_exception(errors[i]);
+				}
+				catch (const std::exception &ex)
+				{
+					throw std::runtime_error("Sample " + std::to_string(first + i) + " failed - reason: " + ex.what());
+				}
+			}
+
+			for (int q = 0; q < quantities; q++)
+				stats[q].add(values[i * quantities + q]);
+		}
+	}
+
+	return stats;
+}
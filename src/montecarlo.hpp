@@ -0,0 +1,190 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "circuit.hpp"
+#include "scheduler.hpp"
+
+/**
+	\file montecarlo.hpp
+	\brief Analiza Monte Carlo - losowanie wartości elementów i statystyki strumieniowe
+	\author Jacek Wieczorek
+*/
+
+/**
+	\brief Generator liczb pseudolosowych jednej próby (xoshiro256**)
+
+	Każda próba ma własny strumień wyznaczony przez ziarno analizy i numer próby, więc
+	wylosowane wartości nie zależą od liczby wątków ani od kolejności wykonania prób.
+	Rozkład normalny wyznaczany jest metodą Boxa-Mullera (a nie przez
+	std::normal_distribution, której wyniki zależą od implementacji biblioteki).
+
+	\see https://prng.di.unimi.it/
+*/
+class sample_rng
+{
+public:
+	sample_rng(std::uint64_t seed, std::uint64_t stream);
+
+	std::uint64_t next();
+	double uniform();
+	double normal();
+
+private:
+	std::uint64_t m_state[4];
+};
+
+/**
+	\brief Rozkład odchyłki wartości elementu od wartości nominalnej
+*/
+enum class tolerance_distribution
+{
+	UNIFORM,  //!< Rozkład jednostajny w przedziale +/- tolerancja
+	GAUSSIAN  //!< Rozkład normalny, tolerancja odpowiada 3 sigma
+};
+
+/**
+	\brief Tolerancja wartości elementu
+*/
+struct component_tolerance
+{
+	double tolerance; //!< Względna tolerancja (np. 0.05 dla 5%)
+	tolerance_distribution distribution = tolerance_distribution::UNIFORM;
+
+	double sample(double nominal, sample_rng &rng) const;
+};
+
+/**
+	\brief Estymator kwantyla bez przechowywania próbek (algorytm P²)
+
+	\see R. Jain, I. Chlamtac, "The P² algorithm for dynamic calculation of quantiles
+		and histograms without storing observations", CACM 28(10), 1985
+*/
+class p2_quantile
+{
+public:
+	explicit p2_quantile(double p);
+
+	void add(double x);
+	double get_value() const;
+
+private:
+	double parabolic(int i, int d) const;
+	double linear(int i, int d) const;
+
+	double m_p;
+	int m_count = 0;
+	double m_heights[5];   //!< Wysokości znaczników
+	double m_positions[5]; //!< Położenia znaczników
+	double m_desired[5];   //!< Pożądane położenia znaczników
+	double m_increments[5];
+};
+
+/**
+	\brief Histogram o stałej liczbie przedziałów i zakresie rozszerzanym w trakcie zbierania próbek
+
+	Zakres początkowy wyznaczany jest na podstawie pierwszych próbek. Próbka spoza zakresu
+	powoduje jego podwojenie (przez połączenie sąsiednich przedziałów), więc liczności
+	pozostają dokładne, a pamięć nie zależy od liczby próbek.
+*/
+class streaming_histogram
+{
+public:
+	explicit streaming_histogram(int bins);
+
+	void add(double x);
+	double get_lower() const;
+	double get_bin_width() const;
+	std::vector<long long> get_counts() const;
+
+private:
+	void start();
+	void insert(double x);
+	streaming_histogram started() const;
+
+	//! Liczba próbek zbieranych przed ustaleniem zakresu
+	static constexpr int initial_samples = 1024;
+
+	std::vector<double> m_initial;
+	std::vector<long long> m_counts;
+	double m_lower = 0;
+	double m_width = 0;
+};
+
+/**
+	\brief Statystyki jednej wielkości wyznaczane strumieniowo
+
+	Średnia i odchylenie standardowe liczone są algorytmem Welforda, percentyle -
+	algorytmem P², a rozkład zbierany jest w histogramie \ref streaming_histogram.
+*/
+class streaming_statistics
+{
+public:
+	explicit streaming_statistics(int bins = 20);
+
+	void add(double x);
+
+	long long get_count() const;
+	double get_mean() const;
+	double get_sigma() const;
+	double get_min() const;
+	double get_max() const;
+	double get_percentile(int i) const;
+	const streaming_histogram &get_histogram() const;
+
+	//! Wyznaczane percentyle (w procentach)
+	static const std::vector<double> percentiles;
+
+private:
+	long long m_count = 0;
+	double m_mean = 0;
+	double m_m2 = 0;
+	double m_min = 0;
+	double m_max = 0;
+	std::vector<p2_quantile> m_quantiles;
+	streaming_histogram m_histogram;
+};
+
+/**
+	\brief Analiza Monte Carlo - wielokrotne rozwiązanie układu dla losowych wartości elementów
+
+	Wszystkie próby korzystają z jednego planu rozwiązania (\ref solve_plan) - każde zadanie
+	tworzy jego prywatną kopię i zmienia w niej jedynie wartości elementów obarczonych
+	tolerancją. Próby wykonywane są równolegle w paczkach (\ref task_scheduler), a wyniki
+	każdej paczki dodawane są do statystyk w kolejności prób - wynik analizy nie zależy
+	od liczby wątków.
+*/
+class monte_carlo
+{
+public:
+	/**
+		\brief Funkcja mierząca wielkości w rozwiązanym układzie
+
+		\param ctx Kontekst z rozwiązaniem próby
+		\param values Tablica, do której należy zapisać zmierzone wartości
+	*/
+	using measure_function = std::function<void(const solve_context &ctx, double *values)>;
+
+	monte_carlo(std::shared_ptr<const solve_plan> plan, const std::map<std::string, component_tolerance> &tolerances);
+
+	std::vector<streaming_statistics> run(task_scheduler &scheduler, int samples, std::uint64_t seed,
+		double omega, int quantities, int bins, const measure_function &measure) const;
+
+private:
+	//! Element obarczony tolerancją
+	struct varied_component
+	{
+		solve_plan::component_ref ref;
+		double nominal;
+		component_tolerance tolerance;
+	};
+
+	//! Liczba prób w jednej paczce
+	static constexpr int batch_size = 1024;
+
+	std::shared_ptr<const solve_plan> m_plan;
+	std::vector<varied_component> m_components;
+};
@@ -0,0 +1,187 @@
+#include "netlist.hpp"
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+	\file netlist.cpp
+	\brief Implementacja \ref netlist_buffer, \ref line_reader i analizy tokenów
+	\author Jacek Wieczorek
+*/
+
+/**
+	\brief Odwzorowuje w pamięci lub wczytuje zawartość deskryptora (od bieżącej pozycji)
+	\throws std::runtime_error jeżeli nie udało się odczytać wejścia
+*/
+netlist_buffer::netlist_buffer(int fd)
+{
+	struct stat st;
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+	{
+		const off_t pos = lseek(fd, 0, SEEK_CUR);
+		void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map != MAP_FAILED)
+		{
+			m_map = map;
+			m_map_size = st.st_size;
+			m_offset = std::clamp<off_t>(pos, 0, st.st_size);
+			madvise(m_map, m_map_size, MADV_SEQUENTIAL);
+			return;
+		}
+	}
+
+	// Potok, terminal lub plik, którego nie udało się odwzorować
+	char chunk[1 << 16];
+	ssize_t count;
+	while ((count = read(fd, chunk, sizeof(chunk))) != 0)
+	{
+		if (count < 0)
+			throw std::runtime_error("Could not read input");
+		m_data.insert(m_data.end(), chunk, chunk + count);
+	}
+}
+
+netlist_buffer::~netlist_buffer()
+{
+	if (m_map)
+		munmap(m_map, m_map_size);
+}
+
+/**
+	\brief Zwraca zawartość wejścia
+*/
+std::string_view netlist_buffer::text() const
+{
+	if (m_map)
+		return {static_cast<const char*>(m_map) + m_offset, m_map_size - m_offset};
+	return {m_data.data(), m_data.size()};
+}
+
+line_reader::line_reader(std::string_view text) :
+	m_rest(text)
+{
+}
+
+/**
+	\brief Odczytuje kolejną linię
+	\returns false, jeżeli tekst się skończył
+*/
+bool line_reader::next(std::string_view &line)
+{
+	if (m_rest.empty())
+		return false;
+
+	const auto end = m_rest.find('\n');
+	line = m_rest.substr(0, end);
+	m_rest.remove_prefix(end == std::string_view::npos ? m_rest.size() : end + 1);
+
+	if (!line.empty() && line.back() == '\r')
+		line.remove_suffix(1);
+	return true;
+}
+
+/**
+	\brief Dzieli tekst na fragmenty rozdzielone znakami białymi (i opcjonalnie przecinkami)
+
+	\param s Tekst
+	\param tokens Wektor fragmentów (widoków na s) - czyszczony, ale jego pamięć jest wykorzystywana ponownie
+	\param comma_separated Czy przecinki również rozdzielają fragmenty
+*/
+void tokenize(std::string_view s, std::vector<std::string_view> &tokens, bool comma_separated)
+{
+	auto separator = [comma_separated](char c){
+		return std::isspace(static_cast<unsigned char>(c)) || (comma_separated && c == ',');
+	};
+
+	tokens.clear();
+	const char *p = s.data();
+	const char *end = p + s.size();
+	while (p != end)
+	{
+		while (p != end && separator(*p))
+			p++;
+
+		const char *begin = p;
+		while (p != end && !separator(*p))
+			p++;
+
+		if (p != begin)
+			tokens.emplace_back(begin, p - begin);
+	}
+}
+
+/**
+	\brief Zamienia tekst będący liczbą z przedrostkiem SI (np. `2.2k`, `1Meg`) na wartość
+
+	\throws std::invalid_argument jeżeli tekst nie zaczyna się od liczby
+	\throws std::runtime_error dla nieznanych przedrostków
+*/
+double parse_si_number(std::string_view s)
+{
+	const char *begin = s.data();
+	const char *end = begin + s.size();
+	if (begin != end && *begin == '+')
+		begin++;
+
+	double value;
+	auto [ptr, ec] = std::from_chars(begin, end, value);
+	if (ec != std::errc{})
+		throw std::invalid_argument("Invalid number");
+
+	const std::string_view prefix(ptr, end - ptr);
+	if (prefix.empty())
+		return value;
+
+	if (prefix.size() == 1)
+	{
+		switch (prefix[0])
+		{
+			case 'p': return value * 1e-12;
+			case 'n': return value * 1e-9;
+			case 'u': return value * 1e-6;
+			case 'm': return value * 1e-3;
+			case 'k': return value * 1e3;
+			case 'G': return value * 1e9;
+		}
+	}
+	else if (prefix == "Meg")
+		return value * 1e6;
+
+	throw std::runtime_error("Invalid SI prefix");
+}
+
+/**
+	\brief Zamienia początek tekstu na liczbę całkowitą (jak std::stoi, np. numer węzła)
+
+	\throws std::invalid_argument jeżeli tekst nie zaczyna się od liczby
+	\throws std::out_of_range jeżeli liczba nie mieści się w typie int
+*/
+int parse_int(std::string_view s)
+{
+	const char *begin = s.data();
+	const char *end = begin + s.size();
+	if (begin != end && *begin == '+')
+		begin++;
+
+	int value;
+	auto [ptr, ec] = std::from_chars(begin, end, value);
+	if (ec == std::errc::result_out_of_range)
+		throw std::out_of_range("Integer out of range");
+	if (ec != std::errc{})
+		throw std::invalid_argument("Invalid integer");
+	return value;
+}
+
+/**
+	\brief Porównuje teksty bez uwzględniania wielkości liter
+*/
+bool iequals(std::string_view a, std::string_view b)
+{
+	return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](char x, char y){
+		return std::tolower(static_cast<unsigned char>(x)) == std::tolower(static_cast<unsigned char>(y));
+	});
+}
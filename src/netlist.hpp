@@ -0,0 +1,54 @@
+#pragma once
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+/**
+	\file netlist.hpp
+	\brief Wczytywanie pliku SPICE i podział na linie i tokeny bez kopiowania tekstu
+	\author Jacek Wieczorek
+*/
+
+/**
+	\brief Cała zawartość pliku wejściowego w jednym buforze
+
+	Zwykłe pliki są odwzorowywane w pamięci (mmap), a pozostałe wejścia (potoki, terminal)
+	wczytywane w całości. Linie i tokeny są widokami (std::string_view) na ten bufor, więc
+	są ważne tak długo, jak istnieje obiekt.
+*/
+class netlist_buffer
+{
+public:
+	explicit netlist_buffer(int fd);
+	~netlist_buffer();
+
+	netlist_buffer(const netlist_buffer &) = delete;
+	netlist_buffer &operator=(const netlist_buffer &) = delete;
+
+	std::string_view text() const;
+
+private:
+	void *m_map = nullptr;      //!< Odwzorowany plik (lub nullptr)
+	std::size_t m_map_size = 0; //!< Rozmiar odwzorowania [B]
+	std::size_t m_offset = 0;   //!< Bieżąca pozycja deskryptora w chwili odwzorowania
+	std::vector<char> m_data;   //!< Zawartość wejścia, które nie jest zwykłym plikiem
+};
+
+/**
+	\brief Kolejne linie tekstu (bez znaków końca linii, także '\\r')
+*/
+class line_reader
+{
+public:
+	explicit line_reader(std::string_view text);
+
+	bool next(std::string_view &line);
+
+private:
+	std::string_view m_rest;
+};
+
+void tokenize(std::string_view s, std::vector<std::string_view> &tokens, bool comma_separated = false);
+double parse_si_number(std::string_view s);
+int parse_int(std::string_view s);
+bool iequals(std::string_view a, std::string_view b);
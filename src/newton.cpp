@@ -0,0 +1,276 @@
+#include "newton.hpp"
+#include <cmath>
+#include <stdexcept>
+
+/**
+	\file newton.cpp
+	\brief Implementacja \ref newton_solver
+	\author Jacek Wieczorek
+*/
+
+/**
+	\brief Przygotowuje analizę - buduje strukturę układu równań
+
+	\param plan Plan rozwiązania układu (z elementami nieliniowymi)
+	\param options Parametry metody Newtona-Raphsona
+*/
+newton_solver::newton_solver(std::shared_ptr<const solve_plan> plan, const newton_options &options) :
+	m_plan(std::move(plan)),
+	m_options(options)
+{
+	const auto &st = m_plan->get_components();
+	const int node_count = m_plan->get_node_count();
+
+	m_plan->assemble(0.0, m_problem);
+	m_linear_admittances = m_problem.admittances.size();
+	m_linear_transconductances = m_problem.transconductances.size();
+	m_linear_current_sources = m_problem.current_sources.size();
+
+	// Konduktancje od każdego węzła do masy (gmin stepping)
+	for (int i = 0; i < node_count; i++)
+		m_problem.admittances.push_back({{i, -1}, 0.0});
+
+	// Miejsca na linearyzacje elementów nieliniowych - wpis g_kj macierzy konduktancji to
+	// transkonduktancja od węzła k do masy sterowana potencjałem węzła j
+	for (const auto &nodes : st.nonlinear.nodes)
+	{
+		for (int k = 0; k < 3; k++)
+			for (int j = 0; j < 3; j++)
+				m_problem.transconductances.push_back({{nodes[k], -1}, {nodes[j], -1}, 0.0});
+		for (int k = 0; k < 3; k++)
+			m_problem.current_sources.push_back({{nodes[k], -1}, 0.0});
+	}
+
+	m_devices.resize(st.nonlinear.size());
+	m_x.assign(node_count + m_plan->get_branch_count(), 0.0);
+}
+
+/**
+	\brief Wpisuje do układu wartości źródeł niezależnych przemnożone przez scale
+*/
+void newton_solver::load_sources(double scale)
+{
+	const auto &st = m_plan->get_components();
+	for (int i = 0; i < st.voltage_sources.size(); i++)
+		m_problem.voltage_sources[i].V = scale * st.voltage_sources.value[i];
+	for (int i = 0; i < st.current_sources.size(); i++)
+		m_problem.current_sources[i].I = scale * st.current_sources.value[i];
+}
+
+/**
+	\brief Wpisuje do układu linearyzację elementu nieliniowego
+
+	Prąd k-tego wyprowadzenia \f$ i_k + \sum_j g_{kj} (v_j - v_j^0) \f$ to suma transkonduktancji
+	i źródła prądowego \f$ i_k - \sum_j g_{kj} v_j^0 \f$ wypływającego z węzła.
+*/
+void newton_solver::stamp_device(int d)
+{
+	const auto &ds = m_devices[d];
+	auto *trans = &m_problem.transconductances[m_linear_transconductances + 9 * d];
+	auto *sources = &m_problem.current_sources[m_linear_current_sources + 3 * d];
+
+	for (int k = 0; k < 3; k++)
+	{
+		double ieq = ds.lin.current[k];
+		for (int j = 0; j < 3; j++)
+		{
+			trans[3 * k + j].G = ds.lin.conductance[k][j];
+			ieq -= ds.lin.conductance[k][j] * ds.v[j];
+		}
+		sources[k].I = -ieq;
+	}
+}
+
+/**
+	\brief Iteracje metody Newtona-Raphsona od bieżącego przybliżenia
+
+	\param gshunt Konduktancja dołączana od każdego węzła do masy [S]
+	\param source_scale Mnożnik wartości źródeł niezależnych
+	\returns true, jeżeli iteracja jest zbieżna
+	\throws std::runtime_error jeżeli nie udało się rozwiązać układu
+*/
+bool newton_solver::iterate(double gshunt, double source_scale)
+{
+	const auto &st = m_plan->get_components();
+	const int node_count = m_plan->get_node_count();
+	const auto &o = m_options;
+
+	for (int i = 0; i < node_count; i++)
+	{
+		auto &Y = m_problem.admittances[m_linear_admittances + i].Y;
+		if (Y != gshunt)
+		{
+			Y = gshunt;
+			m_matrix_dirty = true;
+		}
+	}
+	load_sources(source_scale);
+
+	auto close = [&](double a, double b, double abs){
+		return std::abs(a - b) <= o.reltol * std::max(std::abs(a), std::abs(b)) + abs;
+	};
+
+	for (int it = 0; it < o.max_iterations; it++)
+	{
+		// Linearyzacja elementów w bieżącym punkcie pracy
+		bool limited = false;
+		for (int d = 0; d < st.nonlinear.size(); d++)
+		{
+			auto &ds = m_devices[d];
+			const auto *device = st.nonlinear.comp[d];
+			const auto &nodes = st.nonlinear.nodes[d];
+
+			std::array<double, 3> v{};
+			for (int k = 0; k < device->terminal_count; k++)
+				v[k] = nodes[k] < 0 ? 0.0 : m_x[nodes[k]];
+
+			if (ds.valid && o.bypass && close(v[0], ds.v[0], o.vntol) && close(v[1], ds.v[1], o.vntol) && close(v[2], ds.v[2], o.vntol))
+				continue;
+
+			if (ds.valid)
+				limited |= device->limit(ds.v, v);
+
+			device->evaluate(v, ds.lin);
+			ds.v = v;
+			ds.valid = true;
+			stamp_device(d);
+			m_matrix_dirty = true;
+		}
+
+		// Nowy rozkład tylko wtedy, gdy zmieniła się macierz układu
+		auto solution = m_matrix_dirty || !m_lu ? m_problem.solve() : m_problem.solve(m_lu);
+		if (m_matrix_dirty || !m_lu)
+		{
+			m_lu = solution.get_factorization();
+			m_matrix_dirty = false;
+		}
+		if (solution.get_node_count() != node_count)
+			throw std::runtime_error("Invalid nonlinear equation system");
+
+		const auto &x = solution.get_matrix();
+		bool converged = !limited;
+		for (unsigned int i = 0; i < m_x.size(); i++)
+		{
+			const double xi = x(i, 0).real();
+			if (!std::isfinite(xi))
+				return false;
+
+			converged &= close(xi, m_x[i], static_cast<int>(i) < node_count ? o.vntol : o.abstol);
+			m_x[i] = xi;
+		}
+
+		if (converged)
+			return true;
+	}
+
+	return false;
+}
+
+/**
+	\brief Unieważnia linearyzacje elementów i zeruje przybliżenie rozwiązania
+*/
+void newton_solver::reset()
+{
+	std::fill(m_x.begin(), m_x.end(), 0.0);
+	for (auto &ds : m_devices)
+		ds.valid = false;
+}
+
+/**
+	\brief Wyznacza punkt pracy
+
+	Przybliżeniem początkowym jest poprzednie rozwiązanie (lub zera przy pierwszym wywołaniu).
+	Wartości źródeł niezależnych odczytywane są z planu przy każdym wywołaniu, więc między
+	kolejnymi punktami analizy mogą być zmieniane w prywatnej kopii planu.
+
+	\returns Stan układu w punkcie pracy
+	\throws std::runtime_error jeżeli iteracja nie jest zbieżna mimo krokowego zmniejszania gmin
+		i zwiększania wartości źródeł
+*/
+const transient_state &newton_solver::solve()
+{
+	auto attempt = [&](double gshunt, double source_scale){
+		try
+		{
+			return iterate(gshunt, source_scale);
+		}
+		catch (const std::runtime_error &ex)
+		{
+			return false;
+		}
+	};
+
+	const auto initial = m_x;
+	if (attempt(0.0, 1.0))
+	{
+		update_state();
+		return m_state;
+	}
+
+	// Krokowe zmniejszanie konduktancji do masy
+	m_x = initial;
+	for (auto &ds : m_devices)
+		ds.valid = false;
+
+	bool ok = true;
+	for (double g = m_options.gmin_start; ok && g > nonlinear_component::gmin; g /= 10)
+		ok = attempt(g, 1.0);
+	if (ok && attempt(0.0, 1.0))
+	{
+		update_state();
+		return m_state;
+	}
+
+	// Krokowe zwiększanie wartości źródeł
+	reset();
+	ok = true;
+	for (int k = 1; ok && k <= m_options.source_steps; k++)
+		ok = attempt(0.0, static_cast<double>(k) / m_options.source_steps);
+	if (ok)
+	{
+		update_state();
+		return m_state;
+	}
+
+	reset();
+	throw std::runtime_error("Newton-Raphson iteration did not converge");
+}
+
+/**
+	\brief Wypełnia stan układu na podstawie rozwiązania
+*/
+void newton_solver::update_state()
+{
+	using kind = solve_plan::component_kind;
+
+	const auto &st = m_plan->get_components();
+	const int node_count = m_plan->get_node_count();
+
+	m_state.m_plan = m_plan;
+	m_state.m_time = 0;
+	m_state.m_voltages.assign(m_x.begin(), m_x.begin() + node_count);
+	m_state.m_branch_currents.assign(m_x.begin() + node_count, m_x.end());
+
+	m_state.m_inductor_currents.resize(st.inductors.size());
+	for (int i = 0; i < st.inductors.size(); i++)
+		m_state.m_inductor_currents[i] = m_plan->passive_admittance(kind::INDUCTOR, i, 0.0).real()
+			* (m_state.index_voltage(st.inductors.a[i]) - m_state.index_voltage(st.inductors.b[i]));
+
+	m_state.m_capacitor_currents.assign(st.capacitors.size(), 0.0);
+	m_state.m_current_sources = st.current_sources.value;
+
+	// Prądy elementów nieliniowych z ich linearyzacji (spełniają prawa Kirchhoffa)
+	m_state.m_device_currents.resize(st.nonlinear.size());
+	for (int d = 0; d < st.nonlinear.size(); d++)
+	{
+		const auto &ds = m_devices[d];
+		const auto &nodes = st.nonlinear.nodes[d];
+		for (int k = 0; k < 3; k++)
+		{
+			double i = ds.lin.current[k];
+			for (int j = 0; j < 3; j++)
+				i += ds.lin.conductance[k][j] * (m_state.index_voltage(nodes[j]) - ds.v[j]);
+			m_state.m_device_currents[d][k] = i;
+		}
+	}
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include <array>
+#include <memory>
+#include <vector>
+#include "circuit.hpp"
+#include "transient.hpp"
+
+/**
+	\file newton.hpp
+	\brief Analiza DC układów z elementami nieliniowymi (metoda Newtona-Raphsona)
+	\author Jacek Wieczorek
+*/
+
+/**
+	\brief Parametry metody Newtona-Raphsona
+*/
+struct newton_options
+{
+	int max_iterations = 100; //!< Największa liczba iteracji jednego rozwiązania
+	double reltol = 1e-3;     //!< Względna tolerancja zmian zmiennych układu
+	double vntol = 1e-6;      //!< Bezwzględna tolerancja zmian potencjałów węzłów [V]
+	double abstol = 1e-12;    //!< Bezwzględna tolerancja zmian prądów gałęzi [A]
+	bool bypass = true;       //!< Czy pomijać linearyzację elementów, których napięcia prawie się nie zmieniły
+	double gmin_start = 1e-2; //!< Początkowa konduktancja do masy przy krokowym zmniejszaniu gmin [S]
+	int source_steps = 20;    //!< Liczba kroków zwiększania wartości źródeł
+};
+
+/**
+	\brief Punkt pracy DC układu z elementami nieliniowymi
+
+	Elementy nieliniowe (\ref nonlinear_component) w każdej iteracji zastępowane są linearyzacją
+	w bieżącym punkcie pracy - macierzą konduktancji (transkonduktancje w mna::mna_problem)
+	i źródłami prądowymi. Struktura układu równań budowana jest raz: część liniowa
+	(\ref solve_plan::assemble()) i stałe miejsca na wpisy elementów nieliniowych, w których
+	kolejne iteracje zmieniają jedynie wartości.
+
+	Elementy, których napięcia zmieniły się od ostatniej linearyzacji mniej niż o tolerancję
+	zbieżności, nie są ponownie linearyzowane (bypass). Jeżeli w iteracji nie zlinearyzowano
+	żadnego elementu, macierz układu nie zmienia się i wykorzystywany jest poprzedni rozkład LU.
+	Zmiana wartości źródeł (kolejny punkt analizy .dc) również nie wymaga nowego rozkładu
+	w pierwszej iteracji, a rozwiązanie poprzedniego punktu jest przybliżeniem początkowym.
+
+	Jeżeli iteracja nie jest zbieżna, stosowane są kolejno:
+	 - krokowe zmniejszanie konduktancji dołączonych od każdego węzła do masy (gmin stepping),
+	 - krokowe zwiększanie wartości wszystkich źródeł niezależnych od zera (source stepping).
+*/
+class newton_solver
+{
+public:
+	explicit newton_solver(std::shared_ptr<const solve_plan> plan, const newton_options &options = {});
+
+	const transient_state &solve();
+
+private:
+	//! Stan elementu nieliniowego - potencjały i linearyzacja z ostatniej iteracji
+	struct device_state
+	{
+		std::array<double, 3> v{};
+		device_linearization lin;
+		bool valid = false;
+	};
+
+	bool iterate(double gshunt, double source_scale);
+	void load_sources(double scale);
+	void stamp_device(int d);
+	void reset();
+	void update_state();
+
+	std::shared_ptr<const solve_plan> m_plan;
+	newton_options m_options;
+
+	//! Układ równań - część liniowa, a za nią wpisy elementów nieliniowych i konduktancji do masy
+	mna::mna_problem m_problem;
+	int m_linear_admittances;
+	int m_linear_transconductances;
+	int m_linear_current_sources;
+
+	//! Rozkład macierzy z ostatniej iteracji
+	std::shared_ptr<const mna::lu_factorization> m_lu;
+	bool m_matrix_dirty = true;
+
+	//! Bieżące przybliżenie rozwiązania (potencjały węzłów i prądy gałęzi)
+	std::vector<double> m_x;
+
+	std::vector<device_state> m_devices;
+	transient_state m_state;
+};
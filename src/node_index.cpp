@@ -0,0 +1,80 @@
+#include "node_index.hpp"
+#include <stdexcept>
+#include <string>
+
+/**
+	\file node_index.cpp
+	\brief Implementacja \ref node_index
+	\author Jacek Wieczorek
+*/
+
+/**
+	\brief Tworzy numerację zawierającą tylko masę
+*/
+node_index::node_index()
+{
+	clear();
+}
+
+/**
+	\brief Usuwa wszystkie węzły poza masą
+*/
+void node_index::clear()
+{
+	m_nodes.clear();
+	rehash(4);
+	insert(0);
+}
+
+/**
+	\brief Dodaje węzeł (jeżeli jeszcze nie istnieje)
+	\returns Numer zmiennej węzła
+*/
+int node_index::insert(int node)
+{
+	if (auto index = find(node); index != npos)
+		return index;
+
+	// Współczynnik wypełnienia nie przekracza 1/2
+	if (2 * (m_nodes.size() + 1) > m_slots.size())
+		rehash(32 - m_shift + 1);
+
+	m_nodes.push_back(node);
+
+	auto h = slot_of(node);
+	while (m_slots[h])
+		h = (h + 1) & m_mask;
+	m_slots[h] = m_nodes.size();
+
+	return m_nodes.size() - 2;
+}
+
+/**
+	\brief Zwraca numer zmiennej węzła
+	\throws std::out_of_range jeżeli węzeł nie istnieje
+*/
+int node_index::at(int node) const
+{
+	auto index = find(node);
+	if (index == npos)
+		throw std::out_of_range("Unknown node " + std::to_string(node));
+	return index;
+}
+
+/**
+	\brief Odbudowuje tablicę mieszającą o rozmiarze 2^bits
+*/
+void node_index::rehash(int bits)
+{
+	m_shift = 32 - bits;
+	m_mask = (1u << bits) - 1;
+	m_slots.assign(1u << bits, 0);
+
+	for (unsigned int i = 0; i < m_nodes.size(); i++)
+	{
+		auto h = slot_of(m_nodes[i]);
+		while (m_slots[h])
+			h = (h + 1) & m_mask;
+		m_slots[h] = i + 1;
+	}
+}
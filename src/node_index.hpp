@@ -0,0 +1,75 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+
+/**
+	\file node_index.hpp
+	\brief Definicja \ref node_index - numeracji węzłów obwodu
+	\author Jacek Wieczorek
+*/
+
+/**
+	\brief Numeracja węzłów - przypisuje dowolnym numerom węzłów kolejne numery zmiennych
+
+	Węzeł 0 (masa) ma zawsze numer -1, a pozostałe węzły otrzymują kolejne numery
+	0, 1, 2, ... w kolejności dodawania. Wyszukiwanie odbywa się w tablicy mieszającej
+	z adresowaniem otwartym (próbkowanie liniowe) w czasie O(1), bez wyjątków
+	w przypadku nieznanego węzła (\ref find()).
+*/
+class node_index
+{
+public:
+	//! Wartość zwracana przez \ref find() dla nieznanego węzła
+	static constexpr int npos = -2;
+
+	node_index();
+
+	int insert(int node);
+	int at(int node) const;
+	void clear();
+
+	/**
+		\brief Zwraca numer zmiennej węzła lub \ref npos, jeżeli węzeł jest nieznany
+	*/
+	int find(int node) const
+	{
+		for (auto h = slot_of(node); m_slots[h]; h = (h + 1) & m_mask)
+			if (m_nodes[m_slots[h] - 1] == node)
+				return m_slots[h] - 2;
+		return npos;
+	}
+
+	/**
+		\brief Zwraca liczbę węzłów (łącznie z masą)
+	*/
+	int size() const
+	{
+		return m_nodes.size();
+	}
+
+	/**
+		\brief Zwraca numery węzłów w kolejności numerów zmiennych (pierwsza jest masa)
+	*/
+	const std::vector<int> &get_nodes() const
+	{
+		return m_nodes;
+	}
+
+private:
+	//! Pozycja w tablicy mieszającej dla węzła (haszowanie Fibonacciego)
+	std::uint32_t slot_of(int node) const
+	{
+		return (static_cast<std::uint32_t>(node) * 2654435769u >> m_shift) & m_mask;
+	}
+
+	void rehash(int bits);
+
+	//! Numery węzłów - węzeł na pozycji i ma numer zmiennej i - 1
+	std::vector<int> m_nodes;
+
+	//! Tablica mieszająca - pozycja węzła w m_nodes powiększona o 1 (0 - puste miejsce)
+	std::vector<int> m_slots;
+
+	std::uint32_t m_mask;
+	int m_shift;
+};
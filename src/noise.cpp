@@ -0,0 +1,177 @@
+#include "noise.hpp"
+#include <cmath>
+#include <exception>
+#include <stdexcept>
+
+/**
+	\file noise.cpp
+	\brief Implementacja \ref noise_analysis
+	\author Jacek Wieczorek
+*/
+
+//! Stała Boltzmanna [J/K]
+static const double boltzmann = 1.380649e-23;
+
+/**
+	\brief Zwraca gęstość widmową mocy szumu sprowadzonego na wejście
+*/
+double noise_point::input() const
+{
+	return output / (gain * gain);
+}
+
+/**
+	\brief Przygotowuje analizę
+
+	\param plan Plan rozwiązania układu
+	\param pos Węzeł wyjściowy
+	\param neg Węzeł odniesienia wyjścia
+	\param input Nazwa źródła wejściowego (SEM lub SPM)
+	\throws std::runtime_error jeżeli źródło wejściowe nie istnieje lub nie jest niezależnym źródłem
+*/
+noise_analysis::noise_analysis(std::shared_ptr<const solve_plan> plan, int pos, int neg, const std::string &input) :
+	m_plan(std::move(plan)),
+	m_pos(pos),
+	m_neg(neg)
+{
+	using kind = solve_plan::component_kind;
+	const auto &names = m_plan->get_names();
+
+	auto it = names.find(input);
+	if (it == names.end())
+		throw std::runtime_error("Input source '" + input + "' does not exist");
+	if (it->second.kind != kind::VOLTAGE_SOURCE && it->second.kind != kind::CURRENT_SOURCE)
+		throw std::runtime_error("Component '" + input + "' is not an independent source");
+	m_input = it->second;
+
+	try
+	{
+		m_plan->node_index(pos);
+		m_plan->node_index(neg);
+	}
+	catch (const std::out_of_range &ex)
+	{
+		throw std::runtime_error("Output node does not exist");
+	}
+
+	for (const auto &[name, ref] : names)
+		if (ref.kind == kind::RESISTOR)
+		{
+			m_names.push_back(name);
+			m_resistors.push_back(ref.index);
+		}
+}
+
+/**
+	\brief Zwraca nazwy źródeł szumu (w kolejności udziałów w \ref noise_point)
+*/
+const std::vector<std::string> &noise_analysis::get_sources() const
+{
+	return m_names;
+}
+
+/**
+	\brief Wyznacza szumy dla jednej częstotliwości
+
+	\param ctx Kontekst analizy (korzystający z planu analizy)
+	\param frequency Częstotliwość [Hz]
+*/
+noise_point noise_analysis::solve(solve_context &ctx, double frequency) const
+{
+	ctx.solve(2 * M_PI * frequency);
+	auto tm = ctx.voltage_transfer(m_pos, m_neg);
+
+	const auto &st = m_plan->get_components();
+	noise_point pt{.frequency = frequency, .output = 0, .gain = 0, .contributions = {}};
+
+	// Wzmocnienie z wejścia
+	if (m_input.kind == solve_plan::component_kind::VOLTAGE_SOURCE)
+		pt.gain = std::abs(tm.voltage_sources.at(m_input.index).value());
+	else
+		pt.gain = std::abs(tm.injection(st.current_sources.a[m_input.index], st.current_sources.b[m_input.index]));
+
+	// Szumy termiczne rezystorów
+	pt.contributions.resize(m_resistors.size());
+	for (unsigned int i = 0; i < m_resistors.size(); i++)
+	{
+		const int r = m_resistors[i];
+		const double density = 4 * boltzmann * temperature / st.resistors.value[r];
+		pt.contributions[i] = std::norm(tm.injection(st.resistors.a[r], st.resistors.b[r])) * density;
+		pt.output += pt.contributions[i];
+	}
+
+	return pt;
+}
+
+/**
+	\brief Wykonuje analizę dla zadanych częstotliwości
+
+	\throws std::runtime_error jeżeli nie udało się rozwiązać układu (zgłaszana jest
+		najniższa częstotliwość, dla której wystąpił błąd)
+*/
+std::vector<noise_point> noise_analysis::run(task_scheduler &scheduler, const std::vector<double> &frequencies) const
+{
+	const int count = frequencies.size();
+	std::vector<noise_point> points(count);
+	std::vector<std::exception_ptr> errors(count);
+
+	scheduler.parallel_for(0, count, 4, [&](int begin, int end){
+		solve_context ctx(m_plan);
+		for (int i = begin; i < end; i++)
+		{
+			try
+			{
+				points[i] = solve(ctx, frequencies[i]);
+			}
+			catch (...)
+			{
+				errors[i] = std::current_exception();
+			}
+		}
+	});
+
+	for (int i = 0; i < count; i++)
+		if (errors[i])
+		{
+			try
+			{
+				std::rethrow_exception(errors[i]);
+			}
+			catch (const std::exception &ex)
+			{
+				throw std::runtime_error("Noise analysis at " + std::to_string(frequencies[i]) + " Hz failed - reason: " + ex.what());
+			}
+		}
+
+	return points;
+}
+
+/**
+	\brief Całkuje gęstości widmowe szumów w paśmie analizy (metodą trapezów)
+*/
+noise_totals noise_analysis::integrate(const std::vector<noise_point> &points)
+{
+	noise_totals totals{.output = 0, .input = 0, .contributions = {}};
+	if (points.empty())
+		return totals;
+
+	totals.contributions.resize(points[0].contributions.size());
+	for (unsigned int i = 1; i < points.size(); i++)
+	{
+		const auto &a = points[i - 1];
+		const auto &b = points[i];
+		const double df = b.frequency - a.frequency;
+
+		totals.output += 0.5 * (a.output + b.output) * df;
+		totals.input += 0.5 * (a.input() + b.input()) * df;
+		for (unsigned int j = 0; j < totals.contributions.size(); j++)
+			totals.contributions[j] += 0.5 * (a.contributions[j] + b.contributions[j]) * df;
+	}
+
+	totals.output = std::sqrt(totals.output);
+	totals.input = std::sqrt(totals.input);
+	for (auto &c : totals.contributions)
+		c = std::sqrt(c);
+
+	return totals;
+}
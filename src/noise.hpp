@@ -0,0 +1,74 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+#include "circuit.hpp"
+#include "scheduler.hpp"
+
+/**
+	\file noise.hpp
+	\brief Analiza szumów małosygnałowych (.noise)
+	\author Jacek Wieczorek
+*/
+
+/**
+	\brief Wynik analizy szumów dla jednej częstotliwości
+*/
+struct noise_point
+{
+	double frequency;                  //!< Częstotliwość [Hz]
+	double output;                     //!< Gęstość widmowa mocy szumu na wyjściu [V²/Hz]
+	double gain;                       //!< Moduł transmitancji z wejścia do wyjścia
+	std::vector<double> contributions; //!< Udziały kolejnych źródeł szumu w gęstości widmowej na wyjściu [V²/Hz]
+
+	double input() const;
+};
+
+/**
+	\brief Szumy scałkowane w paśmie analizy
+*/
+struct noise_totals
+{
+	double output;                     //!< Wartość skuteczna szumu na wyjściu [V]
+	double input;                      //!< Wartość skuteczna szumu sprowadzonego na wejście
+	std::vector<double> contributions; //!< Wartości skuteczne szumu na wyjściu od kolejnych źródeł [V]
+};
+
+/**
+	\brief Analiza szumów termicznych rezystorów
+
+	Każdy rezystor jest źródłem prądu szumu o gęstości widmowej \f$ 4kT/R \f$ połączonym
+	z nim równolegle. Transimpedancje ze wszystkich tych źródeł do napięcia wyjściowego
+	wyznaczane są jednym rozwiązaniem układu sprzężonego dla każdej częstotliwości
+	(\ref solve_context::voltage_transfer()) - zamiast jednego rozwiązania na każde źródło.
+	Z tego samego rozwiązania wyznaczane jest wzmocnienie z wejścia (SEM lub SPM), przez
+	które dzielony jest szum sprowadzany na wejście.
+
+	Częstotliwości analizowane są równolegle, każde zadanie z własnym kontekstem.
+*/
+class noise_analysis
+{
+public:
+	noise_analysis(std::shared_ptr<const solve_plan> plan, int pos, int neg, const std::string &input);
+
+	const std::vector<std::string> &get_sources() const;
+	noise_point solve(solve_context &ctx, double frequency) const;
+	std::vector<noise_point> run(task_scheduler &scheduler, const std::vector<double> &frequencies) const;
+
+	static noise_totals integrate(const std::vector<noise_point> &points);
+
+	//! Temperatura rezystorów [K]
+	static constexpr double temperature = 300.15;
+
+private:
+	std::shared_ptr<const solve_plan> m_plan;
+	int m_pos;
+	int m_neg;
+
+	//! Położenie źródła wejściowego w planie
+	solve_plan::component_ref m_input;
+
+	//! Nazwy i numery rezystorów (źródeł szumu) w planie
+	std::vector<std::string> m_names;
+	std::vector<int> m_resistors;
+};
@@ -0,0 +1,110 @@
+#include "parallel.hpp"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <utility>
+
+/**
+	\file parallel.cpp
+	\brief Implementacja \ref ordered_executor
+	\author Jacek Wieczorek
+*/
+
+/**
+	\brief Tworzy wykonawcę zlecającego kroki zadanemu planiście
+*/
+ordered_executor::ordered_executor(task_scheduler &scheduler) :
+	m_scheduler(scheduler)
+{
+}
+
+/**
+	\brief Zwraca liczbę wątków wykonujących kroki
+*/
+int ordered_executor::get_thread_count() const
+{
+	return m_scheduler.get_thread_count();
+}
+
+/**
+	\brief Wykonuje kroki od 0 do count - 1
+
+	Przy jednym wątku kroki wykonywane są kolejno w wątku wywołującym i wypisują
+	wyniki bezpośrednio na wyjście.
+*/
+void ordered_executor::run(int count, const step_function &step, std::ostream &out) const
+{
+	const int threads = std::min(get_thread_count(), count);
+	if (threads <= 1)
+	{
+		for (int i = 0; i < count; i++)
+			step(i, out);
+		return;
+	}
+
+	// Wynik kroku w buforze porządkującym
+	struct result
+	{
+		std::string text;
+		std::exception_ptr error;
+		std::atomic<bool> ready = false;
+	};
+
+	// Bufor cykliczny - krok i zajmuje pozycję i % window
+	const int window = 4 * threads;
+	std::vector<result> buffer(window);
+	std::atomic<bool> stop = false;
+	task_group group(m_scheduler);
+
+	auto spawn = [&](int i){
+		group.run([&, i]{
+			auto &r = buffer[i % window];
+			if (!stop)
+			{
+				std::ostringstream ss;
+				try
+				{
+					step(i, ss);
+				}
+				catch (...)
+				{
+					r.error = std::current_exception();
+				}
+				r.text = ss.str();
+			}
+			r.ready.store(true, std::memory_order_release);
+		});
+	};
+
+	for (int i = 0; i < std::min(window, count); i++)
+		spawn(i);
+
+	// Wypisywanie wyników w kolejności kroków
+	for (int written = 0; written < count; written++)
+	{
+		auto &slot = buffer[written % window];
+		group.wait_until([&]{return slot.ready.load(std::memory_order_acquire);});
+
+		auto text = std::move(slot.text);
+		auto error = std::exchange(slot.error, nullptr);
+		slot.text.clear();
+		slot.ready = false;
+
+		out << text << std::flush;
+		if (error)
+		{
+			// Pozostałe kroki kończą się bez wykonania
+			stop = true;
+			group.wait();
+			std::rethrow_exception(error);
+		}
+
+		if (written + window < count)
+			spawn(written + window);
+	}
+
+	group.wait();
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include "scheduler.hpp"
+#include <functional>
+#include <ostream>
+
+/**
+	\file parallel.hpp
+	\brief Równoległe wykonywanie niezależnych kroków analizy
+	\author Jacek Wieczorek
+*/
+
+/**
+	\brief Wykonuje niezależne kroki analizy jako zadania \ref task_scheduler, wypisując ich wyniki w kolejności kroków
+
+	Każdy krok wypisuje swój wynik do osobnego bufora. Bufory gotowych kroków trafiają do
+	bufora porządkującego, z którego są wypisywane na wyjście, gdy tylko gotowe są
+	wszystkie wcześniejsze kroki - wynik jest więc identyczny (co do bajtu) z wynikiem
+	wykonania sekwencyjnego. Zadania mogą wyprzedzać wypisywanie najwyżej o kilka kroków
+	na wątek, więc pamięć zajmowana przez bufory nie zależy od liczby kroków.
+
+	Wątek wypisujący wyniki sam wykonuje kroki w oczekiwaniu na kolejny wynik, a kroki
+	mogą zlecać planiście własne zadania (np. równoległy rozkład LU) - liczba aktywnych
+	wątków nie przekracza liczby wątków planisty.
+
+	Jeżeli krok zakończy się wyjątkiem, wypisywane są wyniki wszystkich wcześniejszych
+	kroków i częściowy wynik kroku, który zawiódł, a wyjątek jest przekazywany dalej -
+	tak samo jak przy wykonaniu sekwencyjnym.
+*/
+class ordered_executor
+{
+public:
+	/**
+		\brief Funkcja wykonująca jeden krok
+
+		Kroki mogą być wykonywane współbieżnie, również przez ten sam wątek (jeden krok
+		w trakcie oczekiwania na zadania zlecone przez drugi) - dane robocze kroku
+		nie powinny więc być współdzielone.
+
+		\param step Numer kroku
+		\param out Strumień, do którego należy wypisać wynik kroku
+	*/
+	using step_function = std::function<void(int step, std::ostream &out)>;
+
+	explicit ordered_executor(task_scheduler &scheduler);
+
+	int get_thread_count() const;
+	void run(int count, const step_function &step, std::ostream &out) const;
+
+private:
+	//! Planista wykonujący kroki
+	task_scheduler &m_scheduler;
+};
@@ -0,0 +1,283 @@
+#include "periodic.hpp"
+#include <cmath>
+#include <exception>
+#include <stdexcept>
+
+/**
+	\file periodic.cpp
+	\brief Implementacja \ref periodic_steady_state
+	\author Jacek Wieczorek
+*/
+
+/**
+	\brief Szybka transformata Fouriera (radix-2, w miejscu, bez normalizacji)
+
+	\param x Próbki - liczba musi być potęgą 2
+	\param inverse Czy wyznaczyć transformatę odwrotną (bez dzielenia przez liczbę próbek)
+*/
+static void fft(std::vector<std::complex<double>> &x, bool inverse)
+{
+	const int n = x.size();
+
+	// Permutacja odwracająca kolejność bitów
+	for (int i = 1, j = 0; i < n; i++)
+	{
+		int bit = n >> 1;
+		for (; j & bit; bit >>= 1)
+			j ^= bit;
+		j ^= bit;
+		if (i < j)
+			std::swap(x[i], x[j]);
+	}
+
+	for (int len = 2; len <= n; len <<= 1)
+	{
+		const double angle = 2 * M_PI / len * (inverse ? 1 : -1);
+		const std::complex<double> wlen(std::cos(angle), std::sin(angle));
+		for (int i = 0; i < n; i += len)
+		{
+			std::complex<double> w(1);
+			for (int j = 0; j < len / 2; j++)
+			{
+				auto u = x[i + j];
+				auto v = x[i + j + len / 2] * w;
+				x[i + j] = u + v;
+				x[i + j + len / 2] = u - v;
+				w *= wlen;
+			}
+		}
+	}
+}
+
+/**
+	\brief Zwraca najmniejszą potęgę 2 nie mniejszą od n
+*/
+static int fft_size(int n)
+{
+	int size = 1;
+	while (size < n)
+		size <<= 1;
+	return size;
+}
+
+/**
+	\brief Przygotowuje analizę - rozkłada przebiegi źródeł na harmoniczne
+
+	\param plan Plan rozwiązania układu
+	\param waveforms Przebiegi czasowe źródeł niezależnych (źródła bez przebiegu mają tylko składową stałą)
+	\param frequency Częstotliwość podstawowa [Hz]
+	\param harmonics Liczba uwzględnianych harmonicznych
+	\throws std::runtime_error jeżeli parametry są nieprawidłowe lub przebieg przypisano do elementu,
+		który nie jest źródłem niezależnym
+*/
+periodic_steady_state::periodic_steady_state(std::shared_ptr<const solve_plan> plan, const std::map<std::string, waveform> &waveforms,
+	double frequency, int harmonics) :
+	m_plan(std::move(plan)),
+	m_frequency(frequency),
+	m_harmonics(harmonics)
+{
+	using kind = solve_plan::component_kind;
+
+	if (!(frequency > 0) || harmonics <= 0)
+		throw std::runtime_error("Invalid periodic steady state analysis parameters");
+
+	// Źródła bez przebiegu - tylko składowa stała
+	const auto &st = m_plan->get_components();
+	for (double v : st.voltage_sources.value)
+		m_voltage_harmonics.emplace_back(harmonics + 1).front() = v;
+	for (double i : st.current_sources.value)
+		m_current_harmonics.emplace_back(harmonics + 1).front() = i;
+
+	// Próbkowanie z zapasem, aby ograniczyć aliasing wyższych harmonicznych
+	const int samples = fft_size(8 * (harmonics + 1));
+	const double period = 1.0 / frequency;
+
+	for (const auto &[ref, wf] : waveforms)
+	{
+		auto it = m_plan->get_names().find(ref);
+		if (it == m_plan->get_names().end())
+			throw std::runtime_error("Source '" + ref + "' does not exist");
+
+		spectrum *harm;
+		if (it->second.kind == kind::VOLTAGE_SOURCE)
+			harm = &m_voltage_harmonics[it->second.index];
+		else if (it->second.kind == kind::CURRENT_SOURCE)
+			harm = &m_current_harmonics[it->second.index];
+		else
+			throw std::runtime_error("Component '" + ref + "' is not an independent source");
+
+		std::vector<std::complex<double>> x(samples);
+		for (int m = 0; m < samples; m++)
+			x[m] = wf.value(period * m / samples);
+		fft(x, false);
+
+		// x(t) = c0 + Re(sum C_k exp(jk w0 t))
+		(*harm)[0] = x[0].real() / samples;
+		for (int k = 1; k <= harmonics; k++)
+			(*harm)[k] = 2.0 * x[k] / static_cast<double>(samples);
+	}
+}
+
+/**
+	\brief Dodaje do widm zmiennych układu (przemnożone przez scale) wartości z rozwiązania
+
+	Zmienne to kolejno potencjały węzłów, prądy gałęzi (\ref solve_plan::branch_index()), prądy cewek
+	i kondensatorów.
+*/
+void periodic_steady_state::collect(const solve_context &ctx, std::complex<double> scale, spectrum &values) const
+{
+	const auto &st = m_plan->get_components();
+	const auto &nodes = m_plan->get_node_map().get_nodes();
+	auto out = values.begin();
+
+	for (int i = 0; i < m_plan->get_node_count(); i++)
+		*out++ += scale * ctx.voltage(nodes[i + 1]);
+	for (const auto *comp : st.voltage_sources.comp)
+		*out++ += scale * ctx.current(*comp);
+	for (const auto *comp : st.opamps.comp)
+		*out++ += scale * ctx.current(*comp);
+	for (const auto *arr : {&st.vcvs, &st.ccvs})
+		for (const auto *comp : arr->comp)
+			*out++ += scale * ctx.current(*comp);
+	for (const auto *comp : st.inductors.comp)
+		*out++ += scale * ctx.current(*comp);
+	for (const auto *comp : st.capacitors.comp)
+		*out++ += scale * ctx.current(*comp);
+}
+
+/**
+	\brief Wykonuje analizę
+
+	\param scheduler Planista zadań, w którym równolegle wyznaczane są odpowiedzi na harmoniczne
+	\param points Najmniejsza liczba punktów okresu, w których wyznaczany jest stan (zaokrąglana w górę do potęgi 2)
+	\param visit Funkcja wywoływana po kolei dla każdego punktu okresu
+	\throws std::runtime_error jeżeli nie udało się rozwiązać układu (zgłaszana jest najniższa
+		harmoniczna, dla której wystąpił błąd)
+*/
+void periodic_steady_state::run(task_scheduler &scheduler, int points, const visitor &visit) const
+{
+	using kind = solve_plan::component_kind;
+
+	const auto &st = m_plan->get_components();
+	const int node_count = m_plan->get_node_count();
+	const int branch_count = m_plan->get_branch_count();
+	const int variable_count = node_count + branch_count + st.inductors.size() + st.capacitors.size();
+	const int H = m_harmonics;
+
+	// Widma zmiennych układu (dla każdej harmonicznej)
+	std::vector<spectrum> harmonics(H + 1, spectrum(variable_count));
+	std::vector<std::exception_ptr> errors(H + 1);
+
+	scheduler.parallel_for(0, H + 1, 1, [&](int begin, int end){
+		// Wartości źródeł zmieniane są w prywatnej kopii planu
+		auto plan = std::make_shared<solve_plan>(*m_plan);
+		solve_context ctx(plan);
+
+		auto set_sources = [&](int k, bool imag){
+			for (int i = 0; i < st.voltage_sources.size(); i++)
+			{
+				const auto c = m_voltage_harmonics[i][k];
+				if (k == 0)
+					plan->set_value({kind::VOLTAGE_SOURCE, i}, c.real());
+				else
+					plan->set_ac_value({kind::VOLTAGE_SOURCE, i}, imag ? c.imag() : c.real());
+			}
+			for (int i = 0; i < st.current_sources.size(); i++)
+			{
+				const auto c = m_current_harmonics[i][k];
+				if (k == 0)
+					plan->set_value({kind::CURRENT_SOURCE, i}, c.real());
+				else
+					plan->set_ac_value({kind::CURRENT_SOURCE, i}, imag ? c.imag() : c.real());
+			}
+		};
+
+		for (int k = begin; k < end; k++)
+		{
+			try
+			{
+				if (k == 0)
+				{
+					// Wartości SEM zmieniają strukturę układu DC (zerowa SEM jest zwarciem)
+					set_sources(0, false);
+					ctx.set_plan(plan, true);
+					ctx.solve(0);
+					collect(ctx, 1.0, harmonics[0]);
+				}
+				else
+				{
+					// Część rzeczywista i urojona amplitud - dwa wektory wyrazów wolnych, jeden rozkład
+					const std::complex<double> unit[] = {1.0, {0.0, 1.0}};
+					ctx.solve_batch(2 * M_PI * m_frequency * k, 2,
+						[&](int j){set_sources(k, j == 1);},
+						[&](int j){collect(ctx, unit[j], harmonics[k]);});
+				}
+			}
+			catch (...)
+			{
+				errors[k] = std::current_exception();
+			}
+		}
+	});
+
+	for (int k = 0; k <= H; k++)
+		if (errors[k])
+		{
+			try
+			{
+				std::rethrow_exception(errors[k]);
+			}
+			catch (const std::exception &ex)
+			{
+				throw std::runtime_error("Solving harmonic " + std::to_string(k) + " failed - reason: " + ex.what());
+			}
+		}
+
+	// Odwrotna FFT widma - x(t_m) = c0 + Re(sum C_k exp(jk w0 t_m))
+	const int P = fft_size(std::max(points, 2 * H + 1));
+	auto waveform_of = [&](auto harmonic){
+		std::vector<std::complex<double>> x(P);
+		x[0] = harmonic(0).real() * static_cast<double>(P);
+		for (int k = 1; k <= H; k++)
+		{
+			x[k] = harmonic(k) * (P / 2.0);
+			x[P - k] = std::conj(x[k]);
+		}
+		fft(x, true);
+
+		std::vector<double> samples(P);
+		for (int m = 0; m < P; m++)
+			samples[m] = x[m].real() / P;
+		return samples;
+	};
+
+	std::vector<std::vector<double>> variables(variable_count);
+	for (int v = 0; v < variable_count; v++)
+		variables[v] = waveform_of([&](int k){return harmonics[k][v];});
+
+	std::vector<std::vector<double>> current_sources(st.current_sources.size());
+	for (int i = 0; i < st.current_sources.size(); i++)
+		current_sources[i] = waveform_of([&](int k){return m_current_harmonics[i][k];});
+
+	// Stan układu w kolejnych punktach okresu
+	transient_state state;
+	state.m_plan = m_plan;
+	state.m_voltages.resize(node_count);
+	state.m_branch_currents.resize(branch_count);
+	state.m_inductor_currents.resize(st.inductors.size());
+	state.m_capacitor_currents.resize(st.capacitors.size());
+	state.m_current_sources.resize(st.current_sources.size());
+
+	for (int m = 0; m < P; m++)
+	{
+		int v = 0;
+		for (auto *values : {&state.m_voltages, &state.m_branch_currents, &state.m_inductor_currents, &state.m_capacitor_currents})
+			for (auto &x : *values)
+				x = variables[v++][m];
+		for (int i = 0; i < st.current_sources.size(); i++)
+			state.m_current_sources[i] = current_sources[i][m];
+
+		state.m_time = m / (m_frequency * P);
+		visit(m, state);
+	}
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <complex>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "circuit.hpp"
+#include "scheduler.hpp"
+#include "transient.hpp"
+#include "waveform.hpp"
+
+/**
+	\file periodic.hpp
+	\brief Okresowy stan ustalony układu liniowego wyznaczany w dziedzinie częstotliwości (.pss)
+	\author Jacek Wieczorek
+*/
+
+/**
+	\brief Okresowy stan ustalony wyznaczany przez superpozycję harmonicznych
+
+	Przebiegi źródeł (\ref waveform) próbkowane są w jednym okresie \f$ T = 1/f_0 \f$
+	i rozkładane na harmoniczne (FFT). Układ jest liniowy, więc odpowiedź na każdą harmoniczną
+	wyznaczana jest osobno - analizą DC dla składowej stałej i analizą AC dla pulsacji
+	\f$ k \omega_0 \f$. Amplitudy zespolone źródeł rozdzielane są na część rzeczywistą i urojoną,
+	które rozwiązywane są razem - jako dwa wektory wyrazów wolnych z jednym rozkładem macierzy
+	(\ref solve_context::solve_batch()). Harmoniczne są od siebie niezależne, więc wyznaczane są
+	równolegle. Przebiegi napięć i prądów w stanie ustalonym otrzymywane są odwrotną FFT widm
+	wszystkich zmiennych układu - bez całkowania przez wiele okresów stanu nieustalonego.
+
+	\note Przebiegi źródeł traktowane są jako okresowe - wykorzystywane są ich wartości z przedziału [0, T).
+*/
+class periodic_steady_state
+{
+public:
+	using visitor = transient_analysis::visitor;
+
+	periodic_steady_state(std::shared_ptr<const solve_plan> plan, const std::map<std::string, waveform> &waveforms,
+		double frequency, int harmonics);
+
+	void run(task_scheduler &scheduler, int points, const visitor &visit) const;
+
+private:
+	using spectrum = std::vector<std::complex<double>>;
+
+	void collect(const solve_context &ctx, std::complex<double> scale, spectrum &values) const;
+
+	std::shared_ptr<const solve_plan> m_plan;
+	double m_frequency;
+	int m_harmonics;
+
+	//! Harmoniczne SEM i SPM - składowa stała i amplitudy zespolone kolejnych harmonicznych
+	std::vector<spectrum> m_voltage_harmonics;
+	std::vector<spectrum> m_current_harmonics;
+};
@@ -0,0 +1,566 @@
+#include "circuit.hpp"
+
+/**
+	\file plan.cpp
+	\brief Implementacja \ref solve_plan - skompilowanego obwodu
+	\author Jacek Wieczorek
+*/
+
+/**
+	\brief Dopisuje element na koniec tablic
+	\returns Numer elementu
+*/
+int solve_plan::bipole_array::push_back(const circuit_component *c, int na, int nb, const std::array<double, 2> &v)
+{
+	comp.push_back(c);
+	a.push_back(na);
+	b.push_back(nb);
+	value.push_back(v[0]);
+	ac.push_back(v[1]);
+	return comp.size() - 1;
+}
+
+/**
+	\brief Zwraca liczbę elementów
+*/
+int solve_plan::bipole_array::size() const
+{
+	return comp.size();
+}
+
+/**
+	\brief Usuwa wszystkie elementy
+*/
+void solve_plan::bipole_array::clear()
+{
+	comp.clear();
+	a.clear();
+	b.clear();
+	value.clear();
+	ac.clear();
+}
+
+/**
+	\brief Zwraca liczbę wzmacniaczy
+*/
+int solve_plan::opamp_array::size() const
+{
+	return comp.size();
+}
+
+/**
+	\brief Usuwa wszystkie wzmacniacze
+*/
+void solve_plan::opamp_array::clear()
+{
+	comp.clear();
+	pos.clear();
+	neg.clear();
+	out.clear();
+}
+
+/**
+	\brief Zwraca liczbę źródeł sterowanych
+*/
+int solve_plan::controlled_array::size() const
+{
+	return comp.size();
+}
+
+/**
+	\brief Usuwa wszystkie źródła sterowane
+*/
+void solve_plan::controlled_array::clear()
+{
+	comp.clear();
+	a.clear();
+	b.clear();
+	c.clear();
+	d.clear();
+	control.clear();
+	gain.clear();
+}
+
+/**
+	\brief Zwraca liczbę elementów nieliniowych
+*/
+int solve_plan::nonlinear_array::size() const
+{
+	return comp.size();
+}
+
+/**
+	\brief Usuwa wszystkie elementy nieliniowe
+*/
+void solve_plan::nonlinear_array::clear()
+{
+	comp.clear();
+	nodes.clear();
+}
+
+/**
+	\brief Zwraca tablice elementów dwukońcówkowych danego rodzaju (lub nullptr)
+*/
+solve_plan::bipole_array *solve_plan::component_store::bipoles(component_kind kind)
+{
+	switch (kind)
+	{
+		case component_kind::RESISTOR: return &resistors;
+		case component_kind::INDUCTOR: return &inductors;
+		case component_kind::CAPACITOR: return &capacitors;
+		case component_kind::PASSIVE: return &passives;
+		case component_kind::VOLTAGE_SOURCE: return &voltage_sources;
+		case component_kind::CURRENT_SOURCE: return &current_sources;
+		default: return nullptr;
+	}
+}
+
+/**
+	\brief Zwraca tablice elementów dwukońcówkowych danego rodzaju (lub nullptr)
+*/
+const solve_plan::bipole_array *solve_plan::component_store::bipoles(component_kind kind) const
+{
+	return const_cast<component_store*>(this)->bipoles(kind);
+}
+
+/**
+	\brief Zwraca tablice źródeł sterowanych danego rodzaju (lub nullptr)
+*/
+solve_plan::controlled_array *solve_plan::component_store::controlled(component_kind kind)
+{
+	switch (kind)
+	{
+		case component_kind::VCVS: return &vcvs;
+		case component_kind::VCCS: return &vccs;
+		case component_kind::CCVS: return &ccvs;
+		case component_kind::CCCS: return &cccs;
+		default: return nullptr;
+	}
+}
+
+/**
+	\brief Zwraca tablice źródeł sterowanych danego rodzaju (lub nullptr)
+*/
+const solve_plan::controlled_array *solve_plan::component_store::controlled(component_kind kind) const
+{
+	return const_cast<component_store*>(this)->controlled(kind);
+}
+
+/**
+	\brief Usuwa wszystkie elementy
+*/
+void solve_plan::component_store::clear()
+{
+	resistors.clear();
+	inductors.clear();
+	capacitors.clear();
+	passives.clear();
+	voltage_sources.clear();
+	current_sources.clear();
+	opamps.clear();
+	vcvs.clear();
+	vccs.clear();
+	ccvs.clear();
+	cccs.clear();
+	nonlinear.clear();
+}
+
+/**
+	\brief Zwraca mapowania węzłów (tylko do odczytu)
+*/
+const node_index &solve_plan::get_node_map() const
+{
+	return m_node_map;
+}
+
+/**
+	\brief Zwraca numer zmiennej odpowiadającej węzłowi (-1 dla masy)
+	\throws std::out_of_range dla nieznanego węzła
+*/
+int solve_plan::node_index(int node) const
+{
+	return m_node_map.at(node);
+}
+
+/**
+	\brief Zwraca liczbę węzłów (bez masy)
+*/
+int solve_plan::get_node_count() const
+{
+	return m_node_map.size() - 1;
+}
+
+/**
+	\brief Zwraca liczbę gałęzi (prądów) pełnego układu równań
+*/
+int solve_plan::get_branch_count() const
+{
+	const auto &st = m_components;
+	return st.voltage_sources.size() + st.opamps.size() + st.vcvs.size() + st.ccvs.size();
+}
+
+/**
+	\brief Zwraca numer gałęzi elementu w pełnym układzie równań (\ref assemble())
+
+	Gałęzie to kolejno: SEM, wyjścia wzmacniaczy operacyjnych, źródła napięciowe sterowane
+	napięciem i źródła napięciowe sterowane prądem. Prąd gałęzi jest zmienną o numerze
+	powiększonym o liczbę węzłów.
+
+	\throws std::runtime_error dla elementów bez gałęzi
+*/
+int solve_plan::branch_index(const component_ref &ref) const
+{
+	const auto &st = m_components;
+	switch (ref.kind)
+	{
+		case component_kind::VOLTAGE_SOURCE: return ref.index;
+		case component_kind::OPAMP: return st.voltage_sources.size() + ref.index;
+		case component_kind::VCVS: return st.voltage_sources.size() + st.opamps.size() + ref.index;
+		case component_kind::CCVS: return st.voltage_sources.size() + st.opamps.size() + st.vcvs.size() + ref.index;
+		default: throw std::runtime_error("Component has no branch current");
+	}
+}
+
+/**
+	\brief Zwraca elementy obwodu pogrupowane według rodzaju
+*/
+const solve_plan::component_store &solve_plan::get_components() const
+{
+	return m_components;
+}
+
+/**
+	\brief Zwraca położenie elementu w tablicach planu w czasie O(1) (nullptr dla nieznanych elementów)
+*/
+const solve_plan::component_ref *solve_plan::find_component(const circuit_component *comp) const
+{
+	auto it = m_refs.find(comp);
+	return it == m_refs.end() ? nullptr : &it->second;
+}
+
+/**
+	\brief Zwraca element o zadanej nazwie
+	\throws std::out_of_range dla nieznanych elementów
+*/
+const circuit_component *solve_plan::component(const std::string &ref) const
+{
+	const auto &cr = m_names.at(ref);
+	if (cr.kind == component_kind::OPAMP)
+		return m_components.opamps.comp[cr.index];
+	if (cr.kind == component_kind::NONLINEAR)
+		return m_components.nonlinear.comp[cr.index];
+	if (auto arr = m_components.controlled(cr.kind))
+		return arr->comp[cr.index];
+	return m_components.bipoles(cr.kind)->comp[cr.index];
+}
+
+/**
+	\brief Zwraca położenie elementów w tablicach według nazw (w kolejności alfabetycznej)
+*/
+const std::map<std::string, solve_plan::component_ref> &solve_plan::get_names() const
+{
+	return m_names;
+}
+
+/**
+	\brief Zwraca numer SEM (i jej gałęzi w pełnym układzie równań) w czasie O(1)
+*/
+int solve_plan::voltage_source_index(const circuit_component *comp) const
+{
+	auto ref = find_component(comp);
+	if (!ref || ref->kind != component_kind::VOLTAGE_SOURCE)
+		throw std::runtime_error("Component has no branch current");
+	return ref->index;
+}
+
+/**
+	\brief Zwraca numer wzmacniacza operacyjnego w czasie O(1)
+*/
+int solve_plan::opamp_index(const circuit_component *comp) const
+{
+	auto ref = find_component(comp);
+	if (!ref || ref->kind != component_kind::OPAMP)
+		throw std::runtime_error("Component has no branch current");
+	return ref->index;
+}
+
+/**
+	\brief Admitancja elementu pasywnego o zadanym rodzaju i numerze
+*/
+std::complex<double> solve_plan::passive_admittance(component_kind kind, int index, double omega) const
+{
+	return passive_admittance(kind, index, std::complex<double>{0.0, omega});
+}
+
+/**
+	\brief Admitancja elementu pasywnego o zadanym rodzaju i numerze dla zmiennej zespolonej s
+*/
+std::complex<double> solve_plan::passive_admittance(component_kind kind, int index, std::complex<double> s) const
+{
+	const auto &st = m_components;
+	switch (kind)
+	{
+		case component_kind::RESISTOR: return resistor::admittance_of(st.resistors.value[index]);
+		case component_kind::INDUCTOR: return inductor::admittance_of(st.inductors.value[index], s);
+		case component_kind::CAPACITOR: return capacitor::admittance_of(st.capacitors.value[index], s);
+		default: return static_cast<const passive_component*>(st.passives.comp[index])->admittance(s);
+	}
+}
+
+/**
+	\brief Pochodna admitancji elementu pasywnego o zadanym rodzaju i numerze po jego wartości
+*/
+std::complex<double> solve_plan::passive_admittance_derivative(component_kind kind, int index, double omega) const
+{
+	const auto &st = m_components;
+	switch (kind)
+	{
+		case component_kind::RESISTOR: return resistor::admittance_derivative_of(st.resistors.value[index]);
+		case component_kind::INDUCTOR: return inductor::admittance_derivative_of(st.inductors.value[index], omega);
+		case component_kind::CAPACITOR: return capacitor::admittance_derivative_of(omega);
+		default: return static_cast<const passive_component*>(st.passives.comp[index])->admittance_derivative(omega);
+	}
+}
+
+/**
+	\brief Wpisuje do mna_problem wszystkie elementy obwodu dla zadanej pulsacji
+
+	Każdy węzeł jest osobną zmienną, a gałęzie numerowane są zgodnie z \ref branch_index().
+	Przy analizie AC wszystkie źródła DC są pomijane i na odwrót.
+
+	\param omega Pulsacja (0 - analiza DC)
+	\param problem Problem do wypełnienia (bufory są wykorzystywane ponownie)
+*/
+void solve_plan::assemble(double omega, mna::mna_problem &problem) const
+{
+	assemble(std::complex<double>{0.0, omega}, problem);
+}
+
+/**
+	\brief Wpisuje do mna_problem wszystkie elementy obwodu dla zadanej zmiennej zespolonej s
+
+	Wykorzystywana przy odwrotnej transformacie Laplace'a, która wymaga rozwiązań układu
+	poza osią urojoną. Dla \f$ s \neq 0 \f$ układ pobudzany jest wartościami AC źródeł.
+
+	\param s Zmienna zespolona transformaty Laplace'a (0 - analiza DC)
+	\param problem Problem do wypełnienia (bufory są wykorzystywane ponownie)
+*/
+void solve_plan::assemble(std::complex<double> s, mna::mna_problem &problem) const
+{
+	const auto &st = m_components;
+	const bool dc = s == 0.0;
+
+	// Elementy pasywne - kolejno wszystkie rodzaje
+	problem.admittances.resize(st.resistors.size() + st.inductors.size() + st.capacitors.size() + st.passives.size());
+	auto out = problem.admittances.begin();
+	auto stamp = [&](const bipole_array &arr, auto admittance){
+		for (int i = 0; i < arr.size(); i++)
+			*out++ = {{arr.a[i], arr.b[i]}, admittance(i)};
+	};
+
+	stamp(st.resistors, [&](int i){return resistor::admittance_of(st.resistors.value[i]);});
+	stamp(st.inductors, [&](int i){return inductor::admittance_of(st.inductors.value[i], s);});
+	stamp(st.capacitors, [&](int i){return capacitor::admittance_of(st.capacitors.value[i], s);});
+	stamp(st.passives, [&](int i){return static_cast<const passive_component*>(st.passives.comp[i])->admittance(s);});
+
+	// Wzmacniacze operacyjne
+	problem.opamps.resize(st.opamps.size());
+	for (int i = 0; i < st.opamps.size(); i++)
+		problem.opamps[i] = {st.opamps.pos[i], st.opamps.neg[i], st.opamps.out[i]};
+
+	// Źródła napięciowe
+	const auto &vs = st.voltage_sources;
+	problem.voltage_sources.resize(vs.size());
+	for (int i = 0; i < vs.size(); i++)
+		problem.voltage_sources[i] = {{vs.a[i], vs.b[i]}, dc ? vs.value[i] : vs.ac[i]};
+
+	// Źródła prądowe
+	const auto &cs = st.current_sources;
+	problem.current_sources.resize(cs.size());
+	for (int i = 0; i < cs.size(); i++)
+		problem.current_sources[i] = {{cs.a[i], cs.b[i]}, dc ? cs.value[i] : cs.ac[i]};
+
+	// Źródła sterowane (sterowane prądem odwołują się do numerów SEM, równych numerom w planie)
+	problem.voltage_gains.resize(st.vcvs.size());
+	for (int i = 0; i < st.vcvs.size(); i++)
+		problem.voltage_gains[i] = {{st.vcvs.a[i], st.vcvs.b[i]}, {st.vcvs.c[i], st.vcvs.d[i]}, st.vcvs.gain[i]};
+
+	problem.transconductances.resize(st.vccs.size());
+	for (int i = 0; i < st.vccs.size(); i++)
+		problem.transconductances[i] = {{st.vccs.a[i], st.vccs.b[i]}, {st.vccs.c[i], st.vccs.d[i]}, st.vccs.gain[i]};
+
+	problem.transresistances.resize(st.ccvs.size());
+	for (int i = 0; i < st.ccvs.size(); i++)
+		problem.transresistances[i] = {{st.ccvs.a[i], st.ccvs.b[i]}, st.ccvs.control[i], st.ccvs.gain[i]};
+
+	problem.current_gains.resize(st.cccs.size());
+	for (int i = 0; i < st.cccs.size(); i++)
+		problem.current_gains[i] = {{st.cccs.a[i], st.cccs.b[i]}, st.cccs.control[i], st.cccs.gain[i]};
+}
+
+/**
+	\brief Składa i rozwiązuje układ równań dla zadanej pulsacji
+
+	Nie modyfikuje planu - może być wywoływana jednocześnie z wielu wątków.
+*/
+mna::mna_solution solve_plan::solve(double omega) const
+{
+	mna::mna_problem problem;
+	assemble(omega, problem);
+	return problem.solve();
+}
+
+/**
+	\brief Dołącza komponent do mapy węzłów i tablic elementów
+	\param ref Nazwa elementu
+	\returns Numer elementu w tablicy odpowiedniego rodzaju (-1 dla nieobsługiwanych elementów)
+*/
+int solve_plan::add_component(const std::string &ref, component_kind kind, const circuit_component *comp,
+	const std::array<int, 4> &nodes, const std::array<double, 2> &values)
+{
+	auto add_node = [&](int n)
+	{
+		return m_node_map.insert(n);
+	};
+
+	if (kind == component_kind::OPAMP)
+	{
+		auto &opamps = m_components.opamps;
+		opamps.comp.push_back(comp);
+		opamps.pos.push_back(add_node(nodes[0]));
+		opamps.neg.push_back(add_node(nodes[1]));
+		opamps.out.push_back(add_node(nodes[2]));
+		int index = opamps.size() - 1;
+		m_refs[comp] = m_names[ref] = {kind, index};
+		return index;
+	}
+
+	if (kind == component_kind::NONLINEAR)
+	{
+		auto &nonlinear = m_components.nonlinear;
+		const auto *device = static_cast<const nonlinear_component*>(comp);
+		std::array<int, 3> mapped{-1, -1, -1};
+		for (int i = 0; i < device->terminal_count; i++)
+			mapped[i] = add_node(nodes[i]);
+
+		nonlinear.comp.push_back(device);
+		nonlinear.nodes.push_back(mapped);
+		int index = nonlinear.size() - 1;
+		m_refs[comp] = m_names[ref] = {kind, index};
+		return index;
+	}
+
+	if (auto arr = m_components.controlled(kind))
+	{
+		arr->comp.push_back(comp);
+		arr->a.push_back(add_node(nodes[0]));
+		arr->b.push_back(add_node(nodes[1]));
+		arr->c.push_back(add_node(nodes[2]));
+		arr->d.push_back(add_node(nodes[3]));
+		arr->control.push_back(-1);
+		arr->gain.push_back(values[0]);
+		int index = arr->size() - 1;
+		m_refs[comp] = m_names[ref] = {kind, index};
+		return index;
+	}
+
+	if (auto arr = m_components.bipoles(kind))
+	{
+		int a = add_node(nodes[0]);
+		int b = add_node(nodes[1]);
+		int index = arr->push_back(comp, a, b, values);
+		m_refs[comp] = m_names[ref] = {kind, index};
+		return index;
+	}
+
+	return -1;
+}
+
+/**
+	\brief Wiąże źródła sterowane prądem z SEM, których prąd nimi steruje
+
+	Wywoływana po dołączeniu elementów - SEM sterująca może zostać dołączona później niż źródło sterowane.
+
+	\throws std::runtime_error jeżeli element sterujący nie istnieje lub nie jest SEM
+*/
+void solve_plan::link_controls()
+{
+	for (auto *arr : {&m_components.ccvs, &m_components.cccs})
+		for (int i = 0; i < arr->size(); i++)
+		{
+			const auto &name = static_cast<const controlled_source*>(arr->comp[i])->control_source;
+			auto it = m_names.find(name);
+			if (it == m_names.end())
+				throw std::runtime_error("Controlling source '" + name + "' does not exist");
+			if (it->second.kind != component_kind::VOLTAGE_SOURCE)
+				throw std::runtime_error("Controlling component '" + name + "' is not a voltage source");
+
+			arr->control[i] = it->second.index;
+		}
+}
+
+/**
+	\brief Zmienia wartość elementu dwukońcówkowego (R, L, C, wartość DC źródła lub wzmocnienie
+	źródła sterowanego) w kopii planu
+
+	Struktura planu (numeracja węzłów i gałęzi) pozostaje bez zmian, więc kopia może być
+	rozwiązywana wielokrotnie dla różnych wartości elementów.
+
+	\warning Nie wolno zmieniać planu współdzielonego z innymi kontekstami lub wątkami.
+*/
+void solve_plan::set_value(const component_ref &ref, double value)
+{
+	if (auto arr = m_components.controlled(ref.kind))
+	{
+		arr->gain[ref.index] = value;
+		return;
+	}
+
+	// Admitancja pozostałych elementów pasywnych nie zależy od zapamiętanej wartości
+	auto arr = m_components.bipoles(ref.kind);
+	if (!arr || ref.kind == component_kind::PASSIVE)
+		throw std::runtime_error("Cannot change value of component");
+
+	arr->value[ref.index] = value;
+}
+
+/**
+	\brief Zmienia wartość AC źródła niezależnego w kopii planu
+	\warning Nie wolno zmieniać planu współdzielonego z innymi kontekstami lub wątkami.
+*/
+void solve_plan::set_ac_value(const component_ref &ref, double ac)
+{
+	if (ref.kind != component_kind::VOLTAGE_SOURCE && ref.kind != component_kind::CURRENT_SOURCE)
+		throw std::runtime_error("Only independent sources have AC value");
+
+	m_components.bipoles(ref.kind)->ac[ref.index] = ac;
+}
+
+/**
+	\brief Zmienia zapamiętane wartości elementu
+*/
+void solve_plan::set_values(component_kind kind, int index, const std::array<double, 2> &values)
+{
+	if (auto arr = m_components.bipoles(kind))
+	{
+		arr->value[index] = values[0];
+		arr->ac[index] = values[1];
+	}
+	else if (auto arr = m_components.controlled(kind))
+		arr->gain[index] = values[0];
+}
+
+/**
+	\brief Usuwa wszystkie elementy i węzły (poza masą)
+
+	Węzeł 0 to węzeł odniesienia - mapowany jest na -1 - indeks węzła masy
+	w zapisie macierzowym. Wszystkie inne numery węzłów są mapowane na nieujemne
+	liczby całkowite.
+*/
+void solve_plan::clear()
+{
+	m_components.clear();
+	m_node_map.clear();
+	m_refs.clear();
+	m_names.clear();
+}
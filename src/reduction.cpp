@@ -0,0 +1,383 @@
+#include "reduction.hpp"
+#include <unordered_map>
+#include <deque>
+#include <string>
+
+/**
+	\file reduction.cpp
+	\brief Implementacja upraszczania sieci admitancji
+	\author Jacek Wieczorek
+*/
+
+/**
+	\brief Tworzy wyrażenie odpowiadające pojedynczemu elementowi pasywnemu
+*/
+std::shared_ptr<const admittance_expr> admittance_expr::element(std::shared_ptr<const passive_component> comp)
+{
+	auto e = std::make_shared<admittance_expr>();
+	e->m_op = operation::ELEMENT;
+	e->m_comp = std::move(comp);
+	return e;
+}
+
+/**
+	\brief Tworzy wyrażenie opisujące połączenie równoległe
+*/
+std::shared_ptr<const admittance_expr> admittance_expr::parallel(std::shared_ptr<const admittance_expr> a, std::shared_ptr<const admittance_expr> b)
+{
+	auto e = std::make_shared<admittance_expr>();
+	e->m_op = operation::PARALLEL;
+	e->m_args = {std::move(a), std::move(b)};
+	return e;
+}
+
+/**
+	\brief Tworzy wyrażenie opisujące połączenie szeregowe
+*/
+std::shared_ptr<const admittance_expr> admittance_expr::series(std::shared_ptr<const admittance_expr> a, std::shared_ptr<const admittance_expr> b)
+{
+	auto e = std::make_shared<admittance_expr>();
+	e->m_op = operation::SERIES;
+	e->m_args = {std::move(a), std::move(b)};
+	return e;
+}
+
+/**
+	\brief Tworzy wyrażenie opisujące bok wielokąta powstałego z gwiazdy
+
+	\f[ Y_{ij} = \frac{Y_i Y_j}{\sum_k Y_k} \f]
+
+	\param star Wszystkie gałęzie gwiazdy
+	\param i Numer pierwszej gałęzi
+	\param j Numer drugiej gałęzi
+*/
+std::shared_ptr<const admittance_expr> admittance_expr::star_mesh(std::vector<std::shared_ptr<const admittance_expr>> star, int i, int j)
+{
+	auto e = std::make_shared<admittance_expr>();
+	e->m_op = operation::STAR_MESH;
+	e->m_args = std::move(star);
+	e->m_i = i;
+	e->m_j = j;
+	return e;
+}
+
+/**
+	\brief Oblicza admitancję zastępczą dla zadanej zmiennej zespolonej s (\f$ s = j\omega \f$ dla analizy AC)
+
+	Wspólne fragmenty wyrażenia obliczane są tylko raz.
+
+	\note Połączenie szeregowe lub gwiazda złożona z samych rozwarć (np. kondensatorów
+	przy analizie DC) ma admitancję 0.
+*/
+std::complex<double> admittance_expr::evaluate(std::complex<double> s) const
+{
+	std::unordered_map<const admittance_expr*, std::complex<double>> memo;
+
+	auto eval = [&](auto &self, const admittance_expr &e) -> std::complex<double> {
+		if (e.m_op == operation::ELEMENT)
+			return e.m_comp->admittance(s);
+
+		if (auto it = memo.find(&e); it != memo.end())
+			return it->second;
+
+		std::vector<std::complex<double>> Y;
+		std::complex<double> sum = 0.0;
+		for (const auto &arg : e.m_args)
+		{
+			Y.push_back(self(self, *arg));
+			sum += Y.back();
+		}
+
+		std::complex<double> result;
+		switch (e.m_op)
+		{
+			case operation::PARALLEL:
+				result = sum;
+				break;
+
+			case operation::SERIES:
+				result = sum == 0.0 ? 0.0 : Y[0] * Y[1] / sum;
+				break;
+
+			case operation::STAR_MESH:
+				result = sum == 0.0 ? 0.0 : Y[e.m_i] * Y[e.m_j] / sum;
+				break;
+
+			default:
+				break;
+		}
+
+		memo[&e] = result;
+		return result;
+	};
+
+	return eval(eval, *this);
+}
+
+/**
+	\brief Admitancja elementu zastępczego
+*/
+std::complex<double> equivalent_admittance::admittance(std::complex<double> s) const
+{
+	return expr->evaluate(s);
+}
+
+/**
+	\brief Pochodna admitancji elementu zastępczego
+
+	\note Element zastępczy nie ma jednej wartości, po której można by różniczkować - zwraca 0.
+	Analiza wrażliwości powinna być prowadzona na obwodzie bez uproszczeń.
+*/
+std::complex<double> equivalent_admittance::admittance_derivative(double omega) const
+{
+	(void) omega;
+	return 0.0;
+}
+
+/**
+	\brief Upraszcza obwód
+
+	\param circ Obwód do uproszczenia
+	\param kept_nodes Węzły, które nie mogą zostać usunięte (np. mierzone)
+	\param kept_components Elementy, które muszą pozostać nienaruszone (np. mierzone)
+	\param star_mesh Czy usuwać węzły o stopniu 3 przekształceniem gwiazda-trójkąt
+*/
+network_reduction::network_reduction(const circuit &circ, const std::set<int> &kept_nodes,
+	const std::set<std::string> &kept_components, bool star_mesh)
+{
+	// Gałąź upraszczanej sieci
+	struct edge
+	{
+		int a, b;
+		std::shared_ptr<const admittance_expr> expr;
+		std::shared_ptr<circuit_component> original; //!< Element, jeżeli gałąź nie została uproszczona
+		std::string ref;
+		bool alive;
+	};
+
+	std::vector<edge> edges;
+	std::map<int, std::set<int>> incident;
+	std::set<int> fixed = kept_nodes;
+	fixed.insert(0);
+
+	// Dodaje gałąź, łącząc ją równolegle z istniejącą gałęzią między tymi samymi węzłami
+	auto add_edge = [&](int a, int b, std::shared_ptr<const admittance_expr> expr,
+		std::shared_ptr<circuit_component> original, const std::string &ref){
+		for (int id : incident[a])
+		{
+			auto &e = edges[id];
+			if ((e.a == a && e.b == b) || (e.a == b && e.b == a))
+			{
+				e.expr = admittance_expr::parallel(e.expr, std::move(expr));
+				e.original = nullptr;
+				return;
+			}
+		}
+
+		edges.push_back(edge{a, b, std::move(expr), std::move(original), ref, true});
+		incident[a].insert(edges.size() - 1);
+		incident[b].insert(edges.size() - 1);
+	};
+
+	for (const auto &[ref, comp_ptr] : circ)
+	{
+		// Element pasywny (lub nullptr)
+		const passive_component *pcomp = std::visit(overloaded{
+			[](const voltage_source*) -> const passive_component* {return nullptr;},
+			[](const current_source*) -> const passive_component* {return nullptr;},
+			[](const opamp*) -> const passive_component* {return nullptr;},
+			[](const controlled_source*) -> const passive_component* {return nullptr;},
+			[](const nonlinear_component*) -> const passive_component* {return nullptr;},
+			[](const circuit_component*) -> const passive_component* {return nullptr;},
+			[](const auto *p) -> const passive_component* {return p;},
+		}, comp_ptr->view());
+
+		if (!pcomp || kept_components.count(ref) || pcomp->nodes.first == pcomp->nodes.second)
+		{
+			m_circuit[ref] = comp_ptr;
+
+			// Węzły pozostałych elementów nie mogą zostać usunięte
+			std::visit(overloaded{
+				[&](const opamp *opa){
+					fixed.insert(opa->pos_input_node);
+					fixed.insert(opa->neg_input_node);
+					fixed.insert(opa->output_node);
+				},
+				[&](const controlled_source *cs){
+					fixed.insert(cs->nodes.first);
+					fixed.insert(cs->nodes.second);
+					fixed.insert(cs->control.first);
+					fixed.insert(cs->control.second);
+				},
+				[&](const nonlinear_component *nl){
+					for (int i = 0; i < nl->terminal_count; i++)
+						fixed.insert(nl->nodes[i]);
+				},
+				[&](const circuit_component*){},
+				[&](const auto *bp){
+					fixed.insert(bp->nodes.first);
+					fixed.insert(bp->nodes.second);
+				},
+			}, comp_ptr->view());
+
+			continue;
+		}
+
+		add_edge(pcomp->nodes.first, pcomp->nodes.second,
+			admittance_expr::element(std::shared_ptr<const passive_component>(comp_ptr, pcomp)), comp_ptr, ref);
+	}
+
+	// Usuwanie węzłów o niskim stopniu, dopóki takie istnieją
+	const unsigned int max_degree = star_mesh ? 3 : 2;
+	std::deque<int> queue;
+	for (const auto &[node, ids] : incident)
+		queue.push_back(node);
+
+	while (!queue.empty())
+	{
+		int m = queue.front();
+		queue.pop_front();
+
+		auto &ids = incident[m];
+		if (fixed.count(m) || m_eliminated_nodes.count(m) || ids.empty() || ids.size() > max_degree)
+			continue;
+
+		// Węzeł chroniony nie może zostać odłączony od reszty układu
+		if (ids.size() == 1)
+		{
+			const auto &e = edges[*ids.begin()];
+			int other = e.a == m ? e.b : e.a;
+			if (fixed.count(other) && incident[other].size() == 1)
+				continue;
+		}
+
+		// Usunięcie gałęzi gwiazdy
+		eliminated_node elim{m, {}};
+		for (int id : ids)
+		{
+			auto &e = edges[id];
+			int other = e.a == m ? e.b : e.a;
+			elim.star.emplace_back(other, e.expr);
+			incident[other].erase(id);
+			e.alive = false;
+		}
+		ids.clear();
+
+		// Gałęzie zastępcze
+		if (elim.star.size() == 2)
+		{
+			add_edge(elim.star[0].first, elim.star[1].first,
+				admittance_expr::series(elim.star[0].second, elim.star[1].second), nullptr, "");
+		}
+		else if (elim.star.size() == 3)
+		{
+			std::vector<std::shared_ptr<const admittance_expr>> star;
+			for (const auto &[n, expr] : elim.star)
+				star.push_back(expr);
+
+			for (int i = 0; i < 3; i++)
+				for (int j = i + 1; j < 3; j++)
+					add_edge(elim.star[i].first, elim.star[j].first, admittance_expr::star_mesh(star, i, j), nullptr, "");
+		}
+
+		for (const auto &[n, expr] : elim.star)
+			queue.push_back(n);
+
+		m_eliminated_nodes.insert(m);
+		m_eliminated.push_back(std::move(elim));
+	}
+
+	// Budowa uproszczonego obwodu
+	int cnt = 0;
+	for (const auto &e : edges)
+	{
+		if (!e.alive) continue;
+
+		if (e.original)
+			m_circuit[e.ref] = e.original;
+		else
+		{
+			std::string name = "#";
+			name += std::to_string(++cnt);
+			m_circuit[name] = std::make_shared<equivalent_admittance>(std::make_pair(e.a, e.b), e.expr);
+		}
+	}
+}
+
+/**
+	\brief Zwraca uproszczony obwód
+
+	Elementy, które nie zostały uproszczone zachowują swoje nazwy. Elementy zastępcze
+	nazywane są `#1`, `#2`, ...
+*/
+const circuit &network_reduction::get_circuit() const
+{
+	return m_circuit;
+}
+
+/**
+	\brief Sprawdza, czy węzeł został usunięty z obwodu
+*/
+bool network_reduction::is_eliminated(int node) const
+{
+	return m_eliminated_nodes.count(node);
+}
+
+/**
+	\brief Zwraca liczbę usuniętych węzłów
+*/
+int network_reduction::get_eliminated_count() const
+{
+	return m_eliminated.size();
+}
+
+/**
+	\brief Wyznacza potencjały wszystkich usuniętych węzłów
+
+	Węzły przetwarzane są w kolejności odwrotnej do kolejności usuwania - sąsiedzi
+	każdego węzła w chwili jego usunięcia są albo obecni w uproszczonym układzie,
+	albo zostali usunięci później.
+
+	\param ctx Kontekst analizy uproszczonego obwodu z gotowym rozwiązaniem
+*/
+std::map<int, std::complex<double>> network_reduction::back_substitute(const solve_context &ctx) const
+{
+	const auto omega = ctx.get_solution_omega();
+	std::map<int, std::complex<double>> v;
+
+	for (auto it = m_eliminated.rbegin(); it != m_eliminated.rend(); ++it)
+	{
+		std::complex<double> num = 0.0, den = 0.0;
+		for (const auto &[n, expr] : it->star)
+		{
+			auto Y = expr->evaluate(std::complex<double>{0.0, omega});
+			auto vit = v.find(n);
+			num += Y * (vit != v.end() ? vit->second : ctx.voltage(n));
+			den += Y;
+		}
+
+		v[it->node] = den == 0.0 ? 0.0 : num / den;
+	}
+
+	return v;
+}
+
+/**
+	\brief Pomiar napięcia między węzłami pierwotnego obwodu (także usuniętymi)
+
+	\param ctx Kontekst analizy uproszczonego obwodu z gotowym rozwiązaniem
+	\param pos Numer mierzonego węzła
+	\param neg Numer węzła odniesienia
+*/
+std::complex<double> network_reduction::voltage(const solve_context &ctx, int pos, int neg) const
+{
+	if (!is_eliminated(pos) && !is_eliminated(neg))
+		return ctx.voltage(pos, neg);
+
+	auto v = back_substitute(ctx);
+	auto node_voltage = [&](int n){
+		return is_eliminated(n) ? v.at(n) : ctx.voltage(n);
+	};
+
+	return node_voltage(pos) - node_voltage(neg);
+}
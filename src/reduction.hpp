@@ -0,0 +1,117 @@
+#pragma once
+#include <set>
+#include <map>
+#include <vector>
+#include <memory>
+#include <complex>
+#include "circuit.hpp"
+
+/**
+	\file reduction.hpp
+	\brief Upraszczanie sieci admitancji (połączenia szeregowe, równoległe, gwiazda-wielokąt)
+	\author Jacek Wieczorek
+*/
+
+/**
+	\brief Wyrażenie opisujące admitancję zastępczą fragmentu sieci
+
+	Wyrażenia tworzą drzewo (a właściwie graf acykliczny - gałęzie gwiazdy są
+	współdzielone przez wszystkie boki wielokąta), którego liśćmi są elementy pasywne.
+	Wartość obliczana jest dla zadanej zmiennej zespolonej s (pulsacji), więc jedno
+	uproszczenie sieci może być wykorzystane w całej analizie AC.
+*/
+class admittance_expr
+{
+public:
+	static std::shared_ptr<const admittance_expr> element(std::shared_ptr<const passive_component> comp);
+	static std::shared_ptr<const admittance_expr> parallel(std::shared_ptr<const admittance_expr> a, std::shared_ptr<const admittance_expr> b);
+	static std::shared_ptr<const admittance_expr> series(std::shared_ptr<const admittance_expr> a, std::shared_ptr<const admittance_expr> b);
+	static std::shared_ptr<const admittance_expr> star_mesh(std::vector<std::shared_ptr<const admittance_expr>> star, int i, int j);
+
+	std::complex<double> evaluate(std::complex<double> s) const;
+
+private:
+	//! Rodzaj wyrażenia
+	enum class operation
+	{
+		ELEMENT,
+		PARALLEL,
+		SERIES,
+		STAR_MESH
+	};
+
+	operation m_op;
+
+	//! Element pasywny (dla ELEMENT)
+	std::shared_ptr<const passive_component> m_comp;
+
+	//! Argumenty wyrażenia (dla STAR_MESH - wszystkie gałęzie gwiazdy)
+	std::vector<std::shared_ptr<const admittance_expr>> m_args;
+
+	//! Gałęzie gwiazdy, między którymi przebiega bok wielokąta (dla STAR_MESH)
+	int m_i = 0, m_j = 0;
+};
+
+/**
+	\brief Element zastępczy powstały w wyniku upraszczania sieci
+*/
+struct equivalent_admittance : public passive_component
+{
+	equivalent_admittance(const std::pair<int, int> &p, std::shared_ptr<const admittance_expr> e) :
+		passive_component(p),
+		expr(std::move(e))
+	{}
+
+	std::complex<double> admittance(std::complex<double> s) const override;
+	std::complex<double> admittance_derivative(double omega) const override;
+
+	//! Wyrażenie opisujące admitancję elementu
+	std::shared_ptr<const admittance_expr> expr;
+};
+
+/**
+	\brief Uproszczony obwód wraz z informacjami potrzebnymi do odtworzenia napięć usuniętych węzłów
+
+	Upraszczane są wyłącznie elementy pasywne. Węzeł może zostać usunięty, jeżeli nie jest
+	masą, nie jest węzłem chronionym (np. mierzonym), a podłączone są do niego wyłącznie
+	upraszczalne elementy pasywne. Wykonywane są następujące przekształcenia:
+	 - elementy równoległe zastępowane są jednym elementem,
+	 - węzły o stopniu 1 (wiszące gałęzie) i 2 (połączenia szeregowe) są usuwane,
+	 - opcjonalnie, węzły o stopniu 3 usuwane są przekształceniem gwiazda-trójkąt.
+
+	Potencjał usuniętego węzła jest średnią potencjałów jego sąsiadów ważoną admitancjami
+	gałęzi - \ref voltage() wyznacza go na podstawie rozwiązania uproszczonego układu, więc
+	mierzone węzły nie muszą być chronione.
+*/
+class network_reduction
+{
+public:
+	network_reduction(const circuit &circ, const std::set<int> &kept_nodes,
+		const std::set<std::string> &kept_components, bool star_mesh = false);
+
+	const circuit &get_circuit() const;
+	bool is_eliminated(int node) const;
+	int get_eliminated_count() const;
+
+	std::map<int, std::complex<double>> back_substitute(const solve_context &ctx) const;
+	std::complex<double> voltage(const solve_context &ctx, int pos, int neg = 0) const;
+
+private:
+	/**
+		\brief Usunięty węzeł wraz z gałęziami łączącymi go z sąsiadami w chwili usunięcia
+	*/
+	struct eliminated_node
+	{
+		int node;
+		std::vector<std::pair<int, std::shared_ptr<const admittance_expr>>> star;
+	};
+
+	//! Uproszczony obwód
+	circuit m_circuit;
+
+	//! Usunięte węzły w kolejności usuwania
+	std::vector<eliminated_node> m_eliminated;
+
+	//! Numery usuniętych węzłów
+	std::set<int> m_eliminated_nodes;
+};
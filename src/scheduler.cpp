@@ -0,0 +1,420 @@
+#include "scheduler.hpp"
+#include <algorithm>
+#include <chrono>
+#include <utility>
+
+/**
+	\file scheduler.cpp
+	\brief Implementacja \ref task_scheduler i \ref work_deque
+	\author Jacek Wieczorek
+*/
+
+//! Planista, dla którego bieżący wątek wykonuje zadania
+static thread_local task_scheduler *t_scheduler = nullptr;
+
+//! Kolejka bieżącego wątku roboczego (nullptr dla wątków zewnętrznych)
+static thread_local work_deque *t_deque = nullptr;
+
+/**
+	\brief Tworzy pustą kolejkę
+*/
+work_deque::work_deque() :
+	m_top(0),
+	m_bottom(0)
+{
+	m_rings.push_back(std::make_unique<ring>(64));
+	m_ring.store(m_rings.back().get(), std::memory_order_relaxed);
+}
+
+/**
+	\brief Dodaje zadanie na dół kolejki (tylko właściciel)
+*/
+void work_deque::push(scheduled_task *t)
+{
+	auto b = m_bottom.load(std::memory_order_relaxed);
+	auto top = m_top.load(std::memory_order_acquire);
+	auto *r = m_ring.load(std::memory_order_relaxed);
+
+	// Powiększenie tablicy - zawartość kopiowana jest do nowej, dwa razy większej tablicy
+	if (b - top > r->size() - 1)
+	{
+		auto bigger = std::make_unique<ring>(r->size() * 2);
+		for (auto i = top; i < b; i++)
+			bigger->put(i, r->get(i));
+		r = bigger.get();
+		m_rings.push_back(std::move(bigger));
+		m_ring.store(r, std::memory_order_release);
+	}
+
+	r->put(b, t);
+	m_bottom.store(b + 1, std::memory_order_release);
+}
+
+/**
+	\brief Zdejmuje zadanie z dołu kolejki (tylko właściciel)
+	\returns Zadanie lub nullptr, jeżeli kolejka jest pusta
+*/
+scheduled_task *work_deque::pop()
+{
+	auto b = m_bottom.load(std::memory_order_relaxed) - 1;
+	auto *r = m_ring.load(std::memory_order_relaxed);
+	m_bottom.store(b, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	auto top = m_top.load(std::memory_order_relaxed);
+
+	if (top > b)
+	{
+		m_bottom.store(b + 1, std::memory_order_relaxed);
+		return nullptr;
+	}
+
+	auto *t = r->get(b);
+	if (top == b)
+	{
+		// Ostatnie zadanie - wyścig z podkradającymi wątkami
+		if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			t = nullptr;
+		m_bottom.store(b + 1, std::memory_order_relaxed);
+	}
+
+	return t;
+}
+
+/**
+	\brief Podkrada zadanie z góry kolejki (dowolny wątek, bez blokad)
+	\returns Zadanie lub nullptr, jeżeli kolejka jest pusta lub inny wątek był szybszy
+*/
+scheduled_task *work_deque::steal()
+{
+	auto top = m_top.load(std::memory_order_acquire);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	auto b = m_bottom.load(std::memory_order_acquire);
+
+	if (top >= b)
+		return nullptr;
+
+	auto *r = m_ring.load(std::memory_order_acquire);
+	auto *t = r->get(top);
+	if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+		return nullptr;
+
+	return t;
+}
+
+/**
+	\brief Tworzy planistę i jego wątki robocze
+
+	\param threads Łączna liczba wykonawców (wraz z wątkiem oczekującym na zadania).
+		0 oznacza liczbę wątków sprzętowych.
+*/
+task_scheduler::task_scheduler(int threads)
+{
+	if (threads <= 0)
+		threads = std::max(1u, std::thread::hardware_concurrency());
+
+	for (int i = 0; i < threads - 1; i++)
+		m_deques.push_back(std::make_unique<work_deque>());
+
+	for (int i = 0; i < threads - 1; i++)
+		m_workers.emplace_back(&task_scheduler::worker_loop, this, i);
+}
+
+/**
+	\brief Zatrzymuje wątki robocze
+
+	\note Wszystkie grupy zadań muszą zostać wcześniej zakończone.
+*/
+task_scheduler::~task_scheduler()
+{
+	{
+		std::lock_guard lock(m_mutex);
+		m_stop = true;
+	}
+	m_wake.notify_all();
+
+	for (auto &t : m_workers)
+		t.join();
+}
+
+/**
+	\brief Zwraca łączną liczbę wykonawców zadań
+*/
+int task_scheduler::get_thread_count() const
+{
+	return m_workers.size() + 1;
+}
+
+/**
+	\brief Zwraca planistę, dla którego bieżący wątek wykonuje zadania (lub nullptr)
+
+	Pozwala na zagnieżdżanie równoległości - kod wykonywany w ramach zadania może
+	zlecać kolejne zadania temu samemu planiście, nie znając go.
+*/
+task_scheduler *task_scheduler::current()
+{
+	return t_scheduler;
+}
+
+/**
+	\brief Wykonuje funkcję w bieżącym wątku w ramach planisty
+
+	Zadania zlecane przez kod wykonywany w ramach funkcji (np. przez \ref parallel_for()
+	wywołane pośrednio przez \ref task_scheduler::current()) wykonywane są przez planistę.
+*/
+void task_scheduler::run(const std::function<void()> &fn)
+{
+	auto *prev = t_scheduler;
+	t_scheduler = this;
+	try
+	{
+		fn();
+	}
+	catch (...)
+	{
+		t_scheduler = prev;
+		throw;
+	}
+	t_scheduler = prev;
+}
+
+/**
+	\brief Zleca wykonanie zadania
+
+	Zadania zlecane przez wątek roboczy trafiają do jego własnej kolejki.
+*/
+void task_scheduler::submit(scheduled_task *t)
+{
+	if (t_scheduler == this && t_deque)
+		t_deque->push(t);
+	else
+	{
+		std::lock_guard lock(m_injected_mutex);
+		m_injected.push_back(t);
+	}
+
+	m_pending++;
+	if (m_sleeping > 0)
+	{
+		std::lock_guard lock(m_mutex);
+		m_wake.notify_all();
+	}
+}
+
+/**
+	\brief Wyszukuje zadanie do wykonania przez bieżący wątek
+
+	Kolejność: własna kolejka, kolejka wejściowa, kolejki pozostałych wątków
+	(począwszy od losowego).
+*/
+scheduled_task *task_scheduler::find_task()
+{
+	scheduled_task *t = nullptr;
+
+	if (t_scheduler == this && t_deque)
+		t = t_deque->pop();
+
+	if (!t)
+	{
+		std::lock_guard lock(m_injected_mutex);
+		if (!m_injected.empty())
+		{
+			t = m_injected.front();
+			m_injected.pop_front();
+		}
+	}
+
+	if (!t && !m_deques.empty())
+	{
+		static thread_local unsigned int seed = std::hash<std::thread::id>{}(std::this_thread::get_id());
+		seed = seed * 1664525u + 1013904223u;
+
+		const int n = m_deques.size();
+		const int start = (seed >> 8) % n;
+		for (int i = 0; i < n && !t; i++)
+		{
+			auto &d = *m_deques[(start + i) % n];
+			if (&d != t_deque)
+				t = d.steal();
+		}
+	}
+
+	if (t)
+		m_pending--;
+
+	return t;
+}
+
+/**
+	\brief Wykonuje zadanie i rozlicza je w jego grupie
+*/
+void task_scheduler::execute(scheduled_task *t)
+{
+	auto *prev = t_scheduler;
+	t_scheduler = this;
+
+	std::exception_ptr error;
+	try
+	{
+		t->fn();
+	}
+	catch (...)
+	{
+		error = std::current_exception();
+	}
+
+	t_scheduler = prev;
+	auto *group = t->group;
+	delete t;
+	group->finish(error);
+
+	// Ktoś może czekać na zakończenie grupy
+	if (m_sleeping > 0)
+	{
+		std::lock_guard lock(m_mutex);
+		m_wake.notify_all();
+	}
+}
+
+/**
+	\brief Wykonuje oczekujące zadania, dopóki warunek nie zostanie spełniony
+
+	Jeżeli nie ma zadań do wykonania, wątek usypia do czasu zlecenia nowego zadania
+	lub zakończenia któregoś z wykonywanych.
+*/
+void task_scheduler::wait_until(const std::function<bool()> &done)
+{
+	while (!done())
+	{
+		if (auto t = find_task())
+		{
+			execute(t);
+			continue;
+		}
+
+		std::unique_lock lock(m_mutex);
+		m_sleeping++;
+		m_wake.wait_for(lock, std::chrono::milliseconds(1), [&]{return m_pending > 0 || done();});
+		m_sleeping--;
+	}
+}
+
+/**
+	\brief Pętla wątku roboczego
+*/
+void task_scheduler::worker_loop(int index)
+{
+	t_scheduler = this;
+	t_deque = m_deques[index].get();
+
+	while (!m_stop)
+	{
+		if (auto t = find_task())
+		{
+			execute(t);
+			continue;
+		}
+
+		std::unique_lock lock(m_mutex);
+		m_sleeping++;
+		m_wake.wait(lock, [&]{return m_stop || m_pending > 0;});
+		m_sleeping--;
+	}
+}
+
+/**
+	\brief Równoległa pętla po przedziale [begin, end)
+
+	Przedział dzielony jest na fragmenty o długości co najmniej grain (po kilka na wątek,
+	by wyrównać obciążenie). Bieżący wątek również wykonuje fragmenty.
+
+	\param body Funkcja wywoływana dla każdego fragmentu [b, e)
+*/
+void task_scheduler::parallel_for(int begin, int end, int grain, const std::function<void(int, int)> &body)
+{
+	const int n = end - begin;
+	if (n <= 0)
+		return;
+
+	const int chunks = std::min(4 * get_thread_count(), (n + std::max(grain, 1) - 1) / std::max(grain, 1));
+	if (chunks <= 1)
+	{
+		body(begin, end);
+		return;
+	}
+
+	task_group group(*this);
+	for (int c = 1; c < chunks; c++)
+	{
+		int b = begin + static_cast<long long>(n) * c / chunks;
+		int e = begin + static_cast<long long>(n) * (c + 1) / chunks;
+		group.run([&body, b, e]{body(b, e);});
+	}
+
+	// Pierwszy fragment wykonywany jest od razu (w razie wyjątku destruktor grupy
+	// zaczeka na pozostałe fragmenty)
+	run([&]{body(begin, begin + n / chunks);});
+	group.wait();
+}
+
+/**
+	\brief Tworzy pustą grupę zadań
+*/
+task_group::task_group(task_scheduler &scheduler) :
+	m_scheduler(scheduler)
+{
+}
+
+/**
+	\brief Czeka na zakończenie wszystkich zadań grupy (bez przekazywania wyjątków)
+*/
+task_group::~task_group()
+{
+	m_scheduler.wait_until([&]{return m_remaining == 0;});
+}
+
+/**
+	\brief Zleca wykonanie zadania w ramach grupy
+*/
+void task_group::run(std::function<void()> fn)
+{
+	m_remaining++;
+	m_scheduler.submit(new scheduled_task{std::move(fn), this});
+}
+
+/**
+	\brief Czeka na zakończenie wszystkich zadań grupy, wykonując w tym czasie oczekujące zadania
+	\throws Pierwszy wyjątek rzucony przez zadanie grupy
+*/
+void task_group::wait()
+{
+	m_scheduler.wait_until([&]{return m_remaining == 0;});
+
+	std::lock_guard lock(m_error_mutex);
+	if (m_error)
+		std::rethrow_exception(std::exchange(m_error, nullptr));
+}
+
+/**
+	\brief Wykonuje oczekujące zadania (dowolnych grup), dopóki warunek nie zostanie spełniony
+
+	Pozwala na przetwarzanie wyników poszczególnych zadań przed zakończeniem całej grupy.
+*/
+void task_group::wait_until(const std::function<bool()> &done)
+{
+	m_scheduler.wait_until(done);
+}
+
+/**
+	\brief Rozlicza zakończone zadanie grupy
+*/
+void task_group::finish(std::exception_ptr error)
+{
+	if (error)
+	{
+		std::lock_guard lock(m_error_mutex);
+		if (!m_error)
+			m_error = error;
+	}
+
+	m_remaining--;
+}
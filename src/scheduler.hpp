@@ -0,0 +1,159 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+
+/**
+	\file scheduler.hpp
+	\brief Planista zadań z podkradaniem pracy (work stealing)
+	\author Jacek Wieczorek
+*/
+
+class task_group;
+
+/**
+	\brief Zadanie do wykonania przez \ref task_scheduler
+*/
+struct scheduled_task
+{
+	std::function<void()> fn;
+	task_group *group;
+};
+
+/**
+	\brief Kolejka dwustronna zadań jednego wątku (Chase-Lev)
+
+	Właściciel dodaje i zdejmuje zadania z dołu kolejki (LIFO - dobra lokalność danych
+	przy zagnieżdżonym podziale pracy), a pozostałe wątki bez blokad podkradają zadania
+	z góry (najstarsze, zwykle największe fragmenty pracy). Tablica zadań rośnie
+	w miarę potrzeby - poprzednie tablice zwalniane są dopiero wraz z kolejką, bo mogą
+	być jeszcze czytane przez podkradające wątki.
+
+	\see D. Chase, Y. Lev, "Dynamic Circular Work-Stealing Deque", SPAA 2005
+	\see N. M. Lê i in., "Correct and Efficient Work-Stealing for Weak Memory Models", PPoPP 2013
+*/
+class work_deque
+{
+public:
+	work_deque();
+
+	void push(scheduled_task *t);
+	scheduled_task *pop();
+	scheduled_task *steal();
+
+private:
+	//! Tablica cykliczna o rozmiarze będącym potęgą dwójki
+	struct ring
+	{
+		explicit ring(std::int64_t n) : mask(n - 1), slots(n) {}
+
+		std::int64_t size() const {return mask + 1;}
+		scheduled_task *get(std::int64_t i) const {return slots[i & mask].load(std::memory_order_relaxed);}
+		void put(std::int64_t i, scheduled_task *t) {slots[i & mask].store(t, std::memory_order_relaxed);}
+
+		std::int64_t mask;
+		std::vector<std::atomic<scheduled_task*>> slots;
+	};
+
+	alignas(64) std::atomic<std::int64_t> m_top;
+	alignas(64) std::atomic<std::int64_t> m_bottom;
+	std::atomic<ring*> m_ring;
+
+	//! Wszystkie tablice (bieżąca i poprzednie)
+	std::vector<std::unique_ptr<ring>> m_rings;
+};
+
+/**
+	\brief Planista zadań z podkradaniem pracy, wspólny dla wszystkich analiz
+
+	Każdy wątek roboczy ma własną kolejkę zadań (\ref work_deque). Zadania tworzone przez
+	wątek roboczy trafiają do jego kolejki, a zadania zlecane z zewnątrz - do wspólnej
+	kolejki wejściowej. Bezczynny wątek podkrada zadania z kolejek pozostałych wątków.
+
+	Wątek oczekujący na zakończenie grupy zadań (\ref task_group::wait()) nie blokuje się,
+	tylko sam wykonuje oczekujące zadania. Dzięki temu zagnieżdżona równoległość (np. równoległy
+	rozkład macierzy wewnątrz równoległego kroku analizy AC) nie tworzy nowych wątków i nie
+	prowadzi do zakleszczenia - łączna liczba aktywnych wątków nigdy nie przekracza
+	\ref get_thread_count().
+
+	Wątek zewnętrzny, który czeka na grupę zadań, jest jednym z wykonawców - planista
+	o N wątkach tworzy N - 1 wątków roboczych.
+*/
+class task_scheduler
+{
+public:
+	explicit task_scheduler(int threads = 0);
+	~task_scheduler();
+
+	task_scheduler(const task_scheduler &) = delete;
+	task_scheduler &operator=(const task_scheduler &) = delete;
+
+	int get_thread_count() const;
+	void run(const std::function<void()> &fn);
+	void parallel_for(int begin, int end, int grain, const std::function<void(int, int)> &body);
+
+	static task_scheduler *current();
+
+private:
+	friend class task_group;
+
+	void submit(scheduled_task *t);
+	scheduled_task *find_task();
+	void execute(scheduled_task *t);
+	void wait_until(const std::function<bool()> &done);
+	void worker_loop(int index);
+
+	//! Kolejki wątków roboczych
+	std::vector<std::unique_ptr<work_deque>> m_deques;
+
+	//! Wątki robocze
+	std::vector<std::thread> m_workers;
+
+	//! Kolejka zadań zleconych spoza wątków roboczych
+	std::deque<scheduled_task*> m_injected;
+	std::mutex m_injected_mutex;
+
+	//! Liczba zadań oczekujących na wykonanie
+	std::atomic<int> m_pending{0};
+
+	//! Liczba uśpionych wątków roboczych i wątków oczekujących na grupy zadań
+	std::atomic<int> m_sleeping{0};
+
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::atomic<bool> m_stop{false};
+};
+
+/**
+	\brief Grupa zadań, na których zakończenie można zaczekać
+
+	Wyjątek rzucony przez zadanie jest przekazywany przez \ref wait() (pierwszy z nich,
+	jeżeli zawiodło kilka zadań).
+*/
+class task_group
+{
+public:
+	explicit task_group(task_scheduler &scheduler);
+	~task_group();
+
+	void run(std::function<void()> fn);
+	void wait();
+	void wait_until(const std::function<bool()> &done);
+
+private:
+	friend class task_scheduler;
+
+	void finish(std::exception_ptr error);
+
+	task_scheduler &m_scheduler;
+	std::atomic<int> m_remaining{0};
+	std::exception_ptr m_error;
+	std::mutex m_error_mutex;
+};
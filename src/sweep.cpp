@@ -0,0 +1,198 @@
+#include "sweep.hpp"
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+/**
+	\file sweep.cpp
+	\brief Implementacja \ref dc_sweep
+	\author Jacek Wieczorek
+*/
+
+/**
+	\brief Zwraca liczbę punktów w zakresie (wartość końcowa jest uwzględniana mimo błędów zaokrągleń)
+	\throws std::runtime_error jeżeli liczba punktów nie jest skończona lub nie mieści się w typie int
+*/
+int sweep_range::get_point_count() const
+{
+	const double count = std::floor((stop - start) / step + 1e-9) + 1;
+	if (!(count >= 1 && count <= std::numeric_limits<int>::max()))
+		throw std::runtime_error("Invalid number of points in range of '" + source + "'");
+	return count;
+}
+
+/**
+	\brief Zwraca łączną liczbę punktów zagnieżdżonych zakresów
+	\throws std::runtime_error jeżeli liczba punktów nie mieści się w typie int
+*/
+int sweep_range::get_total_point_count(const std::vector<sweep_range> &ranges)
+{
+	int count = 1;
+	for (const auto &r : ranges)
+	{
+		const int n = r.get_point_count();
+		if (count > std::numeric_limits<int>::max() / n)
+			throw std::runtime_error("Too many sweep points");
+		count *= n;
+	}
+	return count;
+}
+
+/**
+	\brief Zwraca wartość źródła w i-tym punkcie zakresu
+*/
+double sweep_range::get_value(int i) const
+{
+	return start + i * step;
+}
+
+/**
+	\brief Zwraca wartości wszystkich zagnieżdżonych zakresów w punkcie o zadanym numerze
+
+	Numer punktu jest liczbą w systemie o mieszanych podstawach (liczbach punktów zakresów),
+	a pierwszy zakres odpowiada najmniej znaczącej cyfrze - zmienia się najszybciej.
+
+	\param values Wartości kolejnych zakresów (rozmiar równy liczbie zakresów)
+*/
+void sweep_range::get_point_values(const std::vector<sweep_range> &ranges, int point, std::vector<double> &values)
+{
+	for (unsigned int r = 0; r < ranges.size(); r++)
+	{
+		const int n = ranges[r].get_point_count();
+		values[r] = ranges[r].get_value(point % n);
+		point /= n;
+	}
+}
+
+/**
+	\brief Przygotowuje analizę
+
+	\param plan Plan rozwiązania układu
+	\param ranges Zakresy przemiatanych źródeł lub parametrów (pierwsze zmieniane jest najszybciej)
+	\param params Parametry i wyrażenia wartości elementów (wymagane przy przemiataniu parametrów)
+	\throws std::runtime_error jeżeli któreś ze źródeł nie istnieje lub nie jest niezależnym źródłem
+		albo liczba punktów analizy jest nieprawidłowa
+*/
+dc_sweep::dc_sweep(std::shared_ptr<const solve_plan> plan, std::vector<sweep_range> ranges, parameter_set params) :
+	m_plan(std::move(plan)),
+	m_ranges(std::move(ranges)),
+	m_params(std::move(params))
+{
+	using kind = solve_plan::component_kind;
+	const auto &names = m_plan->get_names();
+
+	m_target_refs.resize(m_params.get_target_count());
+	for (int t = 0; t < m_params.get_target_count(); t++)
+		if (auto it = names.find(m_params.get_target_name(t)); it != names.end())
+			m_target_refs[t] = it->second;
+
+	for (const auto &r : m_ranges)
+	{
+		swept_value sv;
+		if (auto it = names.find(r.source); it != names.end())
+		{
+			if (it->second.kind != kind::VOLTAGE_SOURCE && it->second.kind != kind::CURRENT_SOURCE)
+				throw std::runtime_error("Component '" + r.source + "' is not an independent source");
+			sv.ref = it->second;
+		}
+		else if ((sv.param = m_params.find(r.source)) >= 0)
+		{
+			// Elementy zależne od parametru muszą być obecne w analizowanym układzie
+			for (int t : m_params.get_dependent_targets(sv.param))
+			{
+				if (!m_target_refs[t])
+					throw std::runtime_error("Component '" + m_params.get_target_name(t) + "' depending on parameter '"
+						+ r.source + "' is not present in the analysed circuit");
+
+				if (m_target_refs[t]->kind != kind::VOLTAGE_SOURCE && m_target_refs[t]->kind != kind::CURRENT_SOURCE)
+					m_sources_only = false;
+			}
+		}
+		else
+			throw std::runtime_error("Swept source '" + r.source + "' does not exist");
+
+		for (const auto &s : m_swept)
+			if (s.param == sv.param && (sv.param >= 0 || (s.ref.kind == sv.ref.kind && s.ref.index == sv.ref.index)))
+				throw std::runtime_error("Source '" + r.source + "' is swept twice");
+
+		m_swept.push_back(sv);
+	}
+
+	// Łączna liczba punktów musi mieścić się w typie int
+	get_point_count();
+}
+
+/**
+	\brief Zwraca łączną liczbę punktów analizy
+*/
+int dc_sweep::get_point_count() const
+{
+	return sweep_range::get_total_point_count(m_ranges);
+}
+
+/**
+	\brief Wykonuje analizę
+*/
+void dc_sweep::run(const visit_function &visit) const
+{
+	using kind = solve_plan::component_kind;
+
+	// Prywatne kopie planu i parametrów, w których zmieniane są wartości
+	auto plan = std::make_shared<solve_plan>(*m_plan);
+	auto params = m_params;
+
+	// Zerowa SEM jest przy analizie DC zwarciem (inna struktura układu), więc przy jednym
+	// rozkładzie macierzy jest on wyznaczany dla niezerowych wartości przemiatanych SEM -
+	// w punktach każda wartość zmienia już tylko wektor wyrazów wolnych.
+	auto set_placeholder = [&](const solve_plan::component_ref &ref){
+		if (ref.kind == kind::VOLTAGE_SOURCE)
+			plan->set_value(ref, 1.0);
+	};
+
+	if (m_sources_only)
+		for (const auto &sv : m_swept)
+		{
+			if (sv.param < 0)
+				set_placeholder(sv.ref);
+			else
+				for (int t : params.get_dependent_targets(sv.param))
+					set_placeholder(*m_target_refs[t]);
+		}
+
+	solve_context ctx(plan);
+	std::vector<double> values(m_ranges.size());
+
+	auto set_point = [&](int point){
+		sweep_range::get_point_values(m_ranges, point, values);
+		for (unsigned int r = 0; r < m_ranges.size(); r++)
+		{
+			const auto &sv = m_swept[r];
+			if (sv.param < 0)
+				plan->set_value(sv.ref, values[r]);
+			else
+				for (int t : params.set_value(sv.param, values[r]))
+					plan->set_value(*m_target_refs[t], params.get_target_value(t));
+		}
+	};
+
+	const int count = get_point_count();
+	if (!m_sources_only)
+	{
+		// Zmieniają się wartości elementów pasywnych - każdy punkt wymaga nowego rozkładu
+		for (int point = 0; point < count; point++)
+		{
+			set_point(point);
+			ctx.set_plan(plan, true);
+			ctx.solve(0);
+			visit(point, values, ctx);
+		}
+		return;
+	}
+
+	for (int first = 0; first < count; first += batch_size)
+	{
+		ctx.solve_batch(0, std::min(batch_size, count - first),
+			[&](int k){set_point(first + k);},
+			[&](int k){visit(first + k, values, ctx);});
+	}
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+#include "circuit.hpp"
+#include "expression.hpp"
+
+/**
+	\file sweep.hpp
+	\brief Analiza DC ze zmianą wartości niezależnych źródeł (.dc)
+	\author Jacek Wieczorek
+*/
+
+/**
+	\brief Zakres wartości przemiatanego źródła
+*/
+struct sweep_range
+{
+	std::string source; //!< Nazwa źródła (V lub I) lub parametru (.param)
+	double start;       //!< Wartość początkowa
+	double stop;        //!< Wartość końcowa
+	double step;        //!< Krok (ze znakiem zgodnym z kierunkiem zmian)
+
+	int get_point_count() const;
+	double get_value(int i) const;
+
+	static int get_total_point_count(const std::vector<sweep_range> &ranges);
+	static void get_point_values(const std::vector<sweep_range> &ranges, int point, std::vector<double> &values);
+};
+
+/**
+	\brief Analiza DC dla kolejnych wartości jednego lub kilku niezależnych źródeł lub parametrów
+
+	Zmiana wartości niezależnego źródła w układzie liniowym zmienia jedynie wektor
+	wyrazów wolnych, więc macierz układu rozkładana jest raz dla całej analizy, a punkty
+	rozwiązywane są w paczkach jako jeden układ z wieloma wektorami wyrazów wolnych
+	(\ref solve_context::solve_batch()).
+
+	Zmiana parametru oblicza ponownie jedynie wartości zależnych od niego elementów
+	(\ref parameter_set::set_value()). Jeżeli są wśród nich elementy pasywne, układ
+	rozwiązywany jest od nowa w każdym punkcie.
+
+	Pierwsze źródło zmieniane jest najszybciej (pętla wewnętrzna), tak jak w SPICE.
+*/
+class dc_sweep
+{
+public:
+	/**
+		\brief Funkcja wywoływana dla każdego punktu analizy (w kolejności punktów)
+
+		\param point Numer punktu
+		\param values Wartości przemiatanych źródeł w tym punkcie
+		\param ctx Kontekst z rozwiązaniem układu w tym punkcie
+	*/
+	using visit_function = std::function<void(int point, const std::vector<double> &values, const solve_context &ctx)>;
+
+	dc_sweep(std::shared_ptr<const solve_plan> plan, std::vector<sweep_range> ranges, parameter_set params = {});
+
+	int get_point_count() const;
+	void run(const visit_function &visit) const;
+
+private:
+	//! Przemiatana wielkość
+	struct swept_value
+	{
+		int param = -1;                 //!< Numer parametru (-1 dla źródeł)
+		solve_plan::component_ref ref;  //!< Położenie źródła w planie
+	};
+
+	//! Liczba punktów rozwiązywanych jednocześnie
+	static constexpr int batch_size = 64;
+
+	std::shared_ptr<const solve_plan> m_plan;
+	std::vector<sweep_range> m_ranges;
+	std::vector<swept_value> m_swept;
+	parameter_set m_params;
+
+	//! Położenie w planie elementów, których wartości wyznaczają wyrażenia (według numerów wyrażeń)
+	std::vector<std::optional<solve_plan::component_ref>> m_target_refs;
+
+	//! Czy zmieniane są jedynie wartości źródeł (wystarczy jeden rozkład macierzy)
+	bool m_sources_only = true;
+};
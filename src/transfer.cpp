@@ -0,0 +1,90 @@
+#include "transfer.hpp"
+#include <stdexcept>
+
+/**
+	\file transfer.cpp
+	\brief Implementacja \ref transfer_function_analysis
+	\author Jacek Wieczorek
+*/
+
+/**
+	\brief Przygotowuje analizę
+
+	\param plan Plan rozwiązania układu
+	\param pos Węzeł wyjściowy
+	\param neg Węzeł odniesienia wyjścia
+	\param input Nazwa źródła wejściowego (SEM lub SPM)
+	\throws std::runtime_error jeżeli źródło wejściowe lub węzły wyjściowe nie istnieją
+*/
+transfer_function_analysis::transfer_function_analysis(std::shared_ptr<const solve_plan> plan, int pos, int neg,
+	const std::string &input) :
+	m_plan(std::move(plan)),
+	m_pos(pos),
+	m_neg(neg)
+{
+	using kind = solve_plan::component_kind;
+	const auto &names = m_plan->get_names();
+
+	auto it = names.find(input);
+	if (it == names.end())
+		throw std::runtime_error("Input source '" + input + "' does not exist");
+	if (it->second.kind != kind::VOLTAGE_SOURCE && it->second.kind != kind::CURRENT_SOURCE)
+		throw std::runtime_error("Component '" + input + "' is not an independent source");
+	m_input = it->second;
+
+	try
+	{
+		m_plan->node_index(pos);
+		m_plan->node_index(neg);
+	}
+	catch (const std::out_of_range &ex)
+	{
+		throw std::runtime_error("Output node does not exist");
+	}
+}
+
+/**
+	\brief Wykonuje analizę
+	\throws std::runtime_error jeżeli nie udało się rozwiązać układu
+*/
+transfer_function_result transfer_function_analysis::solve() const
+{
+	using kind = solve_plan::component_kind;
+
+	// Prywatna kopia planu - zerowa SEM jest przy analizie DC zwarciem, więc wejściowa SEM
+	// otrzymuje niezerową wartość przed rozkładem macierzy (wtedy pozostaje w układzie)
+	auto plan = std::make_shared<solve_plan>(*m_plan);
+	if (m_input.kind == kind::VOLTAGE_SOURCE)
+		plan->set_value(m_input, 1.0);
+
+	solve_context ctx(plan);
+	ctx.solve(0);
+
+	transfer_function_result result;
+
+	// Rezystancja wyjściowa - jedno rozwiązanie układu sprzężonego
+	auto tm = ctx.voltage_transfer(m_pos, m_neg);
+	result.output_resistance = tm.injection(m_plan->node_index(m_pos), m_plan->node_index(m_neg)).real();
+
+	// Odpowiedź na jednostkowe pobudzenie wejścia przy wyzerowanych pozostałych źródłach.
+	// Zmieniają się tylko wartości źródeł, więc wykorzystywany jest istniejący rozkład macierzy.
+	auto &st = plan->get_components();
+	for (int i = 0; i < st.voltage_sources.size(); i++)
+		if (st.voltage_sources.value[i] != 0)
+			plan->set_value({kind::VOLTAGE_SOURCE, i}, 0.0);
+	for (int i = 0; i < st.current_sources.size(); i++)
+		plan->set_value({kind::CURRENT_SOURCE, i}, 0.0);
+	plan->set_value(m_input, 1.0);
+
+	ctx.set_plan(plan, false);
+	ctx.solve(0);
+
+	const auto *input = m_plan->get_components().bipoles(m_input.kind)->comp[m_input.index];
+	result.gain = ctx.voltage(m_pos, m_neg).real();
+	if (m_input.kind == kind::VOLTAGE_SOURCE)
+		result.input_resistance = -1.0 / ctx.current(*input).real();
+	else
+		result.input_resistance = ctx.voltage(*input).real();
+
+	return result;
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <memory>
+#include <string>
+#include "circuit.hpp"
+
+/**
+	\file transfer.hpp
+	\brief Analiza małosygnałowej funkcji przejścia w punkcie pracy DC (.tf)
+	\author Jacek Wieczorek
+*/
+
+/**
+	\brief Wynik analizy funkcji przejścia
+*/
+struct transfer_function_result
+{
+	double gain;              //!< Wzmocnienie (dla wejścia prądowego - transrezystancja)
+	double input_resistance;  //!< Rezystancja widziana przez źródło wejściowe
+	double output_resistance; //!< Rezystancja wyjściowa (przy wyzerowanych źródłach niezależnych)
+};
+
+/**
+	\brief Funkcja przejścia, rezystancja wejściowa i wyjściowa w punkcie pracy DC
+
+	Macierz układu rozkładana jest raz. Rozwiązanie dla jednostkowej wartości źródła
+	wejściowego i zerowych wartości pozostałych źródeł wymaga jedynie nowego wektora
+	wyrazów wolnych - daje wzmocnienie i prąd źródła wejściowego (rezystancję wejściową).
+	Rezystancja wyjściowa to transimpedancja z prądu wstrzykiwanego do węzła wyjściowego,
+	wyznaczana jednym rozwiązaniem układu sprzężonego (\ref solve_context::voltage_transfer()).
+*/
+class transfer_function_analysis
+{
+public:
+	transfer_function_analysis(std::shared_ptr<const solve_plan> plan, int pos, int neg, const std::string &input);
+
+	transfer_function_result solve() const;
+
+private:
+	std::shared_ptr<const solve_plan> m_plan;
+	int m_pos;
+	int m_neg;
+
+	//! Położenie źródła wejściowego w planie
+	solve_plan::component_ref m_input;
+};
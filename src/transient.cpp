@@ -0,0 +1,558 @@
+#include "transient.hpp"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+/**
+	\file transient.cpp
+	\brief Implementacja \ref transient_analysis
+	\author Jacek Wieczorek
+*/
+
+/**
+	\brief Zwraca chwilę, której dotyczy stan [s]
+*/
+double transient_state::get_time() const
+{
+	return m_time;
+}
+
+/**
+	\brief Zwraca potencjał węzła o zadanym numerze w planie (0 dla masy)
+*/
+double transient_state::index_voltage(int index) const
+{
+	return index < 0 ? 0.0 : m_voltages[index];
+}
+
+/**
+	\brief Pomiar napięcia między węzłami
+	\throws std::out_of_range dla nieistniejących węzłów
+*/
+double transient_state::voltage(int pos, int neg) const
+{
+	return index_voltage(m_plan->node_index(pos)) - index_voltage(m_plan->node_index(neg));
+}
+
+/**
+	\brief Pomiar spadku napięcia na komponencie
+*/
+double transient_state::voltage(const std::string &ref) const
+{
+	const auto &cr = m_plan->get_names().at(ref);
+	const auto &st = m_plan->get_components();
+
+	if (cr.kind == solve_plan::component_kind::OPAMP)
+		return index_voltage(st.opamps.out[cr.index]);
+
+	if (cr.kind == solve_plan::component_kind::NONLINEAR)
+	{
+		const auto &nodes = st.nonlinear.nodes[cr.index];
+		return index_voltage(nodes[0]) - index_voltage(nodes[st.nonlinear.comp[cr.index]->terminal_count - 1]);
+	}
+
+	if (const auto *arr = st.controlled(cr.kind))
+		return index_voltage(arr->a[cr.index]) - index_voltage(arr->b[cr.index]);
+
+	const auto &arr = *st.bipoles(cr.kind);
+	return index_voltage(arr.a[cr.index]) - index_voltage(arr.b[cr.index]);
+}
+
+/**
+	\brief Pomiar prądu płynącego przez komponent
+*/
+double transient_state::current(const std::string &ref) const
+{
+	using kind = solve_plan::component_kind;
+	const auto &cr = m_plan->get_names().at(ref);
+	const auto &st = m_plan->get_components();
+
+	switch (cr.kind)
+	{
+		case kind::RESISTOR:
+			return voltage(ref) / st.resistors.value[cr.index];
+
+		case kind::INDUCTOR:
+			return m_inductor_currents[cr.index];
+
+		case kind::CAPACITOR:
+			return m_capacitor_currents[cr.index];
+
+		case kind::VOLTAGE_SOURCE:
+		case kind::OPAMP:
+		case kind::VCVS:
+		case kind::CCVS:
+			return m_branch_currents[m_plan->branch_index(cr)];
+
+		case kind::VCCS:
+			return st.vccs.gain[cr.index] * (index_voltage(st.vccs.c[cr.index]) - index_voltage(st.vccs.d[cr.index]));
+
+		case kind::CCCS:
+			return st.cccs.gain[cr.index] * m_branch_currents[st.cccs.control[cr.index]];
+
+		case kind::CURRENT_SOURCE:
+			return -m_current_sources[cr.index];
+
+		case kind::NONLINEAR:
+			return m_device_currents[cr.index][0];
+
+		default:
+			throw std::runtime_error("Cannot measure current through component");
+	}
+}
+
+/**
+	\brief Pomiar mocy traconej na komponencie
+*/
+double transient_state::power(const std::string &ref) const
+{
+	// Moc elementu nieliniowego - suma iloczynów potencjałów i prądów wyprowadzeń
+	const auto &cr = m_plan->get_names().at(ref);
+	if (cr.kind == solve_plan::component_kind::NONLINEAR)
+	{
+		const auto &nodes = m_plan->get_components().nonlinear.nodes[cr.index];
+		double p = 0;
+		for (int k = 0; k < 3; k++)
+			p += index_voltage(nodes[k]) * m_device_currents[cr.index][k];
+		return p;
+	}
+
+	return voltage(ref) * current(ref);
+}
+
+/**
+	\brief Przygotowuje analizę
+
+	\param plan Plan rozwiązania układu
+	\param waveforms Przebiegi czasowe źródeł niezależnych (według nazw źródeł)
+	\param method Metoda całkowania
+	\throws std::runtime_error jeżeli przebieg przypisano do elementu, który nie jest źródłem niezależnym
+*/
+transient_analysis::transient_analysis(std::shared_ptr<const solve_plan> plan, const std::map<std::string, waveform> &waveforms,
+	integration_method method) :
+	m_plan(std::move(plan)),
+	m_method(method)
+{
+	using kind = solve_plan::component_kind;
+	const auto &st = m_plan->get_components();
+
+	if (st.passives.size())
+		throw std::runtime_error("Transient analysis requires the original reactive components");
+
+	m_voltage_waveforms.resize(st.voltage_sources.size());
+	m_current_waveforms.resize(st.current_sources.size());
+
+	for (const auto &[ref, wf] : waveforms)
+	{
+		auto it = m_plan->get_names().find(ref);
+		if (it == m_plan->get_names().end())
+			throw std::runtime_error("Source '" + ref + "' does not exist");
+
+		if (it->second.kind == kind::VOLTAGE_SOURCE)
+			m_voltage_waveforms[it->second.index] = wf;
+		else if (it->second.kind == kind::CURRENT_SOURCE)
+			m_current_waveforms[it->second.index] = wf;
+		else
+			throw std::runtime_error("Component '" + ref + "' is not an independent source");
+	}
+}
+
+/**
+	\brief Zwraca wartość SEM w chwili t
+*/
+double transient_analysis::voltage_source_value(int index, double t) const
+{
+	const auto &wf = m_voltage_waveforms[index];
+	return wf ? wf->value(t) : m_plan->get_components().voltage_sources.value[index];
+}
+
+/**
+	\brief Zwraca wartość SPM w chwili t
+*/
+double transient_analysis::current_source_value(int index, double t) const
+{
+	const auto &wf = m_current_waveforms[index];
+	return wf ? wf->value(t) : m_plan->get_components().current_sources.value[index];
+}
+
+/**
+	\brief Wyznacza stan początkowy - punkt pracy DC dla wartości źródeł w chwili 0
+*/
+transient_state transient_analysis::initial_state() const
+{
+	using kind = solve_plan::component_kind;
+
+	auto plan = std::make_shared<solve_plan>(*m_plan);
+	const auto &st = plan->get_components();
+	for (int i = 0; i < st.voltage_sources.size(); i++)
+		plan->set_value({kind::VOLTAGE_SOURCE, i}, voltage_source_value(i, 0));
+	for (int i = 0; i < st.current_sources.size(); i++)
+		plan->set_value({kind::CURRENT_SOURCE, i}, current_source_value(i, 0));
+
+	solve_context ctx(plan);
+	ctx.solve(0);
+
+	transient_state state;
+	state.m_plan = m_plan;
+
+	const auto &nodes = m_plan->get_node_map().get_nodes();
+	state.m_voltages.resize(m_plan->get_node_count());
+	for (unsigned int i = 0; i < state.m_voltages.size(); i++)
+		state.m_voltages[i] = ctx.voltage(nodes[i + 1]).real();
+
+	for (int i = 0; i < st.voltage_sources.size(); i++)
+		state.m_branch_currents.push_back(ctx.current(*st.voltage_sources.comp[i]).real());
+	for (int i = 0; i < st.opamps.size(); i++)
+		state.m_branch_currents.push_back(ctx.current(*st.opamps.comp[i]).real());
+	for (const auto *arr : {&st.vcvs, &st.ccvs})
+		for (const auto *comp : arr->comp)
+			state.m_branch_currents.push_back(ctx.current(*comp).real());
+
+	// W stanie ustalonym DC przez kondensatory nie płynie prąd
+	for (int i = 0; i < st.inductors.size(); i++)
+		state.m_inductor_currents.push_back(ctx.current(*st.inductors.comp[i]).real());
+	state.m_capacitor_currents.assign(st.capacitors.size(), 0.0);
+	state.m_current_sources = st.current_sources.value;
+
+	return state;
+}
+/**
+	\brief Zwraca posortowane chwile nieciągłości przebiegów źródeł z przedziału (0, stop] (łącznie z chwilą stop)
+*/
+std::vector<double> transient_analysis::breakpoints(double stop) const
+{
+	std::vector<double> points{stop};
+	for (const auto *waveforms : {&m_voltage_waveforms, &m_current_waveforms})
+		for (const auto &wf : *waveforms)
+			if (wf)
+			{
+				auto bp = wf->breakpoints(stop);
+				points.insert(points.end(), bp.begin(), bp.end());
+			}
+
+	std::sort(points.begin(), points.end());
+	points.erase(std::unique(points.begin(), points.end()), points.end());
+	return points;
+}
+
+/**
+	\brief Układ stowarzyszony - układ MNA, w którym kondensatory i cewki zastąpiono modelami stowarzyszonymi
+
+	Admitancje cewek i kondensatorów zastępowane są konduktancjami modeli, a ich źródła
+	prądowe dopisywane są za źródłami niezależnymi. Konduktancje zależą tylko od kroku.
+*/
+class transient_analysis::companion_system
+{
+public:
+	explicit companion_system(const transient_analysis &analysis);
+
+	void set_step(double h);
+	void step(transient_state &state, double t, std::shared_ptr<const mna::lu_factorization> &lu);
+
+private:
+	const transient_analysis &m_analysis;
+	const solve_plan::component_store &m_st;
+	mna::mna_problem m_problem;
+	bool m_trap;
+
+	//! Konduktancje i źródła prądowe modeli cewek i kondensatorów (\f$ i_n = G v_n + J_n \f$)
+	std::vector<double> m_Gl, m_Jl, m_Gc, m_Jc;
+};
+
+/**
+	\brief Składa układ stowarzyszony (bez ustalonego kroku)
+*/
+transient_analysis::companion_system::companion_system(const transient_analysis &analysis) :
+	m_analysis(analysis),
+	m_st(analysis.m_plan->get_components()),
+	m_trap(analysis.m_method == integration_method::TRAPEZOIDAL),
+	m_Gl(m_st.inductors.size()),
+	m_Jl(m_st.inductors.size()),
+	m_Gc(m_st.capacitors.size()),
+	m_Jc(m_st.capacitors.size())
+{
+	analysis.m_plan->assemble(0, m_problem);
+
+	for (int i = 0; i < m_st.inductors.size(); i++)
+		m_problem.current_sources.push_back({{m_st.inductors.a[i], m_st.inductors.b[i]}, 0.0});
+	for (int i = 0; i < m_st.capacitors.size(); i++)
+		m_problem.current_sources.push_back({{m_st.capacitors.a[i], m_st.capacitors.b[i]}, 0.0});
+}
+
+/**
+	\brief Ustala krok całkowania - wyznacza konduktancje modeli stowarzyszonych
+	\note Zmiana kroku wymaga rozkładu macierzy dla nowego kroku
+*/
+void transient_analysis::companion_system::set_step(double h)
+{
+	const double k = m_trap ? 2.0 : 1.0;
+	const int nr = m_st.resistors.size();
+	const int nl = m_st.inductors.size();
+
+	for (int i = 0; i < nl; i++)
+		m_problem.admittances[nr + i].Y = m_Gl[i] = h / (k * m_st.inductors.value[i]);
+	for (int i = 0; i < m_st.capacitors.size(); i++)
+		m_problem.admittances[nr + nl + i].Y = m_Gc[i] = k * m_st.capacitors.value[i] / h;
+}
+
+/**
+	\brief Wyznacza stan układu w chwili t na podstawie stanu w poprzedniej chwili
+
+	\param state Stan w poprzedniej chwili - zastępowany nowym stanem
+	\param t Chwila, dla której wyznaczany jest stan (poprzednia chwila powiększona o krok)
+	\param lu Rozkład macierzy dla bieżącego kroku - jeżeli jest pusty, wyznaczany jest nowy rozkład
+*/
+void transient_analysis::companion_system::step(transient_state &state, double t, std::shared_ptr<const mna::lu_factorization> &lu)
+{
+	const auto &st = m_st;
+	const int node_count = m_analysis.m_plan->get_node_count();
+	const int nl = st.inductors.size();
+	const int ncs = st.current_sources.size();
+
+	// Źródła modeli stowarzyszonych na podstawie poprzedniego stanu elementów
+	for (int i = 0; i < nl; i++)
+	{
+		const double v = state.index_voltage(st.inductors.a[i]) - state.index_voltage(st.inductors.b[i]);
+		m_Jl[i] = state.m_inductor_currents[i] + (m_trap ? m_Gl[i] * v : 0.0);
+		m_problem.current_sources[ncs + i].I = -m_Jl[i];
+	}
+	for (int i = 0; i < st.capacitors.size(); i++)
+	{
+		const double v = state.index_voltage(st.capacitors.a[i]) - state.index_voltage(st.capacitors.b[i]);
+		m_Jc[i] = -m_Gc[i] * v - (m_trap ? state.m_capacitor_currents[i] : 0.0);
+		m_problem.current_sources[ncs + nl + i].I = -m_Jc[i];
+	}
+
+	// Źródła niezależne
+	for (int i = 0; i < st.voltage_sources.size(); i++)
+		m_problem.voltage_sources[i].V = m_analysis.voltage_source_value(i, t);
+	for (int i = 0; i < ncs; i++)
+		m_problem.current_sources[i].I = state.m_current_sources[i] = m_analysis.current_source_value(i, t);
+
+	auto solution = lu ? m_problem.solve(lu) : m_problem.solve();
+	if (!lu)
+	{
+		lu = solution.get_factorization();
+		if (solution.get_node_count() != node_count)
+			throw std::runtime_error("Invalid transient analysis equation system");
+	}
+
+	// Nowy stan układu
+	const auto &x = solution.get_matrix();
+	state.m_time = t;
+	for (int i = 0; i < node_count; i++)
+		state.m_voltages[i] = x(i, 0).real();
+	for (unsigned int i = 0; i < state.m_branch_currents.size(); i++)
+		state.m_branch_currents[i] = x(node_count + i, 0).real();
+
+	for (int i = 0; i < nl; i++)
+	{
+		const double v = state.index_voltage(st.inductors.a[i]) - state.index_voltage(st.inductors.b[i]);
+		state.m_inductor_currents[i] = m_Gl[i] * v + m_Jl[i];
+	}
+	for (int i = 0; i < st.capacitors.size(); i++)
+	{
+		const double v = state.index_voltage(st.capacitors.a[i]) - state.index_voltage(st.capacitors.b[i]);
+		state.m_capacitor_currents[i] = m_Gc[i] * v + m_Jc[i];
+	}
+}
+
+/**
+	\brief Wykonuje analizę ze stałym krokiem
+
+	\param step Krok całkowania [s]
+	\param stop Chwila końcowa analizy [s]
+	\param start Chwila, od której przekazywane są wyniki [s]
+	\param visit Funkcja wywoływana dla każdego przekazywanego kroku (począwszy od stanu początkowego)
+	\throws std::runtime_error jeżeli parametry są nieprawidłowe lub nie udało się rozwiązać układu
+*/
+void transient_analysis::run(double step, double stop, double start, const visitor &visit) const
+{
+	if (!(step > 0) || !(stop > 0) || start < 0 || start > stop)
+		throw std::runtime_error("Invalid transient analysis time parameters");
+
+	auto state = initial_state();
+	if (start == 0)
+		visit(0, state);
+
+	companion_system system(*this);
+	system.set_step(step);
+
+	// Rozkład wyznaczany jest przy pierwszym kroku i wykorzystywany we wszystkich kolejnych
+	std::shared_ptr<const mna::lu_factorization> lu;
+
+	const long steps = std::ceil(stop / step - 1e-9);
+	for (long n = 1; n <= steps; n++)
+	{
+		const double t = n * step;
+		system.step(state, t, lu);
+		if (t >= start)
+			visit(n, state);
+	}
+}
+
+/**
+	\brief Wykonuje analizę ze zmiennym krokiem
+
+	\param step Krok początkowy (także po każdym punkcie nieciągłości) [s]
+	\param stop Chwila końcowa analizy [s]
+	\param start Chwila, od której przekazywane są wyniki [s]
+	\param control Największy krok i tolerancje błędu lokalnego
+	\param visit Funkcja wywoływana dla każdego zaakceptowanego kroku (począwszy od stanu początkowego)
+	\throws std::runtime_error jeżeli parametry są nieprawidłowe, nie udało się rozwiązać układu
+		lub błąd lokalny przekracza tolerancję przy najmniejszym dozwolonym kroku
+*/
+void transient_analysis::run_adaptive(double step, double stop, double start, const step_control &control, const visitor &visit) const
+{
+	if (!(step > 0) || !(stop > 0) || start < 0 || start > stop || !(control.max_step > 0))
+		throw std::runtime_error("Invalid transient analysis time parameters");
+	if (!(control.reltol > 0) || !(control.vntol > 0) || !(control.abstol > 0))
+		throw std::runtime_error("Invalid transient analysis tolerances");
+
+	// Najmniejszy krok to max_step / 2^max_level
+	const int max_level = 40;
+	auto level_step = [&](int k){return std::ldexp(control.max_step, -k);};
+	auto step_level = [&](double h){return std::max(0, static_cast<int>(std::ceil(std::log2(control.max_step / h) - 1e-9)));};
+
+	const auto &st = m_plan->get_components();
+	const int nl = st.inductors.size();
+	const int nc = st.capacitors.size();
+	const int order = m_method == integration_method::TRAPEZOIDAL ? 2 : 1;
+	const double lte_factor = order == 1 ? 1.0 : 0.5;
+	const int initial_level = std::min(step_level(step), max_level);
+
+	// Zmienne stanu (napięcia kondensatorów i prądy cewek) zaakceptowanych punktów
+	struct point
+	{
+		double t;
+		std::vector<double> x;
+	};
+	auto make_point = [&](const transient_state &s){
+		point p{s.get_time(), std::vector<double>(nc + nl)};
+		for (int i = 0; i < nc; i++)
+			p.x[i] = s.index_voltage(st.capacitors.a[i]) - s.index_voltage(st.capacitors.b[i]);
+		for (int i = 0; i < nl; i++)
+			p.x[nc + i] = s.m_inductor_currents[i];
+		return p;
+	};
+
+	// Stosunek szacowanego błędu lokalnego do tolerancji (największy dla wszystkich zmiennych).
+	// Błąd metody rzędu p szacowany jest ilorazem różnicowym rzędu p + 1 - wymaga p + 1 poprzednich punktów.
+	std::vector<point> history;
+	std::vector<double> dd(order + 2);
+	auto error_ratio = [&](const point &p){
+		const double h = p.t - history.back().t;
+		double ratio = 0;
+		for (int i = 0; i < nc + nl; i++)
+		{
+			for (int j = 0; j <= order; j++)
+				dd[j] = history[history.size() - order - 1 + j].x[i];
+			dd[order + 1] = p.x[i];
+
+			for (int m = 1; m <= order + 1; m++)
+				for (int j = order + 1; j >= m; j--)
+				{
+					const double t1 = j == order + 1 ? p.t : history[history.size() - order - 1 + j].t;
+					const double t0 = history[history.size() - order - 1 + j - m].t;
+					dd[j] = (dd[j] - dd[j - 1]) / (t1 - t0);
+				}
+
+			const double lte = lte_factor * std::pow(h, order + 1) * std::abs(dd[order + 1]);
+			const double tol = control.reltol * std::max(std::abs(p.x[i]), std::abs(history.back().x[i]))
+				+ (i < nc ? control.vntol : control.abstol);
+			ratio = std::max(ratio, lte / tol);
+		}
+		return ratio;
+	};
+
+	auto state = initial_state();
+	if (start == 0)
+		visit(0, state);
+	history.push_back(make_point(state));
+
+	// Ostatnio używane rozkłady macierzy (najdawniej użyty na początku)
+	std::vector<std::pair<double, std::shared_ptr<const mna::lu_factorization>>> cache;
+	companion_system system(*this);
+	double system_step = 0;
+
+	const auto bps = breakpoints(stop);
+	const double eps = 1e-9 * std::min(control.max_step, step);
+	unsigned int next_bp = 0;
+
+	int level = initial_level;
+	int n = 0;
+	auto trial = state;
+	while (next_bp < bps.size())
+	{
+		// Krok kończy się w punkcie nieciągłości, jeżeli miałby go przekroczyć
+		double h = level_step(level);
+		double t = state.get_time() + h;
+		const bool at_breakpoint = t >= bps[next_bp] - eps;
+		if (at_breakpoint)
+		{
+			t = bps[next_bp];
+			h = t - state.get_time();
+		}
+
+		// Rozkład dla tego kroku z pamięci podręcznej (kroki różniące się o błąd zaokrągleń są utożsamiane)
+		std::shared_ptr<const mna::lu_factorization> lu;
+		auto it = std::find_if(cache.begin(), cache.end(), [&](const auto &c){return std::abs(c.first - h) <= 1e-9 * h;});
+		if (it != cache.end())
+		{
+			h = it->first;
+			lu = it->second;
+			std::rotate(it, it + 1, cache.end());
+		}
+
+		if (h != system_step)
+		{
+			system.set_step(h);
+			system_step = h;
+		}
+
+		trial = state;
+		system.step(trial, t, lu);
+		if (it == cache.end())
+		{
+			cache.emplace_back(h, lu);
+			if (cache.size() > factorization_cache_size)
+				cache.erase(cache.begin());
+		}
+
+		// Kontrola błędu lokalnego (o ile od ostatniego punktu nieciągłości jest dość punktów)
+		auto p = make_point(trial);
+		if (static_cast<int>(history.size()) > order)
+		{
+			const double ratio = error_ratio(p);
+			const double h_opt = h * 0.9 * std::pow(ratio, -1.0 / (order + 1));
+
+			if (ratio > 1)
+			{
+				if (level == max_level)
+					throw std::runtime_error("Timestep too small at t = " + std::to_string(t) + " s");
+				level = std::min(max_level, std::max(level + 1, step_level(h_opt)));
+				continue;
+			}
+
+			// Krok zwiększany jest najwyżej dwukrotnie
+			level = std::min(max_level, std::max(level - 1, step_level(h_opt)));
+		}
+
+		std::swap(state, trial);
+		if (++n, t >= start)
+			visit(n, state);
+
+		history.push_back(std::move(p));
+		if (static_cast<int>(history.size()) > order + 1)
+			history.erase(history.begin());
+
+		// Za punktem nieciągłości historia jest nieprzydatna, a krok wraca do początkowego
+		if (at_breakpoint)
+		{
+			while (next_bp < bps.size() && bps[next_bp] <= t + eps)
+				next_bp++;
+			history.erase(history.begin(), history.end() - 1);
+			level = initial_level;
+		}
+	}
+}
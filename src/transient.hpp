@@ -0,0 +1,127 @@
+#pragma once
+#include <array>
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+#include "circuit.hpp"
+#include "waveform.hpp"
+
+/**
+	\file transient.hpp
+	\brief Analiza stanów nieustalonych (.tran)
+	\author Jacek Wieczorek
+*/
+
+/**
+	\brief Metoda całkowania numerycznego w analizie stanów nieustalonych
+*/
+enum class integration_method
+{
+	BACKWARD_EULER, //!< Niejawna metoda Eulera (rzędu pierwszego, silnie tłumiąca)
+	TRAPEZOIDAL     //!< Metoda trapezów (rzędu drugiego)
+};
+
+/**
+	\brief Parametry sterowania zmiennym krokiem całkowania
+*/
+struct step_control
+{
+	double max_step = 0;   //!< Największy krok [s] (0 - stały krok); dozwolone kroki to max_step / 2^k
+	double reltol = 1e-3;  //!< Względna tolerancja błędu lokalnego
+	double vntol = 1e-6;   //!< Bezwzględna tolerancja błędu napięć kondensatorów [V]
+	double abstol = 1e-12; //!< Bezwzględna tolerancja błędu prądów cewek [A]
+};
+
+/**
+	\brief Stan układu w jednej chwili analizy stanów nieustalonych
+
+	Udostępnia pomiar napięć, prądów i mocy analogicznie do \ref solve_context.
+	Prądy elementów mierzone są zgodnie z konwencją odbiornikową (od pierwszego węzła
+	do drugiego przez element). Dla elementów nieliniowych napięcie mierzone jest między
+	pierwszym i ostatnim wyprowadzeniem (np. \f$ V_{CE} \f$), a prąd to prąd wpływający
+	do pierwszego wyprowadzenia (anody, kolektora, drenu).
+*/
+class transient_state
+{
+public:
+	double get_time() const;
+
+	double voltage(int pos, int neg = 0) const;
+	double voltage(const std::string &ref) const;
+	double current(const std::string &ref) const;
+	double power(const std::string &ref) const;
+
+private:
+	friend class transient_analysis;
+	friend class periodic_steady_state;
+	friend class laplace_response;
+	friend class newton_solver;
+
+	double index_voltage(int index) const;
+
+	std::shared_ptr<const solve_plan> m_plan;
+	double m_time = 0;
+
+	std::vector<double> m_voltages;        //!< Potencjały węzłów (według numeracji planu)
+	std::vector<double> m_branch_currents; //!< Prądy gałęzi (\ref solve_plan::branch_index())
+	std::vector<double> m_inductor_currents;
+	std::vector<double> m_capacitor_currents;
+	std::vector<double> m_current_sources; //!< Chwilowe wartości SPM
+	std::vector<std::array<double, 3>> m_device_currents; //!< Prądy wpływające do wyprowadzeń elementów nieliniowych
+};
+
+/**
+	\brief Analiza stanów nieustalonych ze stałym krokiem całkowania
+
+	Każdy kondensator i każda cewka zastępowane są modelem stowarzyszonym (companion
+	model) - konduktancją \f$ G \f$ połączoną równolegle ze źródłem prądowym \f$ J \f$
+	wyznaczanym z poprzedniego stanu elementu, tak że \f$ i_n = G v_n + J_n \f$:
+	 - kondensator: \f$ G = C/h \f$ (Euler) lub \f$ G = 2C/h \f$ (trapezy),
+	 - cewka: \f$ G = h/L \f$ (Euler) lub \f$ G = h/(2L) \f$ (trapezy).
+
+	Przy stałym kroku i liniowym układzie macierz układu stowarzyszonego nie zmienia się,
+	więc rozkładana jest raz - każdy krok to nowy wektor wyrazów wolnych (wartości źródeł
+	i prądów \f$ J \f$) i jedno rozwiązanie trójkątne z istniejącym rozkładem.
+
+	Stan początkowy to punkt pracy DC dla wartości źródeł w chwili 0.
+
+	Przy zmiennym kroku (\ref run_adaptive()) błąd lokalny (LTE) szacowany jest dla napięć
+	kondensatorów i prądów cewek na podstawie ilorazów różnicowych kolejnych punktów. Kroki
+	ograniczone są do wartości \f$ h_{max} / 2^k \f$, więc zmiana kroku to zwykle powrót do jednego
+	z kilku ostatnio używanych rozkładów macierzy (\ref factorization_cache_size) - rozkład wykonywany
+	jest tylko dla kroku, którego nie ma w pamięci podręcznej. Kroki kończą się dokładnie
+	w punktach nieciągłości przebiegów źródeł (\ref waveform::breakpoints()), po których krok
+	jest zmniejszany do początkowego.
+*/
+class transient_analysis
+{
+public:
+	using visitor = std::function<void(int step, const transient_state &state)>;
+
+	transient_analysis(std::shared_ptr<const solve_plan> plan, const std::map<std::string, waveform> &waveforms,
+		integration_method method);
+
+	void run(double step, double stop, double start, const visitor &visit) const;
+	void run_adaptive(double step, double stop, double start, const step_control &control, const visitor &visit) const;
+
+	//! Liczba rozkładów macierzy (dla różnych kroków) przechowywanych przy zmiennym kroku
+	static constexpr int factorization_cache_size = 4;
+
+private:
+	class companion_system;
+
+	transient_state initial_state() const;
+	std::vector<double> breakpoints(double stop) const;
+	double voltage_source_value(int index, double t) const;
+	double current_source_value(int index, double t) const;
+
+	std::shared_ptr<const solve_plan> m_plan;
+	integration_method m_method;
+
+	//! Przebiegi czasowe SEM i SPM (według numeracji planu; brak - wartość stała)
+	std::vector<std::optional<waveform>> m_voltage_waveforms;
+	std::vector<std::optional<waveform>> m_current_waveforms;
+};
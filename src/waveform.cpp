@@ -0,0 +1,192 @@
+#include "waveform.hpp"
+#include <cctype>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+/**
+	\file waveform.cpp
+	\brief Implementacja \ref waveform
+	\author Jacek Wieczorek
+*/
+
+/**
+	\brief Tworzy przebieg o zadanych parametrach
+
+	\param s Rodzaj przebiegu
+	\param args Parametry w kolejności zgodnej ze SPICE (brakujące otrzymują wartości domyślne)
+	\throws std::runtime_error jeżeli liczba lub wartości parametrów są nieprawidłowe
+*/
+waveform::waveform(shape s, std::vector<double> args) :
+	m_shape(s),
+	m_args(std::move(args))
+{
+	const double inf = std::numeric_limits<double>::infinity();
+
+	switch (m_shape)
+	{
+		case shape::PULSE:
+		{
+			if (m_args.size() < 2 || m_args.size() > 7)
+				throw std::runtime_error("PULSE waveform requires 2 to 7 parameters");
+
+			// TD, TR, TF, PW, PER
+			const double defaults[] = {0, 0, 0, inf, inf};
+			for (auto i = m_args.size(); i < 7; i++)
+				m_args.push_back(defaults[i - 2]);
+
+			for (int i = 2; i < 7; i++)
+				if (m_args[i] < 0)
+					throw std::runtime_error("Negative PULSE waveform time");
+			if (m_args[6] == 0)
+				throw std::runtime_error("Zero PULSE waveform period");
+			break;
+		}
+
+		case shape::SIN:
+			if (m_args.size() < 3 || m_args.size() > 6)
+				throw std::runtime_error("SIN waveform requires 3 to 6 parameters");
+
+			// TD, THETA, PHASE
+			m_args.resize(6, 0.0);
+
+			if (m_args[2] < 0 || m_args[3] < 0)
+				throw std::runtime_error("Negative SIN waveform frequency or delay");
+			break;
+
+		case shape::PWL:
+			if (m_args.size() < 2 || m_args.size() % 2)
+				throw std::runtime_error("PWL waveform requires pairs of time and value");
+
+			for (unsigned int i = 2; i < m_args.size(); i += 2)
+				if (m_args[i] <= m_args[i - 2])
+					throw std::runtime_error("PWL waveform time points must be increasing");
+			break;
+	}
+}
+
+/**
+	\brief Zwraca rodzaj przebiegu na podstawie nazwy (bez rozróżniania wielkości liter)
+	\throws std::runtime_error dla nieznanej nazwy
+*/
+waveform::shape waveform::parse_shape(const std::string &name)
+{
+	std::string s;
+	for (char c : name)
+		s += std::tolower(c);
+
+	if (s == "pulse") return shape::PULSE;
+	if (s == "sin") return shape::SIN;
+	if (s == "pwl") return shape::PWL;
+	throw std::runtime_error("Unknown waveform '" + name + "'");
+}
+
+/**
+	\brief Zwraca rodzaj przebiegu
+*/
+waveform::shape waveform::get_shape() const
+{
+	return m_shape;
+}
+
+/**
+	\brief Zwraca wartość przebiegu w chwili t
+*/
+double waveform::value(double t) const
+{
+	const auto &a = m_args;
+
+	switch (m_shape)
+	{
+		case shape::PULSE:
+		{
+			const double v1 = a[0], v2 = a[1], td = a[2], tr = a[3], tf = a[4], pw = a[5], per = a[6];
+			if (t < td)
+				return v1;
+
+			t -= td;
+			if (std::isfinite(per))
+				t = std::fmod(t, per);
+
+			if (t < tr)
+				return v1 + (v2 - v1) * t / tr;
+			t -= tr;
+			if (t < pw)
+				return v2;
+			t -= pw;
+			if (t < tf)
+				return v2 + (v1 - v2) * t / tf;
+			return v1;
+		}
+
+		case shape::SIN:
+		{
+			const double vo = a[0], va = a[1], freq = a[2], td = a[3], theta = a[4], phase = a[5] * M_PI / 180.0;
+			if (t < td)
+				return vo + va * std::sin(phase);
+
+			t -= td;
+			return vo + va * std::exp(-theta * t) * std::sin(2 * M_PI * freq * t + phase);
+		}
+
+		case shape::PWL:
+		{
+			if (t <= a[0])
+				return a[1];
+
+			for (unsigned int i = 2; i < a.size(); i += 2)
+				if (t < a[i])
+				{
+					const double x = (t - a[i - 2]) / (a[i] - a[i - 2]);
+					return a[i - 1] + (a[i + 1] - a[i - 1]) * x;
+				}
+
+			return a.back();
+		}
+	}
+
+	return 0.0;
+}
+
+/**
+	\brief Zwraca chwile z przedziału (0, stop], w których przebieg lub jego pochodna są nieciągłe
+
+	Kroki całkowania nie powinny przekraczać tych chwil - zmiana nachylenia przebiegu wewnątrz
+	kroku jest źródłem dużego błędu. Chwile zwracane są w kolejności rosnącej (mogą się powtarzać).
+*/
+std::vector<double> waveform::breakpoints(double stop) const
+{
+	const auto &a = m_args;
+	std::vector<double> points;
+
+	switch (m_shape)
+	{
+		case shape::PULSE:
+		{
+			const double td = a[2], tr = a[3], tf = a[4], pw = a[5], per = a[6];
+			for (double base = td; base <= stop; base += per)
+			{
+				for (double t : {base, base + tr, base + tr + pw, base + tr + pw + tf})
+					if (t > 0 && t <= stop)
+						points.push_back(t);
+
+				if (!std::isfinite(per))
+					break;
+			}
+			break;
+		}
+
+		case shape::SIN:
+			if (a[3] > 0 && a[3] <= stop)
+				points.push_back(a[3]);
+			break;
+
+		case shape::PWL:
+			for (unsigned int i = 0; i < a.size(); i += 2)
+				if (a[i] > 0 && a[i] <= stop)
+					points.push_back(a[i]);
+			break;
+	}
+
+	return points;
+}
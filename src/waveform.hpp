@@ -0,0 +1,46 @@
+#pragma once
+#include <string>
+#include <vector>
+
+/**
+	\file waveform.hpp
+	\brief Przebiegi czasowe źródeł niezależnych (PULSE, SIN, PWL) w analizie stanów nieustalonych
+	\author Jacek Wieczorek
+*/
+
+/**
+	\brief Przebieg czasowy wartości źródła
+
+	Parametry podawane są w kolejności zgodnej ze SPICE:
+	 - `PULSE(V1 V2 [TD [TR [TF [PW [PER]]]]])` - impuls (lub ciąg impulsów o okresie PER),
+		domyślnie o zerowych czasach narastania i opadania i nieskończonej szerokości,
+	 - `SIN(VO VA FREQ [TD [THETA [PHASE]]])` - sinusoida tłumiona współczynnikiem THETA,
+		przesunięta o PHASE stopni, zaczynająca się po czasie TD,
+	 - `PWL(T1 V1 T2 V2 ...)` - przebieg odcinkami liniowy (stały przed pierwszym
+		i po ostatnim punkcie).
+*/
+class waveform
+{
+public:
+	//! Rodzaj przebiegu
+	enum class shape
+	{
+		PULSE,
+		SIN,
+		PWL
+	};
+
+	waveform(shape s, std::vector<double> args);
+
+	static shape parse_shape(const std::string &name);
+
+	double value(double t) const;
+	std::vector<double> breakpoints(double stop) const;
+	shape get_shape() const;
+
+private:
+	shape m_shape;
+
+	//! Parametry przebiegu (uzupełnione wartościami domyślnymi)
+	std::vector<double> m_args;
+};
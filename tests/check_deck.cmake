@@ -0,0 +1,135 @@
+# Uruchamia symulator dla pliku SPICE i sprawdza wynik
+#
+# Zmienne:
+#  MYSPICE - ścieżka do programu (w wersji rozszerzonej)
+#  DECK - plik wejściowy
+#  ARGS - argumenty programu rozdzielone spacjami, np. "-j 1" (opcjonalnie)
+#  EXPECT - wyrażenie regularne, które musi pasować do standardowego wyjścia (opcjonalnie)
+#  EXPECT_ERROR - wyrażenie regularne, które musi pasować do standardowego wyjścia błędów (opcjonalnie)
+#  EXPECT_FAILURE - jeżeli ustawione, symulacja musi zakończyć się błędem (np. niepoprawny plik wejściowy)
+#  COMPARE_UNREDUCED - jeżeli ustawione, wynik musi być identyczny z wynikiem dla pliku bez polecenia .reduce
+#  COMPARE_ARGS - argumenty programu, z którymi wynik musi być identyczny (np. inna liczba wątków)
+#  EXPECT_VALUES - pary "x:y" rozdzielone spacjami - w wierszu wyniku, którego druga kolumna (czas, częstotliwość)
+#                  to dokładnie x, pierwsza wartość pomiaru musi być równa y z tolerancją TOLERANCE (opcjonalnie)
+#  TOLERANCE - dopuszczalny błąd względny EXPECT_VALUES w ppm (domyślnie 1000)
+
+function(run_deck deck args out err)
+	separate_arguments(args UNIX_COMMAND "${args}")
+	execute_process(COMMAND "${MYSPICE}" ${args} INPUT_FILE "${deck}"
+		OUTPUT_VARIABLE stdout ERROR_VARIABLE stderr RESULT_VARIABLE result)
+	if(EXPECT_FAILURE AND result EQUAL 0)
+		message(FATAL_ERROR "Simulation of ${deck} should have failed:\n${stdout}${stderr}")
+	elseif(NOT EXPECT_FAILURE AND NOT result EQUAL 0)
+		message(FATAL_ERROR "Simulation of ${deck} failed (${result}):\n${stdout}${stderr}")
+	endif()
+	set(${out} "${stdout}" PARENT_SCOPE)
+	set(${err} "${stderr}" PARENT_SCOPE)
+endfunction()
+
+# Zamienia liczbę dziesiętną (np. 6.25e-06) na liczbę całkowitą w jednostkach 1e-9 (arytmetyka CMake jest całkowita)
+function(to_nano text out)
+	if(NOT text MATCHES "^(-?)([0-9]+)\\.?([0-9]*)([eE]([-+]?[0-9]+))?$")
+		message(FATAL_ERROR "'${text}' is not a number")
+	endif()
+	set(sign "${CMAKE_MATCH_1}")
+	set(digits "${CMAKE_MATCH_2}${CMAKE_MATCH_3}")
+	string(LENGTH "${CMAKE_MATCH_3}" fraction)
+	set(exponent "${CMAKE_MATCH_5}")
+	if(exponent STREQUAL "")
+		set(exponent 0)
+	endif()
+
+	math(EXPR shift "${exponent} + 9 - ${fraction}")
+	if(shift LESS 0)
+		string(LENGTH "${digits}" length)
+		math(EXPR length "${length} + ${shift}")
+		if(length GREATER 0)
+			string(SUBSTRING "${digits}" 0 ${length} digits)
+		else()
+			set(digits 0)
+		endif()
+	endif()
+	while(shift GREATER 0)
+		string(APPEND digits "0")
+		math(EXPR shift "${shift} - 1")
+	endwhile()
+
+	# Usunięcie zer wiodących (REGEX REPLACE dopasowuje ^ ponownie po każdym zastąpieniu)
+	string(REGEX MATCH "[1-9][0-9]*$|0$" digits "${digits}")
+	math(EXPR value "${sign}${digits}")
+	set(${out} ${value} PARENT_SCOPE)
+endfunction()
+
+run_deck("${DECK}" "${ARGS}" output errors)
+message("${output}${errors}")
+
+if(DEFINED EXPECT AND NOT output MATCHES "${EXPECT}")
+	message(FATAL_ERROR "Output does not match '${EXPECT}'")
+endif()
+
+if(DEFINED EXPECT_ERROR AND NOT errors MATCHES "${EXPECT_ERROR}")
+	message(FATAL_ERROR "Error output does not match '${EXPECT_ERROR}'")
+endif()
+
+if(COMPARE_UNREDUCED)
+	get_filename_component(name "${DECK}" NAME)
+	file(READ "${DECK}" text)
+	string(REGEX REPLACE "\n\\.reduce[^\n]*" "" text "${text}")
+	file(WRITE "${CMAKE_CURRENT_BINARY_DIR}/unreduced_${name}" "${text}")
+
+	run_deck("${CMAKE_CURRENT_BINARY_DIR}/unreduced_${name}" "${ARGS}" reference reference_errors)
+	if(NOT output STREQUAL reference)
+		message(FATAL_ERROR "Output differs from the unreduced circuit:\n${reference}")
+	endif()
+endif()
+
+if(DEFINED COMPARE_ARGS)
+	run_deck("${DECK}" "${COMPARE_ARGS}" reference reference_errors)
+	if(NOT output STREQUAL reference)
+		message(FATAL_ERROR "Output differs from the output with arguments '${COMPARE_ARGS}':\n${reference}")
+	endif()
+endif()
+
+if(DEFINED EXPECT_VALUES)
+	if(NOT DEFINED TOLERANCE)
+		set(TOLERANCE 1000)
+	endif()
+
+	string(REPLACE "\n" ";" lines "${output}")
+	string(REPLACE " " ";" pairs "${EXPECT_VALUES}")
+	foreach(pair IN LISTS pairs)
+		string(REPLACE ":" ";" pair "${pair}")
+		list(GET pair 0 x)
+		list(GET pair 1 expected)
+
+		set(actual "")
+		foreach(line IN LISTS lines)
+			string(REPLACE "\t" ";" columns "${line}")
+			list(LENGTH columns count)
+			if(count GREATER 2)
+				list(GET columns 1 column_x)
+				if(column_x STREQUAL x)
+					list(GET columns 2 actual)
+				endif()
+			endif()
+		endforeach()
+		if(actual STREQUAL "")
+			message(FATAL_ERROR "No output row for ${x}")
+		endif()
+
+		# |actual - expected| <= TOLERANCE * 1e-6 * |expected|
+		to_nano("${actual}" a)
+		to_nano("${expected}" e)
+		math(EXPR error "(${a} - ${e}) * 1000000")
+		math(EXPR limit "${TOLERANCE} * ${e}")
+		if(error LESS 0)
+			math(EXPR error "-(${error})")
+		endif()
+		if(limit LESS 0)
+			math(EXPR limit "-(${limit})")
+		endif()
+		if(error GREATER limit)
+			message(FATAL_ERROR "Value at ${x} is ${actual}, expected ${expected} (tolerance ${TOLERANCE} ppm)")
+		endif()
+	endforeach()
+endif()